@@ -60,6 +60,12 @@ class BoundingVolume
 
 	bool intersects(BoundingVolume const& other) const;
 
+	/**
+	 * @brief Same as childMask for each of the volumes, combined. A child intersects or is
+	 * inside the bounding volume if it does for any of the volumes.
+	 */
+	ChildMask childMask(Point const& parent_center, double child_half_size) const;
+
 	std::vector<BoundingVar>::iterator begin() { return bounding_volume_.begin(); }
 
 	std::vector<BoundingVar>::const_iterator begin() const
@@ -51,6 +51,7 @@
 #include <ufo/geometry/plane.h>
 #include <ufo/geometry/ray.h>
 #include <ufo/geometry/sphere.h>
+#include <ufo/geometry/types.h>
 
 namespace ufo::geometry {
 /////////////////////////////////////////////////////////////////////////////////////////
@@ -262,6 +263,30 @@ bool inside(const Sphere& sphere_1, const Sphere& sphere_2);
 
 // TODO: Triangle
 
+/////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////// Child tests
+//////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////////////////
+
+// Tests of all 8 children of an octree node at once. Child i has its center at
+// parent_center +- child_half_size on each axis, + in x if bit 0 of i is set, in y if
+// bit 1 and in z if bit 2, same as Octree::getChildCenter. The intersects bits are the
+// same as intersects(child AABB, volume) gives. See ChildMask.
+
+ChildMask childMask(const AABB& aabb, const Point& parent_center, double child_half_size);
+ChildMask childMask(const Frustum& frustum, const Point& parent_center,
+                    double child_half_size);
+ChildMask childMask(const LineSegment& line_segment, const Point& parent_center,
+                    double child_half_size);
+ChildMask childMask(const OBB& obb, const Point& parent_center, double child_half_size);
+ChildMask childMask(const Plane& plane, const Point& parent_center,
+                    double child_half_size);
+ChildMask childMask(const Point& point, const Point& parent_center,
+                    double child_half_size);
+ChildMask childMask(const Ray& ray, const Point& parent_center, double child_half_size);
+ChildMask childMask(const Sphere& sphere, const Point& parent_center,
+                    double child_half_size);
+
 }  // namespace ufo::geometry
 
 #endif  // UFO_GEOMETRY_COLLISION_CHECKS_H
\ No newline at end of file
@@ -51,11 +51,22 @@
 #include <ufo/geometry/ray.h>
 #include <ufo/geometry/sphere.h>
 
+#include <cstdint>
 #include <variant>
 
 namespace ufo::geometry {
 using BoundingVar =
     std::variant<AABB, Frustum, LineSegment, OBB, Plane, Point, Ray, Sphere>;
+
+// The result of testing the 8 children of an octree node against a volume, see
+// childMask in collision_checks.h
+struct ChildMask {
+	// Bit i is set if child i intersects the volume
+	std::uint8_t intersects = 0;
+	// Bit i is set if child i is completely inside the volume, so its children intersect
+	// it as well. Only computed for AABB, frustum, OBB and sphere, always 0 for the others
+	std::uint8_t inside = 0;
+};
 }  // namespace ufo::geometry
 
 #endif  // UFO_GEOMETRY_TYPES_H
\ No newline at end of file
@@ -0,0 +1,177 @@
+/**
+ * UFOMap: An Efficient Probabilistic 3D Mapping Framework That Embraces the Unknown
+ *
+ * @author D. Duberg, KTH Royal Institute of Technology, Copyright (c) 2020.
+ * @see https://github.com/UnknownFreeOccupied/ufomap
+ * License: BSD 3
+ *
+ */
+
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2020, D. Duberg, KTH Royal Institute of Technology
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef UFO_MAP_BOUNDED_QUEUE_H
+#define UFO_MAP_BOUNDED_QUEUE_H
+
+// STD
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <optional>
+#include <utility>
+
+namespace ufo::map
+{
+/**
+ * @brief What to do when pushing to a full queue
+ *
+ */
+enum class BackpressurePolicy {
+	// Wait until there is space
+	block,
+	// Remove the oldest element to make space
+	drop_oldest,
+	// Merge the new element into the newest element in the queue
+	merge
+};
+
+/**
+ * @brief Thread safe FIFO queue with a maximum number of elements
+ *
+ * @tparam T The element type. Has to have a `void merge(T&& other)` member function if
+ * the merge policy is used
+ */
+template <typename T>
+class BoundedQueue
+{
+ public:
+	BoundedQueue(std::size_t capacity = 1,
+	             BackpressurePolicy policy = BackpressurePolicy::block)
+	    : capacity_(std::max(std::size_t(1), capacity)), policy_(policy)
+	{
+	}
+
+	/**
+	 * @brief Push an element to the back of the queue, following the backpressure policy
+	 * if the queue is full
+	 *
+	 * @param value The element to push
+	 * @return The element that was dropped, the oldest with the drop oldest policy or
+	 * value itself if the queue is closed
+	 */
+	std::optional<T> push(T value)
+	{
+		std::unique_lock lock(mutex_);
+
+		if (BackpressurePolicy::block == policy_) {
+			not_full_.wait(lock, [this] { return closed_ || capacity_ > queue_.size(); });
+		}
+
+		if (closed_) {
+			return std::optional<T>(std::move(value));
+		}
+
+		std::optional<T> dropped;
+		if (capacity_ <= queue_.size()) {
+			if (BackpressurePolicy::merge == policy_) {
+				queue_.back().merge(std::move(value));
+				return dropped;
+			}
+			dropped = std::move(queue_.front());
+			queue_.pop_front();
+		}
+
+		queue_.push_back(std::move(value));
+		lock.unlock();
+		not_empty_.notify_one();
+		return dropped;
+	}
+
+	/**
+	 * @brief Take the element at the front of the queue, waits until there is one
+	 *
+	 * @param value Where to put the element
+	 * @return false if the queue is closed and empty, true otherwise
+	 */
+	bool pop(T& value)
+	{
+		std::unique_lock lock(mutex_);
+		not_empty_.wait(lock, [this] { return closed_ || !queue_.empty(); });
+		if (queue_.empty()) {
+			return false;
+		}
+		value = std::move(queue_.front());
+		queue_.pop_front();
+		lock.unlock();
+		not_full_.notify_one();
+		return true;
+	}
+
+	/**
+	 * @brief Close the queue. Elements already in the queue can still be popped, new
+	 * elements are not accepted
+	 *
+	 */
+	void close()
+	{
+		{
+			std::scoped_lock lock(mutex_);
+			closed_ = true;
+		}
+		not_empty_.notify_all();
+		not_full_.notify_all();
+	}
+
+	std::size_t size() const
+	{
+		std::scoped_lock lock(mutex_);
+		return queue_.size();
+	}
+
+	std::size_t capacity() const noexcept { return capacity_; }
+
+	BackpressurePolicy policy() const noexcept { return policy_; }
+
+ private:
+	std::deque<T> queue_;
+	std::size_t capacity_;
+	BackpressurePolicy policy_;
+	bool closed_ = false;
+
+	mutable std::mutex mutex_;
+	std::condition_variable not_empty_;
+	std::condition_variable not_full_;
+};
+}  // namespace ufo::map
+
+#endif  // UFO_MAP_BOUNDED_QUEUE_H
@@ -0,0 +1,395 @@
+/**
+ * UFOMap: An Efficient Probabilistic 3D Mapping Framework That Embraces the Unknown
+ *
+ * @author D. Duberg, KTH Royal Institute of Technology, Copyright (c) 2020.
+ * @see https://github.com/UnknownFreeOccupied/ufomap
+ * License: BSD 3
+ *
+ */
+
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2020, D. Duberg, KTH Royal Institute of Technology
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef UFO_MAP_CODE_CONCURRENT_H
+#define UFO_MAP_CODE_CONCURRENT_H
+
+// UFO
+#include <ufo/map/code.h>
+#include <ufo/map/types.h>
+
+// STD
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <mutex>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace ufo::map
+{
+/**
+ * @brief Open addressing hash table keyed on Code, split into shards that can be
+ * inserted into concurrently
+ *
+ * @details The shard is selected by the Morton prefix a few levels above the code, so
+ * codes that are close in space end up in the same shard. Each shard stores its
+ * elements densely and uses linear probing. Clearing keeps the allocated memory, a
+ * cleared slot is recognized by an old stamp, so clear is independent of the capacity.
+ *
+ * Only insertion and lookup are safe to call concurrently. Iterating, clearing,
+ * reserving and swapping require that no other thread is using the table.
+ *
+ * @tparam V The stored element, either Code or std::pair<Code, T>
+ */
+template <typename V>
+class ConcurrentCodeTable
+{
+ public:
+	using value_type = V;
+
+	ConcurrentCodeTable(unsigned int shard_power = 6, unsigned int power = 10)
+	    : shards_(std::size_t(1) << shard_power),
+	      shard_mask_((CodeType(1) << shard_power) - 1)
+	{
+		for (Shard& shard : shards_) {
+			shard.slots.resize(std::size_t(1) << power);
+			shard.power = power;
+		}
+	}
+
+	struct ConcurrentCodeTableIterator {
+		using iterator_category = std::forward_iterator_tag;
+		using value_type = V;
+		using difference_type = std::ptrdiff_t;
+		using pointer = V const*;
+		using reference = V const&;
+
+		ConcurrentCodeTableIterator(ConcurrentCodeTable const* table = nullptr)
+		    : table_(table)
+		{
+			if (table_) {
+				shard_ = 0;
+				index_ = 0;
+				skipEmpty();
+			}
+		}
+
+		V const& operator*() const { return table_->shards_[shard_].entries[index_]; }
+
+		V const* operator->() const { return &table_->shards_[shard_].entries[index_]; }
+
+		// Postfix increment
+		ConcurrentCodeTableIterator operator++(int)
+		{
+			ConcurrentCodeTableIterator result = *this;
+			++(*this);
+			return result;
+		}
+
+		// Prefix increment
+		ConcurrentCodeTableIterator& operator++()
+		{
+			++index_;
+			skipEmpty();
+			return *this;
+		}
+
+		bool operator==(ConcurrentCodeTableIterator const& rhs) const
+		{
+			return rhs.table_ == table_ &&
+			       (!table_ || (rhs.shard_ == shard_ && rhs.index_ == index_));
+		}
+
+		bool operator!=(ConcurrentCodeTableIterator const& rhs) const
+		{
+			return !(*this == rhs);
+		}
+
+	 private:
+		void skipEmpty()
+		{
+			while (shard_ < table_->shards_.size() &&
+			       index_ >= table_->shards_[shard_].entries.size()) {
+				++shard_;
+				index_ = 0;
+			}
+			if (shard_ == table_->shards_.size()) {
+				table_ = nullptr;
+			}
+		}
+
+	 private:
+		ConcurrentCodeTable const* table_;
+		std::size_t shard_;
+		std::size_t index_;
+	};
+
+	using const_iterator = ConcurrentCodeTableIterator;
+
+	bool contains(Code const& code) const
+	{
+		Shard const& shard = getShard(code);
+		std::scoped_lock lock(shard.mutex);
+		return shard.size() != find(shard, code);
+	}
+
+	void clear()
+	{
+		for (Shard& shard : shards_) {
+			shard.entries.clear();
+			if (0 == ++shard.stamp) {
+				// Stamp wrapped around, all slots have to be reset once
+				std::fill(shard.slots.begin(), shard.slots.end(), Slot());
+				shard.stamp = 1;
+			}
+		}
+	}
+
+	bool empty() const noexcept { return 0 == size(); }
+
+	std::size_t size() const noexcept
+	{
+		std::size_t size = 0;
+		for (Shard const& shard : shards_) {
+			size += shard.entries.size();
+		}
+		return size;
+	}
+
+	std::size_t num_shards() const noexcept { return shards_.size(); }
+
+	/**
+	 * @brief Bytes allocated by the table, including space reserved for future elements
+	 */
+	std::size_t memoryUsage() const noexcept
+	{
+		std::size_t usage = shards_.capacity() * sizeof(Shard);
+		for (Shard const& shard : shards_) {
+			usage += shard.entries.capacity() * sizeof(V);
+			usage += shard.slots.capacity() * sizeof(Slot);
+		}
+		return usage;
+	}
+
+	float max_load_factor() const noexcept { return max_load_factor_; }
+
+	void max_load_factor(float max_load_factor)
+	{
+		max_load_factor_ = std::clamp(max_load_factor, 0.1f, 0.95f);
+		for (Shard& shard : shards_) {
+			growIfNeeded(shard, 0);
+		}
+	}
+
+	void reserve(std::size_t count)
+	{
+		std::size_t per_shard = count / shards_.size() + 1;
+		for (Shard& shard : shards_) {
+			shard.entries.reserve(per_shard);
+			growIfNeeded(shard, per_shard - shard.entries.size());
+		}
+	}
+
+	const_iterator begin() const { return const_iterator(this); }
+
+	const_iterator end() const { return const_iterator(); }
+
+	void swap(ConcurrentCodeTable& other)
+	{
+		shards_.swap(other.shards_);
+		std::swap(shard_mask_, other.shard_mask_);
+		std::swap(max_load_factor_, other.max_load_factor_);
+	}
+
+ protected:
+	/**
+	 * @brief Insert the element if no element with the same code exists.
+	 *
+	 * @return The stored element, by value since other threads can move it, and if it
+	 * was inserted
+	 */
+	std::pair<V, bool> insertImpl(V const& value)
+	{
+		Code const& code = getCode(value);
+		Shard& shard = getShard(code);
+		std::scoped_lock lock(shard.mutex);
+
+		std::size_t index = find(shard, code);
+		if (shard.size() != index) {
+			return std::make_pair(shard.entries[index], false);
+		}
+
+		growIfNeeded(shard, 1);
+		shard.slots[freeSlot(shard, code)] =
+		    Slot{static_cast<std::uint32_t>(shard.entries.size()), shard.stamp};
+		shard.entries.push_back(value);
+		return std::make_pair(value, true);
+	}
+
+ private:
+	struct Slot {
+		std::uint32_t index = 0;
+		std::uint32_t stamp = 0;
+	};
+
+	// Aligned to avoid false sharing between the shard locks
+	struct alignas(64) Shard {
+		std::vector<V> entries;
+		std::vector<Slot> slots;
+		unsigned int power;
+		std::uint32_t stamp = 1;
+		mutable std::mutex mutex;
+
+		std::size_t size() const noexcept { return entries.size(); }
+	};
+
+	static Code const& getCode(V const& value)
+	{
+		if constexpr (std::is_same_v<V, Code>) {
+			return value;
+		} else {
+			return value.first;
+		}
+	}
+
+	Shard& getShard(Code const& code)
+	{
+		return shards_[(code.getCode() >> shardShift(code)) & shard_mask_];
+	}
+
+	Shard const& getShard(Code const& code) const
+	{
+		return shards_[(code.getCode() >> shardShift(code)) & shard_mask_];
+	}
+
+	static CodeType shardShift(Code const& code)
+	{
+		return 3 * std::min(code.getDepth() + SHARD_DEPTH_OFFSET, DepthType(20));
+	}
+
+	static std::size_t hash(Code const& code, unsigned int power)
+	{
+		// Fibonacci hashing of the code at its own depth
+		CodeType value = (code.getCode() >> (3 * code.getDepth())) ^
+		                 (static_cast<CodeType>(code.getDepth()) << 58);
+		return static_cast<std::size_t>((value * 0x9E3779B97F4A7C15) >> (64 - power));
+	}
+
+	// Returns the index of the element with code, or the size of the shard if not found
+	static std::size_t find(Shard const& shard, Code const& code)
+	{
+		std::size_t mask = shard.slots.size() - 1;
+		for (std::size_t i = hash(code, shard.power);; i = (i + 1) & mask) {
+			Slot const& slot = shard.slots[i];
+			if (slot.stamp != shard.stamp) {
+				return shard.size();
+			}
+			if (getCode(shard.entries[slot.index]) == code) {
+				return slot.index;
+			}
+		}
+	}
+
+	static std::size_t freeSlot(Shard const& shard, Code const& code)
+	{
+		std::size_t mask = shard.slots.size() - 1;
+		std::size_t i = hash(code, shard.power);
+		while (shard.slots[i].stamp == shard.stamp) {
+			i = (i + 1) & mask;
+		}
+		return i;
+	}
+
+	void growIfNeeded(Shard& shard, std::size_t num_new)
+	{
+		std::size_t num = shard.size() + num_new;
+		if (num <= max_load_factor_ * shard.slots.size()) {
+			return;
+		}
+
+		while (num > max_load_factor_ * (std::size_t(1) << shard.power)) {
+			++shard.power;
+		}
+
+		shard.slots.assign(std::size_t(1) << shard.power, Slot());
+		shard.stamp = 1;
+		for (std::size_t i = 0; i != shard.size(); ++i) {
+			shard.slots[freeSlot(shard, getCode(shard.entries[i]))] =
+			    Slot{static_cast<std::uint32_t>(i), shard.stamp};
+		}
+	}
+
+ private:
+	std::vector<Shard> shards_;
+	CodeType shard_mask_;
+	float max_load_factor_ = 0.5;
+
+	// Codes sharing the Morton prefix this many levels up are stored in the same shard
+	inline static const DepthType SHARD_DEPTH_OFFSET = 3;
+
+	friend struct ConcurrentCodeTableIterator;
+};
+
+/**
+ * @brief Drop-in for CodeSet that can be inserted into from multiple threads
+ *
+ */
+class ConcurrentCodeSet : public ConcurrentCodeTable<Code>
+{
+ public:
+	using ConcurrentCodeTable<Code>::ConcurrentCodeTable;
+
+	std::pair<Code, bool> insert(Code const& code) { return insertImpl(code); }
+};
+
+/**
+ * @brief Drop-in for CodeMap that can be inserted into from multiple threads
+ *
+ * @tparam T The mapped type
+ */
+template <typename T>
+class ConcurrentCodeMap : public ConcurrentCodeTable<std::pair<Code, T>>
+{
+ public:
+	using ConcurrentCodeTable<std::pair<Code, T>>::ConcurrentCodeTable;
+
+	std::pair<T, bool> try_emplace(Code const& code, T const& value)
+	{
+		auto [elem, inserted] = this->insertImpl(std::make_pair(code, value));
+		return std::make_pair(elem.second, inserted);
+	}
+};
+}  // namespace ufo::map
+
+#endif  // UFO_MAP_CODE_CONCURRENT_H
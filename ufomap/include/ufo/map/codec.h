@@ -0,0 +1,114 @@
+/**
+ * UFOMap: An Efficient Probabilistic 3D Mapping Framework That Embraces the Unknown
+ *
+ * @author D. Duberg, KTH Royal Institute of Technology, Copyright (c) 2020.
+ * @see https://github.com/UnknownFreeOccupied/ufomap
+ * License: BSD 3
+ *
+ */
+
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2020, D. Duberg, KTH Royal Institute of Technology
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef UFO_MAP_CODEC_H
+#define UFO_MAP_CODEC_H
+
+// STD
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace ufo::map
+{
+/**
+ * @brief Compression of the data in files, messages, tiles and deltas. The value is what
+ * is stored in binary data, so none and lz4 match the old compressed flag.
+ *
+ */
+enum class Codec : std::uint8_t {
+	none = 0,
+	// Fast compression and decompression
+	lz4 = 1,
+	// Slower compression to the same format as lz4, decompresses as fast
+	lz4_hc = 2,
+	// Better ratio than LZ4, only available if built with zstd
+	zstd = 3
+};
+
+/**
+ * @brief The name of codec, as written in file headers.
+ */
+std::string_view toString(Codec codec) noexcept;
+
+/**
+ * @brief The codec named name, or std::nullopt if there is none.
+ */
+std::optional<Codec> codecFromString(std::string_view name) noexcept;
+
+/**
+ * @brief Whether codec can be used by this build.
+ */
+bool isCodecAvailable(Codec codec) noexcept;
+
+/**
+ * @brief Compress src, replacing the content of dst.
+ *
+ * @param level The acceleration for lz4 and the compression level for lz4_hc and zstd,
+ * where 0 is the default of the codec.
+ * @param dictionary Used by zstd, the same dictionary has to be given to decompress.
+ * @return Whether src could be compressed.
+ */
+bool compress(Codec codec, std::string_view src, std::string& dst, int level = 0,
+              std::string_view dictionary = {});
+
+/**
+ * @brief Decompress src into dst.
+ *
+ * @param dst Resized to the uncompressed size before the call.
+ * @return Whether src decompressed to exactly dst.size() bytes.
+ */
+bool decompress(Codec codec, std::string_view src, std::string& dst,
+                std::string_view dictionary = {});
+
+/**
+ * @brief Train a zstd dictionary of at most max_size bytes from samples.
+ *
+ * @return The dictionary, empty if it could not be trained.
+ */
+std::string trainDictionary(std::vector<std::string> const& samples,
+                            std::size_t max_size);
+}  // namespace ufo::map
+
+#endif  // UFO_MAP_CODEC_H
@@ -0,0 +1,152 @@
+/**
+ * UFOMap: An Efficient Probabilistic 3D Mapping Framework That Embraces the Unknown
+ *
+ * @author D. Duberg, KTH Royal Institute of Technology, Copyright (c) 2020.
+ * @see https://github.com/UnknownFreeOccupied/ufomap
+ * License: BSD 3
+ *
+ */
+
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2020, D. Duberg, KTH Royal Institute of Technology
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef UFO_MAP_DEPTH_SCHEDULE_H
+#define UFO_MAP_DEPTH_SCHEDULE_H
+
+// UFO
+#include <ufo/map/types.h>
+
+// STD
+#include <algorithm>
+#include <initializer_list>
+#include <iterator>
+#include <limits>
+#include <utility>
+#include <vector>
+
+namespace ufo::map
+{
+/**
+ * @brief Maps distance from the sensor to the depth free space is integrated at
+ *
+ * @details Consists of steps (distance, depth), meaning that from distance and further
+ * out free space is integrated at depth. Closer than the first step depth 0 is used.
+ * E.g., {{10, 1}, {20, 2}} integrates free space at depth 0 up to 10 m, depth 1 between
+ * 10 m and 20 m, and depth 2 beyond 20 m.
+ */
+class DepthSchedule
+{
+ public:
+	DepthSchedule() {}
+
+	DepthSchedule(std::initializer_list<std::pair<double, DepthType>> steps)
+	{
+		for (auto const& [distance, depth] : steps) {
+			add(distance, depth);
+		}
+	}
+
+	/**
+	 * @brief Use depth from distance and further out. Replaces a step at the same
+	 * distance.
+	 */
+	void add(double distance, DepthType depth)
+	{
+		auto it = std::lower_bound(
+		    steps_.begin(), steps_.end(), distance,
+		    [](auto const& step, double distance) { return step.first < distance; });
+		if (steps_.end() != it && it->first == distance) {
+			it->second = depth;
+		} else {
+			steps_.insert(it, std::make_pair(distance, depth));
+		}
+	}
+
+	void clear() { steps_.clear(); }
+
+	bool empty() const noexcept { return steps_.empty(); }
+
+	/**
+	 * @brief The depth to integrate free space at distance from the sensor.
+	 */
+	DepthType depth(double distance) const
+	{
+		auto it = std::upper_bound(
+		    steps_.begin(), steps_.end(), distance,
+		    [](double distance, auto const& step) { return distance < step.first; });
+		return steps_.begin() == it ? 0 : std::prev(it)->second;
+	}
+
+	/**
+	 * @brief The largest depth used by the schedule.
+	 */
+	DepthType maxDepth() const
+	{
+		DepthType max = 0;
+		for (auto const& step : steps_) {
+			max = std::max(max, step.second);
+		}
+		return max;
+	}
+
+	/**
+	 * @brief The distance intervals [begin, end) with the depth used in each, covering
+	 * [0, infinity).
+	 */
+	std::vector<std::pair<std::pair<double, double>, DepthType>> intervals() const
+	{
+		std::vector<std::pair<std::pair<double, double>, DepthType>> result;
+		double begin = 0.0;
+		DepthType depth = 0;
+		for (auto const& step : steps_) {
+			if (step.first > begin) {
+				result.push_back(std::make_pair(std::make_pair(begin, step.first), depth));
+				begin = step.first;
+			}
+			depth = step.second;
+		}
+		result.push_back(std::make_pair(
+		    std::make_pair(begin, std::numeric_limits<double>::infinity()), depth));
+		return result;
+	}
+
+	std::vector<std::pair<double, DepthType>> const& steps() const noexcept
+	{
+		return steps_;
+	}
+
+ private:
+	std::vector<std::pair<double, DepthType>> steps_;
+};
+}  // namespace ufo::map
+
+#endif  // UFO_MAP_DEPTH_SCHEDULE_H
@@ -0,0 +1,243 @@
+/**
+ * UFOMap: An Efficient Probabilistic 3D Mapping Framework That Embraces the Unknown
+ *
+ * @author D. Duberg, KTH Royal Institute of Technology, Copyright (c) 2020.
+ * @see https://github.com/UnknownFreeOccupied/ufomap
+ * License: BSD 3
+ *
+ */
+
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2020, D. Duberg, KTH Royal Institute of Technology
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef UFO_MAP_DISTANCE_FIELD_H
+#define UFO_MAP_DISTANCE_FIELD_H
+
+// UFO
+#include <ufo/map/code.h>
+#include <ufo/map/key.h>
+#include <ufo/map/types.h>
+
+// STD
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <set>
+#include <utility>
+#include <vector>
+
+namespace ufo::map
+{
+/**
+ * @brief Euclidean distance to the closest obstacle for every voxel within a max distance
+ *
+ * @details Obstacles are depth 0 voxels. Setting obstacles only records the change,
+ * update() then moves the distances with lower (obstacle added) and raise (obstacle
+ * removed) wavefronts that stop where the distances do not change, so the cost is
+ * proportional to the affected volume. Every voxel stores its closest obstacle, so
+ * distance and gradient queries are a single lookup. Voxels are stored in dense blocks
+ * so the wavefronts mostly find their neighbors without hashing.
+ */
+class DistanceField
+{
+ public:
+	DistanceField(double resolution, double max_distance);
+
+	double getResolution() const noexcept { return resolution_; }
+
+	double getMaxDistance() const noexcept { return max_distance_; }
+
+	void clear();
+
+	/**
+	 * @brief Make every voxel in code an obstacle, or none of them.
+	 */
+	void setObstacle(Code const& code, bool obstacle);
+
+	bool isObstacle(Key const& key) const
+	{
+		Cell const* cell = find(key);
+		return cell && 0 == cell->distance;
+	}
+
+	std::size_t numObstacles() const noexcept { return obstacles_.size(); }
+
+	/**
+	 * @brief Propagate the obstacles set since the last update.
+	 */
+	void update();
+
+	/**
+	 * @brief Distance from the voxel key to the closest obstacle, or the max distance if
+	 * there is none that close.
+	 */
+	double getDistance(Key const& key) const;
+
+	/**
+	 * @brief Unit vector pointing away from the closest obstacle, zero if there is none
+	 * within the max distance or key is an obstacle.
+	 */
+	Point3 getGradient(Key const& key) const;
+
+	std::size_t memoryUsage() const;
+
+ private:
+	// Distance of a voxel without obstacle
+	static constexpr std::uint32_t NONE = std::numeric_limits<std::uint32_t>::max();
+
+	struct Cell {
+		// The closest obstacle
+		std::array<KeyType, 3> obstacle;
+		// Squared distance to the obstacle in voxels, 0 if this is an obstacle
+		std::uint32_t distance = NONE;
+		// Whether the obstacle was removed and the cell is waiting to be raised
+		bool raise = false;
+	};
+
+	// Blocks of BLOCK_SIZE^3 voxels
+	static constexpr KeyType BLOCK_BITS = 2;
+	static constexpr KeyType BLOCK_SIZE = KeyType(1) << BLOCK_BITS;
+
+	struct Block {
+		std::array<Cell, BLOCK_SIZE * BLOCK_SIZE * BLOCK_SIZE> cells;
+	};
+
+	static Key toBlockKey(Key const& key)
+	{
+		return Key(key[0] >> BLOCK_BITS, key[1] >> BLOCK_BITS, key[2] >> BLOCK_BITS,
+		           BLOCK_BITS);
+	}
+
+	static std::size_t toCellIndex(Key const& key)
+	{
+		constexpr KeyType mask = BLOCK_SIZE - 1;
+		return (key[0] & mask) | ((key[1] & mask) << BLOCK_BITS) |
+		       ((key[2] & mask) << (2 * BLOCK_BITS));
+	}
+
+	// The blocks around the block of a key, looked up once each while visiting the
+	// neighbors of the key
+	class NeighborBlocks
+	{
+	 public:
+		explicit NeighborBlocks(Key const& key) : center_(toBlockKey(key)) {}
+
+		Cell* find(KeyMap<Block>& blocks, Key const& neighbor)
+		{
+			auto [index, block_key] = toIndex(neighbor);
+			if (!looked_up_[index]) {
+				looked_up_[index] = true;
+				auto it = blocks.find(block_key);
+				blocks_[index] = blocks.end() == it ? nullptr : &it->second;
+			}
+			return blocks_[index] ? &blocks_[index]->cells[toCellIndex(neighbor)] : nullptr;
+		}
+
+		Cell& get(KeyMap<Block>& blocks, Key const& neighbor)
+		{
+			auto [index, block_key] = toIndex(neighbor);
+			if (!blocks_[index]) {
+				looked_up_[index] = true;
+				blocks_[index] = &blocks[block_key];
+			}
+			return blocks_[index]->cells[toCellIndex(neighbor)];
+		}
+
+	 private:
+		std::pair<std::size_t, Key> toIndex(Key const& neighbor) const
+		{
+			Key const block_key = toBlockKey(neighbor);
+			std::size_t index = 0;
+			for (std::size_t i = 0; 3 != i; ++i) {
+				index = 3 * index + 1 + static_cast<int>(block_key[i]) -
+				        static_cast<int>(center_[i]);
+			}
+			return {index, block_key};
+		}
+
+	 private:
+		Key center_;
+		std::array<Block*, 27> blocks_{};
+		std::array<bool, 27> looked_up_{};
+	};
+
+	Cell const* find(Key const& key) const;
+
+	Cell* find(Key const& key);
+
+	Cell& get(Key const& key);
+
+	bool isObstacle(std::array<KeyType, 3> const& key) const
+	{
+		return isObstacle(Key(key[0], key[1], key[2], 0));
+	}
+
+	void push(std::uint32_t distance, Key const& key)
+	{
+		open_[distance].push_back(key);
+		open_min_ = std::min(open_min_, std::size_t(distance));
+		++open_size_;
+	}
+
+	void addObstacle(Key const& key);
+
+	void removeObstacle(Key const& key);
+
+	void lower(Key const& key, std::array<KeyType, 3> const& obstacle);
+
+	void raise(Key const& key);
+
+	template <typename F>
+	static void forEachNeighbor(Key const& key, F f);
+
+ private:
+	double resolution_;
+	double max_distance_;
+	// Max squared distance in voxels
+	std::uint32_t max_distance_squared_;
+
+	// Element references stay valid when the map grows
+	KeyMap<Block> blocks_;
+	// Morton codes of the obstacles, so all obstacles in a node are a contiguous range
+	std::set<CodeType> obstacles_;
+	// Cells to raise or lower, bucketed by squared distance since those are integers
+	std::vector<std::vector<Key>> open_;
+	std::size_t open_min_ = 0;
+	std::size_t open_size_ = 0;
+	// Cells that lost their obstacle, their blocks are removed after update if empty
+	std::vector<Key> cleared_;
+};
+}  // namespace ufo::map
+
+#endif  // UFO_MAP_DISTANCE_FIELD_H
@@ -0,0 +1,153 @@
+/**
+ * UFOMap: An Efficient Probabilistic 3D Mapping Framework That Embraces the Unknown
+ *
+ * @author D. Duberg, KTH Royal Institute of Technology, Copyright (c) 2020.
+ * @see https://github.com/UnknownFreeOccupied/ufomap
+ * License: BSD 3
+ *
+ */
+
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2020, D. Duberg, KTH Royal Institute of Technology
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef UFO_MAP_INTEGRATION_CONTEXT_H
+#define UFO_MAP_INTEGRATION_CONTEXT_H
+
+// UFO
+#include <ufo/map/code.h>
+#include <ufo/map/code_concurrent.h>
+#include <ufo/map/point_cloud.h>
+
+// STD
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace ufo::map
+{
+/**
+ * @brief Scratch buffers used when integrating point clouds
+ *
+ * @details The buffers are cleared, not freed, between clouds, so after the first few
+ * clouds no more memory is allocated for them. A map creates its own context, but one
+ * can be shared between maps that are not integrated into at the same time.
+ *
+ * @tparam LogitType The type of the occupancy updates
+ */
+template <typename LogitType>
+struct IntegrationContext {
+	using Updates = std::vector<std::pair<Code, LogitType>>;
+
+	// Discretized cloud and occupied hits of one cloud
+	struct Cloud {
+		PointCloud discretized;
+		Updates occupied_hits;
+
+		void clear()
+		{
+			discretized.clear();
+			occupied_hits.clear();
+		}
+	};
+
+	IntegrationContext()
+	{
+		indices.max_load_factor(0.8);
+		indices.reserve(100003);
+	}
+
+	/**
+	 * @brief Cleared buffers for the next cloud. There are two sets of buffers that are
+	 * alternated between, so the next cloud can be discretized while the previous one is
+	 * integrated.
+	 */
+	Cloud& nextCloud()
+	{
+		current_cloud = 1 - current_cloud;
+		clouds[current_cloud].clear();
+		return clouds[current_cloud];
+	}
+
+	/**
+	 * @brief Reserve space for clouds with up to num_points points.
+	 */
+	void reserve(std::size_t num_points)
+	{
+		for (Cloud& cloud : clouds) {
+			cloud.discretized.reserve(num_points);
+			cloud.occupied_hits.reserve(num_points);
+		}
+		indices.reserve(num_points);
+		sort_buffer.reserve(num_points);
+	}
+
+	/**
+	 * @brief Bytes allocated by the buffers, including reserved space.
+	 */
+	std::size_t memoryUsage() const noexcept
+	{
+		std::size_t usage = sizeof(*this);
+		for (Cloud const& cloud : clouds) {
+			usage += cloud.discretized.capacity() * sizeof(Point3) +
+			         cloud.occupied_hits.capacity() * sizeof(typename Updates::value_type);
+		}
+		usage += indices.memoryUsage() + free_hits.memoryUsage();
+		usage += (free_hits_batch.capacity() + sort_buffer.capacity()) *
+		         sizeof(typename Updates::value_type);
+		usage += filtered.capacity() * sizeof(Point3);
+		usage += voxel_order.capacity() * sizeof(typename decltype(voxel_order)::value_type);
+		usage +=
+		    angular_order.capacity() * sizeof(typename decltype(angular_order)::value_type);
+		return usage;
+	}
+
+	std::array<Cloud, 2> clouds;
+	std::size_t current_cloud = 0;
+
+	// End points already seen, used to remove duplicates
+	ConcurrentCodeSet indices;
+	// Free space found by ray casting
+	ConcurrentCodeMap<LogitType> free_hits;
+	Updates free_hits_batch;
+	// Used when sorting updates
+	Updates sort_buffer;
+
+	// Prefilter stage
+	PointCloud filtered;
+	std::vector<std::pair<CodeType, std::size_t>> voxel_order;
+	std::vector<std::pair<std::pair<std::uint64_t, double>, std::size_t>> angular_order;
+};
+}  // namespace ufo::map
+
+#endif  // UFO_MAP_INTEGRATION_CONTEXT_H
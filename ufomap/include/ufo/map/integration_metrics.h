@@ -0,0 +1,316 @@
+/**
+ * UFOMap: An Efficient Probabilistic 3D Mapping Framework That Embraces the Unknown
+ *
+ * @author D. Duberg, KTH Royal Institute of Technology, Copyright (c) 2020.
+ * @see https://github.com/UnknownFreeOccupied/ufomap
+ * License: BSD 3
+ *
+ */
+
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2020, D. Duberg, KTH Royal Institute of Technology
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef UFO_MAP_INTEGRATION_METRICS_H
+#define UFO_MAP_INTEGRATION_METRICS_H
+
+// STD
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string_view>
+
+namespace ufo::map
+{
+// Metrics are only collected when built with UFOMAP_METRICS, otherwise the calls that
+// collect them compile to nothing
+#ifdef UFOMAP_METRICS
+inline constexpr bool METRICS_ENABLED = true;
+#else
+inline constexpr bool METRICS_ENABLED = false;
+#endif
+
+/**
+ * @brief The stages of integrating a point cloud, in the order they are run
+ *
+ * @details With eager propagation the parents are recomputed as part of the update
+ * stage, see the node_updates counter. The propagate stage is lazy propagation.
+ */
+enum class IntegrationStage : std::size_t {
+	discretize,  // Points to end codes and ray end points
+	ray_cast,    // Free space into the hash map
+	collect,     // Hash map to the list of updates
+	sort,        // Updates in Morton order
+	update,      // Updates applied to the leaves, parents recomputed and nodes pruned
+	propagate,   // Lazy propagation of the inner nodes
+};
+
+inline constexpr std::size_t NUM_INTEGRATION_STAGES = 6;
+
+enum class IntegrationCounter : std::size_t {
+	clouds,
+	points,
+	rays,             // Rays cast, ray segments with a depth schedule
+	dda_steps,        // Nodes visited by the rays
+	hash_inserts,     // Visited nodes that were new to the hash map
+	hash_collisions,  // Visited nodes that another ray had already put in the hash map
+	early_stops,      // Rays stopped by early stopping
+	nodes_created,
+	nodes_pruned,
+	node_updates,  // Inner nodes recomputed from their children
+};
+
+inline constexpr std::size_t NUM_INTEGRATION_COUNTERS = 10;
+
+constexpr std::string_view toString(IntegrationStage stage) noexcept
+{
+	switch (stage) {
+		case IntegrationStage::discretize:
+			return "discretize";
+		case IntegrationStage::ray_cast:
+			return "ray cast";
+		case IntegrationStage::collect:
+			return "collect";
+		case IntegrationStage::sort:
+			return "sort";
+		case IntegrationStage::update:
+			return "update";
+		case IntegrationStage::propagate:
+			return "propagate";
+	}
+	return "unknown";
+}
+
+constexpr std::string_view toString(IntegrationCounter counter) noexcept
+{
+	switch (counter) {
+		case IntegrationCounter::clouds:
+			return "clouds";
+		case IntegrationCounter::points:
+			return "points";
+		case IntegrationCounter::rays:
+			return "rays";
+		case IntegrationCounter::dda_steps:
+			return "DDA steps";
+		case IntegrationCounter::hash_inserts:
+			return "hash inserts";
+		case IntegrationCounter::hash_collisions:
+			return "hash collisions";
+		case IntegrationCounter::early_stops:
+			return "early stops";
+		case IntegrationCounter::nodes_created:
+			return "nodes created";
+		case IntegrationCounter::nodes_pruned:
+			return "nodes pruned";
+		case IntegrationCounter::node_updates:
+			return "node updates";
+	}
+	return "unknown";
+}
+
+/**
+ * @brief Durations in seconds, binned in powers of two of microseconds
+ */
+struct TimingHistogram {
+	// Bucket i holds [2^i, 2^(i + 1)) us, the first also the shorter and the last also
+	// the longer durations
+	static constexpr std::size_t NUM_BUCKETS = 24;
+
+	std::array<std::uint64_t, NUM_BUCKETS> buckets{};
+	std::uint64_t count = 0;
+	double total = 0.0;
+	double min = 0.0;
+	double max = 0.0;
+
+	void add(double seconds)
+	{
+		++buckets[bucket(seconds)];
+		min = 0 == count ? seconds : std::min(min, seconds);
+		max = std::max(max, seconds);
+		total += seconds;
+		++count;
+	}
+
+	double mean() const noexcept { return 0 == count ? 0.0 : total / count; }
+
+	/**
+	 * @return Upper bound of the bucket the q quantile, [0, 1], is in, at most max
+	 */
+	double quantile(double q) const
+	{
+		std::uint64_t rank = std::ceil(q * count);
+		std::uint64_t sum = 0;
+		for (std::size_t i = 0; NUM_BUCKETS != i; ++i) {
+			sum += buckets[i];
+			if (0 != sum && sum >= rank) {
+				// The last bucket has no upper bound
+				return NUM_BUCKETS - 1 == i ? max : std::min(max, std::ldexp(1.0e-6, i + 1));
+			}
+		}
+		return max;
+	}
+
+	static std::size_t bucket(double seconds)
+	{
+		if (2.0e-6 > seconds) {
+			return 0;
+		}
+		return std::min(NUM_BUCKETS - 1,
+		                static_cast<std::size_t>(std::ilogb(seconds * 1.0e6)));
+	}
+};
+
+/**
+ * @brief Integration metrics since the last reset
+ */
+struct IntegrationStats {
+	std::array<std::uint64_t, NUM_INTEGRATION_COUNTERS> counters{};
+	std::array<TimingHistogram, NUM_INTEGRATION_STAGES> stages{};
+
+	std::uint64_t operator[](IntegrationCounter counter) const
+	{
+		return counters[static_cast<std::size_t>(counter)];
+	}
+
+	TimingHistogram const& operator[](IntegrationStage stage) const
+	{
+		return stages[static_cast<std::size_t>(stage)];
+	}
+};
+
+/**
+ * @brief Collects integration metrics, safe to use from multiple threads
+ */
+class IntegrationMetrics
+{
+ public:
+	void add(IntegrationCounter counter, std::uint64_t n = 1) noexcept
+	{
+		if constexpr (METRICS_ENABLED) {
+			counters_[static_cast<std::size_t>(counter)].fetch_add(n,
+			                                                       std::memory_order_relaxed);
+		}
+	}
+
+	/**
+	 * @brief Add the counters of a cast ray, a step that did not insert is a collision
+	 */
+	void addRay(std::uint64_t steps, std::uint64_t inserts, bool early_stop) noexcept
+	{
+		if constexpr (METRICS_ENABLED) {
+			add(IntegrationCounter::rays);
+			add(IntegrationCounter::dda_steps, steps);
+			add(IntegrationCounter::hash_inserts, inserts);
+			add(IntegrationCounter::hash_collisions, steps - inserts);
+			if (early_stop) {
+				add(IntegrationCounter::early_stops);
+			}
+		}
+	}
+
+	void time(IntegrationStage stage, double seconds)
+	{
+		if constexpr (METRICS_ENABLED) {
+			std::scoped_lock lock(mutex_);
+			stages_[static_cast<std::size_t>(stage)].add(seconds);
+		}
+	}
+
+	IntegrationStats stats() const
+	{
+		IntegrationStats stats;
+		if constexpr (METRICS_ENABLED) {
+			for (std::size_t i = 0; NUM_INTEGRATION_COUNTERS != i; ++i) {
+				stats.counters[i] = counters_[i].load(std::memory_order_relaxed);
+			}
+			std::scoped_lock lock(mutex_);
+			stats.stages = stages_;
+		}
+		return stats;
+	}
+
+	void reset()
+	{
+		if constexpr (METRICS_ENABLED) {
+			for (auto& counter : counters_) {
+				counter.store(0, std::memory_order_relaxed);
+			}
+			std::scoped_lock lock(mutex_);
+			stages_ = {};
+		}
+	}
+
+ private:
+	std::array<std::atomic<std::uint64_t>, NUM_INTEGRATION_COUNTERS> counters_{};
+	mutable std::mutex mutex_;
+	std::array<TimingHistogram, NUM_INTEGRATION_STAGES> stages_{};
+};
+
+/**
+ * @brief Times a stage from construction to destruction
+ */
+class StageTimer
+{
+ public:
+	StageTimer(IntegrationMetrics& metrics, IntegrationStage stage)
+	    : metrics_(metrics), stage_(stage)
+	{
+		if constexpr (METRICS_ENABLED) {
+			start_ = std::chrono::steady_clock::now();
+		}
+	}
+
+	~StageTimer()
+	{
+		if constexpr (METRICS_ENABLED) {
+			metrics_.time(stage_, std::chrono::duration<double>(
+			                          std::chrono::steady_clock::now() - start_)
+			                          .count());
+		}
+	}
+
+	StageTimer(StageTimer const&) = delete;
+	StageTimer& operator=(StageTimer const&) = delete;
+
+ private:
+	IntegrationMetrics& metrics_;
+	IntegrationStage stage_;
+	std::chrono::steady_clock::time_point start_;
+};
+}  // namespace ufo::map
+
+#endif  // UFO_MAP_INTEGRATION_METRICS_H
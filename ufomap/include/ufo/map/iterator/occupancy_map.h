@@ -69,7 +69,24 @@ class OccupancyMapIterator
 	      unknown_space_(unknown_space),
 	      contains_(contains)
 	{
-		Base::init(root);
+		Base::init(root, tree->getRootCode());
+	}
+
+	/**
+	 * @brief Iterate only the subtree of node, which is the node at code.
+	 */
+	OccupancyMapIterator(TREE const* tree, LEAF_NODE const& node, Code const& code,
+	                     ufo::geometry::BoundingVolume const& bounding_volume,
+	                     bool occupied_space = true, bool free_space = true,
+	                     bool unknown_space = false, bool contains = false,
+	                     DepthType min_depth = 0)
+	    : Base(tree, bounding_volume, min_depth),
+	      occupied_space_(occupied_space),
+	      free_space_(free_space),
+	      unknown_space_(unknown_space),
+	      contains_(contains)
+	{
+		Base::init(node, code);
 	}
 
 	OccupancyMapIterator(OccupancyMapIterator const& other)
@@ -47,6 +47,7 @@
 #include <ufo/map/code.h>
 #include <ufo/map/types.h>
 
+#include <algorithm>
 #include <array>
 #include <type_traits>
 
@@ -57,16 +58,18 @@ template <typename TREE, typename DATA_TYPE, typename INNER_NODE, typename LEAF_
 class OctreeIterator
 {
  protected:
+	// The center and size of a node are computed from code_ and the depth when needed
 	struct IteratorNode {
 		// Pointer to the actual node
 		LEAF_NODE const* node;
 		// The index of the node from its parent
 		unsigned int index;
-		// The AABB for the node
-		ufo::geometry::AABB aabb;
 		// Indicates if this node is completely inside the bounding volume.
 		// Meaning its children does not have to do any intersection checks.
 		bool inside;
+		// Which children intersect and are inside the bounding volume, set when moving
+		// down to them if the node is not inside
+		ufo::geometry::ChildMask child_mask;
 	};
 
  public:
@@ -83,13 +86,25 @@ class OctreeIterator
 	               unsigned int min_depth = 0)
 	    : OctreeIterator(tree, bounding_volume, min_depth)
 	{
-		init(root);
+		init(root, tree->getRootCode());
+	}
+
+	/**
+	 * @brief Iterate only the subtree of node, which is the node at code.
+	 */
+	OctreeIterator(TREE const* tree, LEAF_NODE const& node, Code const& code,
+	               ufo::geometry::BoundingVolume const& bounding_volume,
+	               DepthType min_depth = 0)
+	    : OctreeIterator(tree, bounding_volume, min_depth)
+	{
+		init(node, code);
 	}
 
 	OctreeIterator(OctreeIterator const& other)
 	    : tree_(other.tree_),
 	      bounding_volume_(other.bounding_volume_),
 	      path_(other.path_),
+	      code_(other.code_),
 	      current_depth_(other.current_depth_),
 	      min_depth_(other.min_depth_),
 	      max_depth_(other.max_depth_)
@@ -101,6 +116,7 @@ class OctreeIterator
 		tree_ = rhs.tree_;
 		bounding_volume_ = rhs.bounding_volume_;
 		path_ = rhs.path_;
+		code_ = rhs.code_;
 		current_depth_ = rhs.current_depth_;
 		min_depth_ = rhs.min_depth_;
 		max_depth_ = rhs.max_depth_;
@@ -138,30 +154,24 @@ class OctreeIterator
 
 	double getHalfSize() const { return tree_->getNodeHalfSize(getDepth()); }
 
-	ufo::geometry::AABB getBoundingVolume() const { return path_[current_depth_].aabb; }
+	ufo::geometry::AABB getBoundingVolume() const { return getAABB(getDepth()); }
 
 	// bool completelyInsideBoundingVolume() const { return path_[current_depth_].inside; }
 
 	DepthType getDepth() const { return current_depth_; }
 
-	Point3 getCenter() const { return path_[current_depth_].aabb.center; }
+	Point3 getCenter() const { return tree_->toCoord(getCode()); }
 
 	Code getCode(DepthType depth = 0) const
 	{
-		// TODO: Improve
-		Code code = tree_->getRootCode();
-		for (int d = code.getDepth() - 1;
-		     static_cast<int>(getDepth()) <= d && static_cast<int>(depth) <= d; --d) {
-			code = code.getChild(path_[d].index);
-		}
-		return code;
+		return Code(code_).toDepth(std::max(depth, getDepth()));
 	}
 
-	double getX() const { return path_[current_depth_].aabb.center[0]; }
+	double getX() const { return getCenter()[0]; }
 
-	double getY() const { return path_[current_depth_].aabb.center[1]; }
+	double getY() const { return getCenter()[1]; }
 
-	double getZ() const { return path_[current_depth_].aabb.center[2]; }
+	double getZ() const { return getCenter()[2]; }
 
 	bool isPureLeaf() const { return 0 == getDepth(); }
 
@@ -178,25 +188,17 @@ class OctreeIterator
 	using iterator_category = std::forward_iterator_tag;
 
  protected:
-	void init(INNER_NODE const& root)
+	void init(LEAF_NODE const& root, Code const& code)
 	{
-		current_depth_ = tree_->getTreeDepthLevels();
+		current_depth_ = code.getDepth();
 		max_depth_ = current_depth_;
+		code_ = code.getCode();
 
 		IteratorNode node;
 		node.node = &root;
 		node.index = 7;  // Root has no siblings
-		node.aabb.center = Point3(0, 0, 0);
-		double s = tree_->getNodeHalfSize(current_depth_);
-		node.aabb.half_size = Point3(s, s, s);
 		node.inside = bounding_volume_.empty();
 
-		// Prefill AABBs
-		for (size_t depth = min_depth_; depth < current_depth_; ++depth) {
-			s = tree_->getNodeHalfSize(depth);
-			path_[depth].aabb.half_size = Point3(s, s, s);
-		}
-
 		if (validNode(node, current_depth_) && current_depth_ >= min_depth_) {
 			path_[current_depth_] = node;
 			if (!validReturnNode()) {
@@ -210,38 +212,26 @@ class OctreeIterator
 
 	bool hasMore() const { return getDepth() <= max_depth_; }
 
-	virtual bool validNode(IteratorNode& node, DepthType) const
+	// The AABB of the node at depth on the current path
+	ufo::geometry::AABB getAABB(DepthType depth) const
+	{
+		return ufo::geometry::AABB(tree_->toCoord(Code(code_).toDepth(depth)),
+		                           tree_->getNodeHalfSize(depth));
+	}
+
+	virtual bool validNode(IteratorNode& node, DepthType depth) const
 	{
 		if (node.inside) {
 			return true;
 		}
 
-		// Bounding volume can only contain one otherwise we cannot make sure the node is
-		// completely inside and we therefore only do the simple intersection test instead
-		// if (0 < depth && 1 == bounding_volume_.size()) {
-		// 	// Check if the node is completely inside the bounding volume
-		// 	double hs = node.aabb.half_size[0];
-		// 	Point3 const& c = node.aabb.center;
-		// 	std::array<Point3, 8> corners = {Point3(-hs, -hs, -hs), Point3(-hs, -hs, hs),
-		// 	                                 Point3(-hs, hs, -hs),  Point3(-hs, hs, hs),
-		// 	                                 Point3(hs, -hs, -hs),  Point3(hs, -hs, hs),
-		// 	                                 Point3(hs, hs, -hs),   Point3(hs, hs, hs)};
-		// 	bool one_inside = false;
-		// 	node.inside = true;
-		// 	for (Point3 const& offset : corners) {
-		// 		if (!bounding_volume_.intersects(c + offset)) {
-		// 			// The node is not completely inside the bounding volume
-		// 			node.inside = false;
-		// 			break;
-		// 		}
-		// 		one_inside = true;
-		// 	}
-
-		// 	if (one_inside) {
-		// 		return true;
-		// 	}
-		// }
-		return bounding_volume_.intersects(node.aabb);
+		if (max_depth_ == depth) {
+			return bounding_volume_.intersects(getAABB(depth));
+		}
+		// The children of a node that is completely inside do not have to be checked
+		ufo::geometry::ChildMask const& mask = path_[depth + 1].child_mask;
+		node.inside = (mask.inside >> node.index) & 1U;
+		return (mask.intersects >> node.index) & 1U;
 	}
 
 	virtual bool validReturnNode() const
@@ -276,6 +266,11 @@ class OctreeIterator
 			++path_[current_depth_].index;
 		} else {
 			// Current node has children
+			if (!path_[current_depth_].inside) {
+				// Check all of them against the bounding volume at once
+				path_[current_depth_].child_mask = bounding_volume_.childMask(
+				    getCenter(), tree_->getNodeHalfSize(current_depth_ - 1));
+			}
 			--current_depth_;
 			path_[current_depth_].index = 0;
 		}
@@ -299,26 +294,32 @@ class OctreeIterator
 	{
 		DepthType depth = current_depth_;
 		DepthType parent_depth = depth + 1;
-		Point3 const& p_center = path_[parent_depth].aabb.center;
-		double hs = path_[depth].aabb.half_size[0];
+		if (8 <= path_[depth].index) {
+			return false;
+		}
 		for (; 8 > path_[depth].index; ++path_[depth].index) {
 			INNER_NODE const& inner_node =
 			    static_cast<INNER_NODE const&>(*path_[parent_depth].node);
 			path_[depth].node = &tree_->getChild(inner_node, depth, path_[depth].index);
-			path_[depth].aabb.center = tree_->getChildCenter(p_center, hs, path_[depth].index);
 			path_[depth].inside = path_[parent_depth].inside;
 
 			if (validNode(path_[depth], depth)) {
+				CodeType const shift = 3 * depth;
+				code_ =
+				    (code_ & ~(CodeType(7) << shift)) | (CodeType(path_[depth].index) << shift);
 				return true;
 			}
 		}
 		return false;
 	}
 
+
  protected:
 	TREE const* tree_ = nullptr;
 	ufo::geometry::BoundingVolume bounding_volume_;
 	std::array<IteratorNode, TREE::getMaxDepthLevels()> path_;
+	// Code of the current node, the bits below the current depth are not used
+	CodeType code_;
 	DepthType current_depth_;
 	DepthType min_depth_;
 	DepthType max_depth_;
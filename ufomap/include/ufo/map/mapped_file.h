@@ -0,0 +1,93 @@
+/**
+ * UFOMap: An Efficient Probabilistic 3D Mapping Framework That Embraces the Unknown
+ *
+ * @author D. Duberg, KTH Royal Institute of Technology, Copyright (c) 2020.
+ * @see https://github.com/UnknownFreeOccupied/ufomap
+ * License: BSD 3
+ *
+ */
+
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2020, D. Duberg, KTH Royal Institute of Technology
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef UFO_MAP_MAPPED_FILE_H
+#define UFO_MAP_MAPPED_FILE_H
+
+// STD
+#include <cstddef>
+#include <string>
+
+namespace ufo::map
+{
+/**
+ * @brief A file mapped into memory with copy-on-write. Writes to the memory are private
+ * to the process and never reach the file, pages that are not written to are shared
+ * with other processes mapping the same file.
+ *
+ */
+class MappedFile
+{
+ public:
+	MappedFile() = default;
+
+	MappedFile(MappedFile const&) = delete;
+
+	MappedFile(MappedFile&& other) noexcept;
+
+	MappedFile& operator=(MappedFile const&) = delete;
+
+	MappedFile& operator=(MappedFile&& rhs) noexcept;
+
+	~MappedFile() { close(); }
+
+	/**
+	 * @brief Map filename, closing the currently mapped file.
+	 *
+	 * @return Whether the file could be mapped.
+	 */
+	bool open(std::string const& filename);
+
+	void close() noexcept;
+
+	bool isOpen() const noexcept { return nullptr != data_; }
+
+	char* data() const noexcept { return data_; }
+
+	std::size_t size() const noexcept { return size_; }
+
+ private:
+	char* data_ = nullptr;
+	std::size_t size_ = 0;
+};
+}  // namespace ufo::map
+
+#endif  // UFO_MAP_MAPPED_FILE_H
@@ -0,0 +1,96 @@
+/**
+ * UFOMap: An Efficient Probabilistic 3D Mapping Framework That Embraces the Unknown
+ *
+ * @author D. Duberg, KTH Royal Institute of Technology, Copyright (c) 2020.
+ * @see https://github.com/UnknownFreeOccupied/ufomap
+ * License: BSD 3
+ *
+ */
+
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2020, D. Duberg, KTH Royal Institute of Technology
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef UFO_MAP_MEMORY_REPORT_H
+#define UFO_MAP_MEMORY_REPORT_H
+
+// STD
+#include <cstddef>
+#include <numeric>
+#include <vector>
+
+namespace ufo::map
+{
+/**
+ * @brief Memory used by a map, in bytes unless stated otherwise
+ *
+ * @details All values are computed from counters and container capacities, so creating
+ * a report does not visit the nodes. Allocator overhead is exact for pool allocation and
+ * estimated for blocks allocated with new.
+ */
+struct MemoryReport {
+	// Allocated nodes and their memory at each depth, indexed by depth
+	std::vector<std::size_t> num_nodes;
+	std::vector<std::size_t> node_memory;
+
+	std::size_t inner_node_memory = 0;
+	std::size_t leaf_node_memory = 0;
+	// Allocator bookkeeping, padding, and pooled blocks that are not in use
+	std::size_t allocator_overhead = 0;
+	// Node index, see Octree::enableNodeIndex
+	std::size_t node_index = 0;
+	// Integration scratch buffers, see IntegrationContext
+	std::size_t integration_scratch = 0;
+	// Changed codes kept for change detection
+	std::size_t change_detection = 0;
+	// Distance field and its pending changes
+	std::size_t distance_field = 0;
+	// Frontiers and their pending changes
+	std::size_t frontiers = 0;
+	// Integration pipeline state, not including the queued clouds
+	std::size_t pipeline = 0;
+
+	std::size_t nodeMemory() const noexcept { return inner_node_memory + leaf_node_memory; }
+
+	std::size_t total() const noexcept
+	{
+		return nodeMemory() + allocator_overhead + node_index + integration_scratch +
+		       change_detection + distance_field + frontiers + pipeline;
+	}
+
+	std::size_t totalNumNodes() const noexcept
+	{
+		return std::accumulate(num_nodes.begin(), num_nodes.end(), std::size_t(0));
+	}
+};
+}  // namespace ufo::map
+
+#endif  // UFO_MAP_MEMORY_REPORT_H
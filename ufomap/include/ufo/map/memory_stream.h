@@ -0,0 +1,135 @@
+/**
+ * UFOMap: An Efficient Probabilistic 3D Mapping Framework That Embraces the Unknown
+ *
+ * @author D. Duberg, KTH Royal Institute of Technology, Copyright (c) 2020.
+ * @see https://github.com/UnknownFreeOccupied/ufomap
+ * License: BSD 3
+ *
+ */
+
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2020, D. Duberg, KTH Royal Institute of Technology
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef UFO_MAP_MEMORY_STREAM_H
+#define UFO_MAP_MEMORY_STREAM_H
+
+// STD
+#include <cstdint>
+#include <ios>
+#include <streambuf>
+#include <type_traits>
+#include <vector>
+
+namespace ufo::map
+{
+/**
+ * @brief Stream buffer that appends what is written to a vector of bytes, so a map can
+ * be written straight into, e.g., the data of a message without a stringstream in
+ * between
+ *
+ * @tparam Byte A single byte type, e.g., char, int8_t or uint8_t
+ */
+template <typename Byte>
+class VectorStreamBuffer : public std::streambuf
+{
+	static_assert(1 == sizeof(Byte) && std::is_trivial_v<Byte>, "Byte has to be a byte");
+
+ public:
+	explicit VectorStreamBuffer(std::vector<Byte>& data) : data_(data) {}
+
+ protected:
+	std::streamsize xsputn(char const* s, std::streamsize count) override
+	{
+		Byte const* first = reinterpret_cast<Byte const*>(s);
+		data_.insert(data_.end(), first, first + count);
+		return count;
+	}
+
+	int_type overflow(int_type ch) override
+	{
+		if (!traits_type::eq_int_type(ch, traits_type::eof())) {
+			data_.push_back(static_cast<Byte>(traits_type::to_char_type(ch)));
+		}
+		return traits_type::not_eof(ch);
+	}
+
+ private:
+	std::vector<Byte>& data_;
+};
+
+/**
+ * @brief Stream buffer that reads, and seeks, in place in a buffer of bytes, so a map
+ * can be read straight from, e.g., the data of a message without copying it into a
+ * stringstream first. The buffer has to outlive the stream buffer.
+ */
+class MemoryStreamBuffer : public std::streambuf
+{
+ public:
+	MemoryStreamBuffer(void const* data, std::size_t size)
+	{
+		// The get area is only read from
+		char* first = const_cast<char*>(static_cast<char const*>(data));
+		setg(first, first, first + size);
+	}
+
+ protected:
+	pos_type seekoff(off_type off, std::ios_base::seekdir dir,
+	                 std::ios_base::openmode which = std::ios_base::in) override
+	{
+		if (!(which & std::ios_base::in)) {
+			return pos_type(off_type(-1));
+		}
+
+		off_type position = off;
+		if (std::ios_base::cur == dir) {
+			position += gptr() - eback();
+		} else if (std::ios_base::end == dir) {
+			position += egptr() - eback();
+		}
+
+		if (0 > position || egptr() - eback() < position) {
+			return pos_type(off_type(-1));
+		}
+		setg(eback(), eback() + position, egptr());
+		return pos_type(position);
+	}
+
+	pos_type seekpos(pos_type pos,
+	                 std::ios_base::openmode which = std::ios_base::in) override
+	{
+		return seekoff(off_type(pos), std::ios_base::beg, which);
+	}
+};
+}  // namespace ufo::map
+
+#endif  // UFO_MAP_MEMORY_STREAM_H
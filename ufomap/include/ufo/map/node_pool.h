@@ -0,0 +1,271 @@
+/**
+ * UFOMap: An Efficient Probabilistic 3D Mapping Framework That Embraces the Unknown
+ *
+ * @author D. Duberg, KTH Royal Institute of Technology, Copyright (c) 2020.
+ * @see https://github.com/UnknownFreeOccupied/ufomap
+ * License: BSD 3
+ *
+ */
+
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2020, D. Duberg, KTH Royal Institute of Technology
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef UFO_MAP_NODE_POOL_H
+#define UFO_MAP_NODE_POOL_H
+
+// STD
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <vector>
+
+namespace ufo::map
+{
+/**
+ * @brief Number of blocks and memory used by a node pool
+ *
+ */
+struct NodePoolStats {
+	std::size_t live_blocks = 0;  // Blocks in use
+	std::size_t free_blocks = 0;  // Blocks allocated from the system but not in use
+	std::size_t num_slabs = 0;
+	std::size_t memory_usage = 0;  // Bytes allocated from the system
+
+	NodePoolStats& operator+=(NodePoolStats const& rhs) noexcept
+	{
+		live_blocks += rhs.live_blocks;
+		free_blocks += rhs.free_blocks;
+		num_slabs += rhs.num_slabs;
+		memory_usage += rhs.memory_usage;
+		return *this;
+	}
+};
+
+/**
+ * @brief Pool allocator for the eight children of an octree node
+ *
+ * @details Blocks of eight nodes are carved out of large slabs. Freed blocks are put on
+ * a free list and reused by the next allocation. Memory is only given back to the system
+ * by release(), which frees all slabs at once.
+ *
+ * Blocks can either be handed out as pointers, allocate()/deallocate(), or as 32-bit
+ * indices, allocateIndex()/deallocateIndex()/get(). Index 0 is never used, so it can
+ * mean "no block". A pool should only be used in one of the two ways.
+ *
+ * An index pool can also be given blocks stored somewhere else, such as a mapped file,
+ * with map(). Those blocks are used in place and new blocks come from new slabs.
+ *
+ * @tparam T The node type
+ * @tparam BLOCKS_PER_SLAB Number of blocks of eight nodes in each slab
+ */
+template <typename T, std::size_t BLOCKS_PER_SLAB = 512>
+class NodePool
+{
+ public:
+	using Block = std::array<T, 8>;
+
+	NodePool() {}
+
+	NodePool(NodePool const&) = delete;
+
+	NodePool& operator=(NodePool const&) = delete;
+
+	~NodePool() { release(); }
+
+	/**
+	 * @brief Get a block of eight value initialized nodes.
+	 */
+	Block* allocate()
+	{
+		Slot* slot;
+		if (free_) {
+			slot = free_;
+			free_ = free_->next;
+			--num_free_;
+		} else {
+			if (BLOCKS_PER_SLAB == next_in_slab_) {
+				slabs_.emplace_back(new Slot[BLOCKS_PER_SLAB], SlabDeleter{true});
+				next_in_slab_ = 0;
+			}
+			slot = &slabs_.back()[next_in_slab_++];
+		}
+		++num_live_;
+		return new (slot->storage) Block();
+	}
+
+	/**
+	 * @brief Give back a block that was allocated from this pool.
+	 */
+	void deallocate(Block* block) noexcept
+	{
+		block->~Block();
+		Slot* slot = reinterpret_cast<Slot*>(block);
+		slot->next = free_;
+		free_ = slot;
+		++num_free_;
+		--num_live_;
+	}
+
+	/**
+	 * @brief Get a block of eight value initialized nodes, identified by an index that
+	 * is never 0.
+	 */
+	std::uint32_t allocateIndex()
+	{
+		std::uint32_t index;
+		if (free_index_) {
+			index = free_index_;
+			free_index_ = slot(index)->next_index;
+			--num_free_;
+		} else {
+			if (BLOCKS_PER_SLAB == next_in_slab_) {
+				slabs_.emplace_back(new Slot[BLOCKS_PER_SLAB], SlabDeleter{true});
+				next_in_slab_ = 0;
+			}
+			index = static_cast<std::uint32_t>((slabs_.size() - 1) * BLOCKS_PER_SLAB +
+			                                   next_in_slab_++ + 1);
+		}
+		++num_live_;
+		new (slot(index)->storage) Block();
+		return index;
+	}
+
+	/**
+	 * @brief Give back a block that was allocated with allocateIndex().
+	 */
+	void deallocateIndex(std::uint32_t index) noexcept
+	{
+		get(index)->~Block();
+		slot(index)->next_index = free_index_;
+		free_index_ = index;
+		++num_free_;
+		--num_live_;
+	}
+
+	/**
+	 * @brief The block with index, as returned by allocateIndex().
+	 */
+	Block* get(std::uint32_t index) const noexcept
+	{
+		return std::launder(reinterpret_cast<Block*>(slot(index)->storage));
+	}
+
+	/**
+	 * @brief Use num_blocks blocks of slotSize() bytes each, stored one after the other at
+	 * data, as the blocks with index 1 to num_blocks. The pool is released first. The
+	 * memory is not owned by the pool and has to stay valid until the next release().
+	 */
+	void map(void* data, std::size_t num_blocks)
+	{
+		release();
+		Slot* slots = static_cast<Slot*>(data);
+		for (std::size_t i = 0; i < num_blocks; i += BLOCKS_PER_SLAB) {
+			slabs_.emplace_back(slots + i, SlabDeleter{false});
+		}
+		num_live_ = num_blocks;
+	}
+
+	/**
+	 * @brief The number of bytes each block takes in a slab, and in the data given to
+	 * map().
+	 */
+	static constexpr std::size_t slotSize() noexcept { return sizeof(Slot); }
+
+	/**
+	 * @brief Free all memory. All blocks have to be destroyed, or be trivially
+	 * destructible, before calling this.
+	 */
+	void release() noexcept
+	{
+		slabs_.clear();
+		slabs_.shrink_to_fit();
+		free_ = nullptr;
+		free_index_ = 0;
+		next_in_slab_ = BLOCKS_PER_SLAB;
+		num_live_ = 0;
+		num_free_ = 0;
+	}
+
+	std::size_t numLiveBlocks() const noexcept { return num_live_; }
+
+	std::size_t numFreeBlocks() const noexcept
+	{
+		return num_free_ + (slabs_.empty() ? 0 : BLOCKS_PER_SLAB - next_in_slab_);
+	}
+
+	NodePoolStats getStats() const noexcept
+	{
+		NodePoolStats stats;
+		stats.live_blocks = numLiveBlocks();
+		stats.free_blocks = numFreeBlocks();
+		stats.num_slabs = slabs_.size();
+		stats.memory_usage = slabs_.size() * BLOCKS_PER_SLAB * sizeof(Slot);
+		return stats;
+	}
+
+ private:
+	union Slot {
+		Slot* next;
+		std::uint32_t next_index;
+		alignas(Block) unsigned char storage[sizeof(Block)];
+	};
+
+	// Slabs given with map() are not freed
+	struct SlabDeleter {
+		bool owned;
+
+		void operator()(Slot* slab) const noexcept
+		{
+			if (owned) {
+				delete[] slab;
+			}
+		}
+	};
+
+	Slot* slot(std::uint32_t index) const noexcept
+	{
+		--index;
+		return &slabs_[index / BLOCKS_PER_SLAB][index % BLOCKS_PER_SLAB];
+	}
+
+	std::vector<std::unique_ptr<Slot[], SlabDeleter>> slabs_;
+	Slot* free_ = nullptr;          // Free list
+	std::uint32_t free_index_ = 0;  // Free list when handing out indices
+	std::size_t next_in_slab_ = BLOCKS_PER_SLAB;
+	std::size_t num_live_ = 0;
+	std::size_t num_free_ = 0;
+};
+}  // namespace ufo::map
+
+#endif  // UFO_MAP_NODE_POOL_H
@@ -69,11 +69,28 @@ class OccupancyMap : public OccupancyMapBase<OccupancyNode<float>>
 
 	OccupancyMap(OccupancyMap const& other);
 
+	OccupancyMap(OccupancyMap const& other,
+	             ufo::geometry::BoundingVolume const& bounding_volume);
+
 	//
 	// Destructor
 	//
 
-	virtual ~OccupancyMap() {}
+	virtual ~OccupancyMap() { stopPipeline(); }
+
+	//
+	// Read only copy
+	//
+
+	/**
+	 * @brief Immutable deep copy for readers on other threads, see makeReadOnlyCopy().
+	 */
+	std::shared_ptr<OccupancyMap const> readOnlyCopy(
+	    ufo::geometry::BoundingVolume const& bounding_volume =
+	        ufo::geometry::BoundingVolume())
+	{
+		return makeReadOnlyCopy<OccupancyMap>(bounding_volume);
+	}
 
 	//
 	// Tree Type
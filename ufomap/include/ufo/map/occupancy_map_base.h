@@ -42,25 +42,82 @@
 #ifndef UFO_MAP_OCCUPANCY_MAP_BASE_H
 #define UFO_MAP_OCCUPANCY_MAP_BASE_H
 
+#include <ufo/map/bounded_queue.h>
+#include <ufo/map/code_concurrent.h>
+#include <ufo/map/depth_schedule.h>
+#include <ufo/map/distance_field.h>
+#include <ufo/map/integration_context.h>
+#include <ufo/map/integration_metrics.h>
 #include <ufo/map/iterator/occupancy_map.h>
 #include <ufo/map/iterator/occupancy_map_nearest.h>
 #include <ufo/map/occupancy_map_node.h>
 #include <ufo/map/octree.h>
 #include <ufo/map/point_cloud.h>
+#include <ufo/map/prefilter.h>
+#include <ufo/map/ray_packet.h>
 #include <ufo/map/types.h>
 
+// STD
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <execution>
+#include <future>
+#include <iterator>
+#include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <numeric>
+#include <optional>
+#include <set>
+#include <shared_mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
 namespace ufo::map
 {
 enum OccupancyState { unknown, free, occupied };
 
-template <typename DATA_TYPE>
-class OccupancyMapBase : public Octree<DATA_TYPE, OccupancyMapInnerNode<DATA_TYPE>,
-                                       OccupancyMapLeafNode<DATA_TYPE>>
+/**
+ * @brief Where a ray cast by castRays stopped
+ *
+ */
+struct RayHit {
+	// The node the ray stopped in
+	Code code;
+	// Distance from the origin to where the ray entered code, negative if the ray does not
+	// pass through the map
+	double distance = -1;
+	// Occupied if the ray hit something, unknown if it was stopped by unknown space, and
+	// free if it reached the max range or the edge of the map
+	OccupancyState state = OccupancyState::free;
+};
+
+// Identifies a point cloud in the integration pipeline
+using IntegrationTicket = std::uint64_t;
+
+template <typename DATA_TYPE,
+          typename INNER_NODE_TYPE = OccupancyMapInnerNode<DATA_TYPE>,
+          DepthType FIXED_DEPTH_LEVELS = 0>
+class OccupancyMapBase
+    : public Octree<DATA_TYPE, INNER_NODE_TYPE, OccupancyMapLeafNode<DATA_TYPE>,
+                    FIXED_DEPTH_LEVELS>
 {
  protected:
-	using Base = Octree<DATA_TYPE, OccupancyMapInnerNode<DATA_TYPE>,
-	                    OccupancyMapLeafNode<DATA_TYPE>>;
-	using INNER_NODE = OccupancyMapInnerNode<DATA_TYPE>;
+	using Base = Octree<DATA_TYPE, INNER_NODE_TYPE, OccupancyMapLeafNode<DATA_TYPE>,
+	                    FIXED_DEPTH_LEVELS>;
+	using INNER_NODE = INNER_NODE_TYPE;
 	using LEAF_NODE = OccupancyMapLeafNode<DATA_TYPE>;
 
 	using OccupancyMapBasereeIterator =
@@ -76,10 +133,22 @@ class OccupancyMapBase : public Octree<DATA_TYPE, OccupancyMapInnerNode<DATA_TYP
 
 	using LogitType = decltype(DATA_TYPE::occupancy);
 
+	// Type used for the sensor model and thresholds. Floating point occupancy uses
+	// double, integer occupancy the integer fixed point type it is stored as.
+	using LogitValue =
+	    std::conditional_t<std::is_floating_point_v<LogitType>, double, LogitType>;
+
 	// TODO: Why do I need this here instead of using it from Base?
 	using Path = std::array<LEAF_NODE*, Base::MAX_DEPTH_LEVELS>;
+	using ChunkRoots = typename Base::ChunkRoots;
+	using ConstChunkRoots = typename Base::ConstChunkRoots;
 
  public:
+	using Accessor = typename Base::Accessor;
+	// Iterator over the changed codes, a forward iterator with Code as value type. Was
+	// CodeSet::const_iterator before the changes were kept in a ConcurrentCodeSet.
+	using ChangesIterator = ConcurrentCodeSet::const_iterator;
+
 	//
 	// Tree type
 	//
@@ -162,6 +231,47 @@ class OccupancyMapBase : public Octree<DATA_TYPE, OccupancyMapInnerNode<DATA_TYP
 		                                min_depth);
 	}
 
+	//
+	// Parallel iteration
+	//
+
+	/**
+	 * @brief Call f with an iterator at each node beginLeaves with the same arguments
+	 * visits.
+	 *
+	 * @details The tree is split into subtrees that are iterated in parallel, so f is
+	 * called concurrently and in no particular order.
+	 */
+	template <class UnaryFunction>
+	void parallelForEachLeaf(ufo::geometry::BoundingVolume const& bounding_volume,
+	                         UnaryFunction f, bool occupied_space = true,
+	                         bool free_space = true, bool unknown_space = false,
+	                         bool contains = false, DepthType min_depth = 0) const
+	{
+		auto const subtrees = splitTree(
+		    bounding_volume, min_depth,
+		    64 * std::max(1U, std::thread::hardware_concurrency()));
+		std::for_each(
+		    std::execution::par, subtrees.begin(), subtrees.end(), [&](auto const& subtree) {
+			    OccupancyMapLeafIterator const end;
+			    for (OccupancyMapLeafIterator it(this, *subtree.first, subtree.second,
+			                                     bounding_volume, occupied_space, free_space,
+			                                     unknown_space, contains, min_depth);
+			         end != it; ++it) {
+				    f(std::as_const(it));
+			    }
+		    });
+	}
+
+	template <class UnaryFunction>
+	void parallelForEachLeaf(UnaryFunction f, bool occupied_space = true,
+	                         bool free_space = true, bool unknown_space = false,
+	                         bool contains = false, DepthType min_depth = 0) const
+	{
+		parallelForEachLeaf(ufo::geometry::BoundingVolume(), f, occupied_space, free_space,
+		                    unknown_space, contains, min_depth);
+	}
+
 	//
 	// Nearest neighbor iterators
 	//
@@ -244,6 +354,151 @@ class OccupancyMapBase : public Octree<DATA_TYPE, OccupancyMapInnerNode<DATA_TYP
 		                                  min_depth);
 	}
 
+	//
+	// Nearest neighbor search
+	//
+
+	/**
+	 * @brief Buffers reused between knnSearch calls, so repeated queries do not allocate.
+	 * Each thread needs its own.
+	 */
+	class SearchContext
+	{
+	 private:
+		friend class OccupancyMapBase;
+
+		// The k best nodes found so far, a max heap on squared distance
+		std::vector<std::pair<double, Code>> best_;
+	};
+
+	/**
+	 * @brief The k nodes closest to point, closest first.
+	 *
+	 * @details A node is returned if it is at depth or has no children, and is in one of
+	 * the selected spaces. Subtrees that cannot contain such a node, or that are further
+	 * away than the current k:th best node, are not visited.
+	 *
+	 * @param codes Set to the codes of the nodes
+	 * @param squared_distances If not null, set to the squared distances from point to the
+	 * nodes
+	 * @return The number of nodes found, at most k
+	 */
+	std::size_t knnSearch(Point3 const& point, std::size_t k, std::vector<Code>& codes,
+	                      SearchContext& context,
+	                      std::vector<double>* squared_distances = nullptr,
+	                      bool occupied_space = true, bool free_space = false,
+	                      bool unknown_space = false, DepthType depth = 0) const
+	{
+		codes.clear();
+		if (squared_distances) {
+			squared_distances->clear();
+		}
+		if (0 == k) {
+			return 0;
+		}
+
+		checkPropagated(Base::getRoot(), Base::getTreeDepthLevels());
+
+		auto& best = context.best_;
+		best.clear();
+		best.reserve(k);
+		knnSearchRecurs(Base::getRoot(), Base::getRootCode(), Point3(0, 0, 0), point, k,
+		                best, occupied_space, free_space, unknown_space, depth);
+
+		std::sort_heap(best.begin(), best.end(),
+		               [](auto const& a, auto const& b) { return a.first < b.first; });
+		codes.reserve(best.size());
+		for (auto const& [squared_distance, code] : best) {
+			codes.push_back(code);
+		}
+		if (squared_distances) {
+			squared_distances->reserve(best.size());
+			for (auto const& [squared_distance, code] : best) {
+				squared_distances->push_back(squared_distance);
+			}
+		}
+		return best.size();
+	}
+
+	std::size_t knnSearch(Point3 const& point, std::size_t k, std::vector<Code>& codes,
+	                      std::vector<double>* squared_distances = nullptr,
+	                      bool occupied_space = true, bool free_space = false,
+	                      bool unknown_space = false, DepthType depth = 0) const
+	{
+		SearchContext context;
+		return knnSearch(point, k, codes, context, squared_distances, occupied_space,
+		                 free_space, unknown_space, depth);
+	}
+
+	/**
+	 * @brief The nodes within radius of point, in Morton order. Which nodes are returned
+	 * is the same as for knnSearch.
+	 *
+	 * @return The number of nodes found
+	 */
+	std::size_t radiusSearch(Point3 const& point, double radius, std::vector<Code>& codes,
+	                         std::vector<double>* squared_distances = nullptr,
+	                         bool occupied_space = true, bool free_space = false,
+	                         bool unknown_space = false, DepthType depth = 0) const
+	{
+		codes.clear();
+		if (squared_distances) {
+			squared_distances->clear();
+		}
+		if (0 > radius) {
+			return 0;
+		}
+
+		checkPropagated(Base::getRoot(), Base::getTreeDepthLevels());
+
+		radiusSearchRecurs(Base::getRoot(), Base::getRootCode(), Point3(0, 0, 0), point,
+		                   radius * radius, codes, squared_distances, occupied_space,
+		                   free_space, unknown_space, depth);
+		return codes.size();
+	}
+
+	//
+	// Collision checking
+	//
+
+	/**
+	 * @brief For each of volumes, whether it intersects an occupied node at depth or
+	 * above.
+	 *
+	 * @details The volumes are checked in groups of 64 with one traversal of the tree
+	 * each, carrying a bitmask of the volumes that still intersect the node. A volume is
+	 * dropped as soon as it hits something. Groups are checked in parallel.
+	 *
+	 * @param occupied Set to one bool per volume
+	 * @param unknown_as_occupied Whether unknown space counts as occupied
+	 */
+	void anyOccupied(std::vector<ufo::geometry::BoundingVar> const& volumes,
+	                 std::vector<bool>& occupied, bool unknown_as_occupied = false,
+	                 DepthType depth = 0) const
+	{
+		// Throw here instead of in a worker thread
+		checkPropagated(Base::getRoot(), Base::getTreeDepthLevels());
+
+		std::vector<std::uint64_t> hits((volumes.size() + 63) / 64);
+		std::vector<std::size_t> groups(hits.size());
+		std::iota(groups.begin(), groups.end(), 0);
+		std::for_each(std::execution::par, groups.begin(), groups.end(),
+		              [&](std::size_t group) {
+			              std::size_t const num = std::min<std::size_t>(
+			                  64, volumes.size() - 64 * group);
+			              std::uint64_t const active =
+			                  64 == num ? ~std::uint64_t(0) : (std::uint64_t(1) << num) - 1;
+			              anyOccupiedRecurs(Base::getRoot(), Point3(0, 0, 0),
+			                                Base::getTreeDepthLevels(), &volumes[64 * group],
+			                                active, hits[group], unknown_as_occupied, depth);
+		              });
+
+		occupied.resize(volumes.size());
+		for (std::size_t i = 0; volumes.size() != i; ++i) {
+			occupied[i] = (hits[i / 64] >> (i % 64)) & 1;
+		}
+	}
+
 	//
 	// Integration
 	//
@@ -268,61 +523,30 @@ class OccupancyMapBase : public Octree<DATA_TYPE, OccupancyMapInnerNode<DATA_TYP
 	}
 
 	template <typename T>
-	void insertPointCloud(Point3 const& sensor_origin, T cloud, double max_range = -1,
+	void insertPointCloud(Point3 const& sensor_origin, T const& cloud, double max_range = -1,
 	                      DepthType depth = 0, bool simple_ray_casting = false,
-	                      unsigned int early_stopping = 0, bool async = false)
+	                      unsigned int early_stopping = 0, bool async = false,
+	                      bool parallel = false)
 	{
-		std::vector<std::pair<Code, float>> occupied_hits;
-		occupied_hits.reserve(cloud.size());
-		PointCloud discretized;
-		discretized.reserve(cloud.size());
-		Point3 min_change = Base::getMax();
-		Point3 max_change = Base::getMin();
-		for (Point3& end : cloud) {
-			Point3 origin = sensor_origin;
-			Point3 direction = (end - origin);
-			double distance = direction.norm();
-
-			// Move origin and end inside BBX
-			if (!Base::moveLineInside(origin, end)) {
-				// Line outside of BBX
-				continue;
-			}
-
-			if (0 > max_range || distance <= max_range) {
-				// Occupied space
-				Code end_code = Base::toCode(end);
-				if (indices_.insert(end_code).second) {
-					occupied_hits.push_back(std::make_pair(end_code, prob_hit_log_));
-				}
-			} else {
-				direction /= distance;
-				end = origin + (direction * max_range);
-			}
-
-			discretized.push_back(end);
-
-			for (int i : {0, 1, 2}) {
-				min_change[i] = std::min(min_change[i], std::min(end[i], origin[i]));
-				max_change[i] = std::max(max_change[i], std::max(end[i], origin[i]));
-			}
-		}
+		typename IntegrationContext<LogitType>::Cloud& buffers = context_->nextCloud();
+		Point3 min_change;
+		Point3 max_change;
+		discretizePointCloud(sensor_origin, cloud, max_range, buffers.discretized,
+		                     buffers.occupied_hits, min_change, max_change);
 
-		LogitType prob_miss_log = prob_miss_log_ / double((2.0 * depth) + 1);
-
-		indices_.clear();
+		LogitType prob_miss_log = getProbMissLog(depth);
 
 		insertPointCloudWait();
 
 		if (async) {
 			integrate_ = std::async(
-			    std::launch::async, &OccupancyMapBase<DATA_TYPE>::insertPointCloudHelper, this,
-			    sensor_origin, std::move(discretized), std::move(occupied_hits), prob_miss_log,
-			    depth, simple_ray_casting, early_stopping, min_change, max_change);
+			    std::launch::async, &OccupancyMapBase::insertPointCloudHelper, this,
+			    sensor_origin, std::ref(buffers), prob_miss_log, depth, simple_ray_casting,
+			    early_stopping, parallel, min_change, max_change);
 		} else {
-			insertPointCloudHelper(sensor_origin, std::move(discretized),
-			                       std::move(occupied_hits), prob_miss_log, depth,
-			                       simple_ray_casting, early_stopping, min_change, max_change);
+			insertPointCloudHelper(sensor_origin, buffers, prob_miss_log, depth,
+			                       simple_ray_casting, early_stopping, parallel, min_change,
+			                       max_change);
 		}
 	}
 
@@ -330,101 +554,104 @@ class OccupancyMapBase : public Octree<DATA_TYPE, OccupancyMapInnerNode<DATA_TYP
 	void insertPointCloud(Point3 const& sensor_origin, T cloud,
 	                      math::Pose6 const& frame_origin, double max_range = -1,
 	                      DepthType depth = 0, bool simple_ray_casting = false,
-	                      unsigned int early_stopping = 0, bool async = false)
+	                      unsigned int early_stopping = 0, bool async = false,
+	                      bool parallel = false)
 	{
 		cloud.transform(frame_origin, async);
 		insertPointCloud(sensor_origin, cloud, max_range, depth, simple_ray_casting,
-		                 early_stopping, async);
+		                 early_stopping, async, parallel);
 	}
 
 	template <typename T>
 	void insertPointCloudDiscrete(Point3 const& sensor_origin, T const& cloud,
 	                              double max_range = -1, DepthType depth = 0,
 	                              bool simple_ray_casting = false,
-	                              unsigned int early_stopping = 0, bool async = false)
+	                              unsigned int early_stopping = 0, bool async = false,
+	                              bool parallel = false)
 	{
-		double squared_max_range = max_range * max_range;
-
-		std::vector<std::pair<Code, float>> occupied_hits;
-		occupied_hits.reserve(cloud.size());
-		PointCloud discretized;
-		discretized.reserve(cloud.size());
-		Point3 min_change = Base::getMax();
-		Point3 max_change = Base::getMin();
-		for (Point3 end : cloud) {
-			if (0 > max_range || (end - sensor_origin).squaredNorm() < squared_max_range) {
-				if (Base::isInside(end)) {
-					Code end_code = Base::toCode(end);
-					if (!indices_.insert(end_code).second) {
-						continue;
-					}
-					occupied_hits.push_back(std::make_pair(end_code, prob_hit_log_));
-				}
-			} else {
-				Point3 direction = Base::toCoord(Base::toKey(end, depth)) - sensor_origin;
-				double distance = direction.norm();
-				direction /= distance;
-				if (0 <= max_range && distance > max_range) {
-					end = sensor_origin + (direction * max_range);
-				}
-			}
-			Point3 current = sensor_origin;
-			// Move origin and end inside map
-			if (!Base::moveLineInside(current, end)) {
-				// Line outside of map
-				continue;
-			}
-
-			Key end_key = Base::toKey(end, depth);
-
-			if (0 < depth && !indices_.insert(Base::toCode(end_key)).second) {
-				continue;
-			}
-
-			Point3 end_coord = Base::toCoord(end_key);
-
-			discretized.push_back(end_coord);
-
-			// Min/max change detection
-			Point3 current_center = Base::toCoord(Base::toKey(current, depth));
-			Point3 end_center = end_coord;
-
-			double temp = Base::getNodeHalfSize(depth);
-			for (int i : {0, 1, 2}) {
-				min_change[i] = std::min(
-				    min_change[i], std::min(end_center[i] - temp, current_center[i] - temp));
-				max_change[i] = std::max(
-				    max_change[i], std::max(end_center[i] + temp, current_center[i] + temp));
-			}
-		}
-
-		LogitType prob_miss_log = prob_miss_log_ / double((2.0 * depth) + 1);
+		typename IntegrationContext<LogitType>::Cloud& buffers = context_->nextCloud();
+		Point3 min_change;
+		Point3 max_change;
+		discretizePointCloudDiscrete(sensor_origin, cloud, max_range, depth,
+		                             buffers.discretized, buffers.occupied_hits, min_change,
+		                             max_change);
 
-		indices_.clear();
+		LogitType prob_miss_log = getProbMissLog(depth);
 
 		insertPointCloudWait();
 
 		if (async) {
 			integrate_ = std::async(
-			    std::launch::async, &OccupancyMapBase<DATA_TYPE>::insertPointCloudHelper, this,
-			    sensor_origin, std::move(discretized), std::move(occupied_hits), prob_miss_log,
-			    depth, simple_ray_casting, early_stopping, min_change, max_change);
+			    std::launch::async, &OccupancyMapBase::insertPointCloudHelper, this,
+			    sensor_origin, std::ref(buffers), prob_miss_log, depth, simple_ray_casting,
+			    early_stopping, parallel, min_change, max_change);
 		} else {
-			insertPointCloudHelper(sensor_origin, std::move(discretized),
-			                       std::move(occupied_hits), prob_miss_log, depth,
-			                       simple_ray_casting, early_stopping, min_change, max_change);
+			insertPointCloudHelper(sensor_origin, buffers, prob_miss_log, depth,
+			                       simple_ray_casting, early_stopping, parallel, min_change,
+			                       max_change);
 		}
 	}
 
 	template <typename T>
-	void InsertPointCloudDiscrete(Point3 const& sensor_origin, T cloud,
+	void insertPointCloudDiscrete(Point3 const& sensor_origin, T cloud,
 	                              math::Pose6 const& frame_origin, double max_range = -1,
 	                              DepthType depth = 0, bool simple_ray_casting = false,
-	                              unsigned int early_stopping = 0, bool async = false)
+	                              unsigned int early_stopping = 0, bool async = false,
+	                              bool parallel = false)
 	{
 		cloud.transform(frame_origin, async);
 		insertPointCloudDiscrete(sensor_origin, cloud, max_range, depth, simple_ray_casting,
-		                         early_stopping, async);
+		                         early_stopping, async, parallel);
+	}
+
+	// Kept for backwards compatibility, use insertPointCloudDiscrete
+	template <typename T>
+	void InsertPointCloudDiscrete(Point3 const& sensor_origin, T cloud,
+	                              math::Pose6 const& frame_origin, double max_range = -1,
+	                              DepthType depth = 0, bool simple_ray_casting = false,
+	                              unsigned int early_stopping = 0, bool async = false,
+	                              bool parallel = false)
+	{
+		insertPointCloudDiscrete(sensor_origin, std::move(cloud), frame_origin, max_range,
+		                         depth, simple_ray_casting, early_stopping, async, parallel);
+	}
+
+	/**
+	 * @brief Integrate a point cloud where the depth free space is integrated at depends
+	 * on the distance from the sensor, given by schedule. Occupied space is integrated
+	 * at depth 0. Free space at depth d is updated with the miss probability scaled by
+	 * 1 / (2d + 1), same as insertPointCloudDiscrete.
+	 */
+	template <typename T>
+	void insertPointCloudDiscrete(Point3 const& sensor_origin, T const& cloud,
+	                              DepthSchedule const& schedule, double max_range = -1,
+	                              bool simple_ray_casting = false,
+	                              unsigned int early_stopping = 0, bool async = false,
+	                              bool parallel = false)
+	{
+		typename IntegrationContext<LogitType>::Cloud& buffers = context_->nextCloud();
+		Point3 min_change;
+		Point3 max_change;
+		discretizePointCloudDiscrete(sensor_origin, cloud, max_range, 0, buffers.discretized,
+		                             buffers.occupied_hits, min_change, max_change);
+
+		// Free space can be integrated at coarser nodes than the end points
+		double extra = Base::getNodeHalfSize(schedule.maxDepth());
+		min_change -= extra;
+		max_change += extra;
+
+		insertPointCloudWait();
+
+		if (async) {
+			integrate_ = std::async(
+			    std::launch::async, &OccupancyMapBase::insertPointCloudScheduledHelper,
+			    this, sensor_origin, std::ref(buffers), schedule, simple_ray_casting,
+			    early_stopping, parallel, min_change, max_change);
+		} else {
+			insertPointCloudScheduledHelper(sensor_origin, buffers, schedule,
+			                                simple_ray_casting, early_stopping, parallel,
+			                                min_change, max_change);
+		}
 	}
 
 	bool insertPointCloudDone() const
@@ -435,136 +662,490 @@ class OccupancyMapBase : public Octree<DATA_TYPE, OccupancyMapInnerNode<DATA_TYP
 		return true;
 	}
 
+	/**
+	 * @brief When the latest point cloud integration was applied to the map. For
+	 * asynchronous integration, call insertPointCloudWait() before, the time is then
+	 * when the integration really finished and not when insert returned.
+	 */
+	std::chrono::steady_clock::time_point insertPointCloudEnd() const noexcept
+	{
+		return integration_end_;
+	}
+
 	void insertPointCloudWait() const
 	{
 		if (integrate_.valid()) {
 			integrate_.wait();
 		}
+		if (pipeline_) {
+			std::unique_lock lock(pipeline_->mutex);
+			IntegrationTicket last = pipeline_->next_ticket - 1;
+			pipeline_->done.wait(lock, [this, last] { return pipeline_->isDone(last); });
+		}
 	}
 
 	//
-	// Cast ray
+	// Prefilter
 	//
 
-	std::optional<Code> castRay(Point3 origin, Point3 direction,
-	                            bool ignore_unknown = false, double max_range = -1,
-	                            DepthType depth = 0) const
+	/**
+	 * @brief Enable/disable the prefilter stage that removes redundant points from clouds
+	 * before they are integrated.
+	 */
+	void enablePrefilter(bool enable) noexcept { prefilter_enabled_ = enable; }
+
+	bool isPrefilterEnabled() const noexcept { return prefilter_enabled_; }
+
+	void setPrefilterOptions(PrefilterOptions const& options) noexcept
 	{
-		if (0 > max_range) {
-			max_range = Base::getMin().distance(Base::getMin());
-		}
+		prefilter_options_ = options;
+	}
 
-		direction.normalize();
-		Point3 end = origin + (direction * max_range);
+	PrefilterOptions const& getPrefilterOptions() const noexcept
+	{
+		return prefilter_options_;
+	}
 
-		if (!Base::moveLineIntoBBX(origin, end)) {
-			// Line fully outside of octree bounds
-			return std::nullopt;
+	/**
+	 * @brief How many points the prefilter stage kept and dropped for the latest cloud.
+	 */
+	PrefilterStats getPrefilterStats() const noexcept { return prefilter_stats_; }
+
+	/**
+	 * @brief Remove redundant points from cloud.
+	 *
+	 * @details First, points are sorted in Morton order at the voxel depth and the points
+	 * in each node are merged into their centroid. Then, points are bucketed by direction
+	 * from the sensor and points in the same bucket whose distances differ less than the
+	 * range tolerance are merged into the farthest of them. Points outside the map are
+	 * kept as is, points that are not finite are removed.
+	 *
+	 * @param filtered The points that are kept
+	 */
+	template <typename T>
+	PrefilterStats prefilter(Point3 const& sensor_origin, T const& cloud,
+	                         PointCloud& filtered, PrefilterOptions const& options)
+	{
+		PrefilterStats stats;
+		stats.input = cloud.size();
+
+		filtered.clear();
+		filtered.reserve(cloud.size());
+
+		if (options.voxel_filter) {
+			auto& order = context_->voxel_order;
+			order.clear();
+			std::size_t index = 0;
+			for (auto const& point : cloud) {
+				Point3 p(point);
+				if (Base::isInside(p)) {
+					order.push_back(
+					    std::make_pair(Base::toCode(p, options.voxel_depth).getCode(), index));
+				} else if (p.isFinite()) {
+					filtered.push_back(p);
+				}
+				++index;
+			}
+
+			std::sort(order.begin(), order.end());
+
+			for (auto it = order.begin(); order.end() != it;) {
+				Point3 sum;
+				std::size_t num = 0;
+				auto last = it;
+				for (; order.end() != last && last->first == it->first; ++last) {
+					sum += Point3(cloud[last->second]);
+					++num;
+				}
+				filtered.push_back(sum / static_cast<double>(num));
+				stats.voxel_dropped += num - 1;
+				it = last;
+			}
+		} else {
+			for (auto const& point : cloud) {
+				Point3 p(point);
+				if (p.isFinite()) {
+					filtered.push_back(p);
+				}
+			}
 		}
 
-		Key current;
-		Key ending;
-		std::array<int, 3> step;
-		Point3 t_delta;
-		Point3 t_max;
-		Base::computeRayInit(origin, end, direction, current, ending, step, t_delta, t_max,
-		                     depth);
-		// Increment
-		Code current_code = Base::toCode(current);
-		while (current != ending && t_max.min() <= max_range) {
-			if (isOccupied(current_code)) {
-				return current_code;
+		if (0.0 < options.angular_resolution) {
+			constexpr double pi = 3.14159265358979323846;
+			auto& order = context_->angular_order;
+			order.clear();
+			for (std::size_t i = 0; i < filtered.size(); ++i) {
+				Point3 direction = filtered[i] - sensor_origin;
+				double range = direction.norm();
+				double azimuth = std::atan2(direction[1], direction[0]) + pi;
+				double elevation =
+				    std::atan2(direction[2], std::hypot(direction[0], direction[1])) + (pi / 2);
+				std::uint64_t bucket =
+				    (static_cast<std::uint64_t>(azimuth / options.angular_resolution) << 32) |
+				    static_cast<std::uint64_t>(elevation / options.angular_resolution);
+				order.push_back(std::make_pair(std::make_pair(bucket, range), i));
 			}
-			if (!ignore_unknown && isUnknown(current_code)) {
-				return std::nullopt;
+
+			std::sort(order.begin(), order.end());
+
+			// Keep the farthest point of each group, reuse the front of filtered
+			std::size_t kept = 0;
+			for (std::size_t i = 0; i < order.size(); ++i) {
+				auto const& [key, index] = order[i];
+				bool last_in_group = order.size() == i + 1 ||
+				                     order[i + 1].first.first != key.first ||
+				                     order[i + 1].first.second - key.second >
+				                         options.range_tolerance;
+				if (last_in_group) {
+					order[kept++].second = index;
+				} else {
+					++stats.angular_dropped;
+				}
 			}
-			Base::computeRayTakeStep(current, step, t_delta, t_max);
-			current_code = Base::toCode(current);
+			order.resize(kept);
+
+			// Keep the original order of the points
+			std::sort(order.begin(), order.end(),
+			          [](auto const& a, auto const& b) { return a.second < b.second; });
+			for (std::size_t i = 0; i < order.size(); ++i) {
+				filtered[i] = filtered[order[i].second];
+			}
+			filtered.resize(order.size());
 		}
 
-		return isOccupied(current_code) ? current_code : std::nullopt;
+		stats.kept = filtered.size();
+		return stats;
 	}
 
 	//
-	// Set value volume
+	// Integration metrics
 	//
 
-	void setValueVolume(ufo::geometry::BoundingVar const& bounding_volume,
-	                    double occupancy_value, DepthType min_depth = 0)
-	{
-		if (Base::getTreeDepthLevels() < min_depth) {
-			return;
-		}
+	/**
+	 * @brief Whether the library was built with UFOMAP_METRICS, otherwise the metrics
+	 * are not collected and always zero.
+	 */
+	static constexpr bool isIntegrationMetricsEnabled() noexcept { return METRICS_ENABLED; }
 
-		Point3 const center(0, 0, 0);
-		double half_size = Base::getNodeHalfSize(Base::getTreeDepthLevels());
-		ufo::geometry::AABB aabb(center, half_size);
-		if (!std::visit(
-		        [&aabb](auto&& arg) -> bool { return geometry::intersects(arg, aabb); },
-		        bounding_volume)) {
-			return;  // No node intersects
-		} else if (Base::getTreeDepthLevels() == min_depth) {
-			Base::deleteChildren(Base::getRoot(), Base::getTreeDepthLevels());
-			setOccupancy(Base::getRoot().value.occupancy, toLogit(occupancy_value));
-			updateNode(Base::getRoot(), Base::getTreeDepthLevels());
-			return;
-		}
+	/**
+	 * @brief Snapshot of the counters and per stage timings since the last reset, can be
+	 * taken while integrating.
+	 */
+	IntegrationStats getIntegrationStats() const { return Base::metrics_.stats(); }
 
-		if (setValueVolumeRecurs(bounding_volume, toLogit(occupancy_value), Base::getRoot(),
-		                         center, Base::getTreeDepthLevels(), min_depth)) {
-			// TODO: Is this needed?
-			updateNode(Base::getRoot(), Base::getTreeDepthLevels());
-		}
-	}
+	void resetIntegrationStats() { Base::metrics_.reset(); }
 
 	//
-	// Set value
+	// Integration context
 	//
 
-	void setOccupancy(Code const& code, double occupancy_value)
-	{
-		setNodeValue(code, toLogit(occupancy_value));
-	}
+	/**
+	 * @brief The scratch buffers used when integrating point clouds.
+	 */
+	IntegrationContext<LogitType>& getIntegrationContext() { return *context_; }
 
-	void setOccupancy(Point3 const& coord, double occupancy_value, DepthType depth = 0)
-	{
-		setOccupancy(Base::toCode(coord, depth), occupancy_value);
-	}
+	IntegrationContext<LogitType> const& getIntegrationContext() const { return *context_; }
 
-	void setOccupancy(double x, double y, double z, double occupancy_value,
-	                  DepthType depth = 0)
+	/**
+	 * @brief Use context for the scratch buffers when integrating point clouds, e.g., to
+	 * share one between maps that are not integrated into at the same time.
+	 */
+	void setIntegrationContext(std::shared_ptr<IntegrationContext<LogitType>> context)
 	{
-		setOccupancy(Base::toCode(x, y, z, depth), occupancy_value);
+		insertPointCloudWait();
+		if (context) {
+			context_ = std::move(context);
+		}
 	}
 
 	//
-	// Update value
+	// Integration pipeline
 	//
 
-	void updateOccupancy(Code const& code, double occupancy_value_update)
+	/**
+	 * @brief Start integrating point clouds in a pipeline running on its own threads.
+	 *
+	 * @details The pipeline has three stages (transform/discretize, ray cast, and apply to
+	 * the map) connected by bounded queues. Ray casting does not read the map, so it runs
+	 * at the same time as the previous cloud is applied. When a queue is full the policy
+	 * decides whether the stage pushing to it waits, drops the oldest cloud in the queue,
+	 * or merges the cloud into the newest cloud in the queue. Merged clouds are applied
+	 * together, occupied hits first.
+	 *
+	 * The map should not be modified or read, other than through tickets, while clouds
+	 * are in the pipeline.
+	 *
+	 * @param queue_capacity The maximum number of clouds waiting before each stage
+	 * @param policy What to do when a queue is full
+	 */
+	void startPipeline(std::size_t queue_capacity = 2,
+	                   BackpressurePolicy policy = BackpressurePolicy::block)
 	{
-		updateValue(code, toLogit(occupancy_value_update));
+		stopPipeline();
+		insertPointCloudWait();
+
+		pipeline_ = std::make_unique<Pipeline>(queue_capacity, policy);
+		pipeline_->discretize_thread = std::thread(&OccupancyMapBase::pipelineDiscretize, this);
+		pipeline_->ray_cast_thread = std::thread(&OccupancyMapBase::pipelineRayCast, this);
+		pipeline_->apply_thread = std::thread(&OccupancyMapBase::pipelineApply, this);
 	}
 
-	void updateOccupancy(Point3 const& coord, double occupancy_value_update,
-	                     DepthType depth = 0)
+	/**
+	 * @brief Stop the pipeline, after all clouds in it have been integrated.
+	 */
+	void stopPipeline()
 	{
-		updateOccupancy(Base::toCode(coord, depth), occupancy_value_update);
+		if (!pipeline_) {
+			return;
+		}
+
+		pipeline_->clouds.close();
+		pipeline_->discretize_thread.join();
+		pipeline_->discretized.close();
+		pipeline_->ray_cast_thread.join();
+		pipeline_->hits.close();
+		pipeline_->apply_thread.join();
+
+		pipeline_.reset();
 	}
 
-	void updateOccupancy(double x, double y, double z, double occupancy_value_update,
-	                     DepthType depth = 0)
+	bool isPipelineRunning() const noexcept { return static_cast<bool>(pipeline_); }
+
+	/**
+	 * @brief Queue a point cloud for integration in the pipeline. Only blocks if the
+	 * pipeline is full and the policy is to block.
+	 *
+	 * @param frame_origin Transform applied to the cloud in the first stage
+	 * @param discrete Whether to integrate as insertPointCloudDiscrete or insertPointCloud
+	 * @return Ticket that can be used to wait for the cloud
+	 */
+	IntegrationTicket insertPointCloudPipelined(
+	    Point3 const& sensor_origin, PointCloud cloud,
+	    std::optional<math::Pose6> const& frame_origin = std::nullopt,
+	    double max_range = -1, DepthType depth = 0, bool simple_ray_casting = false,
+	    unsigned int early_stopping = 0, bool parallel = false, bool discrete = false)
 	{
-		updateOccupancy(Base::toCode(x, y, z, depth), occupancy_value_update);
-	}
+		if (!pipeline_) {
+			startPipeline();
+		}
 
-	//
-	// Integrate hit/miss
-	//
+		IntegrationTicket ticket;
+		{
+			std::scoped_lock lock(pipeline_->mutex);
+			ticket = pipeline_->next_ticket++;
+		}
 
-	void integrateHit(Code const& code)
-	{
-		updateValue(code, static_cast<float>(prob_hit_log_));
+		PipelineBatch<PipelineCloud> batch;
+		batch.items.push_back(PipelineCloud{ticket, sensor_origin, std::move(cloud),
+		                                    frame_origin, max_range, depth,
+		                                    simple_ray_casting, early_stopping, parallel,
+		                                    discrete});
+		pipelineDropped(pipeline_->clouds.push(std::move(batch)));
+		return ticket;
+	}
+
+	/**
+	 * @brief Whether the cloud with ticket has been integrated or dropped.
+	 */
+	bool isDone(IntegrationTicket ticket) const
+	{
+		if (!pipeline_) {
+			return true;
+		}
+		std::scoped_lock lock(pipeline_->mutex);
+		return pipeline_->isDone(ticket);
+	}
+
+	/**
+	 * @brief Wait until the cloud with ticket has been integrated or dropped.
+	 */
+	void waitFor(IntegrationTicket ticket) const
+	{
+		if (!pipeline_) {
+			return;
+		}
+		std::unique_lock lock(pipeline_->mutex);
+		pipeline_->done.wait(lock, [this, ticket] { return pipeline_->isDone(ticket); });
+	}
+
+	/**
+	 * @brief Whether the cloud with ticket was dropped because of backpressure.
+	 *
+	 * @details Drops are remembered for the last `Pipeline::drop_history` applied
+	 * tickets, and until the pipeline is stopped. For older tickets this returns false,
+	 * while isDone still returns true.
+	 */
+	bool wasDropped(IntegrationTicket ticket) const
+	{
+		if (!pipeline_) {
+			return false;
+		}
+		std::scoped_lock lock(pipeline_->mutex);
+		return 0 != pipeline_->dropped.count(ticket);
+	}
+
+	//
+	// Cast ray
+	//
+
+	/**
+	 * @brief Cast a ray and return the first occupied node it hits at depth.
+	 *
+	 * @param hierarchical Leap across inner nodes that contain nothing that can stop the
+	 * ray, instead of stepping through them one node at depth at a time.
+	 */
+	std::optional<Code> castRay(Point3 origin, Point3 direction,
+	                            bool ignore_unknown = false, double max_range = -1,
+	                            DepthType depth = 0, bool hierarchical = false) const
+	{
+		RayCache cache(*this);
+		RayHit const hit =
+		    hierarchical
+		        ? castRayHierarchical(origin, direction, ignore_unknown, max_range, depth)
+		        : castRay(origin, direction, ignore_unknown, max_range, depth, cache);
+		return OccupancyState::occupied == hit.state ? std::optional<Code>(hit.code)
+		                                             : std::nullopt;
+	}
+
+	/**
+	 * @brief Cast a ray from each origin along each direction, in parallel.
+	 *
+	 * @details Rays next to each other are cast by the same thread, which reuses the node
+	 * it looked up last for as long as the rays stay inside it. Pass all rays of a sensor
+	 * in scan order for this to pay off.
+	 *
+	 * @param origins One origin shared by all rays, or one origin per ray.
+	 * @param results Resized to the number of rays, so its memory is reused between calls.
+	 * @param ignore_unknown Whether rays pass through unknown space.
+	 * @param hierarchical See castRay.
+	 */
+	void castRays(std::vector<Point3> const& origins, std::vector<Point3> const& directions,
+	              double max_range, std::vector<RayHit>& results,
+	              bool ignore_unknown = false, DepthType depth = 0,
+	              bool hierarchical = false) const
+	{
+		if (1 != origins.size() && origins.size() != directions.size()) {
+			throw std::invalid_argument(
+			    "castRays needs one origin or one origin per direction");
+		}
+
+		// Throw here instead of in a worker thread
+		checkPropagated(Base::getRoot(), Base::getTreeDepthLevels());
+
+		results.resize(directions.size());
+
+		static constexpr std::size_t CHUNK_SIZE = 256;
+		std::vector<std::size_t> chunks((directions.size() + CHUNK_SIZE - 1) / CHUNK_SIZE);
+		std::iota(chunks.begin(), chunks.end(), 0);
+		std::for_each(std::execution::par, chunks.begin(), chunks.end(),
+		              [&](std::size_t chunk) {
+			              RayCache cache(*this);
+			              std::size_t const last =
+			                  std::min(directions.size(), (chunk + 1) * CHUNK_SIZE);
+			              for (std::size_t i = chunk * CHUNK_SIZE; last != i; ++i) {
+				              Point3 const& origin = origins[1 == origins.size() ? 0 : i];
+				              results[i] = hierarchical
+				                               ? castRayHierarchical(origin, directions[i],
+				                                                     ignore_unknown, max_range,
+				                                                     depth)
+				                               : castRay(origin, directions[i], ignore_unknown,
+				                                         max_range, depth, cache);
+			              }
+		              });
+	}
+
+	//
+	// Set value volume
+	//
+
+	void setValueVolume(ufo::geometry::BoundingVar const& bounding_volume,
+	                    double occupancy_value, DepthType min_depth = 0)
+	{
+		auto lock = writeLock();
+		if (Base::getTreeDepthLevels() < min_depth) {
+			return;
+		}
+
+		Point3 const center(0, 0, 0);
+		double half_size = Base::getNodeHalfSize(Base::getTreeDepthLevels());
+		ufo::geometry::AABB aabb(center, half_size);
+		if (!std::visit(
+		        [&aabb](auto&& arg) -> bool { return geometry::intersects(arg, aabb); },
+		        bounding_volume)) {
+			return;  // No node intersects
+		} else if (Base::getTreeDepthLevels() == min_depth) {
+			Base::deleteChildren(Base::getRoot(), Base::getTreeDepthLevels());
+			setOccupancy(Base::getRoot().value.occupancy, toLogit(occupancy_value));
+			updateNode(Base::getRoot(), Base::getTreeDepthLevels());
+			return;
+		}
+
+		if (setValueVolumeRecurs(bounding_volume, toLogit(occupancy_value), Base::getRoot(),
+		                         center, Base::getTreeDepthLevels(), min_depth)) {
+			// TODO: Is this needed?
+			updateNode(Base::getRoot(), Base::getTreeDepthLevels());
+		}
+	}
+
+	//
+	// Set value
+	//
+
+	void setOccupancy(Code const& code, double occupancy_value)
+	{
+		setNodeValue(code, toLogit(occupancy_value));
+	}
+
+	void setOccupancy(Point3 const& coord, double occupancy_value, DepthType depth = 0)
+	{
+		setOccupancy(Base::toCode(coord, depth), occupancy_value);
+	}
+
+	void setOccupancy(double x, double y, double z, double occupancy_value,
+	                  DepthType depth = 0)
+	{
+		setOccupancy(Base::toCode(x, y, z, depth), occupancy_value);
+	}
+
+	//
+	// Update value
+	//
+
+	void updateOccupancy(Code const& code, double occupancy_value_update)
+	{
+		updateValue(code, toLogit(occupancy_value_update));
+	}
+
+	void updateOccupancy(Point3 const& coord, double occupancy_value_update,
+	                     DepthType depth = 0)
+	{
+		updateOccupancy(Base::toCode(coord, depth), occupancy_value_update);
+	}
+
+	void updateOccupancy(double x, double y, double z, double occupancy_value_update,
+	                     DepthType depth = 0)
+	{
+		updateOccupancy(Base::toCode(x, y, z, depth), occupancy_value_update);
+	}
+
+	void updateOccupancy(std::vector<std::pair<Code, double>> const& updates)
+	{
+		std::vector<std::pair<Code, LogitType>> logit_updates;
+		logit_updates.reserve(updates.size());
+		for (auto const& [code, occupancy_value_update] : updates) {
+			logit_updates.emplace_back(code, toLogit(occupancy_value_update));
+		}
+		auto lock = writeLock();
+		updateValueBatch(logit_updates);
+	}
+
+	//
+	// Integrate hit/miss
+	//
+
+	void integrateHit(Code const& code)
+	{
+		updateValue(code, static_cast<LogitType>(prob_hit_log_));
 	}
 
 	void integrateHit(Point3 const& coord, DepthType depth = 0)
@@ -579,7 +1160,7 @@ class OccupancyMapBase : public Octree<DATA_TYPE, OccupancyMapInnerNode<DATA_TYP
 
 	void integrateMiss(Code const& code)
 	{
-		updateValue(code, static_cast<float>(prob_miss_log_));
+		updateValue(code, static_cast<LogitType>(prob_miss_log_));
 	}
 
 	void integrateMiss(Point3 const& coord, DepthType depth = 0)
@@ -598,7 +1179,9 @@ class OccupancyMapBase : public Octree<DATA_TYPE, OccupancyMapInnerNode<DATA_TYP
 
 	double getOccupancy(Code const& code) const
 	{
-		return toProb(Base::getNode(code).first->value.occupancy);
+		auto [node, depth] = Base::getNode(code);
+		checkPropagated(*node, depth);
+		return toProb(node->value.occupancy);
 	}
 
 	double getOccupancy(Point3 const& coord, DepthType depth = 0) const
@@ -611,6 +1194,34 @@ class OccupancyMapBase : public Octree<DATA_TYPE, OccupancyMapInnerNode<DATA_TYP
 		return getOccupancy(Base::toCode(x, y, z, depth));
 	}
 
+	/**
+	 * @brief Same as getOccupancy(code), but starts from the path of the accessor's
+	 * previous lookup.
+	 */
+	double getOccupancy(Code const& code, Accessor& accessor) const
+	{
+		auto [node, depth] = accessor.getNode(code);
+		checkPropagated(*node, depth);
+		return getOccupancy(*node);
+	}
+
+	double getOccupancy(Point3 const& coord, Accessor& accessor, DepthType depth = 0) const
+	{
+		return getOccupancy(Base::toCode(coord, depth), accessor);
+	}
+
+	/**
+	 * @brief The occupancy at each of points, in the same order. See getStates.
+	 */
+	void getOccupancies(std::vector<Point3> const& points, std::vector<double>& occupancies,
+	                    DepthType depth = 0) const
+	{
+		occupancies.resize(points.size());
+		forEachNode(points, depth, [this, &occupancies](std::size_t i, LEAF_NODE const& node) {
+			occupancies[i] = getOccupancy(node);
+		});
+	}
+
 	//
 	// Checking state
 	//
@@ -618,13 +1229,8 @@ class OccupancyMapBase : public Octree<DATA_TYPE, OccupancyMapInnerNode<DATA_TYP
 	OccupancyState getState(Code const& code) const
 	{
 		auto [node, depth] = Base::getNode(code);
-		if (isOccupied(*node)) {
-			return OccupancyState::occupied;
-		} else if (isFree(*node)) {
-			return OccupancyState::free;
-		} else {
-			return OccupancyState::unknown;
-		}
+		checkPropagated(*node, depth);
+		return getState(*node);
 	}
 
 	OccupancyState getState(Point3 const& coord, DepthType depth = 0) const
@@ -637,6 +1243,39 @@ class OccupancyMapBase : public Octree<DATA_TYPE, OccupancyMapInnerNode<DATA_TYP
 		return getState(Base::toCode(x, y, z, depth));
 	}
 
+	/**
+	 * @brief Same as getState(code), but starts from the path of the accessor's previous
+	 * lookup.
+	 */
+	OccupancyState getState(Code const& code, Accessor& accessor) const
+	{
+		auto [node, depth] = accessor.getNode(code);
+		checkPropagated(*node, depth);
+		return getState(*node);
+	}
+
+	OccupancyState getState(Point3 const& coord, Accessor& accessor,
+	                        DepthType depth = 0) const
+	{
+		return getState(Base::toCode(coord, depth), accessor);
+	}
+
+	/**
+	 * @brief The state at each of points, in the same order.
+	 *
+	 * @details The points are looked up in Morton order, so each lookup only descends
+	 * from where its path leaves the path of the previous one. Large batches are split
+	 * across threads.
+	 */
+	void getStates(std::vector<Point3> const& points, std::vector<OccupancyState>& states,
+	               DepthType depth = 0) const
+	{
+		states.resize(points.size());
+		forEachNode(points, depth, [this, &states](std::size_t i, LEAF_NODE const& node) {
+			states[i] = getState(node);
+		});
+	}
+
 	bool isOccupied(Code const& code) const
 	{
 		return OccupancyState::occupied == getState(code);
@@ -698,6 +1337,7 @@ class OccupancyMapBase : public Octree<DATA_TYPE, OccupancyMapInnerNode<DATA_TYP
 	bool containsUnknown(Code const& code) const
 	{
 		auto [node, depth] = Base::getNode(code);
+		checkPropagated(*node, depth);
 		return containsUnknown(*node, depth);
 	}
 
@@ -714,6 +1354,7 @@ class OccupancyMapBase : public Octree<DATA_TYPE, OccupancyMapInnerNode<DATA_TYP
 	bool containsFree(Code const& code) const
 	{
 		auto [node, depth] = Base::getNode(code);
+		checkPropagated(*node, depth);
 		return containsFree(*node, depth);
 	}
 
@@ -772,13 +1413,58 @@ class OccupancyMapBase : public Octree<DATA_TYPE, OccupancyMapInnerNode<DATA_TYP
 		clamping_thres_max_log_ = toLogit(probability);
 	}
 
+	//
+	// Memory
+	//
+
+	/**
+	 * @brief Memory of the tree, the integration scratch buffers, change detection, and
+	 * the pipeline. Should not be called while a cloud is being integrated. A shared
+	 * integration context is counted by each map using it.
+	 */
+	MemoryReport getMemoryReport() const override
+	{
+		MemoryReport report = Base::getMemoryReport();
+		report.integration_scratch = context_->memoryUsage();
+		report.change_detection = changes_.memoryUsage();
+		if (distance_field_) {
+			report.distance_field =
+			    distance_field_->memoryUsage() + distance_changes_.memoryUsage();
+		}
+		// A tree node has three pointers and a color besides the element
+		report.frontiers =
+		    frontiers_.size() * (sizeof(std::pair<CodeType, DepthType>) + 4 * sizeof(void*)) +
+		    frontier_changes_.memoryUsage() + frontier_value_changes_.memoryUsage();
+		if (pipeline_) {
+			report.pipeline = sizeof(Pipeline) + pipeline_->free_hits.memoryUsage();
+		}
+		return report;
+	}
+
+	//
+	// Clear
+	//
+
+	void clear() { clear(Base::getResolution(), Base::getTreeDepthLevels()); }
+
+	/**
+	 * @brief Remove all nodes. The root is unknown afterwards, same as for a new map.
+	 */
+	void clear(double new_resolution, DepthType new_depth_levels)
+	{
+		insertPointCloudWait();
+		Base::clear(new_resolution, new_depth_levels);
+		// The cleared root has no indicators set, so its children would be skipped
+		updateNode(Base::getRoot(), Base::getTreeDepthLevels());
+	}
+
 	//
 	// Change detection
 	//
 
-	CodeSet::const_iterator changesBegin() const noexcept { return changes_.begin(); }
+	ChangesIterator changesBegin() const noexcept { return changes_.begin(); }
 
-	CodeSet::const_iterator changesEnd() const noexcept { return changes_.end(); }
+	ChangesIterator changesEnd() const noexcept { return changes_.end(); }
 
 	void enableChangeDetection(bool enable) noexcept { change_detection_enabled_ = enable; }
 
@@ -822,126 +1508,728 @@ class OccupancyMapBase : public Octree<DATA_TYPE, OccupancyMapInnerNode<DATA_TYP
 	}
 
 	//
-	// Bounding box contain all known
+	// Distance field
 	//
 
-	ufo::geometry::AABB getKnownBBX() const
+	/**
+	 * @brief Keep a Euclidean distance field of the occupied space, up to max_distance
+	 * from it. The field is built from the current map and then follows the changes made
+	 * to it when updateDistanceField is called, independent of change detection.
+	 */
+	void enableDistanceField(double max_distance)
 	{
-		if (!containsFree(Base::getRootCode()) && !containsOccupied(Base::getRootCode())) {
-			// Only unknown
-			return ufo::geometry::AABB(Point3(0, 0, 0), 0);
+		auto lock = writeLock();
+		distance_field_ = std::make_unique<DistanceField>(Base::getResolution(), max_distance);
+		distance_changes_.clear();
+		setDistanceObstacles(Base::getRoot(), Code(0, Base::getTreeDepthLevels()), true);
+		distance_field_->update();
+	}
+
+	void disableDistanceField()
+	{
+		distance_field_.reset();
+		distance_changes_.clear();
+	}
+
+	bool isDistanceFieldEnabled() const noexcept { return bool(distance_field_); }
+
+	/**
+	 * @brief Move the distance field to the current map, only visiting what changed since
+	 * the last update.
+	 */
+	void updateDistanceField()
+	{
+		if (!distance_field_) {
+			return;
 		}
 
-		Point3 min(std::numeric_limits<double>::max(), std::numeric_limits<double>::max(),
-		           std::numeric_limits<double>::max());
-		Point3 max(std::numeric_limits<double>::lowest(),
-		           std::numeric_limits<double>::lowest(),
-		           std::numeric_limits<double>::lowest());
+		auto lock = writeLock();
+		if (Base::getResolution() != distance_field_->getResolution()) {
+			// The map was cleared with a new resolution
+			lock.unlock();
+			enableDistanceField(distance_field_->getMaxDistance());
+			return;
+		}
 
-		for (auto it = beginLeaves(true, true, false), it_end = endLeaves(); it != it_end;
-		     ++it) {
-			double hf = it.getHalfSize();
-			Point3 center = it.getCenter();
-			for (int i : {0, 1, 2}) {
-				min[i] = std::min(min[i], center[i] - hf);
-				max[i] = std::max(max[i], center[i] + hf);
+		for (Code const& code : distance_changes_) {
+			auto const [node, depth] = Base::getNode(code);
+			if (depth > code.getDepth()) {
+				// Inside a leaf, all voxels of code have its state
+				distance_field_->setObstacle(code, isOccupied(*node));
+			} else {
+				setDistanceObstacles(*node, code.toDepth(depth), false);
 			}
 		}
-
-		return ufo::geometry::AABB(min, max);
+		distance_changes_.clear();
+		distance_field_->update();
 	}
 
- protected:
-	//
-	// Constructor
-	//
-
-	OccupancyMapBase(double resolution, DepthType depth_levels = 16,
-	                 bool automatic_pruning = true, double occupied_thres = 0.5,
-	                 double free_thres = 0.5, double prob_hit = 0.7, double prob_miss = 0.4,
-	                 double clamping_thres_min = 0.1192, double clamping_thres_max = 0.971)
-	    : Base(resolution, depth_levels, automatic_pruning),
-	      occupied_thres_log_(toLogit(occupied_thres)),
-	      free_thres_log_(toLogit(free_thres)),
-	      prob_hit_log_(toLogit(prob_hit)),
-	      prob_miss_log_(toLogit(prob_miss)),
-	      clamping_thres_min_log_(toLogit(clamping_thres_min)),
-	      clamping_thres_max_log_(toLogit(clamping_thres_max))
+	/**
+	 * @brief Distance from coord to the closest occupied voxel, or the max distance of the
+	 * field if there is none that close. The field is as of the last updateDistanceField.
+	 */
+	double getDistance(Point3 const& coord) const
 	{
-		updateNode(Base::getRoot(), Base::getTreeDepthLevels());
+		return distanceField().getDistance(Base::toKey(coord));
+	}
 
-		// Reserve for better performance
-		indices_.max_load_factor(0.8);
-		indices_.reserve(100003);
+	double getDistance(double x, double y, double z) const
+	{
+		return getDistance(Point3(x, y, z));
 	}
 
-	OccupancyMapBase(std::string const& filename, bool automatic_pruning = true,
-	                 double occupied_thres = 0.5, double free_thres = 0.5,
-	                 double prob_hit = 0.7, double prob_miss = 0.4,
-	                 double clamping_thres_min = 0.1192, double clamping_thres_max = 0.971)
-	    : OccupancyMapBase(0.1, 16, automatic_pruning, occupied_thres, free_thres, prob_hit,
-	                       prob_miss, clamping_thres_min, clamping_thres_max)
+	/**
+	 * @brief Unit vector pointing away from the closest occupied voxel, zero if there is
+	 * none within the max distance or coord is occupied.
+	 */
+	Point3 getDistanceGradient(Point3 const& coord) const
 	{
-		Base::read(filename);
+		return distanceField().getGradient(Base::toKey(coord));
 	}
 
-	OccupancyMapBase(OccupancyMapBase const& other)
-	    : OccupancyMapBase(other.resolution_, other.depth_levels_,
-	                       other.automatic_pruning_enabled_, other.getOccupiedThres(),
-	                       other.getFreeThres(), other.getProbHit(), other.getProbMiss(),
-	                       other.getClampingThresMin(), other.getClampingThresMax())
+	Point3 getDistanceGradient(double x, double y, double z) const
 	{
-		std::stringstream s(std::ios_base::in | std::ios_base::out | std::ios_base::binary);
-		other.write(s);
-		Base::read(s);
+		return getDistanceGradient(Point3(x, y, z));
 	}
 
 	//
-	// Destructor
+	// Frontiers
 	//
 
-	virtual ~OccupancyMapBase() {}
+	/**
+	 * @brief The frontier nodes in a node at some depth, see getFrontierClusters.
+	 */
+	struct FrontierCluster {
+		Code code;
+		std::size_t num_frontiers = 0;
+		// Mean of the centers of the frontier nodes, weighted by their volume
+		Point3 centroid;
+	};
+
+	/**
+	 * @brief Keep track of the frontiers, the free leaf nodes with a face next to unknown
+	 * space. They are found in the current map and then follow the changes made to it when
+	 * updateFrontiers is called, independent of change detection.
+	 */
+	void enableFrontiers()
+	{
+		auto lock = writeLock();
+		checkPropagated(Base::getRoot(), Base::getTreeDepthLevels());
+		frontiers_enabled_ = true;
+		frontier_resolution_ = Base::getResolution();
+		frontiers_.clear();
+		frontier_changes_.clear();
+		frontier_value_changes_.clear();
+		addFrontiers(Base::getRoot(), Base::getRootCode());
+	}
 
-	//
-	// Probability <-> logit
-	//
+	void disableFrontiers()
+	{
+		frontiers_enabled_ = false;
+		frontiers_.clear();
+		frontier_changes_.clear();
+		frontier_value_changes_.clear();
+	}
 
-	static double toLogit(double prob) { return std::log(prob / (1.0 - prob)); }
+	bool isFrontiersEnabled() const noexcept { return frontiers_enabled_; }
 
-	static double toProb(LogitType logit) { return 1.0 / (1.0 + std::exp(-logit)); }
+	/**
+	 * @brief Move the frontiers to the current map. Only the changed nodes and their face
+	 * neighbors are checked, so the time is proportional to the changes since the last
+	 * update and not to the size of the map.
+	 */
+	void updateFrontiers()
+	{
+		if (!frontiers_enabled_) {
+			return;
+		}
 
-	//
-	// Get occupancy
-	//
+		auto lock = writeLock();
+		if (Base::getResolution() != frontier_resolution_) {
+			// The map was cleared with a new resolution
+			lock.unlock();
+			enableFrontiers();
+			return;
+		}
+		checkPropagated(Base::getRoot(), Base::getTreeDepthLevels());
+
+		// A change can only make the node itself and the nodes touching it (stop being)
+		// frontiers, those are in the node or in one of its face neighbors
+		KeyType const num_keys = KeyType(1) << Base::getTreeDepthLevels();
+		std::vector<Code> regions;
+		regions.reserve(7 * frontier_changes_.size() + frontier_value_changes_.size());
+		// The nodes that did not change state are only checked for being pruned or split
+		for (Code const& code : frontier_value_changes_) {
+			regions.push_back(code.toDepth(code.getDepth()));
+		}
+		frontier_value_changes_.clear();
+		for (Code code : frontier_changes_) {
+			code = code.toDepth(code.getDepth());
+			regions.push_back(code);
+			Key const key = code.toKey();
+			KeyType const step = KeyType(1) << code.getDepth();
+			for (std::size_t axis : {0, 1, 2}) {
+				if (step <= key[axis]) {
+					Key neighbor = key;
+					neighbor[axis] -= step;
+					regions.emplace_back(neighbor);
+				}
+				if (key[axis] + step < num_keys) {
+					Key neighbor = key;
+					neighbor[axis] += step;
+					regions.emplace_back(neighbor);
+				}
+			}
+		}
+		frontier_changes_.clear();
+		sortOutermost(regions);
+
+		// Check the whole leaf a region is in, and the whole frontier, since a frontier
+		// that has been split can have children outside of the regions
+		Accessor accessor(*this);
+		for (Code& region : regions) {
+			DepthType const depth = accessor.getNode(region).second;
+			if (depth != region.getDepth()) {
+				region = region.toDepth(depth);
+			}
+			region = containingFrontier(region);
+		}
+		sortOutermost(regions);
 
-	static double getOccupancy(LEAF_NODE const& node)
-	{
-		return toProb(node.value.occupancy);
+		for (Code const& region : regions) {
+			eraseFrontiers(region);
+			addFrontiers(*accessor.getNode(region).first, region, accessor);
+		}
 	}
 
-	//
-	// Checking state
-	//
+	std::size_t numFrontiers() const noexcept { return frontiers_.size(); }
 
-	bool isOccupied(LEAF_NODE const& node) const
+	/**
+	 * @brief The frontier nodes, in Morton order, as of the last updateFrontiers.
+	 */
+	std::vector<Code> getFrontiers() const
 	{
-		return occupied_thres_log_ < node.value.occupancy;
+		return getFrontiers([](Code const&) { return true; });
 	}
 
-	bool isUnknown(LEAF_NODE const& node) const
+	/**
+	 * @brief The frontier nodes that intersect bounding_volume, in Morton order, as of the
+	 * last updateFrontiers.
+	 */
+	std::vector<Code> getFrontiers(
+	    ufo::geometry::BoundingVolume const& bounding_volume) const
 	{
-		return free_thres_log_ <= node.value.occupancy &&
-		       occupied_thres_log_ >= node.value.occupancy;
+		return getFrontiers([this, &bounding_volume](Code const& code) {
+			return nodeIntersects(bounding_volume, code);
+		});
 	}
 
-	bool isFree(LEAF_NODE const& node) const
+	/**
+	 * @brief The frontier nodes grouped by the node at depth they are in, in Morton order.
+	 * A frontier node above depth is its own cluster.
+	 *
+	 * @details Neighboring frontiers share their coarse nodes, so the clusters are a cheap
+	 * set of exploration goals for planners that do not need every frontier voxel.
+	 */
+	std::vector<FrontierCluster> getFrontierClusters(DepthType depth) const
 	{
-		return free_thres_log_ > node.value.occupancy;
+		return getFrontierClusters(depth, [](Code const&) { return true; });
 	}
 
-	//
-	// Checking if contains
-	//
+	/**
+	 * @brief Same as getFrontierClusters, with only the frontier nodes that intersect
+	 * bounding_volume.
+	 */
+	std::vector<FrontierCluster> getFrontierClusters(
+	    ufo::geometry::BoundingVolume const& bounding_volume, DepthType depth) const
+	{
+		return getFrontierClusters(depth, [this, &bounding_volume](Code const& code) {
+			return nodeIntersects(bounding_volume, code);
+		});
+	}
+
+	//
+	// Delta
+	//
+
+	/**
+	 * @brief Write the nodes that changed since the change detection was last reset, so
+	 * that another map with the same resolution and depth levels can be brought up to date
+	 * with applyDelta.
+	 *
+	 * @details The changed codes are written in Morton order, each as the variable length
+	 * difference to the previous one, followed by the value of the node or, if the node has
+	 * children, its subtree.
+	 *
+	 * @return Whether the delta was written.
+	 */
+	bool writeDelta(std::ostream& s, bool compress = false,
+	                int compression_acceleration_level = 1, int compression_level = 0) const
+	{
+		auto const [codec, level] =
+		    Base::toCodec(compress, compression_acceleration_level, compression_level);
+		return writeDelta(s, codec, level);
+	}
+
+	bool writeDelta(std::ostream& s, Codec codec, int compression_level = 0) const
+	{
+		std::vector<Code> codes = getDeltaCodes();
+
+		std::string data;
+		writeVarint(data, codes.size());
+		CodeType prev_code = 0;
+		for (Code const& code : codes) {
+			writeVarint(data, code.getCode() - prev_code);
+			prev_code = code.getCode();
+
+			DepthType const depth = code.getDepth();
+			LEAF_NODE const* node = Base::getNode(code).first;
+			bool const children = Base::hasChildren(node, depth);
+			data.push_back(static_cast<char>(depth | (children ? DELTA_SUBTREE : 0U)));
+			if (children) {
+				if (!writeSubtreeNodes(data, ufo::geometry::BoundingVolume(),
+				                       static_cast<INNER_NODE const&>(*node), code, 0)) {
+					return false;
+				}
+			} else {
+				appendNodeData(data, *node);
+			}
+		}
+
+		typename Base::Chunk chunk;
+		if (!Base::packChunk(Base::getRootCode(), std::move(data), codec, compression_level,
+		                     chunk)) {
+			return false;
+		}
+
+		double const resolution = Base::getResolution();
+		std::uint8_t const depth_levels = Base::getTreeDepthLevels();
+		std::uint8_t const codec_value = static_cast<std::uint8_t>(codec);
+		s.write(reinterpret_cast<char const*>(&resolution), sizeof(resolution));
+		s.write(reinterpret_cast<char const*>(&depth_levels), sizeof(depth_levels));
+		s.write(reinterpret_cast<char const*>(&codec_value), sizeof(codec_value));
+		Base::writeChunk(s, chunk);
+		return s.good();
+	}
+
+	/**
+	 * @brief Apply a delta written by writeDelta. Only the nodes in the delta, and their
+	 * ancestors, are touched.
+	 *
+	 * @return Whether the delta was applied. False if it is malformed or from a map with a
+	 * different resolution or number of depth levels.
+	 */
+	bool applyDelta(std::istream& s)
+	{
+		double resolution;
+		std::uint8_t depth_levels;
+		std::uint8_t codec_value;
+		s.read(reinterpret_cast<char*>(&resolution), sizeof(resolution));
+		s.read(reinterpret_cast<char*>(&depth_levels), sizeof(depth_levels));
+		s.read(reinterpret_cast<char*>(&codec_value), sizeof(codec_value));
+		Codec const codec = static_cast<Codec>(codec_value);
+		if (!s.good() || Base::getResolution() != resolution ||
+		    Base::getTreeDepthLevels() != depth_levels || !isCodecAvailable(codec)) {
+			return false;
+		}
+
+		typename Base::Chunk chunk;
+		std::string data_string;
+		if (!Base::readChunk(s, chunk) || !Base::unpackChunk(chunk, codec, data_string)) {
+			return false;
+		}
+		std::string_view data(data_string);
+
+		auto lock = writeLock();
+
+		std::uint64_t num_codes;
+		if (!readVarint(data, num_codes)) {
+			return false;
+		}
+		CodeType code_value = 0;
+		for (; 0 != num_codes; --num_codes) {
+			std::uint64_t code_diff;
+			if (!readVarint(data, code_diff) || data.empty()) {
+				return false;
+			}
+			std::uint8_t const depth_and_children = data.front();
+			data.remove_prefix(1);
+			code_value += code_diff;
+			DepthType const depth = depth_and_children & ~DELTA_SUBTREE;
+			if (Base::getTreeDepthLevels() < depth) {
+				return false;
+			}
+			Code const code(code_value, depth);
+
+			auto path = Base::createNode(code);
+			if (depth_and_children & DELTA_SUBTREE) {
+				if (!readSubtreeNodes(data, ufo::geometry::BoundingVolume(), true,
+				                      static_cast<INNER_NODE&>(*path[depth]), code)) {
+					return false;
+				}
+				if (Base::getTreeDepthLevels() != depth) {
+					updateAllParents(path, depth + 1);
+				}
+			} else {
+				if (Base::hasChildren(path[depth], depth)) {
+					Base::deleteChildren(static_cast<INNER_NODE&>(*path[depth]), depth);
+				}
+				if (!readNodeData(data, *path[depth])) {
+					return false;
+				}
+				if (0 != depth) {
+					// Only updates the flags, the value was read
+					updateNode(static_cast<INNER_NODE&>(*path[depth]), depth);
+				}
+				if (Base::getTreeDepthLevels() != depth) {
+					updateAllParents(path, depth + 1);
+				}
+			}
+
+			markChanged(code);
+		}
+
+		return true;
+	}
+
+	//
+	// Lazy propagation
+	//
+
+	/**
+	 * @brief Enable/disable lazy propagation.
+	 *
+	 * @details With lazy propagation, writes only mark the inner nodes above them as
+	 * modified instead of updating them directly. The inner nodes are updated by
+	 * propagate(), which is also called at the end of each insertPointCloud*. Querying
+	 * a modified inner node throws std::logic_error. Disabling lazy propagation
+	 * propagates.
+	 */
+	void enableLazyPropagation(bool enable)
+	{
+		if (lazy_propagation_enabled_ && !enable) {
+			propagate();
+		}
+		lazy_propagation_enabled_ = enable;
+	}
+
+	bool isLazyPropagationEnabled() const noexcept { return lazy_propagation_enabled_; }
+
+	/**
+	 * @brief Whether all inner nodes are up to date.
+	 */
+	bool isPropagated() const noexcept { return !Base::getRoot().modified; }
+
+	/**
+	 * @brief Update all modified inner nodes, bottom up.
+	 */
+	void propagate()
+	{
+		insertPointCloudWait();
+		auto lock = writeLock();
+		propagate(Base::getRoot(), Base::getTreeDepthLevels());
+	}
+
+	//
+	// Concurrent queries
+	//
+
+	/**
+	 * @brief Allow other threads to query the map while point clouds are integrated.
+	 * Readers hold readLock() for as long as they use anything from the map, including
+	 * iterators and node references. The integration holds writeLock() only while it
+	 * applies the updates to the tree, ray casting runs in parallel with the readers.
+	 * Readers share the lock, so they do not wait for each other.
+	 *
+	 * Queries never lock by themselves, also not the batch and parallel ones
+	 * (parallelForEachLeaf(), anyOccupied(), castRays(), getStates(), getFrontiers(),
+	 * writeDelta() and so on), so they can be called while holding readLock(). Taking
+	 * the shared lock twice on one thread deadlocks once a writer waits for it.
+	 *
+	 * The integration, updateOccupancy() with a batch of updates, setValueVolume(),
+	 * propagate() and the copy constructors lock by themselves, so they must not be
+	 * called while holding either lock. Other modifications have to be made while
+	 * holding writeLock().
+	 */
+	void enableConcurrentQueries(bool enable)
+	{
+		insertPointCloudWait();
+		concurrent_queries_enabled_ = enable;
+	}
+
+	bool isConcurrentQueriesEnabled() const noexcept { return concurrent_queries_enabled_; }
+
+	/**
+	 * @return A lock that keeps the map from being modified, does not lock if concurrent
+	 * queries are disabled.
+	 */
+	std::shared_lock<std::shared_mutex> readLock() const
+	{
+		return concurrent_queries_enabled_ ? std::shared_lock(query_mutex_)
+		                                   : std::shared_lock<std::shared_mutex>();
+	}
+
+	/**
+	 * @return A lock that keeps readers out while the map is modified, does not lock if
+	 * concurrent queries are disabled.
+	 */
+	std::unique_lock<std::shared_mutex> writeLock() const
+	{
+		return concurrent_queries_enabled_ ? std::unique_lock(query_mutex_)
+		                                   : std::unique_lock<std::shared_mutex>();
+	}
+
+	//
+	// Sliding window
+	//
+
+	using Base::updateWindow;
+
+	/**
+	 * @brief Evict the tiles outside window, see Octree::enableSlidingWindow(). Waits for
+	 * the point clouds being integrated and propagates first, so the evicted tiles leave
+	 * an up to date summary.
+	 */
+	void updateWindow(ufo::geometry::BoundingVar const& window) override
+	{
+		propagate();
+		auto lock = writeLock();
+		Base::updateWindow(window);
+	}
+
+	void restoreAllTiles() override
+	{
+		insertPointCloudWait();
+		auto lock = writeLock();
+		Base::restoreAllTiles();
+	}
+
+	//
+	// Bounding box contain all known
+	//
+
+	ufo::geometry::AABB getKnownBBX() const
+	{
+		if (!containsFree(Base::getRootCode()) && !containsOccupied(Base::getRootCode())) {
+			// Only unknown
+			return ufo::geometry::AABB(Point3(0, 0, 0), 0);
+		}
+
+		Point3 min(std::numeric_limits<double>::max(), std::numeric_limits<double>::max(),
+		           std::numeric_limits<double>::max());
+		Point3 max(std::numeric_limits<double>::lowest(),
+		           std::numeric_limits<double>::lowest(),
+		           std::numeric_limits<double>::lowest());
+
+		for (auto it = beginLeaves(true, true, false), it_end = endLeaves(); it != it_end;
+		     ++it) {
+			double hf = it.getHalfSize();
+			Point3 center = it.getCenter();
+			for (int i : {0, 1, 2}) {
+				min[i] = std::min(min[i], center[i] - hf);
+				max[i] = std::max(max[i], center[i] + hf);
+			}
+		}
+
+		return ufo::geometry::AABB(min, max);
+	}
+
+ protected:
+	//
+	// Constructor
+	//
+
+	OccupancyMapBase(double resolution, DepthType depth_levels = 16,
+	                 bool automatic_pruning = true, double occupied_thres = 0.5,
+	                 double free_thres = 0.5, double prob_hit = 0.7, double prob_miss = 0.4,
+	                 double clamping_thres_min = 0.1192, double clamping_thres_max = 0.971)
+	    : Base(resolution, depth_levels, automatic_pruning),
+	      occupied_thres_log_(toLogit(occupied_thres)),
+	      free_thres_log_(toLogit(free_thres)),
+	      prob_hit_log_(toLogit(prob_hit)),
+	      prob_miss_log_(toLogit(prob_miss)),
+	      clamping_thres_min_log_(toLogit(clamping_thres_min)),
+	      clamping_thres_max_log_(toLogit(clamping_thres_max))
+	{
+		updateNode(Base::getRoot(), Base::getTreeDepthLevels());
+
+		// Reserve for better performance
+	}
+
+	OccupancyMapBase(std::string const& filename, bool automatic_pruning = true,
+	                 double occupied_thres = 0.5, double free_thres = 0.5,
+	                 double prob_hit = 0.7, double prob_miss = 0.4,
+	                 double clamping_thres_min = 0.1192, double clamping_thres_max = 0.971)
+	    : OccupancyMapBase(0.1, Base::isFixedDepth() ? FIXED_DEPTH_LEVELS : 16,
+	                       automatic_pruning, occupied_thres, free_thres, prob_hit,
+	                       prob_miss, clamping_thres_min, clamping_thres_max)
+	{
+		Base::read(filename);
+	}
+
+	OccupancyMapBase(OccupancyMapBase const& other)
+	    : OccupancyMapBase(other, ufo::geometry::BoundingVolume())
+	{
+	}
+
+	/**
+	 * @brief Copy the nodes of other that intersect bounding_volume, the nodes outside
+	 * are copied without their children.
+	 */
+	OccupancyMapBase(OccupancyMapBase const& other,
+	                 ufo::geometry::BoundingVolume const& bounding_volume)
+	    : Base(other.resolution_, other.getTreeDepthLevels(),
+	           other.automatic_pruning_enabled_),
+	      occupied_thres_log_(other.occupied_thres_log_),
+	      free_thres_log_(other.free_thres_log_),
+	      prob_hit_log_(other.prob_hit_log_),
+	      prob_miss_log_(other.prob_miss_log_),
+	      clamping_thres_min_log_(other.clamping_thres_min_log_),
+	      clamping_thres_max_log_(other.clamping_thres_max_log_),
+	      lazy_propagation_enabled_(other.lazy_propagation_enabled_)
+	{
+		other.insertPointCloudWait();
+		// The pipeline can apply a cloud to other while it is copied
+		auto lock = other.readLock();
+		Base::copyNodes(other, bounding_volume);
+	}
+
+	/**
+	 * @brief Copy for readers on other threads, see OccupancyMap::readOnlyCopy().
+	 * Integration is finished and the inner nodes propagated before copying, so the
+	 * copy can be queried while this map is updated.
+	 *
+	 * @note This is a deep copy of the nodes in bounding_volume, it takes time and memory
+	 * linear in their number and holds the read lock meanwhile. Keep it off paths that
+	 * have to be fast, or limit it to a small bounding volume.
+	 */
+	template <typename Map>
+	std::shared_ptr<Map const> makeReadOnlyCopy(
+	    ufo::geometry::BoundingVolume const& bounding_volume)
+	{
+		propagate();
+		return std::make_shared<Map const>(static_cast<Map const&>(*this), bounding_volume);
+	}
+
+	//
+	// Destructor
+	//
+
+	virtual ~OccupancyMapBase() { stopPipeline(); }
+
+	//
+	// Probability <-> logit
+	//
+
+	static LogitValue toLogit(double prob)
+	{
+		return quantizeLogit(std::log(prob / (1.0 - prob)));
+	}
+
+	static double toProb(LogitType logit)
+	{
+		if constexpr (std::is_floating_point_v<LogitType>) {
+			return 1.0 / (1.0 + std::exp(-logit));
+		} else {
+			return 1.0 / (1.0 + std::exp(-dequantizeLogit(logit)));
+		}
+	}
+
+	//
+	// Fixed point logits
+	//
+
+	/**
+	 * @brief Convert a logit to the stored representation. Identity for floating point
+	 * occupancy, rounded and saturated fixed point for integer occupancy.
+	 */
+	static LogitValue quantizeLogit(double logit)
+	{
+		if constexpr (std::is_floating_point_v<LogitType>) {
+			return logit;
+		} else {
+			constexpr double min = std::numeric_limits<LogitType>::min();
+			constexpr double max = std::numeric_limits<LogitType>::max();
+			return static_cast<LogitType>(
+			    std::lround(std::clamp(logit * logit_scale_v<LogitType>, min, max)));
+		}
+	}
+
+	static double dequantizeLogit(LogitValue logit)
+	{
+		if constexpr (std::is_floating_point_v<LogitType>) {
+			return logit;
+		} else {
+			return logit / logit_scale_v<LogitType>;
+		}
+	}
+
+	/**
+	 * @brief The miss update for a ray cast at depth. For integer occupancy a non-zero
+	 * miss is never rounded to zero, so coarse free space integration still has an
+	 * effect.
+	 */
+	LogitType getProbMissLog(DepthType depth) const
+	{
+		LogitType prob_miss_log =
+		    quantizeLogit(dequantizeLogit(prob_miss_log_) / double((2.0 * depth) + 1));
+		if constexpr (!std::is_floating_point_v<LogitType>) {
+			if (0 == prob_miss_log && 0 != prob_miss_log_) {
+				prob_miss_log = 0 > prob_miss_log_ ? -1 : 1;
+			}
+		}
+		return prob_miss_log;
+	}
+
+	//
+	// Get occupancy
+	//
+
+	static double getOccupancy(LEAF_NODE const& node)
+	{
+		return toProb(node.value.occupancy);
+	}
+
+	//
+	// Checking state
+	//
+
+	bool isOccupied(LEAF_NODE const& node) const
+	{
+		return occupied_thres_log_ < node.value.occupancy;
+	}
+
+	bool isUnknown(LEAF_NODE const& node) const
+	{
+		return free_thres_log_ <= node.value.occupancy &&
+		       occupied_thres_log_ >= node.value.occupancy;
+	}
+
+	bool isFree(LEAF_NODE const& node) const
+	{
+		return free_thres_log_ > node.value.occupancy;
+	}
+
+	bool sameState(LogitType a, LogitType b) const
+	{
+		return (occupied_thres_log_ < a) == (occupied_thres_log_ < b) &&
+		       (free_thres_log_ > a) == (free_thres_log_ > b);
+	}
+
+	OccupancyState getState(LEAF_NODE const& node) const
+	{
+		if (isOccupied(node)) {
+			return OccupancyState::occupied;
+		} else if (isFree(node)) {
+			return OccupancyState::free;
+		} else {
+			return OccupancyState::unknown;
+		}
+	}
+
+	//
+	// Checking if contains
+	//
 
 	// TODO: Should this exist?
 	bool containsOccupied(LEAF_NODE const& node, DepthType depth) const
@@ -996,12 +2284,17 @@ class OccupancyMapBase : public Octree<DATA_TYPE, OccupancyMapInnerNode<DATA_TYP
 		ufo::geometry::AABB aabb;
 		aabb.half_size =
 		    ufo::geometry::Point(child_half_size, child_half_size, child_half_size);
+		std::uint8_t const intersects =
+		    std::visit(
+		        [&center, child_half_size](auto&& arg) {
+			        return geometry::childMask(arg, center, child_half_size);
+		        },
+		        bounding_volume)
+		        .intersects;
 		bool changed = false;
 		for (size_t i = 0; i < 8; ++i) {
 			aabb.center = Base::getChildCenter(center, child_half_size, i);
-			if (std::visit(
-			        [&aabb](auto&& arg) -> bool { return geometry::intersects(arg, aabb); },
-			        bounding_volume)) {
+			if ((intersects >> i) & 1U) {
 				if (0 == child_depth) {
 					if (setOccupancy(Base::getLeafChild(node, i).value.occupancy,
 					                 occupancy_value)) {
@@ -1044,7 +2337,7 @@ class OccupancyMapBase : public Octree<DATA_TYPE, OccupancyMapInnerNode<DATA_TYP
 		}
 
 		if (code.getDepth() != depth) {
-			createNode(path, code, depth);
+			Base::createNode(code, path, depth);
 			depth = code.getDepth();
 		}
 
@@ -1052,6 +2345,7 @@ class OccupancyMapBase : public Octree<DATA_TYPE, OccupancyMapInnerNode<DATA_TYP
 		if (Base::hasChildren(path[depth], depth)) {
 			Base::deleteChildren(static_cast<INNER_NODE&>(*path[depth]), depth);
 		}
+		markChanged(code);
 
 		updateParents(path, depth);
 	}
@@ -1066,10 +2360,9 @@ class OccupancyMapBase : public Octree<DATA_TYPE, OccupancyMapInnerNode<DATA_TYP
 		DepthType depth = code.getDepth();
 
 		if (Base::isLeaf(path[depth], depth)) {
+			LogitType const old_occupancy = path[depth]->value.occupancy;
 			if (updateOccupancy(path[depth]->value.occupancy, update)) {
-				if (change_detection_enabled_) {
-					changes_.insert(code);
-				}
+				markChanged(code, !sameState(old_occupancy, path[depth]->value.occupancy));
 			}
 		} else {
 			if (!updateAllChildren(code, static_cast<INNER_NODE&>(*path[depth]), depth,
@@ -1082,30 +2375,185 @@ class OccupancyMapBase : public Octree<DATA_TYPE, OccupancyMapInnerNode<DATA_TYP
 		updateParents(path, depth);
 	}
 
-	bool updateAllChildren(Code const& code, INNER_NODE& node, DepthType depth,
-	                       LogitType const& update)
+	/**
+	 * @brief Apply many updates at once.
+	 *
+	 * @details The updates are sorted in Morton order (in place), so consecutive updates
+	 * share the path from the root down to their common ancestor. An inner node is
+	 * recomputed once, after all updates in its subtree have been applied, instead of once
+	 * per update.
+	 *
+	 * @param updates The codes and the logit updates. Updates to the same code are applied
+	 * in the order they are given.
+	 */
+	void updateValueBatch(std::vector<std::pair<Code, LogitType>>& updates)
 	{
-		bool changed = false;
-		if (1 == depth) {
-			for (int i = 0; i < 8; ++i) {
-				LEAF_NODE& child = Base::getLeafChild(node, i);
-				if (updateOccupancy(child.value.occupancy, update)) {
-					changed = true;
-					if (change_detection_enabled_) {
-						changes_.insert(code);
+		if (updates.empty()) {
+			return;
+		}
+
+		{
+			StageTimer timer(Base::metrics_, IntegrationStage::sort);
+			sortByCode(updates, context_->sort_buffer);
+		}
+
+		updateValueBatchSorted(updates, [](LEAF_NODE&, auto const&) {});
+	}
+
+	/**
+	 * @brief Same as updateValueBatch(updates) for updates that are already in Morton
+	 * order.
+	 *
+	 * @details Lets maps with more data per node fuse their updates into the same pass.
+	 * The first two elements of an update are the code and the logit update, and
+	 * update_leaf(leaf, update) is called before the occupancy of a leaf is updated.
+	 * Inner nodes are recomputed with updateNode, same as for the occupancy.
+	 */
+	template <typename Update, typename UpdateLeaf>
+	void updateValueBatchSorted(std::vector<Update> const& updates, UpdateLeaf update_leaf)
+	{
+		if (updates.empty()) {
+			return;
+		}
+
+		StageTimer timer(Base::metrics_, IntegrationStage::update);
+		std::uint64_t num_node_updates = 0;
+
+		DepthType const root_depth = Base::getTreeDepthLevels();
+
+		Path path;
+		path[root_depth] = static_cast<LEAF_NODE*>(&Base::getRoot());
+		// Lowest depth where the path is still valid
+		DepthType valid_depth = root_depth;
+		// Nodes on the path that have to be recomputed
+		std::array<bool, Base::MAX_DEPTH_LEVELS> dirty{};
+
+		// Recompute the dirty nodes below depth, bottom up
+		auto flush = [&](DepthType depth) {
+			for (DepthType d = 1; d < depth; ++d) {
+				if (dirty[d]) {
+					dirty[d] = false;
+					++num_node_updates;
+					if (updateNode(static_cast<INNER_NODE&>(*path[d]), d) && d < root_depth) {
+						dirty[d + 1] = true;
 					}
 				}
 			}
-		} else {
-			for (int i = 0; i < 8; ++i) {
+		};
+
+		CodeType prev_code = std::get<0>(updates.front()).getCode();
+		for (Update const& u : updates) {
+			Code const& code = std::get<0>(u);
+			LogitType const update = std::get<1>(u);
+
+			// Lowest depth where this and the previous code share node
+			CodeType diff = prev_code ^ code.getCode();
+			DepthType common_depth = 0;
+			while (0 != (diff >> (3 * common_depth))) {
+				++common_depth;
+			}
+			prev_code = code.getCode();
+
+			DepthType depth = code.getDepth();
+			DepthType keep_depth = std::max(common_depth, depth);
+
+			// Nothing more will be updated in the subtrees below keep depth
+			flush(keep_depth);
+
+			Base::createNode(code, path, std::max(keep_depth, valid_depth));
+			valid_depth = depth;
+
+			if (Base::isLeaf(path[depth], depth)) {
+				update_leaf(*path[depth], u);
+				LogitType const old_occupancy = path[depth]->value.occupancy;
+				if (updateOccupancy(path[depth]->value.occupancy, update)) {
+					markChanged(code, !sameState(old_occupancy, path[depth]->value.occupancy));
+				}
+				dirty[std::max(1u, depth)] = true;
+			} else if (updateAllChildren(code, static_cast<INNER_NODE&>(*path[depth]), depth,
+			                             update) &&
+			           depth < root_depth) {
+				dirty[depth + 1] = true;
+			}
+		}
+
+		flush(root_depth + 1);
+		Base::metrics_.add(IntegrationCounter::node_updates, num_node_updates);
+	}
+
+	// Stable sort of the updates by code, the first element of an update, buffer is used
+	// as scratch space
+	template <typename Update>
+	static void sortByCode(std::vector<Update>& updates, std::vector<Update>& buffer)
+	{
+		if (64 > updates.size()) {
+			// Insertion sort
+			for (auto it = std::next(updates.begin()); updates.end() != it; ++it) {
+				auto value = *it;
+				auto hole = it;
+				for (; updates.begin() != hole &&
+				       std::get<0>(*std::prev(hole)).getCode() > std::get<0>(value).getCode();
+				     --hole) {
+					*hole = *std::prev(hole);
+				}
+				*hole = value;
+			}
+			return;
+		}
+
+		// LSD radix sort, digits where all codes are the same are skipped
+		static constexpr unsigned int DIGIT_BITS = 11;
+		static constexpr CodeType DIGIT_MASK = (CodeType(1) << DIGIT_BITS) - 1;
+
+		buffer.resize(updates.size());
+		std::array<std::size_t, DIGIT_MASK + 1> count;
+		for (unsigned int shift = 0; 8 * sizeof(CodeType) > shift; shift += DIGIT_BITS) {
+			count.fill(0);
+			for (auto const& update : updates) {
+				++count[(std::get<0>(update).getCode() >> shift) & DIGIT_MASK];
+			}
+
+			if (updates.size() ==
+			    count[(std::get<0>(updates.front()).getCode() >> shift) & DIGIT_MASK]) {
+				continue;
+			}
+
+			std::size_t sum = 0;
+			for (std::size_t& c : count) {
+				std::size_t temp = c;
+				c = sum;
+				sum += temp;
+			}
+
+			for (auto const& update : updates) {
+				buffer[count[(std::get<0>(update).getCode() >> shift) & DIGIT_MASK]++] = update;
+			}
+			updates.swap(buffer);
+		}
+	}
+
+	bool updateAllChildren(Code const& code, INNER_NODE& node, DepthType depth,
+	                       LogitType const& update)
+	{
+		bool changed = false;
+		if (1 == depth) {
+			for (int i = 0; i < 8; ++i) {
+				LEAF_NODE& child = Base::getLeafChild(node, i);
+				LogitType const old_occupancy = child.value.occupancy;
+				if (updateOccupancy(child.value.occupancy, update)) {
+					changed = true;
+					markChanged(code, !sameState(old_occupancy, child.value.occupancy));
+				}
+			}
+		} else {
+			for (int i = 0; i < 8; ++i) {
 				INNER_NODE& child = Base::getInnerChild(node, i);
 				if (Base::isLeaf(child)) {
+					LogitType const old_occupancy = child.value.occupancy;
 					if (updateOccupancy(child.value.occupancy, update)) {
 						changed = true;
 						updateNode(child, depth - 1);
-						if (change_detection_enabled_) {
-							changes_.insert(code);
-						}
+						markChanged(code, !sameState(old_occupancy, child.value.occupancy));
 					}
 				} else {
 					// TODO: Careful here
@@ -1125,259 +2573,1739 @@ class OccupancyMapBase : public Octree<DATA_TYPE, OccupancyMapInnerNode<DATA_TYP
 
 	void updateParents(Path const& path, DepthType depth)
 	{
+		if (lazy_propagation_enabled_) {
+			// If a node is modified then so are all of its ancestors
+			for (DepthType d = std::max(1u, depth); d <= Base::getTreeDepthLevels(); ++d) {
+				INNER_NODE& node = static_cast<INNER_NODE&>(*path[d]);
+				if (node.modified) {
+					return;
+				}
+				node.modified = true;
+			}
+			return;
+		}
+
 		for (unsigned int d = std::max(1u, depth); d <= Base::getTreeDepthLevels(); ++d) {
+			Base::metrics_.add(IntegrationCounter::node_updates);
 			if (!updateNode(static_cast<INNER_NODE&>(*path[d]), d)) {
 				return;
 			}
 		}
 	}
 
+	// Same as updateParents, but does not stop at the first node that did not change.
+	// Used when the node at depth - 1 was replaced, since updateNode of a node without
+	// children only reports changes to its flags.
+	void updateAllParents(Path const& path, DepthType depth)
+	{
+		if (lazy_propagation_enabled_) {
+			updateParents(path, depth);
+			return;
+		}
+
+		for (DepthType d = std::max(1u, depth); d <= Base::getTreeDepthLevels(); ++d) {
+			Base::metrics_.add(IntegrationCounter::node_updates);
+			updateNode(static_cast<INNER_NODE&>(*path[d]), d);
+		}
+	}
+
 	//
-	// Update occupancy
+	// Propagate
 	//
 
-	bool updateOccupancy(LogitType& current, LogitType const& update)
+	void propagate(INNER_NODE& node, DepthType depth)
 	{
-		LogitType old_occupancy = current;
-		current = std::clamp<LogitType>(current + update, clamping_thres_min_log_,
-		                                clamping_thres_max_log_);
-		return old_occupancy != current;
+		if (!node.modified) {
+			return;
+		}
+		node.modified = false;
+
+		if (1 < depth && Base::hasChildren(node)) {
+			for (INNER_NODE& child : Base::getInnerChildren(node)) {
+				propagate(child, depth - 1);
+			}
+		}
+
+		updateNode(node, depth);
 	}
 
 	//
-	// Set occupancy
+	// Parallel iteration
 	//
 
-	bool setOccupancy(LogitType& current_value, LogitType const& new_value)
+	// At least num subtrees, unless there are fewer nodes above min_depth, that together
+	// cover the part of the tree in bounding_volume. In Morton order.
+	std::vector<std::pair<LEAF_NODE const*, Code>> splitTree(
+	    ufo::geometry::BoundingVolume const& bounding_volume, DepthType min_depth,
+	    std::size_t num) const
 	{
-		LogitType old_occupancy = current_value;
-		current_value = std::clamp<LogitType>(new_value, clamping_thres_min_log_,
-		                                      clamping_thres_max_log_);
-		return old_occupancy != current_value;
+		std::vector<std::pair<LEAF_NODE const*, Code>> subtrees{
+		    std::make_pair(&Base::getRoot(), Base::getRootCode())};
+		std::vector<std::pair<LEAF_NODE const*, Code>> split;
+		for (bool more = true; more && num > subtrees.size();) {
+			more = false;
+			split.clear();
+			for (auto const& [node, code] : subtrees) {
+				DepthType const depth = code.getDepth();
+				if (searchStops(*node, depth, min_depth)) {
+					split.emplace_back(node, code);
+					continue;
+				}
+				more = true;
+				INNER_NODE const& inner = static_cast<INNER_NODE const&>(*node);
+				DepthType const child_depth = depth - 1;
+				std::uint8_t const intersects =
+				    bounding_volume.empty()
+				        ? 0xFF
+				        : bounding_volume
+				              .childMask(Base::toCoord(code), Base::getNodeHalfSize(child_depth))
+				              .intersects;
+				for (unsigned int i = 0; 8 > i; ++i) {
+					if ((intersects >> i) & 1U) {
+						split.emplace_back(&Base::getChild(inner, child_depth, i), code.getChild(i));
+					}
+				}
+			}
+			subtrees.swap(split);
+		}
+		return subtrees;
 	}
 
 	//
-	// Will value change
+	// Nearest neighbor search
 	//
 
-	virtual bool willValueChange(LogitType current, LogitType update) const
+	// Squared distance from point to the node with center and half_size
+	static double squaredDistance(Point3 const& point, Point3 const& center,
+	                              double half_size)
 	{
-		return (0 > update && clamping_thres_min_log_ < current) ||
-		       (0 < update && clamping_thres_max_log_ > current);
+		double squared_distance = 0;
+		for (int i = 0; 3 > i; ++i) {
+			double const d = std::max(0.0, std::abs(point[i] - center[i]) - half_size);
+			squared_distance += d * d;
+		}
+		return squared_distance;
 	}
 
-	virtual LogitType clampOccupancy(LogitType occupancy) const
+	// Whether the search stops at node instead of going to its children
+	bool searchStops(LEAF_NODE const& node, DepthType depth, DepthType min_depth) const
 	{
-		return std::clamp<LogitType>(occupancy, clamping_thres_min_log_,
-		                             clamping_thres_max_log_);
+		return min_depth >= depth ||
+		       !Base::hasChildren(static_cast<INNER_NODE const&>(node));
+	}
+
+	bool searchReturns(LEAF_NODE const& node, bool occupied_space, bool free_space,
+	                   bool unknown_space) const
+	{
+		return (occupied_space && isOccupied(node)) || (free_space && isFree(node)) ||
+		       (unknown_space && isUnknown(node));
+	}
+
+	bool searchVisits(LEAF_NODE const& node, DepthType depth, bool occupied_space,
+	                  bool free_space, bool unknown_space) const
+	{
+		return (occupied_space && containsOccupied(node, depth)) ||
+		       (free_space && containsFree(node, depth)) ||
+		       (unknown_space && containsUnknown(node, depth));
+	}
+
+	void knnSearchRecurs(LEAF_NODE const& node, Code const& code, Point3 const& center,
+	                     Point3 const& point, std::size_t k,
+	                     std::vector<std::pair<double, Code>>& best, bool occupied_space,
+	                     bool free_space, bool unknown_space, DepthType min_depth) const
+	{
+		auto const compare = [](auto const& a, auto const& b) { return a.first < b.first; };
+
+		DepthType const depth = code.getDepth();
+		if (searchStops(node, depth, min_depth)) {
+			if (!searchReturns(node, occupied_space, free_space, unknown_space)) {
+				return;
+			}
+			double const squared_distance =
+			    squaredDistance(point, center, Base::getNodeHalfSize(depth));
+			if (k > best.size()) {
+				best.emplace_back(squared_distance, code);
+				std::push_heap(best.begin(), best.end(), compare);
+			} else if (best.front().first > squared_distance) {
+				std::pop_heap(best.begin(), best.end(), compare);
+				best.back() = std::make_pair(squared_distance, code);
+				std::push_heap(best.begin(), best.end(), compare);
+			}
+			return;
+		}
+
+		INNER_NODE const& inner = static_cast<INNER_NODE const&>(node);
+		DepthType const child_depth = depth - 1;
+		double const child_half_size = Base::getNodeHalfSize(child_depth);
+
+		// Visit the closest children first, so the bound tightens quickly
+		std::array<std::pair<double, unsigned int>, 8> order;
+		std::array<Point3, 8> centers;
+		std::size_t num = 0;
+		for (unsigned int i = 0; 8 > i; ++i) {
+			LEAF_NODE const& child = Base::getChild(inner, child_depth, i);
+			if (!searchVisits(child, child_depth, occupied_space, free_space, unknown_space)) {
+				continue;
+			}
+			centers[i] = Base::getChildCenter(center, child_half_size, i);
+			double const squared_distance = squaredDistance(point, centers[i], child_half_size);
+			if (k > best.size() || best.front().first > squared_distance) {
+				order[num++] = std::make_pair(squared_distance, i);
+			}
+		}
+		// At most eight children, an insertion sort bounded by num
+		for (std::size_t j = 1; num > j; ++j) {
+			auto const item = order[j];
+			std::size_t k = j;
+			for (; 0 < k && item < order[k - 1]; --k) {
+				order[k] = order[k - 1];
+			}
+			order[k] = item;
+		}
+
+		for (std::size_t j = 0; num != j; ++j) {
+			auto const [squared_distance, i] = order[j];
+			if (k == best.size() && best.front().first <= squared_distance) {
+				// The rest are further away
+				break;
+			}
+			knnSearchRecurs(Base::getChild(inner, child_depth, i), code.getChild(i), centers[i],
+			                point, k, best, occupied_space, free_space, unknown_space,
+			                min_depth);
+		}
+	}
+
+	void radiusSearchRecurs(LEAF_NODE const& node, Code const& code, Point3 const& center,
+	                        Point3 const& point, double squared_radius,
+	                        std::vector<Code>& codes, std::vector<double>* squared_distances,
+	                        bool occupied_space, bool free_space, bool unknown_space,
+	                        DepthType min_depth) const
+	{
+		DepthType const depth = code.getDepth();
+		double const squared_distance =
+		    squaredDistance(point, center, Base::getNodeHalfSize(depth));
+		if (squared_radius < squared_distance ||
+		    !searchVisits(node, depth, occupied_space, free_space, unknown_space)) {
+			return;
+		}
+
+		if (searchStops(node, depth, min_depth)) {
+			if (searchReturns(node, occupied_space, free_space, unknown_space)) {
+				codes.push_back(code);
+				if (squared_distances) {
+					squared_distances->push_back(squared_distance);
+				}
+			}
+			return;
+		}
+
+		INNER_NODE const& inner = static_cast<INNER_NODE const&>(node);
+		DepthType const child_depth = depth - 1;
+		double const child_half_size = Base::getNodeHalfSize(child_depth);
+		for (unsigned int i = 0; 8 > i; ++i) {
+			radiusSearchRecurs(Base::getChild(inner, child_depth, i), code.getChild(i),
+			                   Base::getChildCenter(center, child_half_size, i), point,
+			                   squared_radius, codes, squared_distances, occupied_space,
+			                   free_space, unknown_space, min_depth);
+		}
 	}
 
 	//
-	// Update node
+	// Collision checking
 	//
 
-	virtual bool updateNode(INNER_NODE& node, DepthType depth)
+	// Bit i of active is set if volumes[i] intersects the parent of node and has not hit
+	// anything yet
+	void anyOccupiedRecurs(LEAF_NODE const& node, Point3 const& center, DepthType depth,
+	                       ufo::geometry::BoundingVar const* volumes, std::uint64_t active,
+	                       std::uint64_t& hits, bool unknown_as_occupied,
+	                       DepthType min_depth) const
 	{
-		if (Base::isLeaf(node)) {
-			bool new_contains_free = isFree(node);
-			bool new_contains_unknown = isUnknown(node);
-			bool updated = (node.contains_free != new_contains_free) ||
-			               (node.contains_unknown != new_contains_unknown);
-			node.contains_free = new_contains_free;
-			node.contains_unknown = new_contains_unknown;
-			return updated;
+		bool const occupied = containsOccupied(node, depth);
+		bool const unknown = unknown_as_occupied && containsUnknown(node, depth);
+		if (!occupied && !unknown) {
+			return;
 		}
 
-		LogitType new_occupancy_value = std::numeric_limits<LogitType>::lowest();
-		bool new_contains_free = false;
-		bool new_contains_unknown = false;
+		ufo::geometry::AABB const aabb(center, Base::getNodeHalfSize(depth));
+		for (std::uint64_t remaining = active; 0 != remaining; remaining &= remaining - 1) {
+			int const i = __builtin_ctzll(remaining);
+			if (!std::visit(
+			        [&aabb](auto&& arg) -> bool { return geometry::intersects(arg, aabb); },
+			        volumes[i])) {
+				active &= ~(std::uint64_t(1) << i);
+			}
+		}
+		if (0 == active) {
+			return;
+		}
 
-		if (1 == depth) {
-			for (int i = 0; i < 8; ++i) {
-				LEAF_NODE const& child = Base::getLeafChild(node, i);
-				new_occupancy_value = std::max(new_occupancy_value, child.value.occupancy);
-				new_contains_free = new_contains_free || isFree(child);
-				new_contains_unknown = new_contains_unknown || isUnknown(child);
+		if (searchStops(node, depth, min_depth)) {
+			if (isOccupied(node) || (unknown_as_occupied && isUnknown(node))) {
+				hits |= active;
 			}
-		} else {
-			for (int i = 0; i < 8; ++i) {
-				INNER_NODE const& child = Base::getInnerChild(node, i);
-				new_occupancy_value = std::max(new_occupancy_value, child.value.occupancy);
-				new_contains_free = new_contains_free || containsFree(child);
-				new_contains_unknown = new_contains_unknown || containsUnknown(child);
+			return;
+		}
+
+		INNER_NODE const& inner = static_cast<INNER_NODE const&>(node);
+		DepthType const child_depth = depth - 1;
+		double const child_half_size = Base::getNodeHalfSize(child_depth);
+		for (unsigned int i = 0; 8 > i && 0 != (active & ~hits); ++i) {
+			anyOccupiedRecurs(Base::getChild(inner, child_depth, i),
+			                  Base::getChildCenter(center, child_half_size, i), child_depth,
+			                  volumes, active & ~hits, hits, unknown_as_occupied, min_depth);
+		}
+	}
+
+	//
+	// Batch queries
+	//
+
+	// Calls f(i, node) with the node containing points[i] at depth or the leaf above it
+	template <typename F>
+	void forEachNode(std::vector<Point3> const& points, DepthType depth, F f) const
+	{
+		// Throw here instead of in a worker thread
+		checkPropagated(Base::getRoot(), Base::getTreeDepthLevels());
+
+		std::vector<std::pair<CodeType, std::size_t>> order(points.size());
+		for (std::size_t i = 0; points.size() != i; ++i) {
+			order[i] = std::make_pair(Base::toCode(points[i], depth).getCode(), i);
+		}
+
+		// Only the bits from depth to the root differ
+		sortByCode(order, 3 * depth, 3 * Base::getTreeDepthLevels());
+
+		static constexpr std::size_t CHUNK_SIZE = 4096;
+
+		std::vector<std::size_t> chunks((order.size() + CHUNK_SIZE - 1) / CHUNK_SIZE);
+		std::iota(chunks.begin(), chunks.end(), 0);
+		std::for_each(std::execution::par, chunks.begin(), chunks.end(),
+		              [&](std::size_t chunk) {
+			              std::size_t const first = chunk * CHUNK_SIZE;
+			              std::size_t const last = std::min(order.size(), first + CHUNK_SIZE);
+			              forEachNode(order.begin() + first, order.begin() + last, depth, f);
+		              });
+	}
+
+	// Stable radix sort on bits [first_bit, last_bit) of the codes
+	static void sortByCode(std::vector<std::pair<CodeType, std::size_t>>& order,
+	                       unsigned first_bit, unsigned last_bit)
+	{
+		std::vector<std::pair<CodeType, std::size_t>> buffer(order.size());
+		for (unsigned shift = first_bit; shift < last_bit; shift += 8) {
+			std::array<std::size_t, 257> offset{};
+			for (auto const& e : order) {
+				++offset[((e.first >> shift) & 0xFF) + 1];
+			}
+			std::partial_sum(offset.begin(), offset.end(), offset.begin());
+			for (auto const& e : order) {
+				buffer[offset[(e.first >> shift) & 0xFF]++] = e;
+			}
+			order.swap(buffer);
+		}
+	}
+
+	template <typename InputIt, typename F>
+	void forEachNode(InputIt first, InputIt last, DepthType depth, F f) const
+	{
+		std::array<LEAF_NODE const*, Base::MAX_DEPTH_LEVELS + 1> path;
+		DepthType const root_depth = Base::getTreeDepthLevels();
+		path[root_depth] = &Base::getRoot();
+		// Depth of the node the previous point was in
+		DepthType node_depth = root_depth;
+		CodeType previous = 0;
+		for (; first != last; ++first) {
+			auto const [code, index] = *first;
+			if (CodeType const diff = code ^ previous; 0 != diff) {
+				// The paths split below the node whose child index holds the highest
+				// differing bit, the nodes above it are shared
+				DepthType const split = (63 - __builtin_clzll(diff)) / 3 + 1;
+				node_depth = std::max(node_depth, std::min(split, root_depth));
+			}
+			previous = code;
+
+			Code const c(code, depth);
+			for (; depth < node_depth; --node_depth) {
+				INNER_NODE const& inner = static_cast<INNER_NODE const&>(*path[node_depth]);
+				if (!Base::hasChildren(inner)) {
+					break;
+				}
+				path[node_depth - 1] =
+				    &Base::getChild(inner, node_depth - 1, c.getChildIdx(node_depth - 1));
+			}
+			f(index, *path[node_depth]);
+		}
+	}
+
+	//
+	// Cast ray
+	//
+
+	// The last node a ray looked up and its state, steps inside it skip the lookup and
+	// the other steps start from its path
+	struct RayCache {
+		explicit RayCache(OccupancyMapBase const& map) : accessor(map) {}
+
+		Accessor accessor;
+		Code code;
+		OccupancyState state;
+		bool valid = false;
+	};
+
+	OccupancyState getState(Code const& code, RayCache& cache) const
+	{
+		if (cache.valid && code.toDepth(cache.code.getDepth()) == cache.code) {
+			return cache.state;
+		}
+
+		auto [node, depth] = cache.accessor.getNode(code);
+		checkPropagated(*node, depth);
+		cache.code = code.toDepth(depth);
+		cache.state = getState(*node);
+		cache.valid = true;
+		return cache.state;
+	}
+
+	RayHit castRay(Point3 origin, Point3 direction, bool ignore_unknown, double max_range,
+	               DepthType depth, RayCache& cache) const
+	{
+		if (0 > max_range) {
+			max_range = Base::getMin().distance(Base::getMax());
+		}
+
+		direction.normalize();
+		Point3 end = origin + (direction * max_range);
+		Point3 const ray_origin = origin;
+
+		RayHit hit;
+		if (!Base::moveLineInside(origin, end)) {
+			// Line fully outside of octree bounds
+			return hit;
+		}
+		double const offset = ray_origin.distance(origin);
+		max_range -= offset;
+
+		Key current;
+		Key ending;
+		std::array<int, 3> step;
+		Point3 t_delta;
+		Point3 t_max;
+		Base::computeRayInit(origin, end, direction, current, ending, step, t_delta, t_max,
+		                     depth);
+
+		double distance = 0;
+		while (true) {
+			hit.code = Base::toCode(current);
+			hit.state = getState(hit.code, cache);
+			if (OccupancyState::occupied == hit.state ||
+			    (!ignore_unknown && OccupancyState::unknown == hit.state)) {
+				break;
+			}
+			if (current == ending || t_max.min() > max_range) {
+				hit.state = OccupancyState::free;
+				break;
+			}
+			distance = t_max.min();
+			Base::computeRayTakeStep(current, step, t_delta, t_max);
+		}
+
+		hit.distance = offset + distance;
+		return hit;
+	}
+
+	// Same result as castRay, up to rounding of the distance, but every step goes to the
+	// next node along the ray that is as large as possible, descending only into nodes
+	// that may stop the ray
+	RayHit castRayHierarchical(Point3 origin, Point3 direction, bool ignore_unknown,
+	                           double max_range, DepthType depth) const
+	{
+		if (0 > max_range) {
+			max_range = Base::getMin().distance(Base::getMax());
+		}
+
+		direction.normalize();
+		Point3 end = origin + (direction * max_range);
+		Point3 const ray_origin = origin;
+
+		RayHit hit;
+		if (!Base::moveLineInside(origin, end)) {
+			// Line fully outside of octree bounds
+			return hit;
+		}
+		double const offset = ray_origin.distance(origin);
+		double const length = origin.distance(end);
+		KeyType const key_end = KeyType(1) << Base::getTreeDepthLevels();
+
+		// Depth 0 key of the point where the ray entered the current node
+		Key current = Base::toKey(origin);
+		double distance = 0;
+		while (true) {
+			Code const code = Base::toCode(current);
+			hit.code = code.toDepth(depth);
+
+			LEAF_NODE const* node = &Base::getRoot();
+			DepthType node_depth = Base::getTreeDepthLevels();
+			for (; depth < node_depth; --node_depth) {
+				INNER_NODE const& inner = static_cast<INNER_NODE const&>(*node);
+				checkPropagated(inner, node_depth);
+				if (!Base::hasChildren(inner) ||
+				    !(isOccupied(inner) || (!ignore_unknown && containsUnknown(inner)))) {
+					break;
+				}
+				node = &Base::getChild(inner, node_depth - 1, code.getChildIdx(node_depth - 1));
+			}
+
+			if (isOccupied(*node)) {
+				hit.state = OccupancyState::occupied;
+				break;
+			}
+			if (!ignore_unknown && isUnknown(*node)) {
+				hit.state = OccupancyState::unknown;
+				break;
+			}
+
+			// Find the face of the node the ray leaves through
+			Point3 const center = Base::toCoord(code.toDepth(node_depth));
+			double const half_size = Base::getNodeHalfSize(node_depth);
+			std::size_t axis = 0;
+			double exit = std::numeric_limits<double>::max();
+			for (std::size_t i = 0; 3 != i; ++i) {
+				double t;
+				if (0 < direction[i]) {
+					t = (center[i] + half_size - origin[i]) / direction[i];
+				} else if (0 > direction[i]) {
+					t = (center[i] - half_size - origin[i]) / direction[i];
+				} else {
+					continue;
+				}
+				if (t < exit) {
+					exit = t;
+					axis = i;
+				}
+			}
+
+			hit.state = OccupancyState::free;
+			if (exit > length) {
+				break;
+			}
+
+			// The key past that face, snapped into the node on the other axes so rounding
+			// cannot skip a node
+			KeyType const size = KeyType(1) << node_depth;
+			Key next(0, 0, 0, 0);
+			bool inside = true;
+			for (std::size_t i = 0; 3 != i; ++i) {
+				KeyType const base = (current[i] >> node_depth) << node_depth;
+				if (axis != i) {
+					next[i] = std::clamp(Base::toKey(origin[i] + (direction[i] * exit)), base,
+					                     base + size - 1);
+				} else if (0 < direction[i]) {
+					inside = key_end - size > base;
+					next[i] = base + size;
+				} else {
+					inside = 0 != base;
+					next[i] = base - 1;
+				}
+			}
+			if (!inside) {
+				break;
+			}
+
+			current = next;
+			distance = exit;
+		}
+
+		if (OccupancyState::free == hit.state) {
+			// The ray left a large node through the end of the ray or the map edge, so the
+			// result is the node at depth that contains the end, as for castRay, entered
+			// where the ray crosses its last face
+			hit.code = Base::toCode(end).toDepth(depth);
+			Point3 const center = Base::toCoord(hit.code);
+			double const half_size = Base::getNodeHalfSize(depth);
+			distance = 0;
+			for (std::size_t i = 0; 3 != i; ++i) {
+				if (0 < direction[i]) {
+					distance =
+					    std::max(distance, (center[i] - half_size - origin[i]) / direction[i]);
+				} else if (0 > direction[i]) {
+					distance =
+					    std::max(distance, (center[i] + half_size - origin[i]) / direction[i]);
+				}
+			}
+		}
+
+		hit.distance = offset + distance;
+		return hit;
+	}
+
+	//
+	// Distance field
+	//
+
+	DistanceField const& distanceField() const
+	{
+		if (!distance_field_) {
+			throw std::logic_error("Distance field queried before it was enabled");
+		}
+		return *distance_field_;
+	}
+
+	// state_changed is false if the node changed occupancy but not state
+	void markChanged(Code const& code, bool state_changed = true)
+	{
+		if (change_detection_enabled_) {
+			changes_.insert(code);
+		}
+		if (distance_field_) {
+			distance_changes_.insert(code);
+		}
+		if (frontiers_enabled_) {
+			(state_changed ? frontier_changes_ : frontier_value_changes_).insert(code);
+		}
+	}
+
+	// Give the voxels of the subtree at node the occupancy of its leaves, if only_occupied
+	// the free and unknown leaves are not visited
+	void setDistanceObstacles(LEAF_NODE const& node, Code const& code, bool only_occupied)
+	{
+		DepthType const depth = code.getDepth();
+		if (0 < depth && Base::hasChildren(static_cast<INNER_NODE const&>(node))) {
+			INNER_NODE const& inner = static_cast<INNER_NODE const&>(node);
+			for (std::size_t i = 0; 8 != i; ++i) {
+				setDistanceObstacles(Base::getChild(inner, depth - 1, i), code.getChild(i),
+				                     only_occupied);
+			}
+		} else if (isOccupied(node)) {
+			distance_field_->setObstacle(code, true);
+		} else if (!only_occupied) {
+			distance_field_->setObstacle(code, false);
+		}
+	}
+
+	//
+	// Frontiers
+	//
+
+	bool nodeIntersects(ufo::geometry::BoundingVolume const& bounding_volume,
+	                    Code const& code) const
+	{
+		return bounding_volume.intersects(ufo::geometry::AABB(
+		    Base::toCoord(code), Base::getNodeHalfSize(code.getDepth())));
+	}
+
+	// Add the frontiers in the subtree at node, skipping the subtrees without free space
+	void addFrontiers(LEAF_NODE const& node, Code const& code)
+	{
+		Accessor accessor(*this);
+		addFrontiers(node, code, accessor);
+	}
+
+	void addFrontiers(LEAF_NODE const& node, Code const& code, Accessor& accessor)
+	{
+		DepthType const depth = code.getDepth();
+		if (0 < depth && Base::hasChildren(static_cast<INNER_NODE const&>(node))) {
+			INNER_NODE const& inner = static_cast<INNER_NODE const&>(node);
+			if (containsFree(inner)) {
+				for (std::size_t i = 0; 8 != i; ++i) {
+					addFrontiers(Base::getChild(inner, depth - 1, i), code.getChild(i), accessor);
+				}
+			}
+		} else if (isFree(node) && nextToUnknown(code, accessor)) {
+			frontiers_.emplace(code.getCode(), depth);
+		}
+	}
+
+	// Remove the frontiers in code
+	void eraseFrontiers(Code const& code)
+	{
+		CodeType const first = code.getCode();
+		CodeType const last = first + (CodeType(1) << (3 * code.getDepth()));
+		frontiers_.erase(frontiers_.lower_bound(first), frontiers_.lower_bound(last));
+	}
+
+	// The frontier containing code, or code if there is none
+	Code containingFrontier(Code const& code) const
+	{
+		// Frontiers do not overlap, so one containing code is the last one not after it
+		auto it = frontiers_.upper_bound(code.getCode());
+		if (frontiers_.begin() != it) {
+			--it;
+			if (it->second > code.getDepth() &&
+			    Code(it->first, it->second) == code.toDepth(it->second)) {
+				return Code(it->first, it->second);
+			}
+		}
+		return code;
+	}
+
+	// Whether a face of the node at code touches unknown space
+	bool nextToUnknown(Code const& code, Accessor& accessor) const
+	{
+		KeyType const num_keys = KeyType(1) << Base::getTreeDepthLevels();
+		Key const key = code.toKey();
+		KeyType const step = KeyType(1) << code.getDepth();
+		for (std::size_t axis : {0, 1, 2}) {
+			for (bool upper : {false, true}) {
+				if (upper ? num_keys - step <= key[axis] : step > key[axis]) {
+					// At the edge of the map
+					continue;
+				}
+				Key neighbor = key;
+				neighbor[axis] = upper ? key[axis] + step : key[axis] - step;
+				auto const [node, depth] = accessor.getNode(Code(neighbor));
+				// It is the face on the other side of the neighbor that touches code
+				if (faceUnknown(*node, depth, axis, !upper)) {
+					return true;
+				}
+			}
+		}
+		return false;
+	}
+
+	// Whether any part of the lower or upper face along axis of node is unknown
+	bool faceUnknown(LEAF_NODE const& node, DepthType depth, std::size_t axis,
+	                 bool upper) const
+	{
+		if (0 == depth || !Base::hasChildren(static_cast<INNER_NODE const&>(node))) {
+			return isUnknown(node);
+		}
+		INNER_NODE const& inner = static_cast<INNER_NODE const&>(node);
+		if (!containsUnknown(inner)) {
+			return false;
+		}
+		for (std::size_t i = 0; 8 != i; ++i) {
+			if (upper == bool((i >> axis) & 1U) &&
+			    faceUnknown(Base::getChild(inner, depth - 1, i), depth - 1, axis, upper)) {
+				return true;
+			}
+		}
+		return false;
+	}
+
+	template <typename Predicate>
+	std::vector<Code> getFrontiers(Predicate pred) const
+	{
+		std::vector<Code> frontiers;
+		for (auto const& [code, depth] : frontiers_) {
+			Code const frontier(code, depth);
+			if (pred(frontier)) {
+				frontiers.push_back(frontier);
+			}
+		}
+		return frontiers;
+	}
+
+	template <typename Predicate>
+	std::vector<FrontierCluster> getFrontierClusters(DepthType depth, Predicate pred) const
+	{
+		std::vector<FrontierCluster> clusters;
+		// Total volume of the frontiers in the last cluster
+		double volume = 0.0;
+		for (auto const& [code, frontier_depth] : frontiers_) {
+			Code const frontier(code, frontier_depth);
+			if (!pred(frontier)) {
+				continue;
+			}
+
+			// In Morton order, so the frontiers in a cluster are consecutive
+			Code const cluster = frontier.toDepth(std::max(depth, frontier_depth));
+			if (clusters.empty() || clusters.back().code != cluster) {
+				if (!clusters.empty()) {
+					clusters.back().centroid /= volume;
+				}
+				clusters.push_back(FrontierCluster{cluster, 0, Point3(0, 0, 0)});
+				volume = 0.0;
+			}
+			double const frontier_volume = std::pow(8.0, frontier_depth);
+			clusters.back().num_frontiers += 1;
+			clusters.back().centroid += Base::toCoord(frontier) * frontier_volume;
+			volume += frontier_volume;
+		}
+		if (!clusters.empty()) {
+			clusters.back().centroid /= volume;
+		}
+		return clusters;
+	}
+
+	void checkPropagated(LEAF_NODE const& node, DepthType depth) const
+	{
+		if (0 < depth && static_cast<INNER_NODE const&>(node).modified) {
+			throw std::logic_error("Inner node queried before propagate() was called");
+		}
+	}
+
+	//
+	// Update occupancy
+	//
+
+	bool updateOccupancy(LogitType& current, LogitType const& update)
+	{
+		// Integer types are promoted to int, so the sum cannot overflow before clamping
+		using SumType = decltype(current + update);
+		LogitType old_occupancy = current;
+		current = static_cast<LogitType>(std::clamp<SumType>(
+		    current + update, clamping_thres_min_log_, clamping_thres_max_log_));
+		return old_occupancy != current;
+	}
+
+	//
+	// Set occupancy
+	//
+
+	bool setOccupancy(LogitType& current_value, LogitType const& new_value)
+	{
+		LogitType old_occupancy = current_value;
+		current_value = std::clamp<LogitType>(new_value, clamping_thres_min_log_,
+		                                      clamping_thres_max_log_);
+		return old_occupancy != current_value;
+	}
+
+	//
+	// Will value change
+	//
+
+	virtual bool willValueChange(LogitType current, LogitType update) const
+	{
+		return (0 > update && clamping_thres_min_log_ < current) ||
+		       (0 < update && clamping_thres_max_log_ > current);
+	}
+
+	virtual LogitType clampOccupancy(LogitType occupancy) const
+	{
+		return std::clamp<LogitType>(occupancy, clamping_thres_min_log_,
+		                             clamping_thres_max_log_);
+	}
+
+	//
+	// Update node
+	//
+
+	virtual bool updateNode(INNER_NODE& node, DepthType depth) override
+	{
+		if (Base::isLeaf(node)) {
+			bool new_contains_free = isFree(node);
+			bool new_contains_unknown = isUnknown(node);
+			bool updated = (node.contains_free != new_contains_free) ||
+			               (node.contains_unknown != new_contains_unknown);
+			node.contains_free = new_contains_free;
+			node.contains_unknown = new_contains_unknown;
+			return updated;
+		}
+
+		LogitType new_occupancy_value = std::numeric_limits<LogitType>::lowest();
+		bool new_contains_free = false;
+		bool new_contains_unknown = false;
+
+		if (1 == depth) {
+			for (int i = 0; i < 8; ++i) {
+				LEAF_NODE const& child = Base::getLeafChild(node, i);
+				new_occupancy_value = std::max(new_occupancy_value, child.value.occupancy);
+				new_contains_free = new_contains_free || isFree(child);
+				new_contains_unknown = new_contains_unknown || isUnknown(child);
+			}
+		} else {
+			for (int i = 0; i < 8; ++i) {
+				INNER_NODE const& child = Base::getInnerChild(node, i);
+				new_occupancy_value = std::max(new_occupancy_value, child.value.occupancy);
+				new_contains_free = new_contains_free || containsFree(child);
+				new_contains_unknown = new_contains_unknown || containsUnknown(child);
+			}
+		}
+
+		if (Base::isNodeCollapsible(node, depth)) {
+			Base::deleteChildren(node, depth);
+		}
+
+		if (node.value.occupancy != new_occupancy_value ||
+		    node.contains_free != new_contains_free ||
+		    node.contains_unknown != new_contains_unknown) {
+			node.value.occupancy = new_occupancy_value;
+			node.contains_free = new_contains_free;
+			node.contains_unknown = new_contains_unknown;
+			return true;
+		}
+		return false;
+	}
+
+	//
+	// Discretize
+	//
+
+	// Whether cloud is the output of the prefilter stage
+	template <typename T>
+	bool isFilteredCloud(T const& cloud) const noexcept
+	{
+		if constexpr (std::is_same_v<T, PointCloud>) {
+			return &context_->filtered == &cloud;
+		} else {
+			return false;
+		}
+	}
+
+	template <typename T>
+	void discretizePointCloud(Point3 const& sensor_origin, T const& cloud, double max_range,
+	                          PointCloud& discretized,
+	                          std::vector<std::pair<Code, LogitType>>& occupied_hits,
+	                          Point3& min_change, Point3& max_change)
+	{
+		if (prefilter_enabled_ && !isFilteredCloud(cloud)) {
+			prefilter_stats_ =
+			    prefilter(sensor_origin, cloud, context_->filtered, prefilter_options_);
+			discretizePointCloud(sensor_origin, context_->filtered, max_range, discretized,
+			                     occupied_hits, min_change, max_change);
+			return;
+		}
+
+		StageTimer timer(Base::metrics_, IntegrationStage::discretize);
+		Base::metrics_.add(IntegrationCounter::clouds);
+		Base::metrics_.add(IntegrationCounter::points, cloud.size());
+
+		occupied_hits.reserve(cloud.size());
+		discretized.reserve(cloud.size());
+		min_change = Base::getMax();
+		max_change = Base::getMin();
+		for (auto const& point : cloud) {
+			Point3 end(point);
+			if (!end.isFinite()) {
+				continue;
+			}
+			Point3 origin = sensor_origin;
+			Point3 direction = (end - origin);
+			double distance = direction.norm();
+
+			// Move origin and end inside BBX
+			if (!Base::moveLineInside(origin, end)) {
+				// Line outside of BBX
+				continue;
+			}
+
+			if (0 > max_range || distance <= max_range) {
+				// Occupied space
+				Code end_code = Base::toCode(end);
+				if (context_->indices.insert(end_code).second) {
+					occupied_hits.push_back(std::make_pair(end_code, prob_hit_log_));
+				}
+			} else {
+				direction /= distance;
+				end = origin + (direction * max_range);
+			}
+
+			discretized.push_back(end);
+
+			for (int i : {0, 1, 2}) {
+				min_change[i] = std::min(min_change[i], std::min(end[i], origin[i]));
+				max_change[i] = std::max(max_change[i], std::max(end[i], origin[i]));
+			}
+		}
+
+		context_->indices.clear();
+	}
+
+	template <typename T>
+	void discretizePointCloudDiscrete(Point3 const& sensor_origin, T const& cloud,
+	                                  double max_range, DepthType depth,
+	                                  PointCloud& discretized,
+	                                  std::vector<std::pair<Code, LogitType>>& occupied_hits,
+	                                  Point3& min_change, Point3& max_change)
+	{
+		if (prefilter_enabled_ && !isFilteredCloud(cloud)) {
+			prefilter_stats_ =
+			    prefilter(sensor_origin, cloud, context_->filtered, prefilter_options_);
+			discretizePointCloudDiscrete(sensor_origin, context_->filtered, max_range, depth,
+			                             discretized, occupied_hits, min_change, max_change);
+			return;
+		}
+
+		double squared_max_range = max_range * max_range;
+
+		StageTimer timer(Base::metrics_, IntegrationStage::discretize);
+		Base::metrics_.add(IntegrationCounter::clouds);
+		Base::metrics_.add(IntegrationCounter::points, cloud.size());
+
+		occupied_hits.reserve(cloud.size());
+		discretized.reserve(cloud.size());
+		min_change = Base::getMax();
+		max_change = Base::getMin();
+		for (auto const& point : cloud) {
+			Point3 end(point);
+			if (!end.isFinite()) {
+				continue;
+			}
+			if (0 > max_range || (end - sensor_origin).squaredNorm() < squared_max_range) {
+				if (Base::isInside(end)) {
+					Code end_code = Base::toCode(end);
+					if (!context_->indices.insert(end_code).second) {
+						continue;
+					}
+					occupied_hits.push_back(std::make_pair(end_code, prob_hit_log_));
+				}
+			} else {
+				Point3 direction = Base::toCoord(Base::toKey(end, depth)) - sensor_origin;
+				double distance = direction.norm();
+				direction /= distance;
+				if (0 <= max_range && distance > max_range) {
+					end = sensor_origin + (direction * max_range);
+				}
+			}
+			Point3 current = sensor_origin;
+			// Move origin and end inside map
+			if (!Base::moveLineInside(current, end)) {
+				// Line outside of map
+				continue;
+			}
+
+			Key end_key = Base::toKey(end, depth);
+
+			if (0 < depth && !context_->indices.insert(Base::toCode(end_key)).second) {
+				continue;
+			}
+
+			Point3 end_coord = Base::toCoord(end_key);
+
+			discretized.push_back(end_coord);
+
+			// Min/max change detection
+			Point3 current_center = Base::toCoord(Base::toKey(current, depth));
+			Point3 end_center = end_coord;
+
+			double temp = Base::getNodeHalfSize(depth);
+			for (int i : {0, 1, 2}) {
+				min_change[i] = std::min(
+				    min_change[i], std::min(end_center[i] - temp, current_center[i] - temp));
+				max_change[i] = std::max(
+				    max_change[i], std::max(end_center[i] + temp, current_center[i] + temp));
+			}
+		}
+
+		context_->indices.clear();
+	}
+
+	//
+	// Calculate free space
+	//
+	template <typename T, typename C, typename Map>
+	void freeSpace(Point3 const& sensor_origin, C const& cloud, Map& indices,
+	               T const& value, DepthType depth = 0, bool simple_ray_casting = false,
+	               unsigned int early_stopping = 0) const
+	{
+		freeSpace(sensor_origin, cloud.begin(), cloud.end(), indices, value, depth,
+		          simple_ray_casting, early_stopping);
+	}
+
+	template <typename T, typename InputIt, typename Map>
+	void freeSpace(Point3 const& sensor_origin, InputIt first, InputIt last, Map& indices,
+	               T const& value, DepthType depth = 0,
+	               bool simple_ray_casting = false, unsigned int early_stopping = 0) const
+	{
+		if (!simple_ray_casting && 0 == early_stopping) {
+			// Early stopping depends on the order the rays are traversed in, so packets are
+			// only used without it
+			freeSpacePacket(sensor_origin, first, last, indices, value, depth);
+			return;
+		}
+
+		for (; first != last; ++first) {
+			auto const& point = *first;
+			Point3 current = sensor_origin;
+			Point3 end;
+
+			using point_type = std::decay_t<decltype(point)>;
+			if constexpr (std::is_same_v<point_type, Code>) {
+				end = Base::toCoord(point);
+			} else if constexpr (std::is_base_of_v<point_type, Point3>) {
+				end = point;
+			} else {
+				// TODO: Error
+			}
+
+			// Move origin and end inside map
+			if (!Base::moveLineInside(current, end)) {
+				// Line outside of map
+				continue;
+			}
+
+			if (simple_ray_casting) {
+				freeSpaceSimple(current, end, indices, value, depth, early_stopping);
+			} else {
+				freeSpaceNormal(current, end, indices, value, depth, early_stopping);
+			}
+		}
+	}
+
+	template <typename T, typename Map>
+	void freeSpaceNormal(Point3 const& from, Point3 const& to, Map& indices,
+	                     T const& value, DepthType depth = 0,
+	                     unsigned int early_stopping = 0) const
+	{
+		// Do it backwards
+		Point3 current = to;
+		Point3 end = from;
+
+		Point3 direction = end - current;
+		double distance = direction.norm();
+		direction /= distance;
+		Key current_key;
+		Key end_key;
+		std::array<int, 3> step;
+		Point3 t_delta;
+		Point3 t_max;
+		Base::computeRayInit(current, end, direction, current_key, end_key, step, t_delta,
+		                     t_max, depth);
+
+		if (current_key == end_key) {
+			bool inserted = indices.try_emplace(Base::toCode(current_key), value).second;
+			Base::metrics_.addRay(1, inserted, false);
+			return;
+		}
+
+		// if (0 == depth) {
+		// 	Base::computeRayTakeStep(current_key, step, t_delta, t_max);
+		// }
+		unsigned int already_update_in_row = 0;
+		std::uint64_t num_steps = 0;
+		std::uint64_t num_inserts = 0;
+		bool stopped = false;
+		do {
+			++num_steps;
+			if (indices.try_emplace(Base::toCode(current_key), value).second) {
+				++num_inserts;
+				already_update_in_row = 0;
+			} else {
+				++already_update_in_row;
+				if (0 < early_stopping && already_update_in_row >= early_stopping) {
+					stopped = true;
+					break;
+				}
+			}
+			Base::computeRayTakeStep(current_key, step, t_delta, t_max);
+		} while (current_key != end_key && t_max.min() <= distance);
+		Base::metrics_.addRay(num_steps, num_inserts, stopped);
+	}
+
+	template <typename T, typename InputIt, typename Map>
+	void freeSpacePacket(Point3 const& sensor_origin, InputIt first, InputIt last,
+	                     Map& indices, T const& value, DepthType depth = 0) const
+	{
+		RayPacket<> packet;
+		std::uint64_t num_steps = 0;
+		std::uint64_t num_inserts = 0;
+		auto const visit = [this, &indices, &value, &num_steps,
+		                    &num_inserts](Key const& key) {
+			++num_steps;
+			if (indices.try_emplace(Base::toCode(key), value).second) {
+				++num_inserts;
+			}
+		};
+
+		for (; first != last; ++first) {
+			auto const& point = *first;
+			Point3 current = sensor_origin;
+			Point3 end;
+
+			using point_type = std::decay_t<decltype(point)>;
+			if constexpr (std::is_same_v<point_type, Code>) {
+				end = Base::toCoord(point);
+			} else {
+				end = point;
+			}
+
+			// Move origin and end inside map
+			if (!Base::moveLineInside(current, end)) {
+				// Line outside of map
+				continue;
+			}
+
+			// Do it backwards, same as freeSpaceNormal
+			Point3 direction = current - end;
+			double distance = direction.norm();
+			direction /= distance;
+			Key current_key;
+			Key end_key;
+			std::array<int, 3> step;
+			Point3 t_delta;
+			Point3 t_max;
+			Base::computeRayInit(end, current, direction, current_key, end_key, step, t_delta,
+			                     t_max, depth);
+
+			Base::metrics_.add(IntegrationCounter::rays);
+
+			if (current_key == end_key) {
+				visit(current_key);
+				continue;
+			}
+
+			packet.add(current_key, end_key, step, t_delta, t_max, distance);
+
+			while (packet.full()) {
+				packet.visit(visit);
+				packet.step();
+			}
+		}
+
+		while (!packet.empty()) {
+			packet.visit(visit);
+			packet.step();
+		}
+
+		Base::metrics_.add(IntegrationCounter::dda_steps, num_steps);
+		Base::metrics_.add(IntegrationCounter::hash_inserts, num_inserts);
+		Base::metrics_.add(IntegrationCounter::hash_collisions, num_steps - num_inserts);
+	}
+
+	template <typename T, typename Map>
+	void freeSpaceSimple(Point3 const& from, Point3 const& to, Map& indices,
+	                     T const& value, DepthType depth = 0,
+	                     unsigned int early_stopping = 0) const
+	{
+		// Do it backwards
+		Point3 current = to;
+		Point3 end = from;
+
+		Point3 direction = end - current;
+		double distance = direction.norm();
+		direction /= distance;
+		int num_steps = distance / Base::getNodeSize(depth);
+		Point3 step = direction * Base::getNodeSize(depth);
+		int current_step = 0;
+		double current_distance = distance;
+		double dist_per_step = distance / num_steps;
+		// if (0 == depth) {
+		// 	current += step;
+		// 	current_step = 1;
+		// }
+		unsigned int already_update_in_row = 0;
+		std::uint64_t num_inserts = 0;
+		bool stopped = false;
+		for (; current_step <= num_steps; ++current_step) {
+			// if (indices.try_emplace(Base::toCode(current, depth), value / (current_distance *
+			// current_distance)).second) {
+			if (indices.try_emplace(Base::toCode(current, depth), value).second) {
+				++num_inserts;
+				already_update_in_row = 0;
+			} else {
+				++already_update_in_row;
+				if (0 < early_stopping && already_update_in_row >= early_stopping) {
+					stopped = true;
+					break;
+				}
+			}
+			current += step;
+			current_distance -= dist_per_step;
+		}
+		Base::metrics_.addRay(current_step + stopped, num_inserts, stopped);
+	}
+
+	/**
+	 * @brief Calculate free space by splitting the cloud over multiple threads.
+	 *
+	 * @details All threads insert into the same concurrent map. Early stopping depends
+	 * on the order the rays are cast in, therefore it is not supported here.
+	 */
+	template <typename T, typename Map>
+	void freeSpaceParallel(Point3 const& sensor_origin, PointCloud const& cloud,
+	                       Map& indices, T const& value, DepthType depth = 0,
+	                       bool simple_ray_casting = false) const
+	{
+		forEachChunk(cloud, [&](auto first, auto last) {
+			freeSpace(sensor_origin, first, last, indices, value, depth, simple_ray_casting,
+			          0);
+		});
+	}
+
+	// Calls f(first, last) in parallel for chunks of the cloud, one per thread
+	template <typename BinaryFunction>
+	static void forEachChunk(PointCloud const& cloud, BinaryFunction f)
+	{
+		std::size_t num_chunks =
+		    std::max(1u, std::min(std::thread::hardware_concurrency(),
+		                          static_cast<unsigned int>(cloud.size() / 64 + 1)));
+		std::size_t chunk_size = (cloud.size() + num_chunks - 1) / num_chunks;
+
+		std::vector<std::size_t> chunks(num_chunks);
+		std::iota(chunks.begin(), chunks.end(), 0);
+
+		std::for_each(std::execution::par, chunks.begin(), chunks.end(),
+		              [&](std::size_t chunk) {
+			              auto first = std::next(cloud.begin(),
+			                                     std::min(cloud.size(), chunk * chunk_size));
+			              auto last = std::next(
+			                  cloud.begin(), std::min(cloud.size(), (chunk + 1) * chunk_size));
+			              f(first, last);
+		              });
+	}
+
+	/**
+	 * @brief Calculate free space where each ray is split into segments by distance from
+	 * the sensor, each segment cast at the depth from schedule.
+	 */
+	template <typename InputIt, typename Map>
+	void freeSpaceScheduled(Point3 const& sensor_origin, InputIt first, InputIt last,
+	                        Map& indices, DepthSchedule const& schedule,
+	                        bool simple_ray_casting = false,
+	                        unsigned int early_stopping = 0) const
+	{
+		auto const intervals = schedule.intervals();
+		std::vector<LogitType> values;
+		for (auto const& interval : intervals) {
+			values.push_back(getProbMissLog(interval.second));
+		}
+
+		for (; first != last; ++first) {
+			Point3 current = sensor_origin;
+			Point3 end = *first;
+
+			// Move origin and end inside map
+			if (!Base::moveLineInside(current, end)) {
+				// Line outside of map
+				continue;
+			}
+
+			Point3 direction = end - sensor_origin;
+			double distance = direction.norm();
+			direction /= distance;
+			double begin = (current - sensor_origin).norm();
+
+			for (std::size_t i = 0; i < intervals.size(); ++i) {
+				auto const& [range, depth] = intervals[i];
+				double from = std::max(begin, range.first);
+				double to = std::min(distance, range.second);
+				if (from >= to) {
+					continue;
+				}
+
+				Point3 segment_from = begin == from ? current : sensor_origin + (direction * from);
+				Point3 segment_to = distance == to ? end : sensor_origin + (direction * to);
+				if (simple_ray_casting) {
+					freeSpaceSimple(segment_from, segment_to, indices, values[i], depth,
+					                early_stopping);
+				} else {
+					freeSpaceNormal(segment_from, segment_to, indices, values[i], depth,
+					                early_stopping);
+				}
+			}
+		}
+	}
+
+	//
+	// Integrate free space
+	//
+
+	void castFreeSpace(Point3 const& sensor_origin, PointCloud const& discretized,
+	                   LogitType prob_miss_log, DepthType depth, bool simple_ray_casting,
+	                   unsigned int early_stopping, bool parallel)
+	{
+		StageTimer timer(Base::metrics_, IntegrationStage::ray_cast);
+		if (parallel && 0 == early_stopping) {
+			freeSpaceParallel(sensor_origin, discretized, context_->free_hits, prob_miss_log,
+			                  depth, simple_ray_casting);
+		} else {
+			freeSpace(sensor_origin, discretized, context_->free_hits, prob_miss_log, depth,
+			          simple_ray_casting, early_stopping);
+		}
+	}
+
+	void castFreeSpace(Point3 const& sensor_origin, PointCloud const& discretized,
+	                   DepthSchedule const& schedule, bool simple_ray_casting,
+	                   unsigned int early_stopping, bool parallel)
+	{
+		StageTimer timer(Base::metrics_, IntegrationStage::ray_cast);
+		if (parallel && 0 == early_stopping) {
+			forEachChunk(discretized, [&](auto first, auto last) {
+				freeSpaceScheduled(sensor_origin, first, last, context_->free_hits, schedule,
+				                   simple_ray_casting, 0);
+			});
+		} else {
+			freeSpaceScheduled(sensor_origin, discretized.begin(), discretized.end(),
+			                   context_->free_hits, schedule, simple_ray_casting,
+			                   early_stopping);
+		}
+	}
+
+	void integrateFreeSpace(Point3 const& sensor_origin, PointCloud const& discretized,
+	                        std::future<void>& occupied, LogitType prob_miss_log,
+	                        DepthType depth, bool simple_ray_casting,
+	                        unsigned int early_stopping, bool parallel)
+	{
+		castFreeSpace(sensor_origin, discretized, prob_miss_log, depth, simple_ray_casting,
+		              early_stopping, parallel);
+		occupied.wait();
+		applyFreeSpace();
+	}
+
+	// Apply the free space found by castFreeSpace, has to be done after the occupied space
+	void applyFreeSpace()
+	{
+		{
+			StageTimer timer(Base::metrics_, IntegrationStage::collect);
+			context_->free_hits_batch.assign(context_->free_hits.begin(),
+			                                 context_->free_hits.end());
+			context_->free_hits.clear();
+		}
+
+		updateValueBatch(context_->free_hits_batch);
+
+		if (lazy_propagation_enabled_) {
+			StageTimer timer(Base::metrics_, IntegrationStage::propagate);
+			propagate(Base::getRoot(), Base::getTreeDepthLevels());
+		}
+	}
+
+	//
+	// Integrator helper
+	//
+
+	// Ray casting does not depend on the map, so the map is left untouched until the free
+	// space is found and it gives the same result as updating occupied space in parallel
+	void insertPointCloudHelper(Point3 sensor_origin,
+	                            typename IntegrationContext<LogitType>::Cloud& buffers,
+	                            LogitType prob_miss_log, DepthType depth,
+	                            bool simple_ray_casting, unsigned int early_stopping,
+	                            bool parallel, Point3 min_change, Point3 max_change)
+	{
+		castFreeSpace(sensor_origin, buffers.discretized, prob_miss_log, depth,
+		              simple_ray_casting, early_stopping, parallel);
+		auto lock = writeLock();
+		updateValueBatch(buffers.occupied_hits);
+		applyFreeSpace();
+		updateMinMaxChange(min_change, max_change);
+		integration_end_ = std::chrono::steady_clock::now();
+	}
+
+	void insertPointCloudScheduledHelper(
+	    Point3 sensor_origin, typename IntegrationContext<LogitType>::Cloud& buffers,
+	    DepthSchedule schedule, bool simple_ray_casting, unsigned int early_stopping,
+	    bool parallel, Point3 min_change, Point3 max_change)
+	{
+		castFreeSpace(sensor_origin, buffers.discretized, schedule, simple_ray_casting,
+		              early_stopping, parallel);
+		auto lock = writeLock();
+		updateValueBatch(buffers.occupied_hits);
+		applyFreeSpace();
+		updateMinMaxChange(min_change, max_change);
+		integration_end_ = std::chrono::steady_clock::now();
+	}
+
+	void updateMinMaxChange(Point3 const& min_change, Point3 const& max_change)
+	{
+		if (min_max_change_detection_enabled_) {
+			for (int i : {0, 1, 2}) {
+				min_change_[i] = std::min(min_change_[i], min_change[i]);
+				max_change_[i] = std::max(max_change_[i], max_change[i]);
+			}
+		}
+	}
+
+	//
+	// Integration pipeline
+	//
+
+	struct PipelineCloud {
+		IntegrationTicket ticket;
+		Point3 sensor_origin;
+		PointCloud cloud;
+		std::optional<math::Pose6> frame_origin;
+		double max_range;
+		DepthType depth;
+		bool simple_ray_casting;
+		unsigned int early_stopping;
+		bool parallel;
+		bool discrete;
+	};
+
+	struct PipelineDiscretized {
+		IntegrationTicket ticket;
+		Point3 sensor_origin;
+		PointCloud discretized;
+		std::vector<std::pair<Code, LogitType>> occupied_hits;
+		LogitType prob_miss_log;
+		DepthType depth;
+		bool simple_ray_casting;
+		unsigned int early_stopping;
+		bool parallel;
+		Point3 min_change;
+		Point3 max_change;
+	};
+
+	template <typename T>
+	struct PipelineBatch {
+		std::vector<T> items;
+
+		void merge(PipelineBatch&& other)
+		{
+			std::move(other.items.begin(), other.items.end(), std::back_inserter(items));
+		}
+
+		std::vector<IntegrationTicket> tickets() const
+		{
+			std::vector<IntegrationTicket> tickets;
+			for (T const& item : items) {
+				tickets.push_back(item.ticket);
+			}
+			return tickets;
+		}
+	};
+
+	struct PipelineHits {
+		std::vector<IntegrationTicket> ticket_list;
+		std::vector<std::pair<Code, LogitType>> occupied_hits;
+		std::vector<std::pair<Code, LogitType>> free_hits;
+		Point3 min_change;
+		Point3 max_change;
+
+		void merge(PipelineHits&& other)
+		{
+			std::move(other.ticket_list.begin(), other.ticket_list.end(),
+			          std::back_inserter(ticket_list));
+			std::move(other.occupied_hits.begin(), other.occupied_hits.end(),
+			          std::back_inserter(occupied_hits));
+			std::move(other.free_hits.begin(), other.free_hits.end(),
+			          std::back_inserter(free_hits));
+			for (int i : {0, 1, 2}) {
+				min_change[i] = std::min(min_change[i], other.min_change[i]);
+				max_change[i] = std::max(max_change[i], other.max_change[i]);
+			}
+		}
+
+		std::vector<IntegrationTicket> tickets() const { return ticket_list; }
+	};
+
+	struct Pipeline {
+		Pipeline(std::size_t queue_capacity, BackpressurePolicy policy)
+		    : clouds(queue_capacity, policy),
+		      discretized(queue_capacity, policy),
+		      hits(queue_capacity, policy)
+		{
+		}
+
+		// A ticket is done when everything up to it has been applied, or it was dropped
+		bool isDone(IntegrationTicket ticket) const
+		{
+			return ticket <= last_applied || 0 != dropped.count(ticket);
+		}
+
+		BoundedQueue<PipelineBatch<PipelineCloud>> clouds;
+		BoundedQueue<PipelineBatch<PipelineDiscretized>> discretized;
+		BoundedQueue<PipelineHits> hits;
+
+		std::thread discretize_thread;
+		std::thread ray_cast_thread;
+		std::thread apply_thread;
+
+		// Only used by the ray cast stage
+		ConcurrentCodeMap<LogitType> free_hits;
+
+		mutable std::mutex mutex;
+		mutable std::condition_variable done;
+		IntegrationTicket next_ticket = 1;
+		IntegrationTicket last_applied = 0;
+		std::set<IntegrationTicket> dropped;
+
+		// How many tickets before the last applied the drops are remembered for
+		static constexpr IntegrationTicket drop_history = 4096;
+	};
+
+	template <typename T>
+	void pipelineDropped(std::optional<T> const& dropped)
+	{
+		if (!dropped) {
+			return;
+		}
+		{
+			std::scoped_lock lock(pipeline_->mutex);
+			for (IntegrationTicket ticket : dropped->tickets()) {
+				pipeline_->dropped.insert(ticket);
 			}
 		}
+		pipeline_->done.notify_all();
+	}
 
-		if (Base::isNodeCollapsible(node, depth)) {
-			Base::deleteChildren(node, depth);
-		}
+	void pipelineDiscretize()
+	{
+		PipelineBatch<PipelineCloud> clouds;
+		while (pipeline_->clouds.pop(clouds)) {
+			PipelineBatch<PipelineDiscretized> batch;
+			for (PipelineCloud& cloud : clouds.items) {
+				if (cloud.frame_origin) {
+					cloud.cloud.transform(*cloud.frame_origin, true);
+				}
 
-		if (node.value.occupancy != new_occupancy_value ||
-		    node.contains_free != new_contains_free ||
-		    node.contains_unknown != new_contains_unknown) {
-			node.value.occupancy = new_occupancy_value;
-			node.contains_free = new_contains_free;
-			node.contains_unknown = new_contains_unknown;
-			return true;
+				PipelineDiscretized& d = batch.items.emplace_back();
+				d.ticket = cloud.ticket;
+				d.sensor_origin = cloud.sensor_origin;
+				d.prob_miss_log = getProbMissLog(cloud.depth);
+				d.depth = cloud.depth;
+				d.simple_ray_casting = cloud.simple_ray_casting;
+				d.early_stopping = cloud.early_stopping;
+				d.parallel = cloud.parallel;
+				if (cloud.discrete) {
+					discretizePointCloudDiscrete(cloud.sensor_origin, cloud.cloud, cloud.max_range,
+					                             cloud.depth, d.discretized, d.occupied_hits,
+					                             d.min_change, d.max_change);
+				} else {
+					discretizePointCloud(cloud.sensor_origin, cloud.cloud, cloud.max_range,
+					                     d.discretized, d.occupied_hits, d.min_change,
+					                     d.max_change);
+				}
+			}
+			pipelineDropped(pipeline_->discretized.push(std::move(batch)));
 		}
-		return false;
 	}
 
-	//
-	// Calculate free space
-	//
-	template <typename T, typename C>
-	void freeSpace(Point3 const& sensor_origin, C const& cloud, CodeMap<T>& indices,
-	               T const& value, DepthType depth = 0, bool simple_ray_casting = false,
-	               unsigned int early_stopping = 0) const
+	void pipelineRayCast()
 	{
-		for (auto const& point : cloud) {
-			Point3 current = sensor_origin;
-			Point3 end;
+		PipelineBatch<PipelineDiscretized> batch;
+		while (pipeline_->discretized.pop(batch)) {
+			std::optional<PipelineHits> hits;
+			for (PipelineDiscretized& d : batch.items) {
+				{
+					StageTimer timer(Base::metrics_, IntegrationStage::ray_cast);
+					if (d.parallel && 0 == d.early_stopping) {
+						freeSpaceParallel(d.sensor_origin, d.discretized, pipeline_->free_hits,
+						                  d.prob_miss_log, d.depth, d.simple_ray_casting);
+					} else {
+						freeSpace(d.sensor_origin, d.discretized, pipeline_->free_hits,
+						          d.prob_miss_log, d.depth, d.simple_ray_casting,
+						          d.early_stopping);
+					}
+				}
 
-			using point_type = std::decay_t<decltype(point)>;
-			if constexpr (std::is_same_v<point_type, Code>) {
-				end = Base::toCoord(point);
-			} else if constexpr (std::is_base_of_v<point_type, Point3>) {
-				end = point;
-			} else {
-				// TODO: Error
-			}
+				PipelineHits cur;
+				cur.ticket_list.push_back(d.ticket);
+				cur.occupied_hits = std::move(d.occupied_hits);
+				{
+					StageTimer timer(Base::metrics_, IntegrationStage::collect);
+					cur.free_hits.assign(pipeline_->free_hits.begin(),
+					                     pipeline_->free_hits.end());
+					pipeline_->free_hits.clear();
+				}
+				cur.min_change = d.min_change;
+				cur.max_change = d.max_change;
 
-			// Move origin and end inside map
-			if (!Base::moveLineInside(current, end)) {
-				// Line outside of map
-				continue;
+				if (hits) {
+					hits->merge(std::move(cur));
+				} else {
+					hits = std::move(cur);
+				}
 			}
-
-			if (simple_ray_casting) {
-				freeSpaceSimple(current, end, indices, value, depth, early_stopping);
-			} else {
-				freeSpaceNormal(current, end, indices, value, depth, early_stopping);
+			if (hits) {
+				pipelineDropped(pipeline_->hits.push(std::move(*hits)));
 			}
 		}
 	}
 
-	template <typename T>
-	void freeSpaceNormal(Point3 const& from, Point3 const& to, CodeMap<T>& indices,
-	                     T const& value, DepthType depth = 0,
-	                     unsigned int early_stopping = 0) const
+	void pipelineApply()
 	{
-		// Do it backwards
-		Point3 current = to;
-		Point3 end = from;
-
-		Point3 direction = end - current;
-		double distance = direction.norm();
-		direction /= distance;
-		Key current_key;
-		Key end_key;
-		std::array<int, 3> step;
-		Point3 t_delta;
-		Point3 t_max;
-		Base::computeRayInit(current, end, direction, current_key, end_key, step, t_delta,
-		                     t_max, depth);
-
-		if (current_key == end_key) {
-			indices.try_emplace(Base::toCode(current_key), value);
-			return;
-		}
+		PipelineHits hits;
+		while (pipeline_->hits.pop(hits)) {
+			{
+				auto lock = writeLock();
+				updateValueBatch(hits.occupied_hits);
+				updateValueBatch(hits.free_hits);
+
+				if (min_max_change_detection_enabled_) {
+					for (int i : {0, 1, 2}) {
+						min_change_[i] = std::min(min_change_[i], hits.min_change[i]);
+						max_change_[i] = std::max(max_change_[i], hits.max_change[i]);
+					}
+				}
 
-		// if (0 == depth) {
-		// 	Base::computeRayTakeStep(current_key, step, t_delta, t_max);
-		// }
-		unsigned int already_update_in_row = 0;
-		do {
-			if (indices.try_emplace(Base::toCode(current_key), value).second) {
-				already_update_in_row = 0;
-			} else {
-				++already_update_in_row;
-				if (0 < early_stopping && already_update_in_row >= early_stopping) {
-					break;
+				if (lazy_propagation_enabled_) {
+					StageTimer timer(Base::metrics_, IntegrationStage::propagate);
+					propagate(Base::getRoot(), Base::getTreeDepthLevels());
 				}
+				integration_end_ = std::chrono::steady_clock::now();
 			}
-			Base::computeRayTakeStep(current_key, step, t_delta, t_max);
-		} while (current_key != end_key && t_max.min() <= distance);
-	}
-
-	template <typename T>
-	void freeSpaceSimple(Point3 const& from, Point3 const& to, CodeMap<T>& indices,
-	                     T const& value, DepthType depth = 0,
-	                     unsigned int early_stopping = 0) const
-	{
-		// Do it backwards
-		Point3 current = to;
-		Point3 end = from;
 
-		Point3 direction = end - current;
-		double distance = direction.norm();
-		direction /= distance;
-		int num_steps = distance / Base::getNodeSize(depth);
-		Point3 step = direction * Base::getNodeSize(depth);
-		int current_step = 0;
-		double current_distance = distance;
-		double dist_per_step = distance / num_steps;
-		// if (0 == depth) {
-		// 	current += step;
-		// 	current_step = 1;
-		// }
-		unsigned int already_update_in_row = 0;
-		for (; current_step <= num_steps; ++current_step) {
-			// if (indices.try_emplace(Base::toCode(current, depth), value / (current_distance *
-			// current_distance)).second) {
-			if (indices.try_emplace(Base::toCode(current, depth), value).second) {
-				already_update_in_row = 0;
-			} else {
-				++already_update_in_row;
-				if (0 < early_stopping && already_update_in_row >= early_stopping) {
-					break;
+			{
+				std::scoped_lock lock(pipeline_->mutex);
+				for (IntegrationTicket ticket : hits.ticket_list) {
+					pipeline_->last_applied = std::max(pipeline_->last_applied, ticket);
+				}
+				// Forget drops that are too old to be asked about, they are done anyway
+				if (Pipeline::drop_history < pipeline_->last_applied) {
+					pipeline_->dropped.erase(
+					    pipeline_->dropped.begin(),
+					    pipeline_->dropped.upper_bound(pipeline_->last_applied -
+					                                   Pipeline::drop_history));
 				}
 			}
-			current += step;
-			current_distance -= dist_per_step;
+			pipeline_->done.notify_all();
 		}
 	}
 
 	//
-	// Integrator helper
+	// Delta
 	//
 
-	void insertPointCloudHelper(Point3 sensor_origin, PointCloud&& discretized,
-	                            std::vector<std::pair<Code, float>>&& occupied_hits,
-	                            LogitType prob_miss_log, DepthType depth,
-	                            bool simple_ray_casting, unsigned int early_stopping,
-	                            Point3 min_change, Point3 max_change)
+	// Set in the depth byte of a delta entry if the node has children
+	static constexpr std::uint8_t DELTA_SUBTREE = 0x80;
+
+	// The changed codes, moved up to the depth of the nodes that contain them, without the
+	// codes contained by others and sorted in Morton order
+	std::vector<Code> getDeltaCodes() const
 	{
-		std::future<void> f = std::async(std::launch::async, [this, &occupied_hits]() {
-			std::for_each(begin(occupied_hits), end(occupied_hits),
-			              [this](auto&& hit) { updateValue(hit.first, hit.second); });
-		});
+		std::vector<Code> codes;
+		codes.reserve(changes_.size());
+		for (Code const& code : changes_) {
+			DepthType const depth = Base::getNode(code).second;
+			codes.push_back(depth == code.getDepth() ? code : code.toDepth(depth));
+		}
 
-		CodeMap<LogitType> free_hits;
+		sortOutermost(codes);
+		return codes;
+	}
 
-		freeSpace(sensor_origin, discretized, free_hits, prob_miss_log, depth,
-		          simple_ray_casting, early_stopping);
+	// Sort codes in Morton order and remove the codes contained by others
+	static void sortOutermost(std::vector<Code>& codes)
+	{
+		// A node comes before its descendants
+		std::sort(codes.begin(), codes.end(), [](Code const& a, Code const& b) {
+			return a.getCode() < b.getCode() ||
+			       (a.getCode() == b.getCode() && a.getDepth() > b.getDepth());
+		});
 
-		f.wait();
+		std::size_t num_kept = 0;
+		for (Code const& code : codes) {
+			if (0 == num_kept ||
+			    codes[num_kept - 1] != code.toDepth(codes[num_kept - 1].getDepth())) {
+				codes[num_kept++] = code;
+			}
+		}
+		codes.resize(num_kept);
+	}
 
-		for (auto const& [code, value] : free_hits) {
-			updateValue(code, value);
+	// LEB128, seven bits per byte with the high bit set on all but the last byte
+	static void writeVarint(std::string& data, std::uint64_t value)
+	{
+		for (; 0x80 <= value; value >>= 7) {
+			data.push_back(static_cast<char>((value & 0x7F) | 0x80));
 		}
+		data.push_back(static_cast<char>(value));
+	}
 
-		if (min_max_change_detection_enabled_) {
-			for (int i : {0, 1, 2}) {
-				min_change_[i] = std::min(min_change_[i], min_change[i]);
-				max_change_[i] = std::max(max_change_[i], max_change[i]);
+	static bool readVarint(std::string_view& data, std::uint64_t& value)
+	{
+		value = 0;
+		for (unsigned int shift = 0; 64 > shift && !data.empty(); shift += 7) {
+			std::uint8_t const byte = data.front();
+			data.remove_prefix(1);
+			value |= std::uint64_t(byte & 0x7F) << shift;
+			if (0 == (byte & 0x80)) {
+				return true;
 			}
 		}
+		return false;
 	}
 
 	//
 	// Input/output (read/write)
 	//
 
-	virtual bool readNodes(std::istream& s,
-	                       ufo::geometry::BoundingVolume const& bounding_volume) override
+	virtual bool readNodes(std::string_view& data,
+	                       ufo::geometry::BoundingVolume const& bounding_volume,
+	                       bool complete = false, DepthType chunk_depth = 0,
+	                       ChunkRoots* chunk_roots = nullptr) override
 	{
 		// Check if inside bounding_volume
 		Point3 const center(0, 0, 0);
@@ -1387,77 +4315,34 @@ class OccupancyMapBase : public Octree<DATA_TYPE, OccupancyMapInnerNode<DATA_TYP
 			return true;  // No node intersects
 		}
 
-		uint8_t children;
-		s.read(reinterpret_cast<char*>(&children), sizeof(children));
+		if (data.empty()) {
+			return false;
+		}
+		uint8_t const children = data.front();
+		data.remove_prefix(1);
 
 		if (0 == children) {
 			Base::deleteChildren(Base::getRoot(), Base::getTreeDepthLevels());
-			Base::getRoot().readData(s);
+			if (!readNodeData(data, Base::getRoot())) {
+				return false;
+			}
 			updateNode(Base::getRoot(), Base::getTreeDepthLevels());
 			return true;
 		}
-		return readNodesRecurs(s, bounding_volume, Base::getRoot(), center,
-		                       Base::getTreeDepthLevels());
+		return decodeNodes(data, bounding_volume, complete, Base::getRoot(), center,
+		                   Base::getTreeDepthLevels(), chunk_depth, chunk_roots);
 	}
 
-	bool readNodesRecurs(std::istream& s,
-	                     ufo::geometry::BoundingVolume const& bounding_volume,
-	                     INNER_NODE& node, Point3 const& center, unsigned int current_depth)
+	virtual bool writeNodes(std::string& data,
+	                        ufo::geometry::BoundingVolume const& bounding_volume,
+	                        DepthType min_depth, DepthType chunk_depth = 0,
+	                        ConstChunkRoots* chunk_roots = nullptr) const override
 	{
-		DepthType const child_depth = current_depth - 1;
-		double const child_half_size = Base::getNodeHalfSize(child_depth);
-
-		// 1 bit for each child; 0: leaf child, 1: child has children
-		uint8_t children;
-		s.read(reinterpret_cast<char*>(&children), sizeof(children));
-
-		std::array<Point3, 8> child_centers;
-		std::bitset<8> child_intersects;
-		for (size_t i = 0; i < 8; ++i) {
-			child_centers[i] = Base::getChildCenter(center, child_half_size, i);
-			child_intersects[i] =
-			    bounding_volume.empty() || bounding_volume.intersects(ufo::geometry::AABB(
-			                                   child_centers[i], child_half_size));
-		}
-
-		Base::createChildren(node, current_depth);
-
-		for (size_t i = 0; i < 8; ++i) {
-			if (child_intersects[i]) {
-				INNER_NODE& child = Base::getInnerChild(node, i);
-				if ((children >> i) & 1U) {
-					if (1 == child_depth) {
-						double const grandchild_half_size = Base::getNodeHalfSize(0);
-						Base::createChildren(child, child_depth);
-						for (size_t j = 0; j < 8; ++j) {
-							if (bounding_volume.empty() ||
-							    bounding_volume.intersects(ufo::geometry::AABB(
-							        Base::getChildCenter(child_centers[i], grandchild_half_size, j),
-							        grandchild_half_size))) {
-								Base::getLeafChild(child, j).readData(s);
-							}
-						}
-						updateNode(child, child_depth);
-					} else {
-						readNodesRecurs(s, bounding_volume, child, child_centers[i], child_depth);
-					}
-				} else {
-					Base::deleteChildren(child, child_depth);
-					child.readData(s);
-					updateNode(child, child_depth);
-				}
-			}
+		if (0 < min_depth && !isPropagated()) {
+			// Inner nodes are written
+			throw std::logic_error("Map written at min_depth > 0 before propagate() was called");
 		}
 
-		updateNode(node, current_depth);  // To set indicators
-
-		return true;
-	}
-
-	virtual bool writeNodes(std::ostream& s,
-	                        ufo::geometry::BoundingVolume const& bounding_volume,
-	                        DepthType min_depth) const override
-	{
 		// Check if inside bounding_volume
 		Point3 const center(0, 0, 0);
 		double half_size = Base::getNodeHalfSize(Base::getTreeDepthLevels());
@@ -1470,87 +4355,329 @@ class OccupancyMapBase : public Octree<DATA_TYPE, OccupancyMapInnerNode<DATA_TYP
 		if (Base::hasChildren(Base::getRoot()) && Base::getTreeDepthLevels() > min_depth) {
 			children = UINT8_MAX;
 		}
-		s.write(reinterpret_cast<char*>(&children), sizeof(children));
+		data.push_back(static_cast<char>(children));
 
 		if (0 == children) {
-			Base::getRoot().writeData(s);
+			appendNodeData(data, Base::getRoot());
 			return true;
 		}
-		return writeNodesRecurs(s, bounding_volume, Base::getRoot(), center,
-		                        Base::getTreeDepthLevels(), min_depth);
+		return encodeNodes(data, bounding_volume, Base::getRoot(), center,
+		                   Base::getTreeDepthLevels(), min_depth, chunk_depth, chunk_roots);
 	}
 
-	bool writeNodesRecurs(std::ostream& s,
-	                      ufo::geometry::BoundingVolume const& bounding_volume,
-	                      INNER_NODE const& node, Point3 const& center,
-	                      DepthType current_depth, DepthType min_depth = 0) const
+	virtual bool readSubtreeNodes(std::string_view& data,
+	                              ufo::geometry::BoundingVolume const& bounding_volume,
+	                              bool complete, INNER_NODE& node, Code const& code) override
 	{
-		DepthType const child_depth = current_depth - 1;
-		double const child_half_size = Base::getNodeHalfSize(child_depth);
+		return decodeNodes(data, bounding_volume, complete, node, Base::toCoord(code),
+		                   code.getDepth());
+	}
 
-		// 1 bit for each child; 0: leaf child, 1: child has children
-		uint8_t children = 0;
-		std::array<Point3, 8> child_centers;
-		std::bitset<8> child_intersects;
-		for (size_t i = 0; i < 8; ++i) {
-			if (child_depth > min_depth && Base::hasChildren(Base::getInnerChild(node, i))) {
-				children |= 1U << i;
+	virtual bool writeSubtreeNodes(std::string& data,
+	                               ufo::geometry::BoundingVolume const& bounding_volume,
+	                               INNER_NODE const& node, Code const& code,
+	                               DepthType min_depth) const override
+	{
+		return encodeNodes(data, bounding_volume, node, Base::toCoord(code), code.getDepth(),
+		                   min_depth);
+	}
+
+	// Whether the data of a node is its memory, so the leaf children of a node can be
+	// read/written with one copy
+	static constexpr bool LEAF_DATA_IS_MEMORY = std::is_trivially_copyable_v<LEAF_NODE> &&
+	                                            sizeof(LEAF_NODE) == LEAF_NODE::dataSize();
+
+	// Frame of the explicit stacks of decodeNodes and encodeNodes
+	template <typename NODE>
+	struct CodecFrame {
+		NODE* node;
+		Point3 center;
+		DepthType depth;
+		unsigned int next_child;
+		std::uint8_t children;    // 1 bit for each child; 0: leaf child, 1: child has children
+		std::uint8_t intersects;  // 1 bit for each child that intersects the bounding volume
+	};
+
+	// Read the nodes below node, depth first
+	bool decodeNodes(std::string_view& data,
+	                 ufo::geometry::BoundingVolume const& bounding_volume, bool complete,
+	                 INNER_NODE& node, Point3 const& center, DepthType depth,
+	                 DepthType chunk_depth = 0, ChunkRoots* chunk_roots = nullptr)
+	{
+		std::array<CodecFrame<INNER_NODE>, Base::MAX_DEPTH_LEVELS> stack;
+		std::size_t size = 0;
+
+		auto push = [&](INNER_NODE& parent, Point3 const& parent_center,
+		                DepthType parent_depth) {
+			if (data.empty()) {
+				return false;
+			}
+			stack[size++] = {&parent, parent_center, parent_depth, 0,
+			                 static_cast<std::uint8_t>(data.front()),
+			                 getChildIntersects(bounding_volume, parent_center, parent_depth)};
+			data.remove_prefix(1);
+			Base::createChildren(parent, parent_depth);
+			return true;
+		};
+
+		bool success = push(node, center, depth);
+		while (success && 0 != size) {
+			CodecFrame<INNER_NODE>& frame = stack[size - 1];
+			if (8 == frame.next_child) {
+				updateNode(*frame.node, frame.depth);  // To set indicators
+				--size;
+				continue;
 			}
 
-			child_centers[i] = Base::getChildCenter(center, child_half_size, i);
-			child_intersects[i] =
-			    bounding_volume.empty() || bounding_volume.intersects(ufo::geometry::AABB(
-			                                   child_centers[i], child_half_size));
-		}
+			unsigned int const i = frame.next_child++;
+			DepthType const child_depth = frame.depth - 1;
+			if (0 == ((frame.intersects >> i) & 1U)) {
+				if (complete) {
+					success = skipNodes(data, (frame.children >> i) & 1U, child_depth,
+					                    chunk_roots ? chunk_depth : 0);
+				}
+				continue;
+			}
 
-		s.write(reinterpret_cast<char*>(&children), sizeof(children));
+			INNER_NODE& child = Base::getInnerChild(*frame.node, i);
+			if (0 == ((frame.children >> i) & 1U)) {
+				Base::deleteChildren(child, child_depth);
+				success = readNodeData(data, child);
+				updateNode(child, child_depth);
+				continue;
+			}
 
-		for (size_t i = 0; i < 8; ++i) {
-			if (child_intersects[i]) {
-				INNER_NODE const& child = Base::getInnerChild(node, i);
-				if ((children >> i) & 1U) {
-					if (1 == child_depth) {
-						double const grandchild_half_size = Base::getNodeHalfSize(0);
-						for (size_t j = 0; j < 8; ++j) {
-							if (bounding_volume.empty() ||
-							    bounding_volume.intersects(ufo::geometry::AABB(
-							        Base::getChildCenter(child_centers[i], grandchild_half_size, j),
-							        grandchild_half_size))) {
-								Base::getLeafChild(child, j).writeData(s);
-							}
+			Point3 const child_center =
+			    Base::getChildCenter(frame.center, Base::getNodeHalfSize(child_depth), i);
+			if (1 == child_depth) {
+				Base::createChildren(child, child_depth);
+				std::array<LEAF_NODE, 8>& leaves = Base::getLeafChildren(child);
+				std::uint8_t const intersects =
+				    getChildIntersects(bounding_volume, child_center, child_depth);
+				if constexpr (LEAF_DATA_IS_MEMORY) {
+					if (UINT8_MAX == intersects) {
+						success = sizeof(leaves) <= data.size();
+						if (success) {
+							std::memcpy(leaves.data(), data.data(), sizeof(leaves));
+							data.remove_prefix(sizeof(leaves));
 						}
-					} else {
-						writeNodesRecurs(s, bounding_volume, child, child_centers[i], child_depth,
-						                 min_depth);
+						updateNode(child, child_depth);
+						continue;
+					}
+				}
+				for (unsigned int j = 0; success && 8 != j; ++j) {
+					if ((intersects >> j) & 1U) {
+						success = readNodeData(data, leaves[j]);
+					} else if (complete) {
+						success = skipNodeData(data, 1);
+					}
+				}
+				updateNode(child, child_depth);
+			} else if (chunk_roots && chunk_depth == child_depth) {
+				// Read later from its own chunk, the children keep the parent from being
+				// collapsed until then
+				Base::createChildren(child, child_depth);
+				chunk_roots->emplace_back(&child, Base::toCode(child_center, child_depth));
+			} else {
+				success = push(child, child_center, child_depth);
+			}
+		}
+
+		return success;
+	}
+
+	// Skip a node in complete data, its subtree if it has children. Subtrees at chunk_depth
+	// are in their own chunks.
+	static bool skipNodes(std::string_view& data, bool children, DepthType depth,
+	                      DepthType chunk_depth)
+	{
+		if (!children) {
+			return skipNodeData(data, 1);
+		} else if (1 == depth) {
+			return skipNodeData(data, 8);
+		} else if (chunk_depth == depth) {
+			return true;
+		}
+
+		if (data.empty()) {
+			return false;
+		}
+		std::uint8_t const grandchildren = data.front();
+		data.remove_prefix(1);
+		for (unsigned int i = 0; 8 != i; ++i) {
+			if (!skipNodes(data, (grandchildren >> i) & 1U, depth - 1, chunk_depth)) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	// Write the nodes below node, depth first
+	bool encodeNodes(std::string& data,
+	                 ufo::geometry::BoundingVolume const& bounding_volume,
+	                 INNER_NODE const& node, Point3 const& center, DepthType depth,
+	                 DepthType min_depth = 0, DepthType chunk_depth = 0,
+	                 ConstChunkRoots* chunk_roots = nullptr) const
+	{
+		std::array<CodecFrame<INNER_NODE const>, Base::MAX_DEPTH_LEVELS> stack;
+		std::size_t size = 0;
+
+		auto push = [&](INNER_NODE const& parent, Point3 const& parent_center,
+		                DepthType parent_depth) {
+			std::uint8_t children = 0;
+			if (parent_depth - 1 > min_depth) {
+				for (unsigned int i = 0; 8 != i; ++i) {
+					if (Base::hasChildren(Base::getInnerChild(parent, i))) {
+						children |= 1U << i;
+					}
+				}
+			}
+			data.push_back(static_cast<char>(children));
+			stack[size++] = {&parent, parent_center, parent_depth, 0, children,
+			                 getChildIntersects(bounding_volume, parent_center, parent_depth)};
+		};
+
+		push(node, center, depth);
+		while (0 != size) {
+			CodecFrame<INNER_NODE const>& frame = stack[size - 1];
+			if (8 == frame.next_child) {
+				--size;
+				continue;
+			}
+
+			unsigned int const i = frame.next_child++;
+			if (0 == ((frame.intersects >> i) & 1U)) {
+				continue;
+			}
+
+			DepthType const child_depth = frame.depth - 1;
+			INNER_NODE const& child = Base::getInnerChild(*frame.node, i);
+			if (0 == ((frame.children >> i) & 1U)) {
+				appendNodeData(data, child);
+				continue;
+			}
+
+			Point3 const child_center =
+			    Base::getChildCenter(frame.center, Base::getNodeHalfSize(child_depth), i);
+			if (1 == child_depth) {
+				std::array<LEAF_NODE, 8> const& leaves = Base::getLeafChildren(child);
+				std::uint8_t const intersects =
+				    getChildIntersects(bounding_volume, child_center, child_depth);
+				if constexpr (LEAF_DATA_IS_MEMORY) {
+					if (UINT8_MAX == intersects) {
+						data.append(reinterpret_cast<char const*>(leaves.data()), sizeof(leaves));
+						continue;
 					}
-				} else {
-					child.writeData(s);
 				}
+				for (unsigned int j = 0; 8 != j; ++j) {
+					if ((intersects >> j) & 1U) {
+						appendNodeData(data, leaves[j]);
+					}
+				}
+			} else if (chunk_roots && chunk_depth == child_depth) {
+				chunk_roots->emplace_back(&child, Base::toCode(child_center, child_depth));
+			} else {
+				push(child, child_center, child_depth);
+			}
+		}
+
+		return true;
+	}
+
+	// 1 bit for each child of the node at center and depth that intersects bounding_volume
+	std::uint8_t getChildIntersects(ufo::geometry::BoundingVolume const& bounding_volume,
+	                                Point3 const& center, DepthType depth) const
+	{
+		if (bounding_volume.empty()) {
+			return UINT8_MAX;
+		}
+		double const child_half_size = Base::getNodeHalfSize(depth - 1);
+		std::uint8_t intersects = 0;
+		for (unsigned int i = 0; 8 != i; ++i) {
+			if (bounding_volume.intersects(ufo::geometry::AABB(
+			        Base::getChildCenter(center, child_half_size, i), child_half_size))) {
+				intersects |= 1U << i;
 			}
 		}
+		return intersects;
+	}
+
+	static bool readNodeData(std::string_view& data, LEAF_NODE& node)
+	{
+		if (LEAF_NODE::dataSize() > data.size()) {
+			return false;
+		}
+		node.readData(data.data());
+		data.remove_prefix(LEAF_NODE::dataSize());
+		return true;
+	}
 
+	static bool skipNodeData(std::string_view& data, std::size_t num_nodes)
+	{
+		if (num_nodes * LEAF_NODE::dataSize() > data.size()) {
+			return false;
+		}
+		data.remove_prefix(num_nodes * LEAF_NODE::dataSize());
 		return true;
 	}
 
+	static void appendNodeData(std::string& data, LEAF_NODE const& node)
+	{
+		std::size_t const size = data.size();
+		data.resize(size + LEAF_NODE::dataSize());
+		node.writeData(data.data() + size);
+	}
+
  protected:
 	// Sensor model
-	double occupied_thres_log_;      // Threshold for occupied
-	double free_thres_log_;          // Threshold for free
-	double prob_hit_log_;            // Logodds probability of hit
-	double prob_miss_log_;           // Logodds probability of miss
-	double clamping_thres_min_log_;  // Min logodds value
-	double clamping_thres_max_log_;  // Max logodds value
+	LogitValue occupied_thres_log_;      // Threshold for occupied
+	LogitValue free_thres_log_;          // Threshold for free
+	LogitValue prob_hit_log_;            // Logodds probability of hit
+	LogitValue prob_miss_log_;           // Logodds probability of miss
+	LogitValue clamping_thres_min_log_;  // Min logodds value
+	LogitValue clamping_thres_max_log_;  // Max logodds value
 
 	// Change detection
 	bool change_detection_enabled_ = false;
-	CodeSet changes_;
+	ConcurrentCodeSet changes_;
 	bool min_max_change_detection_enabled_ = false;
 	Point3 min_change_;
 	Point3 max_change_;
 
+	// Distance field, with the codes changed since it was last updated
+	std::unique_ptr<DistanceField> distance_field_;
+	ConcurrentCodeSet distance_changes_;
+
+	// Frontiers keyed by Morton code, so all frontiers in a node are a contiguous range,
+	// with the codes changed since they were last updated
+	bool frontiers_enabled_ = false;
+	double frontier_resolution_ = 0.0;
+	std::map<CodeType, DepthType> frontiers_;
+	ConcurrentCodeSet frontier_changes_;
+	// Changed without changing state, only the tree structure can have changed there
+	ConcurrentCodeSet frontier_value_changes_;
+
+	// Lazy propagation
+	bool lazy_propagation_enabled_ = false;
+
+	// Concurrent queries, readers share the lock and the tree is modified exclusively
+	bool concurrent_queries_enabled_ = false;
+	mutable std::shared_mutex query_mutex_;
+
+	// Prefilter
+	bool prefilter_enabled_ = false;
+	PrefilterOptions prefilter_options_;
+	PrefilterStats prefilter_stats_;
+
+	// Integration pipeline
+	std::unique_ptr<Pipeline> pipeline_;
+
 	// Defined here for speedup
-	CodeSet indices_;
+	std::shared_ptr<IntegrationContext<LogitType>> context_ =
+	    std::make_shared<IntegrationContext<LogitType>>();
 	std::future<void> integrate_;
+	// Written by the integration, read after waiting for it
+	std::chrono::steady_clock::time_point integration_end_;
 
 	template <typename T, typename D, typename I, typename L, bool O>
 	friend class OccupancyMapIterator;
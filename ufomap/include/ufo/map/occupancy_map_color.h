@@ -44,6 +44,13 @@
 
 #include <ufo/map/occupancy_map_base.h>
 
+// STD
+#include <array>
+#include <chrono>
+#include <future>
+#include <tuple>
+#include <vector>
+
 namespace ufo::map
 {
 class OccupancyMapColor : public OccupancyMapBase<ColorOccupancyNode<float>>
@@ -71,11 +78,28 @@ class OccupancyMapColor : public OccupancyMapBase<ColorOccupancyNode<float>>
 
 	OccupancyMapColor(OccupancyMapColor const& other);
 
+	OccupancyMapColor(OccupancyMapColor const& other,
+	                  ufo::geometry::BoundingVolume const& bounding_volume);
+
 	//
 	// Destructor
 	//
 
-	virtual ~OccupancyMapColor() {}
+	virtual ~OccupancyMapColor() { stopPipeline(); }
+
+	//
+	// Read only copy
+	//
+
+	/**
+	 * @brief Immutable deep copy for readers on other threads, see makeReadOnlyCopy().
+	 */
+	std::shared_ptr<OccupancyMapColor const> readOnlyCopy(
+	    ufo::geometry::BoundingVolume const& bounding_volume =
+	        ufo::geometry::BoundingVolume())
+	{
+		return makeReadOnlyCopy<OccupancyMapColor>(bounding_volume);
+	}
 
 	//
 	// Tree Type
@@ -90,75 +114,44 @@ class OccupancyMapColor : public OccupancyMapBase<ColorOccupancyNode<float>>
 	// Integration
 	//
 
+	/**
+	 * @brief Integrate a point cloud, with colors if it is a PointCloudColor.
+	 *
+	 * @details The colors of the points that fall in the same node are averaged, and the
+	 * colors and occupancy are updated in the same batched pass over the tree, see
+	 * updateValueBatch.
+	 */
 	template <typename T>
 	void insertPointCloud(Point3 const& sensor_origin, T const& cloud,
 	                      double max_range = -1, DepthType depth = 0,
 	                      bool simple_ray_casting = false, unsigned int early_stopping = 0,
-	                      bool async = false)
+	                      bool async = false, bool parallel = false)
 	{
 		if constexpr (std::is_same_v<T, PointCloud>) {
 			Base::insertPointCloud(sensor_origin, cloud, max_range, depth, simple_ray_casting,
-			                       early_stopping, async);
-
-			if constexpr (std::is_same_v<T, PointCloudColor>) {
-				integrateColors(sensor_origin, cloud, max_range);
-			}
-		} else if constexpr (std::is_same_v<T, PointCloudColor>) {
-			std::vector<std::tuple<Code, float, Color>> occupied_hits;
-			occupied_hits.reserve(cloud.size());
-			PointCloud discretized;
-			discretized.reserve(cloud.size());
-			Point3 min_change = Base::getMax();
-			Point3 max_change = Base::getMin();
-			for (Point3Color& end_color : cloud) {
-				Point3 end = end_color;
-				Point3 origin = sensor_origin;
-				Point3 direction = (end - origin);
-				double distance = direction.norm();
-
-				// Move origin and end inside BBX
-				if (!Base::moveLineInside(origin, end)) {
-					// Line outside of BBX
-					continue;
-				}
-
-				if (0 > max_range || distance <= max_range) {
-					// Occupied space
-					Code end_code = Base::toCode(end);
-					if (indices_.insert(end_code).second) {
-						occupied_hits.push_back(
-						    std::make_tuple(end_code, prob_hit_log_, end_color.getColor()));
-					}
-				} else {
-					direction /= distance;
-					end = origin + (direction * max_range);
-				}
-
-				discretized.push_back(end);
-
-				for (int i : {0, 1, 2}) {
-					min_change[i] = std::min(min_change[i], std::min(end[i], origin[i]));
-					max_change[i] = std::max(max_change[i], std::max(end[i], origin[i]));
-				}
-			}
-
-			LogitType prob_miss_log = prob_miss_log_ / double((2.0 * depth) + 1);
-
-			indices_.clear();
+			                       early_stopping, async, parallel);
+		} else if constexpr (std::is_same_v<T, PointCloudColor> ||
+		                     std::is_same_v<T, PointCloudView>) {
+			PointCloud& discretized = context_->nextCloud().discretized;
+			std::vector<ColorHit>& color_hits = color_hits_[context_->current_cloud];
+			Point3 min_change;
+			Point3 max_change;
+			discretizeColorCloud(sensor_origin, cloud, max_range, discretized, color_hits,
+			                     min_change, max_change);
+
+			LogitType prob_miss_log = Base::getProbMissLog(depth);
 
 			Base::insertPointCloudWait();
 
 			if (async) {
-				integrate_ =
-				    std::async(std::launch::async, &OccupancyMapColor::insertPointCloudHelper,
-				               this, sensor_origin, std::move(discretized),
-				               std::move(occupied_hits), prob_miss_log, depth, simple_ray_casting,
-				               early_stopping, min_change, max_change);
+				integrate_ = std::async(
+				    std::launch::async, &OccupancyMapColor::insertPointCloudHelper, this,
+				    sensor_origin, std::ref(discretized), std::ref(color_hits), prob_miss_log,
+				    depth, simple_ray_casting, early_stopping, parallel, min_change, max_change);
 			} else {
-				insertPointCloudHelper(sensor_origin, std::move(discretized),
-				                       std::move(occupied_hits), prob_miss_log, depth,
-				                       simple_ray_casting, early_stopping, min_change,
-				                       max_change);
+				insertPointCloudHelper(sensor_origin, discretized, color_hits, prob_miss_log,
+				                       depth, simple_ray_casting, early_stopping, parallel,
+				                       min_change, max_change);
 			}
 		}
 	}
@@ -167,101 +160,46 @@ class OccupancyMapColor : public OccupancyMapBase<ColorOccupancyNode<float>>
 	void insertPointCloud(Point3 const& sensor_origin, T cloud,
 	                      math::Pose6 const& frame_origin, double max_range = -1,
 	                      DepthType depth = 0, bool simple_ray_casting = false,
-	                      unsigned int early_stopping = 0, bool async = false)
+	                      unsigned int early_stopping = 0, bool async = false,
+	                      bool parallel = false)
 	{
 		cloud.transform(frame_origin, async);
 		insertPointCloud(sensor_origin, cloud, max_range, depth, simple_ray_casting,
-		                 early_stopping, async);
+		                 early_stopping, async, parallel);
 	}
 
 	template <typename T>
 	void insertPointCloudDiscrete(Point3 const& sensor_origin, T const& cloud,
 	                              double max_range = -1, DepthType depth = 0,
 	                              bool simple_ray_casting = false,
-	                              unsigned int early_stopping = 0, bool async = false)
+	                              unsigned int early_stopping = 0, bool async = false,
+	                              bool parallel = false)
 	{
 		if constexpr (std::is_same_v<T, PointCloud>) {
 			Base::insertPointCloudDiscrete(sensor_origin, cloud, max_range, depth,
-			                               simple_ray_casting, early_stopping);
-		} else if constexpr (std::is_same_v<T, PointCloudColor>) {
-			double squared_max_range = max_range * max_range;
-
-			std::vector<std::tuple<Code, float, Color>> occupied_hits;
-			occupied_hits.reserve(cloud.size());
-			PointCloud discretized;
-			discretized.reserve(cloud.size());
-			Point3 min_change = Base::getMax();
-			Point3 max_change = Base::getMin();
-			for (Point3Color const& end_color : cloud) {
-				Point3 end = end_color;
-				double dist_sqrt = (end - sensor_origin).squaredNorm();
-				if (0 > max_range || dist_sqrt < squared_max_range) {
-					if (Base::isInside(end)) {
-						Code end_code = Base::toCode(end);
-						if (!indices_.insert(end_code).second) {
-							continue;
-						}
-						// double dist = std::sqrt(dist_sqrt);
-						// testis.push_back(std::make_tuple(end_code, prob_hit_log_ / (dist * dist),
-						//                                  end_color.getColor()));
-						occupied_hits.push_back(
-						    std::make_tuple(end_code, prob_hit_log_, end_color.getColor()));
-					}
-				} else {
-					Point3 direction = Base::toCoord(Base::toKey(end, depth)) - sensor_origin;
-					dist_sqrt = direction.squaredNorm();
-					if (0 <= max_range && dist_sqrt > squared_max_range) {
-						direction /= std::sqrt(dist_sqrt);
-						end = sensor_origin + (direction * max_range);
-					}
-				}
-				Point3 current = sensor_origin;
-				// Move origin and end inside map
-				if (!Base::moveLineInside(current, end)) {
-					// Line outside of map
-					continue;
-				}
-
-				Key end_key = Base::toKey(end, depth);
-
-				if (0 < depth && !indices_.insert(Base::toCode(end_key)).second) {
-					continue;
-				}
-
-				Point3 end_coord = Base::toCoord(end_key);
-
-				discretized.push_back(end_coord);
-
-				// Min/max change detection
-				Point3 current_center = Base::toCoord(Base::toKey(current, depth));
-				Point3 end_center = end_coord;
-
-				double temp = Base::getNodeHalfSize(depth);
-				for (int i : {0, 1, 2}) {
-					min_change[i] = std::min(
-					    min_change[i], std::min(end_center[i] - temp, current_center[i] - temp));
-					max_change[i] = std::max(
-					    max_change[i], std::max(end_center[i] + temp, current_center[i] + temp));
-				}
-			}
-
-			LogitType prob_miss_log = prob_miss_log_ / double((2.0 * depth) + 1);
-
-			indices_.clear();
+			                               simple_ray_casting, early_stopping, async, parallel);
+		} else if constexpr (std::is_same_v<T, PointCloudColor> ||
+		                     std::is_same_v<T, PointCloudView>) {
+			PointCloud& discretized = context_->nextCloud().discretized;
+			std::vector<ColorHit>& color_hits = color_hits_[context_->current_cloud];
+			Point3 min_change;
+			Point3 max_change;
+			discretizeColorCloudDiscrete(sensor_origin, cloud, max_range, depth, discretized,
+			                             color_hits, min_change, max_change);
+
+			LogitType prob_miss_log = Base::getProbMissLog(depth);
 
 			Base::insertPointCloudWait();
 
 			if (async) {
-				integrate_ =
-				    std::async(std::launch::async, &OccupancyMapColor::insertPointCloudHelper,
-				               this, sensor_origin, std::move(discretized),
-				               std::move(occupied_hits), prob_miss_log, depth, simple_ray_casting,
-				               early_stopping, min_change, max_change);
+				integrate_ = std::async(
+				    std::launch::async, &OccupancyMapColor::insertPointCloudHelper, this,
+				    sensor_origin, std::ref(discretized), std::ref(color_hits), prob_miss_log,
+				    depth, simple_ray_casting, early_stopping, parallel, min_change, max_change);
 			} else {
-				insertPointCloudHelper(sensor_origin, std::move(discretized),
-				                       std::move(occupied_hits), prob_miss_log, depth,
-				                       simple_ray_casting, early_stopping, min_change,
-				                       max_change);
+				insertPointCloudHelper(sensor_origin, discretized, color_hits, prob_miss_log,
+				                       depth, simple_ray_casting, early_stopping, parallel,
+				                       min_change, max_change);
 			}
 		}
 	}
@@ -275,9 +213,7 @@ class OccupancyMapColor : public OccupancyMapBase<ColorOccupancyNode<float>>
 			updateNodeColor(*path[depth], color, toProb(update));
 
 			if (updateOccupancy(path[depth]->value.occupancy, update)) {
-				if (change_detection_enabled_) {
-					changes_.insert(code);
-				}
+				Base::markChanged(code);
 			}
 		} else {
 			// TODO: Error
@@ -290,11 +226,12 @@ class OccupancyMapColor : public OccupancyMapBase<ColorOccupancyNode<float>>
 	void InsertPointCloudDiscrete(Point3 const& sensor_origin, PointCloudColor cloud,
 	                              math::Pose6 const& frame_origin, double max_range = -1,
 	                              DepthType depth = 0, bool simple_ray_casting = false,
-	                              unsigned int early_stopping = 0, bool async = false)
+	                              unsigned int early_stopping = 0, bool async = false,
+	                              bool parallel = false)
 	{
 		cloud.transform(frame_origin, async);
 		insertPointCloudDiscrete(sensor_origin, cloud, max_range, depth, simple_ray_casting,
-		                         early_stopping, async);
+		                         early_stopping, async, parallel);
 	}
 
 	//
@@ -330,46 +267,177 @@ class OccupancyMapColor : public OccupancyMapBase<ColorOccupancyNode<float>>
 	}
 
  protected:
+	// An occupied hit, with the color of the points in the node
+	using ColorHit = std::tuple<Code, LogitType, Color>;
+
 	//
-	// Integrate colors
+	// Discretize
 	//
 
-	void integrateColors(Point3 const& sensor_origin, PointCloudColor const& cloud,
-	                     double max_range = -1);
+	template <typename T>
+	void discretizeColorCloud(Point3 const& sensor_origin, T const& cloud, double max_range,
+	                          PointCloud& discretized, std::vector<ColorHit>& color_hits,
+	                          Point3& min_change, Point3& max_change)
+	{
+		StageTimer timer(Base::metrics_, IntegrationStage::discretize);
+		Base::metrics_.add(IntegrationCounter::clouds);
+		Base::metrics_.add(IntegrationCounter::points, cloud.size());
+
+		color_hits.clear();
+		color_hits.reserve(cloud.size());
+		discretized.reserve(cloud.size());
+		min_change = Base::getMax();
+		max_change = Base::getMin();
+		for (Point3Color const& end_color : cloud) {
+			Point3 end = end_color;
+			if (!end.isFinite()) {
+				continue;
+			}
+			Point3 origin = sensor_origin;
+			Point3 direction = (end - origin);
+			double distance = direction.norm();
+
+			// Move origin and end inside BBX
+			if (!Base::moveLineInside(origin, end)) {
+				// Line outside of BBX
+				continue;
+			}
 
-	//
-	// Integrator helper
-	//
+			if (0 > max_range || distance <= max_range) {
+				// Occupied space, the hits in the same node are merged in mergeColorHits
+				color_hits.emplace_back(Base::toCode(end), prob_hit_log_, end_color.getColor());
+			} else {
+				direction /= distance;
+				end = origin + (direction * max_range);
+			}
 
-	void insertPointCloudHelper(Point3 sensor_origin, PointCloud&& discretized,
-	                            std::vector<std::tuple<Code, float, Color>>&& occupied_hits,
-	                            LogitType prob_miss_log, DepthType depth,
-	                            bool simple_ray_casting, unsigned int early_stopping,
-	                            Point3 min_change, Point3 max_change)
+			discretized.push_back(end);
+
+			for (int i : {0, 1, 2}) {
+				min_change[i] = std::min(min_change[i], std::min(end[i], origin[i]));
+				max_change[i] = std::max(max_change[i], std::max(end[i], origin[i]));
+			}
+		}
+	}
+
+	template <typename T>
+	void discretizeColorCloudDiscrete(Point3 const& sensor_origin, T const& cloud,
+	                                  double max_range, DepthType depth,
+	                                  PointCloud& discretized,
+	                                  std::vector<ColorHit>& color_hits, Point3& min_change,
+	                                  Point3& max_change)
 	{
-		std::future<void> f = std::async(std::launch::async, [this, &occupied_hits]() {
-			std::for_each(begin(occupied_hits), end(occupied_hits), [this](auto&& hit) {
-				updateValue(std::get<0>(hit), std::get<1>(hit), std::get<2>(hit));
-			});
-		});
+		double squared_max_range = max_range * max_range;
+
+		StageTimer timer(Base::metrics_, IntegrationStage::discretize);
+		Base::metrics_.add(IntegrationCounter::clouds);
+		Base::metrics_.add(IntegrationCounter::points, cloud.size());
+
+		color_hits.clear();
+		color_hits.reserve(cloud.size());
+		discretized.reserve(cloud.size());
+		min_change = Base::getMax();
+		max_change = Base::getMin();
+		for (Point3Color const& end_color : cloud) {
+			Point3 end = end_color;
+			if (!end.isFinite()) {
+				continue;
+			}
+			double dist_sqrt = (end - sensor_origin).squaredNorm();
+			if (0 > max_range || dist_sqrt < squared_max_range) {
+				if (Base::isInside(end)) {
+					Code end_code = Base::toCode(end);
+					// Every hit is kept for the color, but only one ray per end node
+					color_hits.emplace_back(end_code, prob_hit_log_, end_color.getColor());
+					if (!context_->indices.insert(end_code).second) {
+						continue;
+					}
+				}
+			} else {
+				Point3 direction = Base::toCoord(Base::toKey(end, depth)) - sensor_origin;
+				dist_sqrt = direction.squaredNorm();
+				if (0 <= max_range && dist_sqrt > squared_max_range) {
+					direction /= std::sqrt(dist_sqrt);
+					end = sensor_origin + (direction * max_range);
+				}
+			}
+			Point3 current = sensor_origin;
+			// Move origin and end inside map
+			if (!Base::moveLineInside(current, end)) {
+				// Line outside of map
+				continue;
+			}
 
-		CodeMap<LogitType> free_hits;
+			Key end_key = Base::toKey(end, depth);
 
-		freeSpace(sensor_origin, discretized, free_hits, prob_miss_log, depth,
-		          simple_ray_casting, early_stopping);
+			if (0 < depth && !context_->indices.insert(Base::toCode(end_key)).second) {
+				continue;
+			}
 
-		f.wait();
+			Point3 end_coord = Base::toCoord(end_key);
 
-		for (auto const& [code, value] : free_hits) {
-			Base::updateValue(code, value);
-		}
+			discretized.push_back(end_coord);
+
+			// Min/max change detection
+			Point3 current_center = Base::toCoord(Base::toKey(current, depth));
+			Point3 end_center = end_coord;
 
-		if (min_max_change_detection_enabled_) {
+			double temp = Base::getNodeHalfSize(depth);
 			for (int i : {0, 1, 2}) {
-				min_change_[i] = std::min(min_change_[i], min_change[i]);
-				max_change_[i] = std::max(max_change_[i], max_change[i]);
+				min_change[i] = std::min(
+				    min_change[i], std::min(end_center[i] - temp, current_center[i] - temp));
+				max_change[i] = std::max(
+				    max_change[i], std::max(end_center[i] + temp, current_center[i] + temp));
 			}
 		}
+
+		context_->indices.clear();
+	}
+
+	//
+	// Merge color hits
+	//
+
+	/**
+	 * @brief Sort the hits in Morton order and merge the hits in the same node into one,
+	 * with the average of their colors. Unset colors are not part of the average.
+	 */
+	void mergeColorHits(std::vector<ColorHit>& color_hits);
+
+	//
+	// Integrator helper
+	//
+
+	// The color hits are merged while the free space is found, neither touches the map.
+	// Then the colors and the occupancy are updated together in one batch.
+	void insertPointCloudHelper(Point3 sensor_origin, PointCloud& discretized,
+	                            std::vector<ColorHit>& color_hits, LogitType prob_miss_log,
+	                            DepthType depth, bool simple_ray_casting,
+	                            unsigned int early_stopping, bool parallel,
+	                            Point3 min_change, Point3 max_change)
+	{
+		std::future<void> merged;
+		if (parallel) {
+			merged = std::async(std::launch::async,
+			                    [this, &color_hits]() { mergeColorHits(color_hits); });
+		} else {
+			mergeColorHits(color_hits);
+		}
+
+		Base::castFreeSpace(sensor_origin, discretized, prob_miss_log, depth,
+		                    simple_ray_casting, early_stopping, parallel);
+
+		if (merged.valid()) {
+			merged.wait();
+		}
+
+		auto lock = Base::writeLock();
+		Base::updateValueBatchSorted(color_hits, [this](LEAF_NODE& node, ColorHit const& hit) {
+			updateNodeColor(node, std::get<2>(hit), toProb(std::get<1>(hit)));
+		});
+		Base::applyFreeSpace();
+		Base::updateMinMaxChange(min_change, max_change);
+		Base::integration_end_ = std::chrono::steady_clock::now();
 	}
 
 	//
@@ -382,8 +450,6 @@ class OccupancyMapColor : public OccupancyMapBase<ColorOccupancyNode<float>>
 	// Update node color
 	//
 
-	void updateNodeColor(Code code, Color update);
-
 	void updateNodeColor(LEAF_NODE& node, Color update, double prob);
 
 	//
@@ -397,6 +463,10 @@ class OccupancyMapColor : public OccupancyMapBase<ColorOccupancyNode<float>>
 	//
 
 	Color getAverageColor(std::vector<Color> const& colors) const;
+
+	// Color hits of the two clouds in context_, see IntegrationContext::nextCloud()
+	std::array<std::vector<ColorHit>, 2> color_hits_;
+	std::vector<ColorHit> color_sort_buffer_;
 };
 }  // namespace ufo::map
 
@@ -47,10 +47,25 @@
 #include <ufo/map/color.h>
 #include <ufo/map/octree_node.h>
 
+// STD
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
 namespace ufo::map
 {
 using Intensity = uint8_t;
 
+// Number of fixed point steps per logit for occupancy stored as integers. The 8-bit type
+// covers logits in [-4, 4), probabilities 0.018 to 0.982, and the 16-bit type [-8, 8).
+template <typename T>
+inline constexpr double logit_scale_v = 1.0;
+template <>
+inline constexpr double logit_scale_v<std::int8_t> = 32.0;
+template <>
+inline constexpr double logit_scale_v<std::int16_t> = 4096.0;
+
 template <typename T>
 struct OccupancyNode {
 	T occupancy = 0;
@@ -85,8 +100,40 @@ struct OccupancyNode {
 		s.read(reinterpret_cast<char*>(&occupancy), sizeof(occupancy));
 		return s;
 	}
+
+	/**
+	 * @brief Write the same data as writeData(s) to buffer
+	 *
+	 * @param buffer The buffer to write to, with room for dataSize() bytes
+	 * @return char* The byte after the written data
+	 */
+	char* writeData(char* buffer) const
+	{
+		std::memcpy(buffer, &occupancy, sizeof(occupancy));
+		return buffer + sizeof(occupancy);
+	}
+
+	/**
+	 * @brief Read the data for this node from buffer
+	 *
+	 * @param buffer The buffer to read from, with at least dataSize() bytes
+	 * @return char const* The byte after the read data
+	 */
+	char const* readData(char const* buffer)
+	{
+		std::memcpy(&occupancy, buffer, sizeof(occupancy));
+		return buffer + sizeof(occupancy);
+	}
+
+	/**
+	 * @return The number of bytes written by writeData
+	 */
+	static constexpr std::size_t dataSize() noexcept { return sizeof(occupancy); }
 };
 
+// writeData and readData copy the color bytewise
+static_assert(std::is_trivially_copyable_v<Color>);
+
 struct ColorNode {
 	Color color;
 
@@ -120,6 +167,35 @@ struct ColorNode {
 		s.read(reinterpret_cast<char*>(&color), sizeof(color));
 		return s;
 	}
+
+	/**
+	 * @brief Write the same data as writeData(s) to buffer
+	 *
+	 * @param buffer The buffer to write to, with room for dataSize() bytes
+	 * @return char* The byte after the written data
+	 */
+	char* writeData(char* buffer) const
+	{
+		std::memcpy(buffer, &color, sizeof(color));
+		return buffer + sizeof(color);
+	}
+
+	/**
+	 * @brief Read the data for this node from buffer
+	 *
+	 * @param buffer The buffer to read from, with at least dataSize() bytes
+	 * @return char const* The byte after the read data
+	 */
+	char const* readData(char const* buffer)
+	{
+		std::memcpy(&color, buffer, sizeof(color));
+		return buffer + sizeof(color);
+	}
+
+	/**
+	 * @return The number of bytes written by writeData
+	 */
+	static constexpr std::size_t dataSize() noexcept { return sizeof(color); }
 };
 
 template <typename T>
@@ -162,6 +238,36 @@ struct ColorOccupancyNode : OccupancyNode<T>, ColorNode {
 	{
 		return ColorNode::readData(OccupancyNode<T>::readData(s));
 	}
+
+	/**
+	 * @brief Write the same data as writeData(s) to buffer
+	 *
+	 * @param buffer The buffer to write to, with room for dataSize() bytes
+	 * @return char* The byte after the written data
+	 */
+	char* writeData(char* buffer) const
+	{
+		return ColorNode::writeData(OccupancyNode<T>::writeData(buffer));
+	}
+
+	/**
+	 * @brief Read the data for this node from buffer
+	 *
+	 * @param buffer The buffer to read from, with at least dataSize() bytes
+	 * @return char const* The byte after the read data
+	 */
+	char const* readData(char const* buffer)
+	{
+		return ColorNode::readData(OccupancyNode<T>::readData(buffer));
+	}
+
+	/**
+	 * @return The number of bytes written by writeData
+	 */
+	static constexpr std::size_t dataSize() noexcept
+	{
+		return OccupancyNode<T>::dataSize() + ColorNode::dataSize();
+	}
 };
 
 template <typename T>
@@ -173,11 +279,38 @@ struct OccupancyMapInnerNodeBase : OccupancyMapLeafNode<T> {
 	bool contains_free;
 	// Indicates whether this node or any of its children contains unknown space
 	bool contains_unknown;
+	// Indicates whether something below this node has been modified since this node was
+	// last updated, only used with lazy propagation
+	bool modified = false;
 };
 
 template <typename T>
 using OccupancyMapInnerNode = OctreeInnerNodeBase<OccupancyMapInnerNodeBase<T>>;
 
+// Same as OccupancyMapInnerNode but with the flags packed into bits and the children
+// stored as an index into the node pools of the tree instead of a pointer. An inner
+// node with float occupancy is 8 bytes instead of 16.
+template <typename T>
+struct OccupancyMapCompactInnerNode : OccupancyMapLeafNode<T> {
+	// Indicates whether this is a leaf node (has no children) or not. If true then the
+	// children are not valid and should not be accessed
+	std::uint32_t is_leaf : 1;
+	// Indicates whether this node or any of its children contains free space
+	std::uint32_t contains_free : 1;
+	// Indicates whether this node or any of its children contains unknown space
+	std::uint32_t contains_unknown : 1;
+	// Indicates whether something below this node has been modified since this node was
+	// last updated, only used with lazy propagation
+	std::uint32_t modified : 1;
+	// Pool index of the children, 0 if the children are not allocated
+	std::uint32_t children : 28;
+
+	OccupancyMapCompactInnerNode()
+	    : is_leaf(1), contains_free(0), contains_unknown(0), modified(0), children(0)
+	{
+	}
+};
+
 template <typename T>
 struct Node {
 	OccupancyMapLeafNode<T> const* node;
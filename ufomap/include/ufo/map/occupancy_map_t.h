@@ -0,0 +1,132 @@
+/**
+ * UFOMap: An Efficient Probabilistic 3D Mapping Framework That Embraces the Unknown
+ *
+ * @author D. Duberg, KTH Royal Institute of Technology, Copyright (c) 2020.
+ * @see https://github.com/UnknownFreeOccupied/ufomap
+ * License: BSD 3
+ *
+ */
+
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2020, D. Duberg, KTH Royal Institute of Technology
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef UFO_MAP_OCCUPANCY_MAP_T_H
+#define UFO_MAP_OCCUPANCY_MAP_T_H
+
+#include <ufo/map/occupancy_map_base.h>
+
+namespace ufo::map
+{
+/**
+ * @brief Occupancy map with the same nodes as OccupancyMap but with the number of depth
+ * levels fixed at compile time.
+ *
+ * @details The tree depth, root depth, node sizes, and key offsets are compile time
+ * constants, so descents from the root have constant trip counts and coordinate
+ * conversions become shifts and multiplies. Writes and reads the same files as
+ * OccupancyMap, as long as they have DEPTH_LEVELS depth levels.
+ *
+ * @tparam DEPTH_LEVELS The number of depth levels, [2, 21].
+ */
+template <DepthType DEPTH_LEVELS>
+class OccupancyMapT
+    : public OccupancyMapBase<OccupancyNode<float>,
+                              OccupancyMapInnerNode<OccupancyNode<float>>, DEPTH_LEVELS>
+{
+	static_assert(0 != DEPTH_LEVELS, "Use OccupancyMap for a runtime number of levels");
+
+ private:
+	using DATA_TYPE = OccupancyNode<float>;
+	using Base =
+	    OccupancyMapBase<DATA_TYPE, OccupancyMapInnerNode<DATA_TYPE>, DEPTH_LEVELS>;
+
+ public:
+	//
+	// Constructors
+	//
+
+	OccupancyMapT(double resolution, bool automatic_pruning = true,
+	              double occupied_thres = 0.5, double free_thres = 0.5,
+	              double prob_hit = 0.7, double prob_miss = 0.4,
+	              double clamping_thres_min = 0.1192, double clamping_thres_max = 0.971)
+	    : Base(resolution, DEPTH_LEVELS, automatic_pruning, occupied_thres, free_thres,
+	           prob_hit, prob_miss, clamping_thres_min, clamping_thres_max)
+	{
+	}
+
+	OccupancyMapT(std::string const& filename, bool automatic_pruning = true,
+	              double occupied_thres = 0.5, double free_thres = 0.5,
+	              double prob_hit = 0.7, double prob_miss = 0.4,
+	              double clamping_thres_min = 0.1192, double clamping_thres_max = 0.971)
+	    : Base(filename, automatic_pruning, occupied_thres, free_thres, prob_hit,
+	           prob_miss, clamping_thres_min, clamping_thres_max)
+	{
+	}
+
+	OccupancyMapT(OccupancyMapT const& other) : Base(other) {}
+
+	OccupancyMapT(OccupancyMapT const& other,
+	              ufo::geometry::BoundingVolume const& bounding_volume)
+	    : Base(other, bounding_volume)
+	{
+	}
+
+	//
+	// Destructor
+	//
+
+	virtual ~OccupancyMapT() { Base::stopPipeline(); }
+
+	//
+	// Read only copy
+	//
+
+	/**
+	 * @brief Immutable deep copy for readers on other threads, see makeReadOnlyCopy().
+	 */
+	std::shared_ptr<OccupancyMapT const> readOnlyCopy(
+	    ufo::geometry::BoundingVolume const& bounding_volume =
+	        ufo::geometry::BoundingVolume())
+	{
+		return Base::template makeReadOnlyCopy<OccupancyMapT>(bounding_volume);
+	}
+
+	//
+	// Tree Type
+	//
+
+	virtual std::string getTreeType() const noexcept override { return "occupancy_map"; }
+};
+}  // namespace ufo::map
+
+#endif  // UFO_MAP_OCCUPANCY_MAP_T_H
@@ -44,32 +44,57 @@
 
 // UFO
 #include <ufo/map/code.h>
+#include <ufo/map/codec.h>
+#include <ufo/map/integration_metrics.h>
 #include <ufo/map/iterator/octree.h>
 #include <ufo/map/iterator/octree_nearest.h>
 #include <ufo/map/key.h>
+#include <ufo/map/mapped_file.h>
+#include <ufo/map/memory_report.h>
+#include <ufo/map/memory_stream.h>
+#include <ufo/map/node_pool.h>
 #include <ufo/map/octree_node.h>
 #include <ufo/map/types.h>
 
 // STD
 #include <algorithm>
+#include <atomic>
 #include <bitset>
+#include <chrono>
+#include <cstdint>
 #include <cstring>
+#include <execution>
+#include <filesystem>
 #include <fstream>
 #include <future>
+#include <iterator>
+#include <limits>
+#include <mutex>
 #include <numeric>
 #include <optional>
 #include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
 #include <type_traits>
+#include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
-// Compression
-#include <lz4.h>
-#include <lz4hc.h>
-
 namespace ufo::map
 {
+/**
+ * @brief Octree with a runtime number of depth levels or, when FIXED_DEPTH_LEVELS is
+ * non-zero, a number of depth levels fixed at compile time.
+ *
+ * @details With a fixed number of depth levels the tree depth, the root depth and the
+ * maximum key value are compile time constants, which lets the compiler unroll the
+ * descents from the root and turn node sizes and coordinate conversions into shifts and
+ * multiplies instead of table lookups.
+ */
 template <typename DATA_TYPE, typename INNER_NODE = OctreeInnerNode<DATA_TYPE>,
-          typename LEAF_NODE = OctreeLeafNode<DATA_TYPE>>
+          typename LEAF_NODE = OctreeLeafNode<DATA_TYPE>,
+          DepthType FIXED_DEPTH_LEVELS = 0>
 class Octree
 {
  public:
@@ -87,8 +112,21 @@ class Octree
 	static inline const DepthType MIN_DEPTH_LEVELS = 2;   // Minimum number of depth levels
 	static inline const DepthType MAX_DEPTH_LEVELS = 21;  // Maximum number of depth levels
 
+	static_assert(0 == FIXED_DEPTH_LEVELS || (MIN_DEPTH_LEVELS <= FIXED_DEPTH_LEVELS &&
+	                                          MAX_DEPTH_LEVELS >= FIXED_DEPTH_LEVELS),
+	              "FIXED_DEPTH_LEVELS has to be 0 or [2, 21]");
+
 	using Path = std::array<LEAF_NODE*, MAX_DEPTH_LEVELS>;
 
+	// Roots of the subtrees that are read/written as separate chunks, with their codes
+	using ChunkRoots = std::vector<std::pair<INNER_NODE*, Code>>;
+	using ConstChunkRoots = std::vector<std::pair<INNER_NODE const*, Code>>;
+
+	// Whether the inner nodes store a 32-bit pool index to their children instead of a
+	// pointer. Compact trees always allocate children from the pools.
+	static constexpr bool COMPACT_CHILDREN =
+	    !std::is_pointer_v<decltype(INNER_NODE::children)>;
+
 	// class Node
 	// {
 	//  protected:
@@ -116,6 +154,11 @@ class Octree
 
 	static std::string getFileVersion() noexcept { return FILE_VERSION; }
 
+	/**
+	 * @brief Whether the number of depth levels is fixed at compile time.
+	 */
+	static constexpr bool isFixedDepth() noexcept { return 0 != FIXED_DEPTH_LEVELS; }
+
 	//
 	// Root code
 	//
@@ -244,22 +287,66 @@ class Octree
 	// Pruning
 	//
 
-	bool prune() { return prune(getRootCode()); }
+	/**
+	 * @brief Free the children that are kept allocated below leaf nodes when automatic
+	 * pruning is disabled.
+	 *
+	 * @return Whether any children were freed.
+	 */
+	bool prune()
+	{
+		prune_pending_.clear();
+		return pruneRecurs(getRoot(), getTreeDepthLevels());
+	}
 
+	/**
+	 * @brief Prune the subtree at code, or the leaf containing it.
+	 */
 	bool pruneNode(Code const& code)
 	{
-		if (0 == code.getDepth()) {
-			return false;
+		auto [node, depth] = getNode(code);
+		return 0 != depth && pruneRecurs(static_cast<INNER_NODE&>(*node), depth);
+	}
+
+	/**
+	 * @brief Prune only the subtrees that nodes have been created in since the last prune,
+	 * until budget has passed. The subtrees are tracked at the incremental prune depth
+	 * while automatic pruning is disabled. Changes made without creating nodes, such as
+	 * setValueVolume() and reading, are only pruned by prune().
+	 *
+	 * @return Whether all tracked subtrees were pruned.
+	 */
+	template <typename Rep, typename Period>
+	bool pruneIncremental(std::chrono::duration<Rep, Period> budget)
+	{
+		auto const end = std::chrono::steady_clock::now() + budget;
+		while (!prune_pending_.empty()) {
+			pruneNode(*prune_pending_.begin());
+			prune_pending_.erase(prune_pending_.begin());
+			if (std::chrono::steady_clock::now() >= end) {
+				break;
+			}
 		}
+		return prune_pending_.empty();
+	}
 
-		auto [node, depth] = getNode(code);
-		if (code.getDepth() != depth ||
-		    !isNodeCollapsible(static_cast<INNER_NODE const&>(*node), code.getDepth())) {
-			return false;
+	std::size_t getNumPrunePending() const noexcept { return prune_pending_.size(); }
+
+	/**
+	 * @brief The depth of the subtrees pruneIncremental() tracks. A lower depth gives
+	 * finer steps within the budget but more subtrees to track.
+	 */
+	void setIncrementalPruneDepth(DepthType depth)
+	{
+		if (getTreeDepthLevels() <= depth) {
+			throw std::invalid_argument("Incremental prune depth has to be below the tree depth");
 		}
-		return deleteChildren(static_cast<INNER_NODE&>(node), code.getDepth(), true);
+		incremental_prune_depth_ = depth;
+		prune_pending_.clear();
 	}
 
+	DepthType getIncrementalPruneDepth() const noexcept { return incremental_prune_depth_; }
+
 	//
 	// Search
 	//
@@ -274,7 +361,10 @@ class Octree
 	// Check if node exists
 	//
 
-	bool nodeExists(Code const& code) const { return nullptr != getNode(code); }
+	bool nodeExists(Code const& code) const
+	{
+		return code.getDepth() == getNode(code).second;
+	}
 
 	//
 	// Get child/parent code
@@ -318,9 +408,9 @@ class Octree
 	{
 		int key_value = (int)std::floor(resolution_factor_ * coord);
 		if (0 == depth) {
-			return key_value + max_value_;  // FIXME: Can this cause problems?
+			return key_value + getMaxValue();  // FIXME: Can this cause problems?
 		}
-		return ((key_value >> depth) << depth) + (1 << (depth - 1)) + max_value_;
+		return ((key_value >> depth) << depth) + (1 << (depth - 1)) + getMaxValue();
 	}
 
 	Key toKey(Point3 const& coord, DepthType depth = 0) const noexcept
@@ -377,9 +467,10 @@ class Octree
 			return 0.0;
 		}
 
-		double divider = double(1 << depth);
-		return (floor((double(key) - double(max_value_)) / divider) + 0.5) *
-		       getNodeSize(depth);
+		// Floored division by 2^depth
+		std::int64_t const index =
+		    (static_cast<std::int64_t>(key) - static_cast<std::int64_t>(getMaxValue())) >> depth;
+		return (double(index) + 0.5) * getNodeSize(depth);
 	}
 
 	Point3 toCoord(Key const& key) const noexcept
@@ -418,6 +509,248 @@ class Octree
 	 */
 	std::size_t getNumLeafNodes() const noexcept { return num_leaf_nodes_; }
 
+	//
+	// Pool allocation
+	//
+
+	/**
+	 * @brief Enable/disable allocating children from per depth pools instead of with new.
+	 * Can only be changed when the tree is empty. Trees with compact inner nodes always
+	 * use pool allocation.
+	 */
+	void enablePoolAllocation(bool enable)
+	{
+		if (enable == pool_allocation_enabled_) {
+			return;
+		}
+		if constexpr (COMPACT_CHILDREN) {
+			throw std::logic_error(
+			    "Pool allocation cannot be disabled for trees with compact inner nodes");
+		}
+		if (root_.children) {
+			throw std::logic_error(
+			    "Pool allocation can only be enabled/disabled when the tree is empty");
+		}
+		pool_allocation_enabled_ = enable;
+	}
+
+	bool isPoolAllocationEnabled() const noexcept { return pool_allocation_enabled_; }
+
+	/**
+	 * @brief Blocks and memory of the pool that children at depth are allocated from.
+	 * With compact inner nodes all inner children share the pool of depth 1.
+	 */
+	NodePoolStats getPoolStats(DepthType depth) const noexcept
+	{
+		if (0 == depth) {
+			return leaf_pool_.getStats();
+		}
+		if constexpr (COMPACT_CHILDREN) {
+			return 1 == depth ? inner_pools_[0].getStats() : NodePoolStats();
+		}
+		return depth < inner_pools_.size() ? inner_pools_[depth].getStats()
+		                                   : NodePoolStats();
+	}
+
+	/**
+	 * @brief Blocks and memory of all pools.
+	 */
+	NodePoolStats getPoolStats() const noexcept
+	{
+		NodePoolStats stats = leaf_pool_.getStats();
+		for (auto const& pool : inner_pools_) {
+			stats += pool.getStats();
+		}
+		return stats;
+	}
+
+	//
+	// Brick allocation
+	//
+
+	/**
+	 * @brief Allocate the lowest brick_depth levels below each node at depth brick_depth
+	 * as one dense brick, instead of eight children at a time. The leaves of a brick are
+	 * stored contiguously in Morton order, so 8x8x8 leaves for brick_depth 3, and the node
+	 * at brick_depth acts as the summary of the brick. Nodes inside a brick are never
+	 * freed individually, the brick is freed when the node at brick_depth is pruned.
+	 *
+	 * @param brick_depth 2 or 3 to enable, 0 to disable. Can only be changed when the tree
+	 * is empty. Not available for trees with compact inner nodes.
+	 */
+	void enableBrickAllocation(DepthType brick_depth)
+	{
+		if (brick_depth == brick_depth_) {
+			return;
+		}
+		if constexpr (COMPACT_CHILDREN) {
+			throw std::logic_error(
+			    "Brick allocation is not available for trees with compact inner nodes");
+		}
+		if (0 != brick_depth && (2 > brick_depth || 3 < brick_depth)) {
+			throw std::invalid_argument("brick_depth has to be 0, 2, or 3");
+		}
+		if (root_.children) {
+			throw std::logic_error(
+			    "Brick allocation can only be enabled/disabled when the tree is empty");
+		}
+		if (0 != tile_depth_ && brick_depth > tile_depth_) {
+			throw std::invalid_argument("brick_depth has to be at most the tile depth");
+		}
+		brick_depth_ = brick_depth;
+	}
+
+	DepthType getBrickDepth() const noexcept { return brick_depth_; }
+
+	//
+	// Node index
+	//
+
+	/**
+	 * @brief Keep a hash table from the code of each node at depth to the node. getNode(),
+	 * and everything built on it such as search() and nodeExists(), then starts at the
+	 * indexed node instead of walking down from the root. Nodes are added to the index
+	 * when created through createNode(). The index is cleared, and refilled as nodes are
+	 * created, when a node above depth is pruned since that can free indexed nodes.
+	 *
+	 * @param depth The depth of the indexed nodes. A lower depth saves more steps per
+	 * lookup but needs more entries.
+	 */
+	void enableNodeIndex(DepthType depth)
+	{
+		if (getTreeDepthLevels() <= depth) {
+			throw std::invalid_argument("Node index depth has to be below the tree depth");
+		}
+		node_index_enabled_ = true;
+		node_index_depth_ = depth;
+		rebuildNodeIndex();
+	}
+
+	void disableNodeIndex()
+	{
+		node_index_enabled_ = false;
+		node_index_.clear();
+	}
+
+	bool isNodeIndexEnabled() const noexcept { return node_index_enabled_; }
+
+	DepthType getNodeIndexDepth() const noexcept { return node_index_depth_; }
+
+	std::size_t getNodeIndexSize() const noexcept { return node_index_.size(); }
+
+	/**
+	 * @brief Index all nodes at the node index depth that exist in the tree.
+	 */
+	void rebuildNodeIndex()
+	{
+		node_index_.clear();
+		if (node_index_enabled_) {
+			rebuildNodeIndexRecurs(getRoot(), Code(0, getTreeDepthLevels()));
+		}
+	}
+
+	//
+	// Sliding window
+	//
+
+	/**
+	 * @brief Keep only the part of the map around the robot in memory. The subtrees, tiles,
+	 * at tile_depth that are outside the window given to updateWindow() are written
+	 * compressed to a file each in directory and freed. An evicted tile is left as a leaf
+	 * that keeps the summary of the subtree, so queries outside the window see the map at
+	 * the tile resolution. A tile is read back when it is inside the window again or
+	 * when a node in it is created, for example by integrating a point cloud.
+	 *
+	 * @param directory Where the tiles are stored, created if it does not exist.
+	 * @param tile_depth The depth of the tiles. Has to be at least 2 and at least the
+	 * brick depth.
+	 */
+	void enableSlidingWindow(std::string const& directory, DepthType tile_depth)
+	{
+		if (2 > tile_depth || getTreeDepthLevels() <= tile_depth) {
+			throw std::invalid_argument("Tile depth has to be [2, " +
+			                            std::to_string(getTreeDepthLevels() - 1) + "]");
+		}
+		if (0 != brick_depth_ && brick_depth_ > tile_depth) {
+			throw std::invalid_argument("Tile depth has to be at least the brick depth");
+		}
+		if (!evicted_tiles_.empty()) {
+			throw std::logic_error("Sliding window enabled while tiles are evicted");
+		}
+		std::filesystem::create_directories(directory);
+		tile_directory_ = directory;
+		tile_depth_ = tile_depth;
+	}
+
+	/**
+	 * @brief Read back all evicted tiles and stop evicting.
+	 */
+	void disableSlidingWindow()
+	{
+		restoreAllTiles();
+		tile_directory_.clear();
+		tile_depth_ = 0;
+	}
+
+	bool isSlidingWindowEnabled() const noexcept { return 0 != tile_depth_; }
+
+	DepthType getTileDepth() const noexcept { return tile_depth_; }
+
+	std::string const& getTileDirectory() const noexcept { return tile_directory_; }
+
+	std::size_t getNumEvictedTiles() const noexcept { return evicted_tiles_.size(); }
+
+	/**
+	 * @return Whether the tile containing code is on disk instead of in memory.
+	 */
+	bool isEvicted(Code const& code) const
+	{
+		return isSlidingWindowEnabled() && tile_depth_ >= code.getDepth() &&
+		       evicted_tiles_.count(code.toDepth(tile_depth_));
+	}
+
+	/**
+	 * @brief Evict the tiles that do not intersect window and read back the evicted tiles
+	 * that do.
+	 */
+	virtual void updateWindow(ufo::geometry::BoundingVar const& window)
+	{
+		if (!isSlidingWindowEnabled()) {
+			throw std::logic_error("Window updated before sliding window was enabled");
+		}
+
+		ufo::geometry::BoundingVolume bv;
+		bv.add(window);
+
+		evictOutsideRecurs(bv, getRoot(), getRootCode());
+
+		std::vector<Code> inside;
+		for (Code const& code : evicted_tiles_) {
+			if (bv.intersects(ufo::geometry::AABB(toCoord(code), getNodeHalfSize(tile_depth_)))) {
+				inside.push_back(code);
+			}
+		}
+		for (Code const& code : inside) {
+			createNode(code);  // Reads the tile back
+		}
+	}
+
+	void updateWindow(Point3 const& center, double radius)
+	{
+		updateWindow(ufo::geometry::Sphere(center, radius));
+	}
+
+	/**
+	 * @brief Read back all evicted tiles, for example before writing the whole map.
+	 */
+	virtual void restoreAllTiles()
+	{
+		std::vector<Code> evicted(evicted_tiles_.begin(), evicted_tiles_.end());
+		for (Code const& code : evicted) {
+			createNode(code);
+		}
+	}
+
 	/**
 	 * @return std::size_t memory usage of a single inner node
 	 */
@@ -437,6 +770,63 @@ class Octree
 		       (getNumLeafNodes() * memoryUsageLeafNode());
 	}
 
+	/**
+	 * @brief Detailed memory usage of the tree, see MemoryReport. Derived maps add their
+	 * scratch buffers and change tracking.
+	 */
+	virtual MemoryReport getMemoryReport() const
+	{
+		MemoryReport report;
+		report.num_nodes.assign(num_nodes_at_depth_.begin(),
+		                        num_nodes_at_depth_.begin() + getTreeDepthLevels() + 1);
+		report.node_memory.resize(report.num_nodes.size());
+		for (std::size_t depth = 0; depth != report.num_nodes.size(); ++depth) {
+			report.node_memory[depth] = report.num_nodes[depth] *
+			                            (0 == depth ? sizeof(LEAF_NODE) : sizeof(INNER_NODE));
+		}
+		report.leaf_node_memory = report.node_memory[0];
+		report.inner_node_memory =
+		    std::accumulate(report.node_memory.begin() + 1, report.node_memory.end(),
+		                    std::size_t(0));
+
+		// A block from new costs its size plus a size field, rounded up to 16 bytes
+		auto block_overhead = [](std::size_t size) {
+			return ((size + sizeof(std::size_t) + 15) / 16) * 16 - size;
+		};
+		std::size_t pooled_memory = 0;
+		for (DepthType depth = 0; depth < getTreeDepthLevels(); ++depth) {
+			if (isInBrick(depth)) {
+				continue;
+			}
+			if (pool_allocation_enabled_) {
+				pooled_memory += report.node_memory[depth];
+			} else {
+				report.allocator_overhead +=
+				    (report.num_nodes[depth] / 8) *
+				    block_overhead(0 == depth ? sizeof(std::array<LEAF_NODE, 8>)
+				                              : sizeof(std::array<INNER_NODE, 8>));
+			}
+		}
+		if (pool_allocation_enabled_) {
+			// Free blocks and unused parts of the slabs
+			report.allocator_overhead += getPoolStats().memory_usage - pooled_memory;
+		}
+		if (isInBrick(0)) {
+			std::size_t num_bricks = report.num_nodes[brick_depth_ - 1] / 8;
+			report.allocator_overhead +=
+			    num_bricks *
+			    block_overhead(3 == brick_depth_ ? sizeof(Brick<3>) : sizeof(Brick<2>));
+		}
+
+		// Each element of the hash table is a separately allocated node with a next
+		// pointer, and the table has one pointer per bucket
+		report.node_index =
+		    node_index_.size() *
+		        (sizeof(typename decltype(node_index_)::value_type) + 2 * sizeof(void*)) +
+		    node_index_.bucket_count() * sizeof(void*);
+		return report;
+	}
+
 	/**
 	 * @return std::size_t number of nodes in the tree
 	 */
@@ -548,14 +938,53 @@ class Octree
 			                            std::to_string(MIN_DEPTH_LEVELS) + " and maximum " +
 			                            std::to_string(MAX_DEPTH_LEVELS));
 		}
+		if (isFixedDepth() && FIXED_DEPTH_LEVELS != new_depth_levels) {
+			throw std::invalid_argument("depth_levels is fixed to " +
+			                            std::to_string(FIXED_DEPTH_LEVELS));
+		}
+
+		if constexpr (std::is_trivially_destructible_v<INNER_NODE> &&
+		              std::is_trivially_destructible_v<LEAF_NODE>) {
+			if (pool_allocation_enabled_ && 0 == brick_depth_) {
+				// No need to visit the nodes, free all pools at once
+				leaf_pool_.release();
+				for (auto& pool : inner_pools_) {
+					pool.release();
+				}
+				getRoot().children = {};
+				num_inner_nodes_ = 0;
+				num_inner_leaf_nodes_ = 1;
+				num_leaf_nodes_ = 0;
+				num_nodes_at_depth_.fill(0);
+			}
+		}
+
+		// The evicted tiles were part of the old tree
+		for (Code const& code : evicted_tiles_) {
+			std::filesystem::remove(getTilePath(code));
+		}
+		evicted_tiles_.clear();
+		prune_pending_.clear();
 
 		// TODO: Should they be manually deleted?
 		deleteChildren(getRoot(), getTreeDepthLevels(), true);
 		getRoot() = INNER_NODE();
+		++structure_version_;
+
+		if (mapped_file_.isOpen()) {
+			// The pools use the mapped file
+			leaf_pool_.release();
+			for (auto& pool : inner_pools_) {
+				pool.release();
+			}
+			mapped_file_.close();
+		}
 		// TODO: Have to call update node
 
+		num_nodes_at_depth_[depth_levels_] = 0;
 		depth_levels_ = new_depth_levels;
 		max_value_ = std::pow(2, getTreeDepthLevels() - 1);
+		num_nodes_at_depth_[depth_levels_] = 1;
 
 		if (new_resolution != resolution_) {
 			resolution_ = new_resolution;
@@ -575,7 +1004,14 @@ class Octree
 
 	double getNodeSize(DepthType depth) const { return getNodeHalfSize(depth + 1); }
 
-	double getNodeHalfSize(DepthType depth) const { return nodes_half_sizes_[depth]; }
+	double getNodeHalfSize(DepthType depth) const
+	{
+		if constexpr (isFixedDepth()) {
+			return resolution_ * 0.5 * static_cast<double>(KeyType(1) << depth);
+		} else {
+			return nodes_half_sizes_[depth];
+		}
+	}
 
 	double getResolution() const noexcept { return resolution_; }
 
@@ -583,7 +1019,14 @@ class Octree
 	// Tree depth
 	//
 
-	DepthType getTreeDepthLevels() const noexcept { return depth_levels_; }
+	DepthType getTreeDepthLevels() const noexcept
+	{
+		if constexpr (isFixedDepth()) {
+			return FIXED_DEPTH_LEVELS;
+		} else {
+			return depth_levels_;
+		}
+	}
 
 	//
 	// Checking for children
@@ -689,16 +1132,46 @@ class Octree
 	}
 
 	virtual bool read(std::string const& filename)
+	{
+		return read(filename, ufo::geometry::BoundingVolume());
+	}
+
+	virtual bool read(std::string const& filename,
+	                  ufo::geometry::BoundingVar const& bounding_volume)
+	{
+		ufo::geometry::BoundingVolume bv;
+		bv.add(bounding_volume);
+		return read(filename, bv);
+	}
+
+	/**
+	 * @brief Read the part of the file inside bounding_volume. Only the chunks
+	 * intersecting bounding_volume are read from a file written without one.
+	 */
+	virtual bool read(std::string const& filename,
+	                  ufo::geometry::BoundingVolume const& bounding_volume)
 	{
 		std::ifstream file(filename.c_str(), std::ios_base::in | std::ios_base::binary);
 		if (!file.is_open()) {
 			return false;
 		}
 		// TODO: Check is_good of finished stream, warn?
-		return read(file);
+		return read(file, bounding_volume);
 	}
 
 	virtual bool read(std::istream& s)
+	{
+		return read(s, ufo::geometry::BoundingVolume());
+	}
+
+	virtual bool read(std::istream& s, ufo::geometry::BoundingVar const& bounding_volume)
+	{
+		ufo::geometry::BoundingVolume bv;
+		bv.add(bounding_volume);
+		return read(s, bv);
+	}
+
+	virtual bool read(std::istream& s, ufo::geometry::BoundingVolume const& bounding_volume)
 	{
 		// check if first line valid:
 		std::string line;
@@ -711,66 +1184,111 @@ class Octree
 		std::string id;
 		double resolution;
 		DepthType depth_levels;
-		bool compressed;
+		Codec codec;
 		int uncompressed_data_size;
-		if (!readHeader(s, file_version, id, resolution, depth_levels, compressed,
+		if (!readHeader(s, file_version, id, resolution, depth_levels, codec,
 		                uncompressed_data_size)) {
 			return false;
 		}
 
-		if (compressed) {
-			std::stringstream uncompressed_s(std::ios_base::in | std::ios_base::out |
-			                                 std::ios_base::binary);
-			if (!decompressData(s, uncompressed_s, uncompressed_data_size)) {
-				return false;
-			}
-			return readData(uncompressed_s, resolution, depth_levels, uncompressed_data_size,
-			                compressed);
-		} else {
-			return readData(s, resolution, depth_levels, uncompressed_data_size, compressed);
-		}
+		return readData(s, bounding_volume, resolution, depth_levels, uncompressed_data_size,
+		                codec, file_version);
 	}
 
 	virtual bool readData(std::istream& s, double resolution, DepthType depth_levels,
-	                      int uncompressed_data_size = 1, bool compressed = false)
+	                      int uncompressed_data_size = 1, bool compressed = false,
+	                      std::string const& file_version = FILE_VERSION)
 	{
 		return readData(s, ufo::geometry::BoundingVolume(), resolution, depth_levels,
-		                uncompressed_data_size, compressed);
+		                uncompressed_data_size, compressed, file_version);
 	}
 
 	virtual bool readData(std::istream& s,
 	                      ufo::geometry::BoundingVar const& bounding_volume,
 	                      double resolution, DepthType depth_levels,
-	                      int uncompressed_data_size = 1, bool compressed = false)
+	                      int uncompressed_data_size = 1, bool compressed = false,
+	                      std::string const& file_version = FILE_VERSION)
 	{
 		ufo::geometry::BoundingVolume bv;
 		bv.add(bounding_volume);
-		return readData(s, bv, resolution, depth_levels, uncompressed_data_size, compressed);
+		return readData(s, bv, resolution, depth_levels, uncompressed_data_size, compressed,
+		                file_version);
+	}
+
+	virtual bool readData(std::istream& s,
+	                      ufo::geometry::BoundingVolume const& bounding_volume,
+	                      double resolution, DepthType depth_levels,
+	                      int uncompressed_data_size = 1, bool compressed = false,
+	                      std::string const& file_version = FILE_VERSION)
+	{
+		return readData(s, bounding_volume, resolution, depth_levels, uncompressed_data_size,
+		                compressed ? Codec::lz4 : Codec::none, file_version);
 	}
 
+	/**
+	 * @brief Read the data part of a file or message.
+	 *
+	 * @param uncompressed_data_size Only used by version 1.0.0 data.
+	 * @param codec The codec the data was compressed with.
+	 * @param file_version The version the data was written with.
+	 */
 	virtual bool readData(std::istream& s,
 	                      ufo::geometry::BoundingVolume const& bounding_volume,
 	                      double resolution, DepthType depth_levels,
-	                      int uncompressed_data_size = 1, bool compressed = false)
+	                      int uncompressed_data_size, Codec codec,
+	                      std::string const& file_version = FILE_VERSION)
 	{
 		if (!s.good()) {
 			// TODO: Warning
 		}
 
+		if (isFixedDepth() && getTreeDepthLevels() != depth_levels) {
+			return false;
+		}
+
 		if (getResolution() != resolution || getTreeDepthLevels() != depth_levels) {
 			clear(resolution, depth_levels);
 		}
 
-		if (compressed) {
-			std::stringstream uncompressed_s(std::ios_base::in | std::ios_base::out |
-			                                 std::ios_base::binary);
-			if (!decompressData(s, uncompressed_s, uncompressed_data_size)) {
-				return false;
-			}
-			return readNodes(uncompressed_s, bounding_volume);
+		bool success;
+		if (LEGACY_FILE_VERSION != file_version) {
+			success = readChunks(s, bounding_volume, codec);
 		} else {
-			return readNodes(s, bounding_volume);
+			// The nodes are one stream, compressed as a whole
+			Chunk chunk;
+			chunk.data.assign(std::istreambuf_iterator<char>(s),
+			                  std::istreambuf_iterator<char>());
+			std::string data;
+			if (Codec::none != codec) {
+				chunk.uncompressed_size = std::max(0, uncompressed_data_size);
+				if (!unpackChunk(chunk, codec, data)) {
+					return false;
+				}
+			} else {
+				data.swap(chunk.data);
+			}
+			std::string_view nodes(data);
+			success = readNodes(nodes, bounding_volume);
 		}
+
+		// Nodes read from file are not created through createNode
+		rebuildNodeIndex();
+		return success;
+	}
+
+	/**
+	 * @brief Read the data part of a message in place, without copying it into a stream.
+	 */
+	template <typename Byte>
+	bool readData(std::vector<Byte> const& data,
+	              ufo::geometry::BoundingVolume const& bounding_volume, double resolution,
+	              DepthType depth_levels, int uncompressed_data_size, Codec codec,
+	              std::string const& file_version = FILE_VERSION)
+	{
+		MemoryStreamBuffer buffer(data.data(), data.size());
+		std::istream s(&buffer);
+		return readData(s, bounding_volume, resolution, depth_levels, uncompressed_data_size,
+		                codec, file_version);
 	}
 
 	virtual bool write(std::string const& filename, bool compress = false,
@@ -798,6 +1316,27 @@ class Octree
 	                   bool compress = false, DepthType min_depth = 0,
 	                   int compression_acceleration_level = 1,
 	                   int compression_level = 0) const
+	{
+		auto const [codec, level] =
+		    toCodec(compress, compression_acceleration_level, compression_level);
+		return write(filename, bounding_volume, codec, min_depth, level);
+	}
+
+	virtual bool write(std::string const& filename, Codec codec, DepthType min_depth = 0,
+	                   int compression_level = 0) const
+	{
+		return write(filename, ufo::geometry::BoundingVolume(), codec, min_depth,
+		             compression_level);
+	}
+
+	/**
+	 * @brief Write the map to filename, compressed with codec.
+	 *
+	 * @param compression_level The level of codec, see compress().
+	 */
+	virtual bool write(std::string const& filename,
+	                   ufo::geometry::BoundingVolume const& bounding_volume, Codec codec,
+	                   DepthType min_depth = 0, int compression_level = 0) const
 	{
 		std::ofstream file(filename.c_str(), std::ios_base::out | std::ios_base::binary);
 
@@ -805,8 +1344,8 @@ class Octree
 			return false;
 		}
 		// TODO: check is_good of finished stream, return
-		const bool success = write(file, bounding_volume, compress, min_depth,
-		                           compression_acceleration_level, compression_level);
+		const bool success =
+		    write(file, bounding_volume, codec, min_depth, compression_level);
 		file.close();
 		return success;
 	}
@@ -836,18 +1375,23 @@ class Octree
 	                   int compression_acceleration_level = 1,
 	                   int compression_level = 0) const
 	{
-		std::stringstream data(std::ios_base::in | std::ios_base::out |
-		                       std::ios_base::binary);
-
-		int uncompressed_data_size =
-		    writeData(data, bounding_volume, compress, min_depth,
-		              compression_acceleration_level, compression_level);
+		auto const [codec, level] =
+		    toCodec(compress, compression_acceleration_level, compression_level);
+		return write(s, bounding_volume, codec, min_depth, level);
+	}
 
-		if (0 > uncompressed_data_size) {
-			return false;
-		}
+	virtual bool write(std::ostream& s, Codec codec, DepthType min_depth = 0,
+	                   int compression_level = 0) const
+	{
+		return write(s, ufo::geometry::BoundingVolume(), codec, min_depth,
+		             compression_level);
+	}
 
-		// Write header
+	virtual bool write(std::ostream& s,
+	                   ufo::geometry::BoundingVolume const& bounding_volume, Codec codec,
+	                   DepthType min_depth = 0, int compression_level = 0) const
+	{
+		// Write header, the chunks carry their own sizes so the data is streamed after it
 		s << FILE_HEADER;
 		s << "\n# (feel free to add / change comments, but leave the first line as "
 		     "it "
@@ -856,14 +1400,13 @@ class Octree
 		s << "id " << getTreeType() << std::endl;
 		s << "resolution " << getResolution() << std::endl;
 		s << "depth_levels " << getTreeDepthLevels() << std::endl;
-		s << "compressed " << compress << std::endl;
-		s << "uncompressed_data_size " << uncompressed_data_size << std::endl;
+		s << "compressed " << (Codec::none != codec) << std::endl;
+		s << "codec " << toString(codec) << std::endl;
 		s << "data" << std::endl;
 
 		// Write data
-		s << data.rdbuf();  // Is correct or do I have to change to begin first?
-
-		return s.good();
+		return 0 <= writeData(s, bounding_volume, codec, min_depth, compression_level) &&
+		       s.good();
 	}
 
 	virtual int writeData(std::ostream& s, bool compress = false, DepthType min_depth = 0,
@@ -892,30 +1435,321 @@ class Octree
 	                      int compression_acceleration_level = 1,
 	                      int compression_level = 0) const
 	{
-		const std::streampos initial_write_position = s.tellp();
-
-		if (compress) {
-			std::stringstream data(std::ios_base::in | std::ios_base::out |
-			                       std::ios_base::binary);
-			int uncompressed_data_size =
-			    writeData(data, bounding_volume, false, min_depth,
-			              compression_acceleration_level, compression_level);
-			if (0 > uncompressed_data_size ||
-			    !compressData(data, s, uncompressed_data_size, compression_acceleration_level,
-			                  compression_level)) {
-				return -1;
-			}
-			return uncompressed_data_size;
-		} else {
-			if (!writeNodes(s, bounding_volume, min_depth)) {
-				return -1;
-			}
-		}
+		auto const [codec, level] =
+		    toCodec(compress, compression_acceleration_level, compression_level);
+		return writeData(s, bounding_volume, codec, min_depth, level);
+	}
 
-		// Return size of data
-		return s.tellp() - initial_write_position;
+	virtual int writeData(std::ostream& s, Codec codec, DepthType min_depth = 0,
+	                      int compression_level = 0) const
+	{
+		return writeData(s, ufo::geometry::BoundingVolume(), codec, min_depth,
+		                 compression_level);
 	}
 
+	/**
+	 * @brief Write the data part of a file or message, in the current file version.
+	 *
+	 * @return The total uncompressed size of the chunks or -1 on failure.
+	 */
+	virtual int writeData(std::ostream& s,
+	                      ufo::geometry::BoundingVolume const& bounding_volume, Codec codec,
+	                      DepthType min_depth = 0, int compression_level = 0) const
+	{
+		return writeChunks(s, bounding_volume, codec, min_depth, compression_level);
+	}
+
+	/**
+	 * @brief Append the same data as writeData(s, ...) to data, e.g., the data of a
+	 * message, without a stream in between.
+	 */
+	template <typename Byte>
+	int writeData(std::vector<Byte>& data,
+	              ufo::geometry::BoundingVolume const& bounding_volume, Codec codec,
+	              DepthType min_depth = 0, int compression_level = 0) const
+	{
+		VectorStreamBuffer<Byte> buffer(data);
+		std::ostream s(&buffer);
+		return writeData(s, bounding_volume, codec, min_depth, compression_level);
+	}
+
+	/**
+	 * @brief The codec and level used by the functions that take whether to compress,
+	 * an LZ4 acceleration level and, if above 0, an LZ4-HC compression level.
+	 */
+	static constexpr std::pair<Codec, int> toCodec(bool compress,
+	                                               int compression_acceleration_level,
+	                                               int compression_level) noexcept
+	{
+		if (!compress) {
+			return {Codec::none, 0};
+		} else if (0 < compression_level) {
+			return {Codec::lz4_hc, compression_level};
+		}
+		return {Codec::lz4, compression_acceleration_level};
+	}
+
+	//
+	// Compression dictionary
+	//
+
+	/**
+	 * @brief Set the dictionary zstd compresses and decompresses with. Data compressed
+	 * with a dictionary can only be read by a map with the same dictionary.
+	 */
+	void setCompressionDictionary(std::string dictionary)
+	{
+		compression_dictionary_ = std::move(dictionary);
+	}
+
+	std::string const& getCompressionDictionary() const noexcept
+	{
+		return compression_dictionary_;
+	}
+
+	/**
+	 * @brief Train a zstd dictionary of at most max_size bytes on the subtree chunks of
+	 * this map. Maps with similar content then compress better with it, the gain is
+	 * largest for small chunks such as deltas and tiles.
+	 *
+	 * @return The dictionary, empty if it could not be trained.
+	 */
+	std::string trainCompressionDictionary(std::size_t max_size = 112640) const
+	{
+		DepthType const chunk_depth =
+		    std::min(chunk_depth_, static_cast<DepthType>(getTreeDepthLevels() - 1));
+		ConstChunkRoots chunk_roots;
+		std::string top;
+		if (!writeNodes(top, ufo::geometry::BoundingVolume(), 0, chunk_depth,
+		                &chunk_roots)) {
+			return std::string();
+		}
+
+		std::vector<std::string> samples(chunk_roots.size());
+		for (std::size_t i = 0; chunk_roots.size() != i; ++i) {
+			auto const& [node, code] = chunk_roots[i];
+			if (!writeSubtreeNodes(samples[i], ufo::geometry::BoundingVolume(), *node, code,
+			                       0)) {
+				return std::string();
+			}
+		}
+		return trainDictionary(samples, max_size);
+	}
+
+	//
+	// Chunks
+	//
+
+	/**
+	 * @brief Set the depth of the subtrees that are written as separate chunks. The chunks
+	 * are compressed and decompressed independently of each other and in parallel.
+	 *
+	 * @param depth The depth of the chunk roots. Has to be at least 2.
+	 */
+	void setChunkDepth(DepthType depth)
+	{
+		if (2 > depth || getTreeDepthLevels() <= depth) {
+			throw std::invalid_argument("Chunk depth has to be [2, " +
+			                            std::to_string(getTreeDepthLevels() - 1) + "]");
+		}
+		chunk_depth_ = depth;
+	}
+
+	DepthType getChunkDepth() const noexcept { return chunk_depth_; }
+
+	//
+	// Flat file
+	//
+
+	/**
+	 * @brief Write the tree in a flat layout that mapFlat() can use in place. The blocks
+	 * of children are stored as arrays in breadth first order, with the children of a
+	 * node referred to by their index in the array. Only for trees with compact inner
+	 * nodes, since they have no pointers.
+	 */
+	bool writeFlat(std::string const& filename) const
+	{
+		static_assert(COMPACT_CHILDREN, "Flat files need compact inner nodes");
+
+		std::ofstream file(filename.c_str(), std::ios_base::out | std::ios_base::binary);
+		if (!file.is_open()) {
+			return false;
+		}
+
+		FlatHeader header;
+		std::memcpy(header.magic, FLAT_FILE_MAGIC, sizeof(header.magic));
+		std::string const tree_type = getTreeType();
+		tree_type.copy(header.tree_type, sizeof(header.tree_type) - 1);
+		header.resolution = resolution_;
+		header.depth_levels = depth_levels_;
+		header.inner_slot_size = NodePool<INNER_NODE>::slotSize();
+		header.leaf_slot_size = NodePool<LEAF_NODE>::slotSize();
+		header.inner_offset = flatAlign(sizeof(FlatHeader));
+		header.num_inner_leaf_nodes = 1;
+
+		// Leaf blocks in the order they are referred to, written after the inner blocks
+		std::vector<std::uint32_t> leaf_blocks;
+		std::uint32_t next_inner = 1;
+		std::vector<std::uint32_t> level;
+		std::vector<std::uint32_t> next_level;
+		// Copy of node with the index of its children in the file
+		auto flatten = [&](INNER_NODE node, DepthType depth) {
+			if (!hasChildren(node)) {
+				node.children = 0;
+			} else if (1 == depth) {
+				leaf_blocks.push_back(node.children);
+				node.children = static_cast<std::uint32_t>(leaf_blocks.size());
+				header.num_leaf_nodes += 8;
+				header.num_inner_leaf_nodes -= 1;
+				header.num_inner_nodes += 1;
+				header.num_nodes_at_depth[0] += 8;
+			} else {
+				next_level.push_back(node.children);
+				node.children = next_inner++;
+				header.num_inner_leaf_nodes += 7;
+				header.num_inner_nodes += 1;
+				header.num_nodes_at_depth[depth - 1] += 8;
+			}
+			return node;
+		};
+
+		header.root = flatten(root_, depth_levels_);
+		header.num_nodes_at_depth[depth_levels_] = 1;
+
+		file.seekp(header.inner_offset);
+		std::array<INNER_NODE, 8> block;
+		for (DepthType depth = depth_levels_ - 1; !next_level.empty(); --depth) {
+			std::swap(level, next_level);
+			next_level.clear();
+			for (std::uint32_t index : level) {
+				std::array<INNER_NODE, 8> const& children = *inner_pools_[0].get(index);
+				for (std::size_t i = 0; 8 != i; ++i) {
+					block[i] = flatten(children[i], depth);
+				}
+				writeFlatBlock(file, block, header.inner_slot_size);
+			}
+			header.num_inner_blocks += level.size();
+		}
+
+		header.leaf_offset = flatAlign(header.inner_offset +
+		                               header.num_inner_blocks * header.inner_slot_size);
+		header.num_leaf_blocks = leaf_blocks.size();
+		file.seekp(header.leaf_offset);
+		for (std::uint32_t index : leaf_blocks) {
+			writeFlatBlock(file, *leaf_pool_.get(index), header.leaf_slot_size);
+		}
+
+		file.seekp(0);
+		file.write(reinterpret_cast<char const*>(&header), sizeof(header));
+		return file.good();
+	}
+
+	/**
+	 * @brief Map a file written by writeFlat() and use it as the tree, without reading
+	 * it. Pages are loaded from the file when first accessed and shared with other
+	 * processes mapping the same file. The tree can still be modified, the changes are
+	 * private to this tree and never written to the file.
+	 *
+	 * @return Whether the file could be mapped and is a flat file of this tree type.
+	 */
+	bool mapFlat(std::string const& filename)
+	{
+		static_assert(COMPACT_CHILDREN, "Flat files need compact inner nodes");
+
+		MappedFile mapped;
+		if (!mapped.open(filename) || sizeof(FlatHeader) > mapped.size()) {
+			return false;
+		}
+		FlatHeader header;
+		std::memcpy(&header, mapped.data(), sizeof(header));
+		if (0 != std::memcmp(header.magic, FLAT_FILE_MAGIC, sizeof(header.magic)) ||
+		    getTreeType() != std::string(header.tree_type,
+		                                 strnlen(header.tree_type, sizeof(header.tree_type))) ||
+		    NodePool<INNER_NODE>::slotSize() != header.inner_slot_size ||
+		    NodePool<LEAF_NODE>::slotSize() != header.leaf_slot_size ||
+		    header.inner_offset + header.num_inner_blocks * header.inner_slot_size >
+		        mapped.size() ||
+		    header.leaf_offset + header.num_leaf_blocks * header.leaf_slot_size >
+		        mapped.size() ||
+		    (isFixedDepth() && FIXED_DEPTH_LEVELS != header.depth_levels)) {
+			return false;
+		}
+
+		clear(header.resolution, header.depth_levels);
+
+		root_ = header.root;
+		inner_pools_[0].map(mapped.data() + header.inner_offset, header.num_inner_blocks);
+		leaf_pool_.map(mapped.data() + header.leaf_offset, header.num_leaf_blocks);
+		num_inner_nodes_ = header.num_inner_nodes;
+		num_inner_leaf_nodes_ = header.num_inner_leaf_nodes;
+		num_leaf_nodes_ = header.num_leaf_nodes;
+		num_nodes_at_depth_ = header.num_nodes_at_depth;
+		mapped_file_ = std::move(mapped);
+
+		rebuildNodeIndex();
+		return true;
+	}
+
+	bool isMapped() const noexcept { return mapped_file_.isOpen(); }
+
+	//
+	// Accessor
+	//
+
+	/**
+	 * @brief Looks up nodes starting from the path of the previous lookup, so lookups
+	 * close to each other only walk up to the ancestor they share and back down.
+	 *
+	 * @details Creating or deleting children anywhere in the tree invalidates the path and
+	 * the next lookup starts from the root. Each thread needs its own accessor.
+	 */
+	class Accessor
+	{
+	 public:
+		explicit Accessor(Octree const& tree) : tree_(&tree) {}
+
+		/**
+		 * @brief Same as Octree::getNode(code).
+		 */
+		std::pair<LEAF_NODE const*, DepthType> getNode(Code const& code)
+		{
+			DepthType const root_depth = tree_->getTreeDepthLevels();
+			if (structure_version_ != tree_->structure_version_) {
+				structure_version_ = tree_->structure_version_;
+				path_[root_depth] = &tree_->getRoot();
+				depth_ = root_depth;
+			} else if (CodeType const diff = code.getCode() ^ code_; 0 != diff) {
+				// The paths split below the node whose child index holds the highest
+				// differing bit
+				DepthType const split = (63 - __builtin_clzll(diff)) / 3 + 1;
+				depth_ = std::max(depth_, std::min(split, root_depth));
+			}
+			code_ = code.getCode();
+
+			// Descend on locals, the members would be reloaded after every store to path_
+			DepthType depth = std::max(depth_, code.getDepth());
+			LEAF_NODE const* node = path_[depth];
+			for (; code.getDepth() < depth; --depth) {
+				INNER_NODE const& inner = static_cast<INNER_NODE const&>(*node);
+				if (!hasChildren(inner)) {
+					break;
+				}
+				node = &tree_->getChild(inner, depth - 1, code.getChildIdx(depth - 1));
+				path_[depth - 1] = node;
+			}
+			depth_ = depth;
+			return std::make_pair(node, depth);
+		}
+
+	 private:
+		Octree const* tree_;
+		std::array<LEAF_NODE const*, MAX_DEPTH_LEVELS + 1> path_;
+		// Code of the previous lookup and the depth of the node it ended at
+		CodeType code_ = 0;
+		DepthType depth_ = 0;
+		std::uint64_t structure_version_ = std::numeric_limits<std::uint64_t>::max();
+	};
+
  protected:
 	//
 	// Constructors
@@ -933,6 +1767,12 @@ class Octree
 			                            std::to_string(getMinDepthLevels()) + ", " +
 			                            std::to_string(getMaxDepthLevels()) + "]");
 		}
+		if (isFixedDepth() && FIXED_DEPTH_LEVELS != depth_levels) {
+			throw std::invalid_argument("depth_levels is fixed to " +
+			                            std::to_string(FIXED_DEPTH_LEVELS));
+		}
+
+		num_nodes_at_depth_[depth_levels_] = 1;
 
 		// Precompute sizes
 		nodes_half_sizes_[0] = resolution_ / 2.0;
@@ -942,6 +1782,19 @@ class Octree
 		}
 	}
 
+	//
+	// Max value
+	//
+
+	KeyType getMaxValue() const noexcept
+	{
+		if constexpr (isFixedDepth()) {
+			return KeyType(1) << (FIXED_DEPTH_LEVELS - 1);
+		} else {
+			return max_value_;
+		}
+	}
+
 	//
 	// Get root
 	//
@@ -974,12 +1827,21 @@ class Octree
 	std::pair<LEAF_NODE const*, DepthType> getNode(Code const& code) const
 	{
 		LEAF_NODE const* node = &getRoot();
-		for (DepthType depth = getTreeDepthLevels() - 1; depth > code.getDepth(); --depth) {
+		DepthType depth = getTreeDepthLevels();
+		if (node_index_enabled_ && node_index_depth_ >= code.getDepth()) {
+			auto it = node_index_.find(code.toDepth(node_index_depth_));
+			if (node_index_.end() != it) {
+				node = it->second;
+				depth = node_index_depth_;
+			}
+		}
+		for (; depth > code.getDepth(); --depth) {
 			INNER_NODE const& inner_node = static_cast<INNER_NODE const&>(*node);
 			if (!hasChildren(inner_node)) {
-				return std::make_pair(node, depth + 1);
+				return std::make_pair(node, depth);
 			}
-			node = &getChild(inner_node, depth, code.getChildIdx(depth));
+			DepthType child_depth = depth - 1;
+			node = &getChild(inner_node, child_depth, code.getChildIdx(child_depth));
 		}
 		return std::make_pair(node, code.getDepth());
 	}
@@ -1003,6 +1865,34 @@ class Octree
 	}
 
 	void createNode(Code const& code, Path& path, DepthType depth)
+	{
+		bool index = node_index_enabled_ && node_index_depth_ < depth &&
+		             node_index_depth_ >= code.getDepth();
+		if (!automatic_pruning_enabled_) {
+			// Children kept below nodes that become leaves can be freed by pruneIncremental
+			DepthType prune_depth = std::max(incremental_prune_depth_, code.getDepth());
+			if (prune_depth < depth) {
+				prune_pending_.insert(code.toDepth(prune_depth));
+			}
+		}
+		if (!evicted_tiles_.empty() && tile_depth_ <= depth &&
+		    tile_depth_ >= code.getDepth()) {
+			// The tile has to be read back before anything in it is created
+			Code tile_code = code.toDepth(tile_depth_);
+			createPath(tile_code, path, depth);
+			if (auto it = evicted_tiles_.find(tile_code); evicted_tiles_.end() != it) {
+				evicted_tiles_.erase(it);
+				restoreTile(static_cast<INNER_NODE&>(*path[tile_depth_]), tile_code);
+			}
+			depth = tile_depth_;
+		}
+		createPath(code, path, depth);
+		if (index) {
+			node_index_.try_emplace(code.toDepth(node_index_depth_), path[node_index_depth_]);
+		}
+	}
+
+	void createPath(Code const& code, Path& path, DepthType depth)
 	{
 		for (; depth > code.getDepth(); --depth) {
 			INNER_NODE& node = static_cast<INNER_NODE&>(*path[depth]);
@@ -1019,6 +1909,16 @@ class Octree
 	// Create / delete children
 	//
 
+	/**
+	 * @return A lock that serializes node allocation, does not lock unless subtrees are
+	 * being built in parallel.
+	 */
+	std::unique_lock<std::mutex> allocationLock()
+	{
+		return concurrent_allocation_ ? std::unique_lock(allocation_mutex_)
+		                              : std::unique_lock<std::mutex>();
+	}
+
 	bool createChildren(INNER_NODE& node, DepthType depth)
 	{
 		if (!node.is_leaf) {
@@ -1027,18 +1927,41 @@ class Octree
 
 		if (!node.children) {
 			// Allocate children
-			if (1 == depth) {
+			auto lock = allocationLock();
+			if (0 != brick_depth_ && brick_depth_ == depth) {
+				if constexpr (!COMPACT_CHILDREN) {
+					if (3 == depth) {
+						allocateBrick<3>(node);
+					} else {
+						allocateBrick<2>(node);
+					}
+				}
+			} else if (1 == depth) {
 				// Children are leaf nodes
-				node.children = new std::array<LEAF_NODE, 8>();
+				if constexpr (COMPACT_CHILDREN) {
+					node.children = leaf_pool_.allocateIndex();
+				} else {
+					node.children = pool_allocation_enabled_ ? leaf_pool_.allocate()
+					                                         : new std::array<LEAF_NODE, 8>();
+				}
 				num_leaf_nodes_ += 8;
 				num_inner_leaf_nodes_ -= 1;
+				num_inner_nodes_ += 1;
+				num_nodes_at_depth_[0] += 8;
 			} else {
 				// Children are inner nodes
 				// Get 8 new and 1 is made into a inner node
-				node.children = new std::array<INNER_NODE, 8>();
+				if constexpr (COMPACT_CHILDREN) {
+					node.children = inner_pools_[0].allocateIndex();
+				} else {
+					node.children = pool_allocation_enabled_
+					                    ? inner_pools_[depth - 1].allocate()
+					                    : new std::array<INNER_NODE, 8>();
+				}
 				num_inner_leaf_nodes_ += 7;
+				num_inner_nodes_ += 1;
+				num_nodes_at_depth_[depth - 1] += 8;
 			}
-			num_inner_nodes_ += 1;
 		}
 
 		if (1 == depth) {
@@ -1054,64 +1977,387 @@ class Octree
 		}
 
 		node.is_leaf = false;
+		if (!concurrent_allocation_) {
+			++structure_version_;
+		}
+		metrics_.add(IntegrationCounter::nodes_created, 8);
 		return true;
 	}
 
 	void deleteChildren(INNER_NODE& node, DepthType depth, bool manual_pruning = false)
 	{
+		auto lock = allocationLock();
+		if (!concurrent_allocation_ && !node.is_leaf) {
+			++structure_version_;
+		}
+		deleteChildrenRecurs(node, depth, manual_pruning);
+	}
+
+	void deleteChildrenRecurs(INNER_NODE& node, DepthType depth, bool manual_pruning)
+	{
+		if (!node.is_leaf && node_index_depth_ < depth && !node_index_.empty()) {
+			// Indexed nodes below this node are no longer part of the tree
+			node_index_.clear();
+		}
+
+		if (!node.is_leaf) {
+			metrics_.add(IntegrationCounter::nodes_pruned, 8);
+		}
 		node.is_leaf = true;
 
-		if (!node.children || (!manual_pruning && !automatic_pruning_enabled_)) {
+		if (!node.children || (!manual_pruning && !automatic_pruning_enabled_) ||
+		    isInBrick(depth)) {
 			return;
 		}
 
+		if constexpr (!COMPACT_CHILDREN) {
+			if (0 != brick_depth_ && brick_depth_ == depth) {
+				if (3 == depth) {
+					deallocateBrick<3>(node);
+				} else {
+					deallocateBrick<2>(node);
+				}
+				node.children = {};
+				return;
+			}
+		}
+
 		if (1 == depth) {
 			// Deleting leaf nodes
-			delete &getLeafChildren(node);
+			if constexpr (COMPACT_CHILDREN) {
+				leaf_pool_.deallocateIndex(node.children);
+			} else if (pool_allocation_enabled_) {
+				leaf_pool_.deallocate(&getLeafChildren(node));
+			} else {
+				delete &getLeafChildren(node);
+			}
 			num_leaf_nodes_ -= 8;
 			num_inner_leaf_nodes_ += 1;
+			num_nodes_at_depth_[0] -= 8;
 		} else {
 			// Deleting inner nodes
 			std::array<INNER_NODE, 8>& children = getInnerChildren(node);
 			for (INNER_NODE& child : children) {
 				// Manual pruning is true in case automatic_pruning_enabled_ changes between calls
-				deleteChildren(child, depth - 1, true);
+				deleteChildrenRecurs(child, depth - 1, true);
+			}
+			if constexpr (COMPACT_CHILDREN) {
+				inner_pools_[0].deallocateIndex(node.children);
+			} else if (pool_allocation_enabled_) {
+				inner_pools_[depth - 1].deallocate(&children);
+			} else {
+				delete &children;
 			}
-			delete &children;
 			// Remove 8 and 1 inner node is made into a inner leaf node
 			num_inner_leaf_nodes_ -= 7;
+			num_nodes_at_depth_[depth - 1] -= 8;
 		}
 		num_inner_nodes_ -= 1;
-		node.children = nullptr;
+		node.children = {};
+	}
+
+	//
+	// Flat file
+	//
+
+	static constexpr char FLAT_FILE_MAGIC[16] = "UFOMap flat 1.0";
+
+	// Followed by the inner blocks at inner_offset and the leaf blocks at leaf_offset
+	struct FlatHeader {
+		char magic[16];
+		char tree_type[64] = {};
+		double resolution = 0;
+		std::uint64_t depth_levels = 0;
+		std::uint64_t inner_slot_size = 0;
+		std::uint64_t leaf_slot_size = 0;
+		std::uint64_t inner_offset = 0;
+		std::uint64_t num_inner_blocks = 0;
+		std::uint64_t leaf_offset = 0;
+		std::uint64_t num_leaf_blocks = 0;
+		std::uint64_t num_inner_nodes = 0;
+		std::uint64_t num_inner_leaf_nodes = 0;
+		std::uint64_t num_leaf_nodes = 0;
+		std::array<std::size_t, MAX_DEPTH_LEVELS + 1> num_nodes_at_depth{};
+		INNER_NODE root;
+	};
+
+	// Blocks start at a cache line
+	static constexpr std::uint64_t flatAlign(std::uint64_t offset) noexcept
+	{
+		return (offset + 63) & ~std::uint64_t(63);
+	}
+
+	template <typename Block>
+	static void writeFlatBlock(std::ostream& s, Block const& block, std::size_t slot_size)
+	{
+		static constexpr std::array<char, 64> padding{};
+		s.write(reinterpret_cast<char const*>(&block), sizeof(block));
+		s.write(padding.data(), slot_size - sizeof(block));
+	}
+
+	//
+	// Prune
+	//
+
+	bool pruneRecurs(INNER_NODE& node, DepthType depth)
+	{
+		if (isLeaf(node)) {
+			if (!node.children || isInBrick(depth)) {
+				return false;
+			}
+			deleteChildren(node, depth, true);
+			return true;
+		}
+		if (1 == depth) {
+			return false;
+		}
+		bool pruned = false;
+		for (INNER_NODE& child : getInnerChildren(node)) {
+			pruned = pruneRecurs(child, depth - 1) || pruned;
+		}
+		return pruned;
+	}
+
+	//
+	// Copy
+	//
+
+	/**
+	 * @brief Replace the nodes of this tree with copies of the nodes of other, which has
+	 * to have the same resolution and depth levels. The child blocks are copied directly
+	 * and allocated the way this tree allocates them. Nodes that do not intersect
+	 * bounding_volume are copied without their children, so they keep their summary.
+	 */
+	void copyNodes(Octree const& other, ufo::geometry::BoundingVolume const& bounding_volume)
+	{
+		deleteChildren(getRoot(), getTreeDepthLevels(), true);
+		copyNode(getRoot(), other.getRoot());
+		copyNodesRecurs(other, bounding_volume, getRoot(), other.getRoot(), getRootCode());
+		rebuildNodeIndex();
+	}
+
+	// Copy the value and indicators of other_node, but not the children
+	static void copyNode(INNER_NODE& node, INNER_NODE const& other_node)
+	{
+		decltype(node.children) children = node.children;
+		node = other_node;
+		node.children = children;
+		node.is_leaf = true;
+	}
+
+	void copyNodesRecurs(Octree const& other,
+	                     ufo::geometry::BoundingVolume const& bounding_volume,
+	                     INNER_NODE& node, INNER_NODE const& other_node, Code const& code)
+	{
+		DepthType const depth = code.getDepth();
+		if (!hasChildren(other_node) ||
+		    (!bounding_volume.empty() &&
+		     !bounding_volume.intersects(
+		         ufo::geometry::AABB(toCoord(code), getNodeHalfSize(depth))))) {
+			return;
+		}
+
+		createChildren(node, depth);
+
+		if (1 == depth) {
+			getLeafChildren(node) = other.getLeafChildren(other_node);
+			return;
+		}
+
+		for (unsigned int i = 0; 8 != i; ++i) {
+			INNER_NODE& child = getInnerChild(node, i);
+			INNER_NODE const& other_child = other.getInnerChild(other_node, i);
+			copyNode(child, other_child);
+			copyNodesRecurs(other, bounding_volume, child, other_child, code.getChild(i));
+		}
+	}
+
+	//
+	// Node index
+	//
+
+	void rebuildNodeIndexRecurs(INNER_NODE const& node, Code const& code)
+	{
+		DepthType child_depth = code.getDepth() - 1;
+		if (isLeaf(node)) {
+			return;
+		}
+		for (unsigned int i = 0; 8 != i; ++i) {
+			if (node_index_depth_ == child_depth) {
+				node_index_.emplace(code.getChild(i), &getChild(node, child_depth, i));
+			} else {
+				rebuildNodeIndexRecurs(getInnerChild(node, i), code.getChild(i));
+			}
+		}
+	}
+
+	//
+	// Sliding window
+	//
+
+	void evictOutsideRecurs(ufo::geometry::BoundingVolume const& window, INNER_NODE& node,
+	                        Code const& code)
+	{
+		if (!hasChildren(node)) {
+			return;
+		}
+		if (tile_depth_ == code.getDepth()) {
+			if (!window.intersects(
+			        ufo::geometry::AABB(toCoord(code), getNodeHalfSize(tile_depth_)))) {
+				evictTile(node, code);
+			}
+			return;
+		}
+		for (unsigned int i = 0; 8 != i; ++i) {
+			evictOutsideRecurs(window, getInnerChild(node, i), code.getChild(i));
+		}
+	}
+
+	std::string getTilePath(Code const& code) const
+	{
+		return (std::filesystem::path(tile_directory_) /
+		        (std::to_string(code.getCode()) + ".tile"))
+		    .string();
+	}
+
+	// A tile file is a single LZ4 compressed chunk with the nodes below the tile root
+	void evictTile(INNER_NODE& node, Code const& code)
+	{
+		std::string data;
+		Chunk chunk;
+		if (!writeSubtreeNodes(data, ufo::geometry::BoundingVolume(), node, code, 0) ||
+		    !packChunk(code, std::move(data), Codec::lz4, 1, chunk)) {
+			throw std::runtime_error("Could not write tile " + getTilePath(code));
+		}
+
+		std::ofstream file(getTilePath(code), std::ios_base::out | std::ios_base::binary);
+		writeChunk(file, chunk);
+		if (!file.good()) {
+			throw std::runtime_error("Could not write tile " + getTilePath(code));
+		}
+
+		deleteChildren(node, tile_depth_, true);
+		evicted_tiles_.insert(code);
+	}
+
+	void restoreTile(INNER_NODE& node, Code const& code)
+	{
+		std::string const filename = getTilePath(code);
+		std::ifstream file(filename, std::ios_base::in | std::ios_base::binary);
+		Chunk chunk;
+		std::string data;
+		if (!readChunk(file, chunk) || code != chunk.code ||
+		    !unpackChunk(chunk, Codec::lz4, data)) {
+			throw std::runtime_error("Could not read tile " + filename);
+		}
+		file.close();
+
+		deleteChildren(node, tile_depth_, true);
+		std::string_view nodes(data);
+		if (!readSubtreeNodes(nodes, ufo::geometry::BoundingVolume(), true, node, code)) {
+			throw std::runtime_error("Could not read tile " + filename);
+		}
+		std::filesystem::remove(filename);
+	}
+
+	//
+	// Bricks
+	//
+
+	// The nodes below the brick root in breadth first order, each block of eight siblings
+	// in Morton order. Since the inner levels come first the brick has the same address as
+	// the children of the brick root.
+	template <DepthType LEVELS>
+	struct Brick {
+		static constexpr std::size_t NUM_LEAF_BLOCKS = std::size_t(1) << (3 * (LEVELS - 1));
+		static constexpr std::size_t NUM_INNER_BLOCKS = (NUM_LEAF_BLOCKS - 1) / 7;
+
+		std::array<std::array<INNER_NODE, 8>, NUM_INNER_BLOCKS> inner;
+		std::array<std::array<LEAF_NODE, 8>, NUM_LEAF_BLOCKS> leaves;
+	};
+
+	bool isInBrick(DepthType depth) const noexcept
+	{
+		return depth < brick_depth_ && brick_depth_ <= depth_levels_;
+	}
+
+	template <DepthType LEVELS>
+	void allocateBrick(INNER_NODE& node)
+	{
+		using BrickType = Brick<LEVELS>;
+		BrickType* brick = new BrickType();
+
+		// Link the inner nodes of one level to the blocks of the next
+		std::size_t next = 1;
+		std::size_t next_leaf = 0;
+		for (std::size_t b = 0; BrickType::NUM_INNER_BLOCKS != b; ++b) {
+			for (INNER_NODE& child : brick->inner[b]) {
+				if (BrickType::NUM_INNER_BLOCKS != next) {
+					child.children = &brick->inner[next++];
+				} else {
+					child.children = &brick->leaves[next_leaf++];
+				}
+			}
+		}
+
+		node.children = &brick->inner[0];
+		num_inner_nodes_ += 1 + (8 * BrickType::NUM_INNER_BLOCKS);
+		num_inner_leaf_nodes_ -= 1;
+		num_leaf_nodes_ += 8 * BrickType::NUM_LEAF_BLOCKS;
+		for (DepthType depth = 0, num = 8 * BrickType::NUM_LEAF_BLOCKS; LEVELS != depth;
+		     ++depth, num /= 8) {
+			num_nodes_at_depth_[depth] += num;
+		}
+	}
+
+	template <DepthType LEVELS>
+	void deallocateBrick(INNER_NODE& node)
+	{
+		using BrickType = Brick<LEVELS>;
+		delete reinterpret_cast<BrickType*>(node.children);
+		num_inner_nodes_ -= 1 + (8 * BrickType::NUM_INNER_BLOCKS);
+		num_inner_leaf_nodes_ += 1;
+		num_leaf_nodes_ -= 8 * BrickType::NUM_LEAF_BLOCKS;
+		for (DepthType depth = 0, num = 8 * BrickType::NUM_LEAF_BLOCKS; LEVELS != depth;
+		     ++depth, num /= 8) {
+			num_nodes_at_depth_[depth] -= num;
+		}
 	}
 
 	//
 	// Get children
 	//
 
-	static constexpr std::array<LEAF_NODE, 8>& getLeafChildren(INNER_NODE const& inner_node)
+	std::array<LEAF_NODE, 8>& getLeafChildren(INNER_NODE const& inner_node) const
 	{
-		return *static_cast<std::array<LEAF_NODE, 8>*>(inner_node.children);
+		if constexpr (COMPACT_CHILDREN) {
+			return *leaf_pool_.get(inner_node.children);
+		} else {
+			return *static_cast<std::array<LEAF_NODE, 8>*>(inner_node.children);
+		}
 	}
 
-	static constexpr std::array<INNER_NODE, 8>& getInnerChildren(
-	    INNER_NODE const& inner_node)
+	std::array<INNER_NODE, 8>& getInnerChildren(INNER_NODE const& inner_node) const
 	{
-		return *static_cast<std::array<INNER_NODE, 8>*>(inner_node.children);
+		if constexpr (COMPACT_CHILDREN) {
+			return *inner_pools_[0].get(inner_node.children);
+		} else {
+			return *static_cast<std::array<INNER_NODE, 8>*>(inner_node.children);
+		}
 	}
 
-	static LEAF_NODE& getLeafChild(INNER_NODE const& inner_node, unsigned int idx)
+	LEAF_NODE& getLeafChild(INNER_NODE const& inner_node, unsigned int idx) const
 	{
 		return getLeafChildren(inner_node)[idx];
 	}
 
-	static INNER_NODE& getInnerChild(INNER_NODE const& inner_node, unsigned int idx)
+	INNER_NODE& getInnerChild(INNER_NODE const& inner_node, unsigned int idx) const
 	{
 		return getInnerChildren(inner_node)[idx];
 	}
 
-	static LEAF_NODE& getChild(INNER_NODE const& inner_node, DepthType child_depth,
-	                           unsigned int idx)
+	LEAF_NODE& getChild(INNER_NODE const& inner_node, DepthType child_depth,
+	                    unsigned int idx) const
 	{
 		if (0 == child_depth) {
 			return getLeafChild(inner_node, idx);
@@ -1336,16 +2582,20 @@ class Octree
 	//
 
 	virtual bool readHeader(std::istream& s, std::string& file_version, std::string& id,
-	                        double& resolution, DepthType& depth_levels, bool& compressed,
+	                        double& resolution, DepthType& depth_levels, Codec& codec,
 	                        int& uncompressed_data_size) const
 	{
 		file_version = "";
 		id = "";
 		resolution = 0.0;
 		depth_levels = 0;
-		compressed = false;
+		codec = Codec::none;
 		uncompressed_data_size = -1;
 
+		// Files from before codecs were added only say whether they are LZ4 compressed
+		bool compressed = false;
+		std::string codec_name(toString(Codec::lz4));
+
 		std::string token;
 		bool header_read = false;
 		while (s.good() && !header_read) {
@@ -1373,6 +2623,8 @@ class Octree
 				s >> depth_levels;
 			} else if ("compressed" == token) {
 				s >> compressed;
+			} else if ("codec" == token) {
+				s >> codec_name;
 			} else if ("uncompressed_data_size" == token) {
 				s >> uncompressed_data_size;
 			} else {
@@ -1404,10 +2656,19 @@ class Octree
 			return false;
 		}
 
-		if (0 > uncompressed_data_size) {
+		if (LEGACY_FILE_VERSION == file_version && 0 > uncompressed_data_size) {
 			return false;
 		}
 
+		if (compressed) {
+			std::optional<Codec> const named = codecFromString(codec_name);
+			if (!named || !isCodecAvailable(*named)) {
+				// Unknown codec or not in this build
+				return false;
+			}
+			codec = *named;
+		}
+
 		if (getTreeType() != id) {
 			// Wrong tree type
 			return false;
@@ -1416,73 +2677,357 @@ class Octree
 		return true;
 	}
 
-	virtual bool readNodes(std::istream& s,
-	                       ufo::geometry::BoundingVolume const& bounding_volume) = 0;
+	// Read/write the nodes from the root. If chunk_roots is set the subtrees of the nodes
+	// at chunk_depth are not read/written, their roots are added to chunk_roots instead.
+	// Reading consumes the read bytes from the front of data, writing appends to data.
+	// If complete is set the data holds all nodes, written without a bounding volume, so
+	// the nodes outside bounding_volume are skipped instead of being absent.
+	virtual bool readNodes(std::string_view& data,
+	                       ufo::geometry::BoundingVolume const& bounding_volume,
+	                       bool complete = false, DepthType chunk_depth = 0,
+	                       ChunkRoots* chunk_roots = nullptr) = 0;
 
-	virtual bool writeNodes(std::ostream& s,
+	virtual bool writeNodes(std::string& data,
 	                        ufo::geometry::BoundingVolume const& bounding_volume,
-	                        DepthType min_depth) const = 0;
+	                        DepthType min_depth, DepthType chunk_depth = 0,
+	                        ConstChunkRoots* chunk_roots = nullptr) const = 0;
+
+	// Read/write the nodes below node, the root of the subtree with code
+	virtual bool readSubtreeNodes(std::string_view& data,
+	                              ufo::geometry::BoundingVolume const& bounding_volume,
+	                              bool complete, INNER_NODE& node, Code const& code) = 0;
+
+	virtual bool writeSubtreeNodes(std::string& data,
+	                               ufo::geometry::BoundingVolume const& bounding_volume,
+	                               INNER_NODE const& node, Code const& code,
+	                               DepthType min_depth) const = 0;
+
+	// Update the indicators of an inner node from its children
+	virtual bool updateNode(INNER_NODE& node, DepthType depth) = 0;
+
+	//
+	// Chunks
+	//
+
+	// The data is the chunk depth, the flags, the number of chunks, the chunks, the index
+	// chunk, and the offset of the index chunk. A chunk is the code of its root, its
+	// uncompressed size, its stored size, and the stored nodes. The first chunk holds the
+	// nodes above the chunk depth, each of the others the subtree of a chunk root. The index
+	// holds the code and offset of each subtree chunk. Offsets are from the start of the
+	// data.
+	struct Chunk {
+		Code code;
+		std::uint32_t uncompressed_size = 0;
+		std::string data;
+	};
+
+	// Set if the data was written without a bounding volume, so a bounding volume read has
+	// to skip the nodes outside of it
+	static constexpr std::uint8_t CHUNKS_COMPLETE = 0x01;
+
+	// Size of the chunk depth, the flags, and the number of chunks
+	static constexpr std::uint64_t CHUNKS_PREFIX_SIZE =
+	    sizeof(std::uint8_t) + sizeof(std::uint8_t) + sizeof(std::uint32_t);
+
+	// Size of a chunk entry in the index, its code, depth and offset
+	static constexpr std::size_t CHUNK_INDEX_ENTRY_SIZE =
+	    sizeof(CodeType) + sizeof(std::uint8_t) + sizeof(std::uint64_t);
+
+	int writeChunks(std::ostream& s, ufo::geometry::BoundingVolume const& bounding_volume,
+	                Codec codec, DepthType min_depth, int compression_level) const
+	{
+		DepthType const chunk_depth =
+		    std::min(chunk_depth_, static_cast<DepthType>(getTreeDepthLevels() - 1));
+
+		ConstChunkRoots chunk_roots;
+		std::vector<Chunk> chunks(1);
+		std::string top;
+		if (!writeNodes(top, bounding_volume, min_depth, chunk_depth, &chunk_roots) ||
+		    !packChunk(getRootCode(), std::move(top), codec, compression_level, chunks[0])) {
+			return -1;
+		}
+
+		std::uint8_t const depth = chunk_depth;
+		std::uint8_t const flags = bounding_volume.empty() ? CHUNKS_COMPLETE : 0;
+		std::uint32_t const num_chunks = 1 + chunk_roots.size();
+		s.write(reinterpret_cast<char const*>(&depth), sizeof(depth));
+		s.write(reinterpret_cast<char const*>(&flags), sizeof(flags));
+		s.write(reinterpret_cast<char const*>(&num_chunks), sizeof(num_chunks));
+
+		std::string index;
+		index.reserve(chunk_roots.size() * CHUNK_INDEX_ENTRY_SIZE);
+		std::uint64_t offset = CHUNKS_PREFIX_SIZE;
+		std::int64_t total_size = 0;
+		for (std::size_t first = 0;; first += CHUNK_BATCH_SIZE) {
+			for (Chunk const& chunk : chunks) {
+				if (0 != first) {
+					appendChunkIndexEntry(index, chunk.code, offset);
+				}
+				offset += writeChunk(s, chunk);
+				total_size += chunk.uncompressed_size;
+			}
+			if (first >= chunk_roots.size()) {
+				break;
+			}
 
-	//
-	// Compress/decompress
-	//
+			// Serialize and compress a batch of subtrees in parallel
+			chunks.resize(std::min(CHUNK_BATCH_SIZE, chunk_roots.size() - first));
+			std::atomic_bool success = true;
+			std::for_each(std::execution::par, chunks.begin(), chunks.end(),
+			              [&](Chunk& chunk) {
+				              std::size_t const index = first + (&chunk - &chunks[0]);
+				              auto const& [node, code] = chunk_roots[index];
+				              std::string data;
+				              if (!writeSubtreeNodes(data, bounding_volume, *node, code,
+				                                     min_depth) ||
+				                  !packChunk(code, std::move(data), codec, compression_level,
+				                             chunk)) {
+					              success = false;
+				              }
+			              });
+			if (!success) {
+				return -1;
+			}
+		}
 
-	bool compressData(std::istream& s_in, std::ostream& s_out, int uncompressed_data_size,
-	                  int acceleration_level = 1, int compression_level = 0) const
+		Chunk index_chunk;
+		if (!packChunk(getRootCode(), std::move(index), codec, compression_level,
+		               index_chunk)) {
+			return -1;
+		}
+		writeChunk(s, index_chunk);
+		s.write(reinterpret_cast<char const*>(&offset), sizeof(offset));
+
+		if (!s.good() || std::numeric_limits<int>::max() < total_size) {
+			return -1;
+		}
+		return total_size;
+	}
+
+	bool readChunks(std::istream& s, ufo::geometry::BoundingVolume const& bounding_volume,
+	                Codec codec)
 	{
-		// Compress data
-		char* data = new char[uncompressed_data_size];
-		s_in.read(data, uncompressed_data_size);
-		const int max_dst_size = LZ4_compressBound(uncompressed_data_size);
-		char* compressed_data = new char[max_dst_size];
-		int compressed_data_size;
-		if (0 >= compression_level) {
-			compressed_data_size =
-			    LZ4_compress_fast(data, compressed_data, uncompressed_data_size, max_dst_size,
-			                      acceleration_level);
+		std::streampos const data_start = s.tellg();
+
+		std::uint8_t chunk_depth;
+		std::uint8_t flags;
+		std::uint32_t num_chunks;
+		s.read(reinterpret_cast<char*>(&chunk_depth), sizeof(chunk_depth));
+		s.read(reinterpret_cast<char*>(&flags), sizeof(flags));
+		s.read(reinterpret_cast<char*>(&num_chunks), sizeof(num_chunks));
+		if (!s.good() || 0 == num_chunks || 2 > chunk_depth ||
+		    getTreeDepthLevels() <= chunk_depth) {
+			return false;
+		}
+		bool const complete = flags & CHUNKS_COMPLETE;
+
+		std::vector<Chunk> chunks(1);
+		std::vector<std::string> data(1);
+		if (!readChunk(s, chunks[0]) || !unpackChunk(chunks[0], codec, data[0])) {
+			return false;
+		}
+
+		ChunkRoots chunk_roots;
+		std::string_view top(data[0]);
+		if (!readNodes(top, bounding_volume, complete, chunk_depth, &chunk_roots)) {
+			return false;
+		}
+		chunks.clear();
+
+		// Chunks that do not intersect the bounding volume were not requested by the top
+		std::unordered_map<Code, INNER_NODE*, Code::Hash> requested;
+		for (auto const& [node, code] : chunk_roots) {
+			requested.emplace(code, node);
+		}
+
+		// Decompress and build the subtrees of a batch in parallel. The chunk roots are
+		// disjoint, so only the node allocation is shared between the tasks. Compact
+		// children are looked up in the pools, which move when they grow, so those trees
+		// are built in order.
+		auto read_batch = [&]() {
+			data.resize(chunks.size());
+			std::atomic_bool success = true;
+			auto read_chunk = [&](Chunk const& chunk) {
+				std::string& chunk_data = data[&chunk - &chunks[0]];
+				std::string_view subtree;
+				if (unpackChunk(chunk, codec, chunk_data)) {
+					subtree = chunk_data;
+				} else {
+					success = false;
+				}
+				if (success && !readSubtreeNodes(subtree, bounding_volume, complete,
+				                                 *requested.at(chunk.code), chunk.code)) {
+					success = false;
+				}
+			};
+			if constexpr (COMPACT_CHILDREN) {
+				std::for_each(chunks.begin(), chunks.end(), read_chunk);
+			} else {
+				concurrent_allocation_ = true;
+				std::for_each(std::execution::par, chunks.begin(), chunks.end(), read_chunk);
+				concurrent_allocation_ = false;
+				++structure_version_;
+			}
+			chunks.clear();
+			return success.load();
+		};
+
+		std::unordered_map<Code, std::uint64_t, Code::Hash> index;
+		if (!bounding_volume.empty() && std::streampos(-1) != data_start &&
+		    readChunkIndex(s, data_start, codec, index)) {
+			// Seek to the requested chunks only
+			for (auto const& [node, code] : chunk_roots) {
+				auto it = index.find(code);
+				if (index.end() == it) {
+					continue;  // Not written
+				}
+				s.seekg(data_start + static_cast<std::streamoff>(it->second));
+				if (!readChunk(s, chunks.emplace_back()) || code != chunks.back().code) {
+					return false;
+				}
+				if (CHUNK_BATCH_SIZE == chunks.size() && !read_batch()) {
+					return false;
+				}
+			}
+			if (!read_batch()) {
+				return false;
+			}
+			s.seekg(0, std::ios_base::end);
 		} else {
-			compressed_data_size = LZ4_compress_HC(
-			    data, compressed_data, uncompressed_data_size, max_dst_size, compression_level);
+			for (std::uint32_t i = 1; num_chunks != i; ++i) {
+				if (!readChunk(s, chunks.emplace_back())) {
+					return false;
+				}
+				if (0 == requested.count(chunks.back().code)) {
+					chunks.pop_back();
+				} else if (CHUNK_BATCH_SIZE == chunks.size() && !read_batch()) {
+					return false;
+				}
+			}
+			if (!read_batch()) {
+				return false;
+			}
+
+			// Skip the index
+			Chunk index_chunk;
+			std::uint64_t index_offset;
+			if (!readChunk(s, index_chunk) ||
+			    !s.read(reinterpret_cast<char*>(&index_offset), sizeof(index_offset))) {
+				return false;
+			}
 		}
 
-		// Check if compression successful
-		if (0 <= compressed_data_size) {
-			// Write compressed data to output stream
-			s_out.write(compressed_data, compressed_data_size);
+		// The nodes above the chunk roots were updated before the chunks were read
+		updateAboveChunksRecurs(getRoot(), getTreeDepthLevels(), chunk_depth);
+		return true;
+	}
+
+	static void appendChunkIndexEntry(std::string& index, Code const& code,
+	                                  std::uint64_t offset)
+	{
+		CodeType const code_value = code.getCode();
+		std::uint8_t const depth = code.getDepth();
+		index.append(reinterpret_cast<char const*>(&code_value), sizeof(code_value));
+		index.append(reinterpret_cast<char const*>(&depth), sizeof(depth));
+		index.append(reinterpret_cast<char const*>(&offset), sizeof(offset));
+	}
+
+	// Read the index from the end of a seekable stream. The stream is left where it was if
+	// the index could not be read.
+	bool readChunkIndex(std::istream& s, std::streampos data_start, Codec codec,
+	                    std::unordered_map<Code, std::uint64_t, Code::Hash>& index) const
+	{
+		std::streampos const position = s.tellg();
+		std::uint64_t index_offset;
+		Chunk index_chunk;
+		std::string data;
+		if (!s.seekg(-static_cast<std::streamoff>(sizeof(index_offset)), std::ios_base::end) ||
+		    !s.read(reinterpret_cast<char*>(&index_offset), sizeof(index_offset)) ||
+		    !s.seekg(data_start + static_cast<std::streamoff>(index_offset)) ||
+		    !readChunk(s, index_chunk) || !unpackChunk(index_chunk, codec, data) ||
+		    0 != data.size() % CHUNK_INDEX_ENTRY_SIZE) {
+			s.clear();
+			s.seekg(position);
+			return false;
 		}
 
-		// Clean up
-		delete[] data;
-		delete[] compressed_data;
-		return 0 <= compressed_data_size;
+		for (std::size_t i = 0; data.size() != i; i += CHUNK_INDEX_ENTRY_SIZE) {
+			CodeType code;
+			std::uint8_t depth;
+			std::uint64_t offset;
+			std::memcpy(&code, &data[i], sizeof(code));
+			std::memcpy(&depth, &data[i + sizeof(code)], sizeof(depth));
+			std::memcpy(&offset, &data[i + sizeof(code) + sizeof(depth)], sizeof(offset));
+			index.emplace(Code(code, depth), offset);
+		}
+		return true;
 	}
 
-	bool decompressData(std::istream& s_in, std::iostream& s_out,
-	                    int uncompressed_data_size) const
+	void updateAboveChunksRecurs(INNER_NODE& node, DepthType depth, DepthType chunk_depth)
 	{
-		// Get size of compressed data
-		const std::streampos initial_read_position = s_in.tellg();
-		s_in.seekg(0, s_in.end);
-		const int compressed_data_size = s_in.tellg() - initial_read_position;
-		s_in.seekg(initial_read_position);
-
-		// Decompress data
-		char* compressed_data = new char[compressed_data_size];
-		s_in.read(compressed_data, compressed_data_size);
-		char* regen_buffer = new char[uncompressed_data_size];
-		const int decompressed_size = LZ4_decompress_safe(
-		    compressed_data, regen_buffer, compressed_data_size, uncompressed_data_size);
+		if (chunk_depth >= depth || !hasChildren(node)) {
+			return;
+		}
+		for (INNER_NODE& child : getInnerChildren(node)) {
+			updateAboveChunksRecurs(child, depth - 1, chunk_depth);
+		}
+		updateNode(node, depth);
+	}
 
-		// Check if decompression successful
-		if (0 <= decompressed_size) {
-			// Write decompressed data to output stream
-			s_out.write(regen_buffer, decompressed_size);
+	bool packChunk(Code const& code, std::string data, Codec codec, int compression_level,
+	               Chunk& chunk) const
+	{
+		if (std::numeric_limits<std::uint32_t>::max() < data.size()) {
+			return false;
 		}
+		chunk.code = code;
+		chunk.uncompressed_size = data.size();
+		if (Codec::none == codec) {
+			chunk.data = std::move(data);
+			return true;
+		}
+		return compress(codec, data, chunk.data, compression_level, compression_dictionary_);
+	}
 
-		// Clean up
-		delete[] compressed_data;
-		delete[] regen_buffer;
-		return 0 <= decompressed_size;
+	bool unpackChunk(Chunk const& chunk, Codec codec, std::string& data) const
+	{
+		data.resize(chunk.uncompressed_size);
+		return decompress(codec, chunk.data, data, compression_dictionary_);
+	}
+
+	// Returns the number of bytes written
+	static std::uint64_t writeChunk(std::ostream& s, Chunk const& chunk)
+	{
+		CodeType const code = chunk.code.getCode();
+		std::uint8_t const depth = chunk.code.getDepth();
+		std::uint32_t const stored_size = chunk.data.size();
+		s.write(reinterpret_cast<char const*>(&code), sizeof(code));
+		s.write(reinterpret_cast<char const*>(&depth), sizeof(depth));
+		s.write(reinterpret_cast<char const*>(&chunk.uncompressed_size),
+		        sizeof(chunk.uncompressed_size));
+		s.write(reinterpret_cast<char const*>(&stored_size), sizeof(stored_size));
+		s.write(chunk.data.data(), stored_size);
+		return sizeof(code) + sizeof(depth) + sizeof(chunk.uncompressed_size) +
+		       sizeof(stored_size) + stored_size;
+	}
+
+	static bool readChunk(std::istream& s, Chunk& chunk)
+	{
+		CodeType code;
+		std::uint8_t depth;
+		std::uint32_t stored_size;
+		s.read(reinterpret_cast<char*>(&code), sizeof(code));
+		s.read(reinterpret_cast<char*>(&depth), sizeof(depth));
+		s.read(reinterpret_cast<char*>(&chunk.uncompressed_size),
+		       sizeof(chunk.uncompressed_size));
+		s.read(reinterpret_cast<char*>(&stored_size), sizeof(stored_size));
+		if (!s.good()) {
+			return false;
+		}
+		chunk.code = Code(code, depth);
+		chunk.data.resize(stored_size);
+		s.read(chunk.data.data(), stored_size);
+		return s.good();
 	}
 
  protected:
@@ -1499,13 +3044,62 @@ class Octree
 	// Automatic pruning
 	bool automatic_pruning_enabled_ = true;
 
+	// Incremental pruning, subtrees nodes have been created in since the last prune
+	DepthType incremental_prune_depth_ = 5;
+	std::unordered_set<Code, Code::Hash> prune_pending_;
+
+	// Flat file the pools use in place, has to outlive the pools
+	MappedFile mapped_file_;
+
+	// Pool allocation, the children at depth are allocated from pool depth. With compact
+	// inner nodes all inner children are allocated from inner_pools_[0].
+	bool pool_allocation_enabled_ = COMPACT_CHILDREN;
+	NodePool<LEAF_NODE> leaf_pool_;
+	std::array<NodePool<INNER_NODE>, MAX_DEPTH_LEVELS> inner_pools_;
+
+	// Node index, nodes at node_index_depth_ by code
+	bool node_index_enabled_ = false;
+	DepthType node_index_depth_ = 0;
+	std::unordered_map<Code, LEAF_NODE*, Code::Hash> node_index_;
+
+	// Set while subtrees are built in parallel, then nodes are allocated and freed under
+	// allocation_mutex_
+	bool concurrent_allocation_ = false;
+
+	// Changed whenever children are created or deleted, see Accessor
+	std::uint64_t structure_version_ = 0;
+	std::mutex allocation_mutex_;
+
+	// Brick allocation, depth of the brick roots or 0 if disabled
+	DepthType brick_depth_ = 0;
+
+	// Depth of the subtrees that are written as separate chunks
+	DepthType chunk_depth_ = 6;
+
+	// Dictionary for zstd, has to be the same when reading as when writing
+	std::string compression_dictionary_;
+
+	// Sliding window, depth of the tiles or 0 if disabled, and the tiles that are on disk
+	DepthType tile_depth_ = 0;
+	std::string tile_directory_;
+	std::unordered_set<Code, Code::Hash> evicted_tiles_;
+
 	// Memory
 	size_t num_inner_nodes_ = 0;       // Current number of inner nodes
 	size_t num_inner_leaf_nodes_ = 1;  // Current number of inner leaf nodes
 	size_t num_leaf_nodes_ = 0;        // Current number of leaf nodes
+	std::array<size_t, MAX_DEPTH_LEVELS + 1> num_nodes_at_depth_{};  // Nodes per depth
+
+	// Integration metrics, counted here since this is where nodes are created and pruned
+	mutable IntegrationMetrics metrics_;
 
 	inline static const std::string FILE_HEADER = "# UFOMap file";  // File header
-	inline static const std::string FILE_VERSION = "1.0.0";         // File version
+	inline static const std::string FILE_VERSION = "1.1.0";         // File version
+	// Version with the nodes as one stream, compressed as a whole
+	inline static const std::string LEGACY_FILE_VERSION = "1.0.0";
+
+	// Number of chunks that are held in memory at once while reading and writing
+	static constexpr std::size_t CHUNK_BATCH_SIZE = 64;
 
 	// TODO: Is this needed? I think so
 	template <typename T, typename D, typename I, typename L, bool O>
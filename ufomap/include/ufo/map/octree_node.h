@@ -43,6 +43,7 @@
 #define UFO_MAP_OCTREE_NODE_H
 
 // STD
+#include <cstddef>
 #include <iostream>
 
 namespace ufo::map
@@ -73,6 +74,27 @@ struct OctreeLeafNode {
 	{
 		return value.readData(s);
 	}
+
+	/**
+	 * @brief Write the same data as writeData(s) to buffer
+	 *
+	 * @param buffer The buffer to write to, with room for dataSize() bytes
+	 * @return char* The byte after the written data
+	 */
+	char* writeData(char* buffer) const { return value.writeData(buffer); }
+
+	/**
+	 * @brief Read the data for this node from buffer
+	 *
+	 * @param buffer The buffer to read from, with at least dataSize() bytes
+	 * @return char const* The byte after the read data
+	 */
+	char const* readData(char const* buffer) { return value.readData(buffer); }
+
+	/**
+	 * @return The number of bytes written by writeData
+	 */
+	static constexpr std::size_t dataSize() noexcept { return T::dataSize(); }
 };
 
 template <typename T>
@@ -48,7 +48,12 @@
 
 // STD
 #include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
 #include <execution>
+#include <iterator>
+#include <numeric>
 #include <type_traits>
 #include <vector>
 
@@ -58,9 +63,9 @@ namespace ufo::map
  * @brief A collection of 3D coordinates of type T
  *
  * @tparam T The type of points to store in the point cloud. Has to inhert from
- * Point3
+ * Point3 or Point3F
  */
-template <typename T, typename = std::enable_if_t<std::is_base_of_v<Point3, T>>>
+template <typename T, typename = std::enable_if_t<math::is_vector3_v<T>>>
 class PointCloudT
 {
  public:
@@ -104,6 +109,11 @@ class PointCloudT
 	 */
 	void reserve(size_t new_cap) { cloud_.reserve(new_cap); }
 
+	/**
+	 * @brief Number of points the point cloud has allocated space for
+	 */
+	size_t capacity() const noexcept { return cloud_.capacity(); }
+
 	/**
 	 * @brief Resizes the container to contain count elements.
 	 * If the current size is greater than count, the container is reduced to its first
@@ -275,8 +285,323 @@ class PointCloudT
 };
 
 using PointCloud = PointCloudT<Point3>;
+using PointCloudF = PointCloudT<Point3F>;
 using PointCloudColor = PointCloudT<Point3Color>;
 
+/**
+ * @brief A point cloud of single-precision points stored as a structure of arrays
+ *
+ * @details Each coordinate is stored in its own array, so the transform is a 3x4 matrix
+ * multiplication that the compiler vectorizes. Iterating gives Point3F by value.
+ */
+class PointCloudSoA
+{
+ public:
+	class const_iterator
+	{
+	 public:
+		using iterator_category = std::forward_iterator_tag;
+		using value_type = Point3F;
+		using difference_type = std::ptrdiff_t;
+		using pointer = void;
+		using reference = Point3F;
+
+		const_iterator(PointCloudSoA const* cloud, size_t index)
+		    : cloud_(cloud), index_(index)
+		{
+		}
+
+		Point3F operator*() const { return (*cloud_)[index_]; }
+
+		const_iterator& operator++()
+		{
+			++index_;
+			return *this;
+		}
+
+		const_iterator operator++(int)
+		{
+			const_iterator result = *this;
+			++index_;
+			return result;
+		}
+
+		bool operator==(const_iterator const& rhs) const { return index_ == rhs.index_; }
+
+		bool operator!=(const_iterator const& rhs) const { return index_ != rhs.index_; }
+
+	 private:
+		PointCloudSoA const* cloud_;
+		size_t index_;
+	};
+
+	PointCloudSoA() {}
+
+	template <typename T>
+	explicit PointCloudSoA(PointCloudT<T> const& cloud)
+	{
+		reserve(cloud.size());
+		for (T const& point : cloud) {
+			push_back(point);
+		}
+	}
+
+	/**
+	 * @brief Get the point at index
+	 */
+	Point3F operator[](size_t index) const { return Point3F(x_[index], y_[index], z_[index]); }
+
+	/**
+	 * @brief Set the point at index
+	 */
+	void set(size_t index, Point3F const& point)
+	{
+		x_[index] = point[0];
+		y_[index] = point[1];
+		z_[index] = point[2];
+	}
+
+	void clear()
+	{
+		x_.clear();
+		y_.clear();
+		z_.clear();
+	}
+
+	void reserve(size_t new_cap)
+	{
+		x_.reserve(new_cap);
+		y_.reserve(new_cap);
+		z_.reserve(new_cap);
+	}
+
+	size_t capacity() const noexcept { return x_.capacity(); }
+
+	void resize(size_t count)
+	{
+		x_.resize(count);
+		y_.resize(count);
+		z_.resize(count);
+	}
+
+	size_t size() const { return x_.size(); }
+
+	bool empty() const { return x_.empty(); }
+
+	void push_back(Point3F const& point)
+	{
+		x_.push_back(point[0]);
+		y_.push_back(point[1]);
+		z_.push_back(point[2]);
+	}
+
+	std::vector<float>& x() { return x_; }
+	std::vector<float> const& x() const { return x_; }
+	std::vector<float>& y() { return y_; }
+	std::vector<float> const& y() const { return y_; }
+	std::vector<float>& z() { return z_; }
+	std::vector<float> const& z() const { return z_; }
+
+	/**
+	 * @brief Transform each point in the point cloud
+	 *
+	 * @param transform The transformation to be applied to each point
+	 * @param parallel Whether to split the points in chunks that are transformed in
+	 * parallel
+	 */
+	void transform(math::Pose6 const& transform, bool parallel = false)
+	{
+		std::array<double, 12> m_d = transform.toMatrix();
+		std::array<float, 12> m;
+		std::copy(m_d.begin(), m_d.end(), m.begin());
+
+		if (!parallel) {
+			transformRange(m, 0, size());
+			return;
+		}
+
+		static constexpr size_t CHUNK_SIZE = 4096;
+		std::vector<size_t> chunks((size() + CHUNK_SIZE - 1) / CHUNK_SIZE);
+		std::iota(chunks.begin(), chunks.end(), 0);
+		std::for_each(std::execution::par, chunks.begin(), chunks.end(),
+		              [this, &m](size_t chunk) {
+			              size_t first = chunk * CHUNK_SIZE;
+			              transformRange(m, first, std::min(size(), first + CHUNK_SIZE));
+		              });
+	}
+
+	const_iterator begin() const { return const_iterator(this, 0); }
+
+	const_iterator end() const { return const_iterator(this, size()); }
+
+	const_iterator cbegin() const { return begin(); }
+
+	const_iterator cend() const { return end(); }
+
+ private:
+	// Row-major 3x4 matrix times the points in [first, last)
+	void transformRange(std::array<float, 12> const& m, size_t first, size_t last)
+	{
+		float* x = x_.data();
+		float* y = y_.data();
+		float* z = z_.data();
+		for (size_t i = first; i < last; ++i) {
+			float p_x = x[i];
+			float p_y = y[i];
+			float p_z = z[i];
+			x[i] = m[0] * p_x + m[1] * p_y + m[2] * p_z + m[3];
+			y[i] = m[4] * p_x + m[5] * p_y + m[6] * p_z + m[7];
+			z[i] = m[8] * p_x + m[9] * p_y + m[10] * p_z + m[11];
+		}
+	}
+
+ private:
+	std::vector<float> x_;
+	std::vector<float> y_;
+	std::vector<float> z_;
+};
+
+/**
+ * @brief A point cloud read in place from an interleaved buffer of single-precision
+ * points, e.g., the data of a ROS PointCloud2
+ *
+ * @details Nothing is copied, each point is read from the buffer and transformed when it
+ * is accessed, so the buffer has to outlive the view. Iterating gives Point3Color by
+ * value, with the color unset if the buffer has no color. Points that are not finite
+ * are given as is, the integration skips them.
+ */
+class PointCloudView
+{
+ public:
+	class const_iterator
+	{
+	 public:
+		using iterator_category = std::forward_iterator_tag;
+		using value_type = Point3Color;
+		using difference_type = std::ptrdiff_t;
+		using pointer = void;
+		using reference = Point3Color;
+
+		const_iterator(PointCloudView const* cloud, size_t index)
+		    : cloud_(cloud), index_(index)
+		{
+		}
+
+		Point3Color operator*() const { return (*cloud_)[index_]; }
+
+		const_iterator& operator++()
+		{
+			++index_;
+			return *this;
+		}
+
+		const_iterator operator++(int)
+		{
+			const_iterator result = *this;
+			++index_;
+			return result;
+		}
+
+		bool operator==(const_iterator const& rhs) const { return index_ == rhs.index_; }
+
+		bool operator!=(const_iterator const& rhs) const { return index_ != rhs.index_; }
+
+	 private:
+		PointCloudView const* cloud_;
+		size_t index_;
+	};
+
+	PointCloudView() {}
+
+	/**
+	 * @param data The first point
+	 * @param size The number of points
+	 * @param point_step The number of bytes between two consecutive points
+	 * @param x_offset, y_offset, z_offset Byte offset of the float coordinates in a point
+	 * @param transform Applied to each point when it is read
+	 */
+	PointCloudView(void const* data, size_t size, size_t point_step, size_t x_offset,
+	               size_t y_offset, size_t z_offset,
+	               math::Pose6 const& transform = math::Pose6())
+	    : data_(static_cast<std::uint8_t const*>(data)),
+	      size_(size),
+	      point_step_(point_step),
+	      offset_{x_offset, y_offset, z_offset},
+	      m_(transform.toMatrix())
+	{
+	}
+
+	/**
+	 * @brief Read the color of the points from the bytes at the offsets
+	 */
+	void setColorOffsets(size_t r_offset, size_t g_offset, size_t b_offset)
+	{
+		has_color_ = true;
+		color_offset_ = {r_offset, g_offset, b_offset};
+	}
+
+	bool hasColor() const noexcept { return has_color_; }
+
+	/**
+	 * @brief Only keep every step:th point, without touching the data
+	 */
+	void subsample(size_t step)
+	{
+		if (1 < step) {
+			size_ = (size_ + step - 1) / step;
+			point_step_ *= step;
+		}
+	}
+
+	/**
+	 * @brief Change the transform applied to each point
+	 */
+	void setTransform(math::Pose6 const& transform) { m_ = transform.toMatrix(); }
+
+	/**
+	 * @brief Get the transformed point at index
+	 */
+	Point3Color operator[](size_t index) const
+	{
+		std::uint8_t const* point = data_ + index * point_step_;
+		float p[3];
+		for (int i : {0, 1, 2}) {
+			// The buffer does not have to be aligned
+			std::memcpy(&p[i], point + offset_[i], sizeof(float));
+		}
+
+		Point3 const xyz(m_[0] * p[0] + m_[1] * p[1] + m_[2] * p[2] + m_[3],
+		                 m_[4] * p[0] + m_[5] * p[1] + m_[6] * p[2] + m_[7],
+		                 m_[8] * p[0] + m_[9] * p[1] + m_[10] * p[2] + m_[11]);
+		if (!has_color_) {
+			return Point3Color(xyz);
+		}
+		return Point3Color(xyz, Color(point[color_offset_[0]], point[color_offset_[1]],
+		                              point[color_offset_[2]]));
+	}
+
+	size_t size() const noexcept { return size_; }
+
+	bool empty() const noexcept { return 0 == size_; }
+
+	const_iterator begin() const { return const_iterator(this, 0); }
+
+	const_iterator end() const { return const_iterator(this, size()); }
+
+	const_iterator cbegin() const { return begin(); }
+
+	const_iterator cend() const { return end(); }
+
+ private:
+	std::uint8_t const* data_ = nullptr;
+	size_t size_ = 0;
+	size_t point_step_ = 0;
+	std::array<size_t, 3> offset_{};
+	bool has_color_ = false;
+	std::array<size_t, 3> color_offset_{};
+	// Row-major 3x4 transformation matrix
+	std::array<double, 12> m_ = math::Pose6().toMatrix();
+};
 }  // namespace ufo::map
 
 #endif  // UFO_MAP_POINT_CLOUD_H
\ No newline at end of file
@@ -0,0 +1,84 @@
+/**
+ * UFOMap: An Efficient Probabilistic 3D Mapping Framework That Embraces the Unknown
+ *
+ * @author D. Duberg, KTH Royal Institute of Technology, Copyright (c) 2020.
+ * @see https://github.com/UnknownFreeOccupied/ufomap
+ * License: BSD 3
+ *
+ */
+
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2020, D. Duberg, KTH Royal Institute of Technology
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef UFO_MAP_PREFILTER_H
+#define UFO_MAP_PREFILTER_H
+
+// UFO
+#include <ufo/map/types.h>
+
+// STD
+#include <cstddef>
+
+namespace ufo::map
+{
+/**
+ * @brief Options for the prefilter stage that removes redundant points before
+ * integration
+ *
+ */
+struct PrefilterOptions {
+	// Merge all points in the same node at voxel_depth into their centroid
+	bool voxel_filter = true;
+	DepthType voxel_depth = 0;
+
+	// Merge points that are in the same angular bucket, as seen from the sensor, and
+	// within range_tolerance of each other into the farthest of them. Disabled if
+	// angular_resolution (radians) is not positive
+	double angular_resolution = 0.0;
+	double range_tolerance = 0.1;
+};
+
+/**
+ * @brief How many points the prefilter stage kept and dropped for the latest cloud
+ *
+ */
+struct PrefilterStats {
+	std::size_t input = 0;
+	std::size_t kept = 0;
+	std::size_t voxel_dropped = 0;
+	std::size_t angular_dropped = 0;
+
+	std::size_t dropped() const noexcept { return voxel_dropped + angular_dropped; }
+};
+}  // namespace ufo::map
+
+#endif  // UFO_MAP_PREFILTER_H
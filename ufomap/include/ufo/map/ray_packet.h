@@ -0,0 +1,253 @@
+/**
+ * UFOMap: An Efficient Probabilistic 3D Mapping Framework That Embraces the Unknown
+ *
+ * @author D. Duberg, KTH Royal Institute of Technology, Copyright (c) 2020.
+ * @see https://github.com/UnknownFreeOccupied/ufomap
+ * License: BSD 3
+ *
+ */
+
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2020, D. Duberg, KTH Royal Institute of Technology
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef UFO_MAP_RAY_PACKET_H
+#define UFO_MAP_RAY_PACKET_H
+
+// UFO
+#include <ufo/map/key.h>
+#include <ufo/map/types.h>
+
+// STD
+#include <array>
+#include <cstdint>
+
+#if defined(__AVX2__) || defined(__AVX512F__)
+#include <immintrin.h>
+#endif
+
+namespace ufo::map
+{
+// Number of rays traversed in lockstep, one SIMD register of doubles per axis
+#if defined(__AVX512F__)
+inline constexpr std::size_t RAY_PACKET_SIZE = 8;
+#else
+inline constexpr std::size_t RAY_PACKET_SIZE = 4;
+#endif
+
+/**
+ * @brief A packet of rays that are traversed (3D-DDA) in lockstep
+ *
+ * @details Rays are added with the output of Octree::computeRayInit. Each step advances
+ * all active rays, with the same decisions as Octree::computeRayTakeStep, so the visited
+ * nodes are exactly the same as when the rays are traversed one at a time. A ray is
+ * done when it reaches its end node or has gone further than its distance. Lanes of rays
+ * that are done can directly be filled with new rays.
+ *
+ * The step is done with AVX-512 or AVX2 if the code is compiled with support for it
+ * (UFOMAP_AVX2/UFOMAP_AVX512 in CMake), otherwise with a plain loop that the compiler
+ * can vectorize, e.g., for NEON.
+ *
+ * @tparam N The number of rays in the packet
+ */
+template <std::size_t N = RAY_PACKET_SIZE>
+class RayPacket
+{
+	static_assert(0 < N && 32 >= N, "Ray packet size has to be between 1 and 32");
+
+ public:
+	/**
+	 * @brief Whether all lanes have a ray.
+	 */
+	bool full() const noexcept { return ALL == active_; }
+
+	/**
+	 * @brief Whether no lane has a ray.
+	 */
+	bool empty() const noexcept { return 0 == active_; }
+
+	/**
+	 * @brief Add a ray to a free lane. The packet cannot be full.
+	 */
+	void add(Key const& current, Key const& end, std::array<int, 3> const& step,
+	         Point3 const& t_delta, Point3 const& t_max, double distance)
+	{
+		std::size_t lane = __builtin_ctz(~active_);
+		current_[lane] = current;
+		end_[lane] = end;
+		step_[lane] = step;
+		for (std::size_t i = 0; i < 3; ++i) {
+			t_delta_[i][lane] = t_delta[i];
+			t_max_[i][lane] = t_max[i];
+		}
+		distance_[lane] = distance;
+		active_ |= std::uint32_t(1) << lane;
+	}
+
+	/**
+	 * @brief Call f with the current key of each ray.
+	 */
+	template <typename UnaryFunction>
+	void visit(UnaryFunction f) const
+	{
+		for (std::uint32_t active = active_; 0 != active; active &= active - 1) {
+			f(current_[__builtin_ctz(active)]);
+		}
+	}
+
+	/**
+	 * @brief Stop traversing the ray in lane.
+	 */
+	void remove(std::size_t lane) noexcept { active_ &= ~(std::uint32_t(1) << lane); }
+
+	/**
+	 * @brief Take one step along all rays. Rays that are done are removed.
+	 */
+	void step()
+	{
+		std::array<std::uint32_t, 3> advance;
+		std::uint32_t inside = stepTMax(advance);
+
+		std::uint32_t active = active_ & inside;
+		for (std::size_t i = 0; i < 3; ++i) {
+			for (std::uint32_t a = advance[i] & active_; 0 != a; a &= a - 1) {
+				std::size_t lane = __builtin_ctz(a);
+				current_[lane][i] += step_[lane][i];
+			}
+		}
+
+		for (std::uint32_t a = active; 0 != a; a &= a - 1) {
+			std::size_t lane = __builtin_ctz(a);
+			if (current_[lane] == end_[lane]) {
+				active &= ~(std::uint32_t(1) << lane);
+			}
+		}
+
+		active_ = active;
+	}
+
+ private:
+	// Advance t_max along the axis with the smallest t_max for each lane. Returns the
+	// lanes that are still within their distance, and the axis each lane advanced
+	std::uint32_t stepTMax(std::array<std::uint32_t, 3>& advance)
+	{
+#if defined(__AVX512F__)
+		if constexpr (8 == N) {
+			__m512d x = _mm512_load_pd(t_max_[0].data());
+			__m512d y = _mm512_load_pd(t_max_[1].data());
+			__m512d z = _mm512_load_pd(t_max_[2].data());
+
+			__mmask8 x_le_y = _mm512_cmp_pd_mask(x, y, _CMP_LE_OQ);
+			__mmask8 advance_x = x_le_y & _mm512_cmp_pd_mask(x, z, _CMP_LE_OQ);
+			__mmask8 advance_y = ~x_le_y & _mm512_cmp_pd_mask(y, z, _CMP_LE_OQ);
+			__mmask8 advance_z = ~(advance_x | advance_y);
+
+			x = _mm512_mask_add_pd(x, advance_x, x, _mm512_load_pd(t_delta_[0].data()));
+			y = _mm512_mask_add_pd(y, advance_y, y, _mm512_load_pd(t_delta_[1].data()));
+			z = _mm512_mask_add_pd(z, advance_z, z, _mm512_load_pd(t_delta_[2].data()));
+
+			_mm512_store_pd(t_max_[0].data(), x);
+			_mm512_store_pd(t_max_[1].data(), y);
+			_mm512_store_pd(t_max_[2].data(), z);
+
+			advance = {advance_x, advance_y, advance_z};
+
+			__m512d min = _mm512_min_pd(_mm512_min_pd(x, y), z);
+			return _mm512_cmp_pd_mask(min, _mm512_load_pd(distance_.data()), _CMP_LE_OQ);
+		}
+#endif
+#if defined(__AVX2__)
+		if constexpr (0 == N % 4) {
+			std::uint32_t inside = 0;
+			advance = {0, 0, 0};
+			for (std::size_t l = 0; l < N; l += 4) {
+				__m256d x = _mm256_load_pd(&t_max_[0][l]);
+				__m256d y = _mm256_load_pd(&t_max_[1][l]);
+				__m256d z = _mm256_load_pd(&t_max_[2][l]);
+
+				__m256d x_le_y = _mm256_cmp_pd(x, y, _CMP_LE_OQ);
+				__m256d advance_x = _mm256_and_pd(x_le_y, _mm256_cmp_pd(x, z, _CMP_LE_OQ));
+				__m256d advance_y = _mm256_andnot_pd(x_le_y, _mm256_cmp_pd(y, z, _CMP_LE_OQ));
+				__m256d advance_z = _mm256_andnot_pd(_mm256_or_pd(advance_x, advance_y),
+				                                     _mm256_cmp_pd(x, x, _CMP_TRUE_UQ));
+
+				x = _mm256_add_pd(x, _mm256_and_pd(advance_x, _mm256_load_pd(&t_delta_[0][l])));
+				y = _mm256_add_pd(y, _mm256_and_pd(advance_y, _mm256_load_pd(&t_delta_[1][l])));
+				z = _mm256_add_pd(z, _mm256_and_pd(advance_z, _mm256_load_pd(&t_delta_[2][l])));
+
+				_mm256_store_pd(&t_max_[0][l], x);
+				_mm256_store_pd(&t_max_[1][l], y);
+				_mm256_store_pd(&t_max_[2][l], z);
+
+				advance[0] |= std::uint32_t(_mm256_movemask_pd(advance_x)) << l;
+				advance[1] |= std::uint32_t(_mm256_movemask_pd(advance_y)) << l;
+				advance[2] |= std::uint32_t(_mm256_movemask_pd(advance_z)) << l;
+
+				__m256d min = _mm256_min_pd(_mm256_min_pd(x, y), z);
+				inside |= std::uint32_t(_mm256_movemask_pd(_mm256_cmp_pd(
+				              min, _mm256_load_pd(&distance_[l]), _CMP_LE_OQ)))
+				          << l;
+			}
+			return inside;
+		}
+#endif
+		std::uint32_t inside = 0;
+		advance = {0, 0, 0};
+		for (std::size_t l = 0; l < N; ++l) {
+			double& x = t_max_[0][l];
+			double& y = t_max_[1][l];
+			double& z = t_max_[2][l];
+			std::size_t dim = x <= y ? (x <= z ? 0 : 2) : (y <= z ? 1 : 2);
+			t_max_[dim][l] += t_delta_[dim][l];
+			advance[dim] |= std::uint32_t(1) << l;
+			if (std::min(std::min(x, y), z) <= distance_[l]) {
+				inside |= std::uint32_t(1) << l;
+			}
+		}
+		return inside;
+	}
+
+ private:
+	static constexpr std::uint32_t ALL =
+	    32 == N ? ~std::uint32_t(0) : (std::uint32_t(1) << N) - 1;
+
+	alignas(64) std::array<std::array<double, N>, 3> t_max_{};
+	alignas(64) std::array<std::array<double, N>, 3> t_delta_{};
+	alignas(64) std::array<double, N> distance_{};
+	std::array<Key, N> current_;
+	std::array<Key, N> end_;
+	std::array<std::array<int, 3>, N> step_;
+	// Lanes with a ray
+	std::uint32_t active_ = 0;
+};
+}  // namespace ufo::map
+
+#endif  // UFO_MAP_RAY_PACKET_H
@@ -56,6 +56,7 @@ using KeyType = unsigned int;
 using DepthType = unsigned int;
 
 using Point3 = ufo::math::Vector3;
+using Point3F = ufo::math::Vector3f;
 
 class Point3Color : public Point3
 {
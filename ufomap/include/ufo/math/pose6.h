@@ -47,8 +47,10 @@
 #include <ufo/math/vector3.h>
 
 // STD
+#include <array>
 #include <cmath>
 #include <type_traits>
+#include <vector>
 
 namespace ufo::math
 {
@@ -111,19 +113,30 @@ class Pose6
 	double pitch() const { return rotation_.toEuler()[1]; }
 	double yaw() const { return rotation_.toEuler()[2]; }
 
-	template <typename T, typename = std::enable_if_t<std::is_base_of_v<Vector3, T>>>
+	template <typename T, typename = std::enable_if_t<is_vector3_v<T>>>
 	T transform(T const& v) const
 	{
 		// TODO: Improve
 		T new_v = v;
-		Vector3 result = rotation_.rotate(v);
+		Vector3 result = rotation_.rotate(Vector3(v)) + translation_;
 		new_v.x() = result.x();
 		new_v.y() = result.y();
 		new_v.z() = result.z();
-		new_v += translation_;
 		return new_v;
 	}
 
+	/**
+	 * @brief The transform as a row-major 3x4 matrix [R | t].
+	 */
+	std::array<double, 12> toMatrix() const
+	{
+		std::vector<double> rot;
+		rotation_.toRotMatrix(rot);
+		return {rot[0], rot[1], rot[2], translation_[0],  //
+		        rot[3], rot[4], rot[5], translation_[1],  //
+		        rot[6], rot[7], rot[8], translation_[2]};
+	}
+
 	Pose6 inversed() const
 	{
 		Pose6 result(*this);
@@ -273,12 +273,12 @@ class Quaternion
 		return *this;
 	}
 
-	template <typename T, typename = std::enable_if_t<std::is_base_of_v<Vector3, T>>>
+	template <typename T, typename = std::enable_if_t<is_vector3_v<T>>>
 	T rotate(T const& v) const
 	{
 		// TODO: Improve
 		T new_v = v;
-		Quaternion q = *this * v * this->inversed();
+		Quaternion q = *this * Vector3(v) * this->inversed();
 		new_v.x() = q.x();
 		new_v.y() = q.y();
 		new_v.z() = q.z();
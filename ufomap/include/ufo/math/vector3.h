@@ -46,17 +46,42 @@
 
 #include <algorithm>
 #include <cmath>
+#include <type_traits>
 
 namespace ufo::math
 {
-class Vector3
+/**
+ * @brief 3D vector of scalar type T
+ *
+ * @tparam T The scalar type, e.g., double or float
+ */
+template <typename T>
+class Vector3T
 {
  public:
-	Vector3() : data_{0.0, 0.0, 0.0} {}
-	Vector3(double x, double y, double z) : data_{x, y, z} {}
-	Vector3(Vector3 const& other) : data_{other.data_[0], other.data_[1], other.data_[2]} {}
+	using value_type = T;
+
+	Vector3T() : data_{0.0, 0.0, 0.0} {}
+	Vector3T(T x, T y, T z) : data_{x, y, z} {}
+	Vector3T(Vector3T const& other) : data_{other.data_[0], other.data_[1], other.data_[2]} {}
 
-	Vector3& operator=(Vector3 const& other)
+	// Implicit if no precision is lost (e.g., float to double), otherwise explicit
+	template <typename U, std::enable_if_t<!std::is_same_v<T, U> &&
+	                                           (sizeof(U) <= sizeof(T)),
+	                                       bool> = true>
+	Vector3T(Vector3T<U> const& other) : data_{T(other[0]), T(other[1]), T(other[2])}
+	{
+	}
+
+	template <typename U, std::enable_if_t<!std::is_same_v<T, U> &&
+	                                           (sizeof(U) > sizeof(T)),
+	                                       bool> = true>
+	explicit Vector3T(Vector3T<U> const& other)
+	    : data_{T(other[0]), T(other[1]), T(other[2])}
+	{
+	}
+
+	Vector3T& operator=(Vector3T const& other)
 	{
 		data_[0] = other.data_[0];
 		data_[1] = other.data_[1];
@@ -64,182 +89,187 @@ class Vector3
 		return *this;
 	}
 
-	Vector3 cross(Vector3 const& other) const { return cross(*this, other); }
-	static Vector3 cross(Vector3 const& first, Vector3 const& second)
+	Vector3T cross(Vector3T const& other) const { return cross(*this, other); }
+	static Vector3T cross(Vector3T const& first, Vector3T const& second)
 	{
-		return Vector3(
+		return Vector3T(
 		    (first.data_[1] * second.data_[2]) - (first.data_[2] * second.data_[1]),
 		    (first.data_[2] * second.data_[0]) - (first.data_[0] * second.data_[2]),
 		    (first.data_[0] * second.data_[1]) - (first.data_[1] * second.data_[0]));
 	}
 
-	double dot(Vector3 const& other) const { return dot(*this, other); }
-	static double dot(Vector3 const& first, Vector3 const& second)
+	T dot(Vector3T const& other) const { return dot(*this, other); }
+	static T dot(Vector3T const& first, Vector3T const& second)
 	{
 		return (first.data_[0] * second.data_[0]) + (first.data_[1] * second.data_[1]) +
 		       (first.data_[2] * second.data_[2]);
 	}
 
-	double& operator()(size_t idx) { return data_[idx]; }
+	T& operator()(size_t idx) { return data_[idx]; }
 
-	double const& operator()(size_t idx) const { return data_[idx]; }
-	double& operator[](size_t idx) { return data_[idx]; }
-	double const& operator[](size_t idx) const { return data_[idx]; }
+	T const& operator()(size_t idx) const { return data_[idx]; }
+	T& operator[](size_t idx) { return data_[idx]; }
+	T const& operator[](size_t idx) const { return data_[idx]; }
 
-	double& x() { return data_[0]; }
-	double const& x() const { return data_[0]; }
-	double& y() { return data_[1]; }
-	double const& y() const { return data_[1]; }
-	double& z() { return data_[2]; }
-	double const& z() const { return data_[2]; }
+	T& x() { return data_[0]; }
+	T const& x() const { return data_[0]; }
+	T& y() { return data_[1]; }
+	T const& y() const { return data_[1]; }
+	T& z() { return data_[2]; }
+	T const& z() const { return data_[2]; }
 
-	double& roll() { return data_[0]; }
-	double const& roll() const { return data_[0]; }
-	double& pitch() { return data_[1]; }
-	double const& pitch() const { return data_[1]; }
-	double& yaw() { return data_[2]; }
-	double const& yaw() const { return data_[2]; }
+	T& roll() { return data_[0]; }
+	T const& roll() const { return data_[0]; }
+	T& pitch() { return data_[1]; }
+	T const& pitch() const { return data_[1]; }
+	T& yaw() { return data_[2]; }
+	T const& yaw() const { return data_[2]; }
 
-	Vector3 operator-() const { return Vector3(-data_[0], -data_[1], -data_[2]); }
+	Vector3T operator-() const { return Vector3T(-data_[0], -data_[1], -data_[2]); }
 
-	Vector3 operator-(Vector3 const& other) const
+	Vector3T operator-(Vector3T const& other) const
 	{
-		return Vector3(data_[0] - other.data_[0], data_[1] - other.data_[1],
+		return Vector3T(data_[0] - other.data_[0], data_[1] - other.data_[1],
 		               data_[2] - other.data_[2]);
 	}
-	Vector3 operator-(double value) const
+	Vector3T operator-(T value) const
 	{
-		return Vector3(data_[0] - value, data_[1] - value, data_[2] - value);
+		return Vector3T(data_[0] - value, data_[1] - value, data_[2] - value);
 	}
-	Vector3 operator+(Vector3 const& other) const
+	Vector3T operator+(Vector3T const& other) const
 	{
-		return Vector3(data_[0] + other.data_[0], data_[1] + other.data_[1],
+		return Vector3T(data_[0] + other.data_[0], data_[1] + other.data_[1],
 		               data_[2] + other.data_[2]);
 	}
-	Vector3 operator+(double value) const
+	Vector3T operator+(T value) const
 	{
-		return Vector3(data_[0] + value, data_[1] + value, data_[2] + value);
+		return Vector3T(data_[0] + value, data_[1] + value, data_[2] + value);
 	}
-	Vector3 operator*(Vector3 const& other) const
+	Vector3T operator*(Vector3T const& other) const
 	{
-		return Vector3(data_[0] * other.data_[0], data_[1] * other.data_[1],
+		return Vector3T(data_[0] * other.data_[0], data_[1] * other.data_[1],
 		               data_[2] * other.data_[2]);
 	}
-	Vector3 operator*(double value) const
+	Vector3T operator*(T value) const
 	{
-		return Vector3(data_[0] * value, data_[1] * value, data_[2] * value);
+		return Vector3T(data_[0] * value, data_[1] * value, data_[2] * value);
 	}
-	Vector3 operator/(Vector3 const& other) const
+	Vector3T operator/(Vector3T const& other) const
 	{
-		return Vector3(data_[0] / other.data_[0], data_[1] / other.data_[1],
+		return Vector3T(data_[0] / other.data_[0], data_[1] / other.data_[1],
 		               data_[2] / other.data_[2]);
 	}
-	Vector3 operator/(double value) const
+	Vector3T operator/(T value) const
 	{
-		return Vector3(data_[0] / value, data_[1] / value, data_[2] / value);
+		return Vector3T(data_[0] / value, data_[1] / value, data_[2] / value);
 	}
 
-	void operator-=(Vector3 const& other)
+	void operator-=(Vector3T const& other)
 	{
 		data_[0] -= other.data_[0];
 		data_[1] -= other.data_[1];
 		data_[2] -= other.data_[2];
 	}
-	void operator+=(Vector3 const& other)
+	void operator+=(Vector3T const& other)
 	{
 		data_[0] += other.data_[0];
 		data_[1] += other.data_[1];
 		data_[2] += other.data_[2];
 	}
-	void operator*=(Vector3 const& other)
+	void operator*=(Vector3T const& other)
 	{
 		data_[0] *= other.data_[0];
 		data_[1] *= other.data_[1];
 		data_[2] *= other.data_[2];
 	}
-	void operator/=(Vector3 const& other)
+	void operator/=(Vector3T const& other)
 	{
 		data_[0] /= other.data_[0];
 		data_[1] /= other.data_[1];
 		data_[2] /= other.data_[2];
 	}
 
-	void operator-=(double value)
+	void operator-=(T value)
 	{
 		data_[0] -= value;
 		data_[1] -= value;
 		data_[2] -= value;
 	}
-	void operator+=(double value)
+	void operator+=(T value)
 	{
 		data_[0] += value;
 		data_[1] += value;
 		data_[2] += value;
 	}
-	void operator*=(double value)
+	void operator*=(T value)
 	{
 		data_[0] *= value;
 		data_[1] *= value;
 		data_[2] *= value;
 	}
-	void operator/=(double value)
+	void operator/=(T value)
 	{
 		data_[0] /= value;
 		data_[1] /= value;
 		data_[2] /= value;
 	}
 
-	bool operator==(Vector3 const& other) const
+	bool operator==(Vector3T const& other) const
 	{
 		return data_[0] == other.data_[0] && data_[1] == other.data_[1] &&
 		       data_[2] == other.data_[2];
 	}
-	bool operator!=(Vector3 const& other) const
+	bool operator!=(Vector3T const& other) const
 	{
 		return data_[0] != other.data_[0] || data_[1] != other.data_[1] ||
 		       data_[2] != other.data_[2];
 	}
 
-	double norm() const { return std::sqrt(squaredNorm()); }
-	double squaredNorm() const
+	bool isFinite() const
+	{
+		return std::isfinite(data_[0]) && std::isfinite(data_[1]) && std::isfinite(data_[2]);
+	}
+
+	T norm() const { return std::sqrt(squaredNorm()); }
+	T squaredNorm() const
 	{
 		return (data_[0] * data_[0]) + (data_[1] * data_[1]) + (data_[2] * data_[2]);
 	}
 
-	Vector3& normalize()
+	Vector3T& normalize()
 	{
 		*this /= norm();
 		return *this;
 	}
-	Vector3 normalized() const
+	Vector3T normalized() const
 	{
-		Vector3 temp(*this);
+		Vector3T temp(*this);
 		return temp.normalize();
 	}
 
-	double angleTo(Vector3 const& other) const
+	T angleTo(Vector3T const& other) const
 	{
 		return std::acos(dot(other) / (norm() * other.norm()));
 	}
 
-	double distance(Vector3 const& other) const
+	T distance(Vector3T const& other) const
 	{
-		double x = data_[0] - other.data_[0];
-		double y = data_[1] - other.data_[1];
-		double z = data_[2] - other.data_[2];
+		T x = data_[0] - other.data_[0];
+		T y = data_[1] - other.data_[1];
+		T z = data_[2] - other.data_[2];
 		return sqrt((x * x) + (y * y) + (z * z));
 	}
-	double distanceXY(Vector3 const& other) const
+	T distanceXY(Vector3T const& other) const
 	{
-		double x = data_[0] - other.data_[0];
-		double y = data_[1] - other.data_[1];
+		T x = data_[0] - other.data_[0];
+		T y = data_[1] - other.data_[1];
 		return sqrt((x * x) + (y * y));
 	}
 
 	size_t size() const { return 3; }
 
-	double min() const { return std::min(std::min(data_[0], data_[1]), data_[2]); }
-	double max() const { return std::max(std::max(data_[0], data_[1]), data_[2]); }
+	T min() const { return std::min(std::min(data_[0], data_[1]), data_[2]); }
+	T max() const { return std::max(std::max(data_[0], data_[1]), data_[2]); }
 
 	size_t minElementIndex() const
 	{
@@ -258,52 +288,52 @@ class Vector3
 		}
 	}
 
-	Vector3& ceil()
+	Vector3T& ceil()
 	{
 		for (int i = 0; i < 3; ++i) {
 			data_[i] = std::ceil(data_[i]);
 		}
 		return *this;
 	}
-	Vector3 ceil() const
+	Vector3T ceil() const
 	{
-		return Vector3(std::ceil(data_[0]), std::ceil(data_[1]), std::ceil(data_[2]));
+		return Vector3T(std::ceil(data_[0]), std::ceil(data_[1]), std::ceil(data_[2]));
 	}
-	Vector3& floor()
+	Vector3T& floor()
 	{
 		for (int i = 0; i < 3; ++i) {
 			data_[i] = std::floor(data_[i]);
 		}
 		return *this;
 	}
-	Vector3 floor() const
+	Vector3T floor() const
 	{
-		return Vector3(std::floor(data_[0]), std::floor(data_[1]), std::floor(data_[2]));
+		return Vector3T(std::floor(data_[0]), std::floor(data_[1]), std::floor(data_[2]));
 	}
-	Vector3& trunc()
+	Vector3T& trunc()
 	{
 		for (int i = 0; i < 3; ++i) {
 			data_[i] = std::trunc(data_[i]);
 		}
 		return *this;
 	}
-	Vector3 trunc() const
+	Vector3T trunc() const
 	{
-		return Vector3(std::trunc(data_[0]), std::trunc(data_[1]), std::trunc(data_[2]));
+		return Vector3T(std::trunc(data_[0]), std::trunc(data_[1]), std::trunc(data_[2]));
 	}
-	Vector3& round()
+	Vector3T& round()
 	{
 		for (int i = 0; i < 3; ++i) {
 			data_[i] = std::round(data_[i]);
 		}
 		return *this;
 	}
-	Vector3 round() const
+	Vector3T round() const
 	{
-		return Vector3(std::round(data_[0]), std::round(data_[1]), std::round(data_[2]));
+		return Vector3T(std::round(data_[0]), std::round(data_[1]), std::round(data_[2]));
 	}
 
-	Vector3& clamp(Vector3 const& min, Vector3 const& max)
+	Vector3T& clamp(Vector3T const& min, Vector3T const& max)
 	{
 		for (int i = 0; i < 3; ++i) {
 			data_[i] = std::clamp(data_[i], min[i], max[i]);
@@ -311,21 +341,29 @@ class Vector3
 		return *this;
 	}
 
-	Vector3 clamp(Vector3 const& min, Vector3 const& max) const
+	Vector3T clamp(Vector3T const& min, Vector3T const& max) const
 	{
 		return clamp(*this, min, max);
 	}
 
-	static Vector3 clamp(Vector3 const& value, Vector3 const& min, Vector3 const& max)
+	static Vector3T clamp(Vector3T const& value, Vector3T const& min, Vector3T const& max)
 	{
-		return Vector3(std::clamp(value[0], min[0], max[0]),
+		return Vector3T(std::clamp(value[0], min[0], max[0]),
 		               std::clamp(value[1], min[1], max[1]),
 		               std::clamp(value[2], min[2], max[2]));
 	}
 
  protected:
-	double data_[3];
+	T data_[3];
 };
+
+using Vector3 = Vector3T<double>;
+using Vector3f = Vector3T<float>;
+
+// Whether T is, or inherits from, a Vector3 of any scalar type
+template <typename T>
+inline constexpr bool is_vector3_v =
+    std::is_base_of_v<Vector3, T> || std::is_base_of_v<Vector3f, T>;
 }  // namespace ufo::math
 
 #endif  // UFO_MATH_VECTOR3_H
\ No newline at end of file
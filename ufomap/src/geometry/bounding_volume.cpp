@@ -64,4 +64,23 @@ bool BoundingVolume::intersects(BoundingVolume const& other) const
 	}
 	return false;
 }
+
+ChildMask BoundingVolume::childMask(Point const& parent_center,
+                                    double child_half_size) const
+{
+	ChildMask mask;
+	for (BoundingVar const& bv : bounding_volume_) {
+		ChildMask bv_mask = std::visit(
+		    [&parent_center, child_half_size](auto&& arg) -> ChildMask {
+			    return geometry::childMask(arg, parent_center, child_half_size);
+		    },
+		    bv);
+		mask.intersects |= bv_mask.intersects;
+		mask.inside |= bv_mask.inside;
+		if (0xFF == mask.inside) {
+			break;
+		}
+	}
+	return mask;
+}
 }  // namespace ufo::geometry
\ No newline at end of file
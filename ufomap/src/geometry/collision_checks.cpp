@@ -41,6 +41,8 @@
 
 #include <ufo/geometry/collision_checks.h>
 
+#include <algorithm>
+#include <cmath>
 #include <exception>
 #include <limits>
 
@@ -822,4 +824,232 @@ bool intersects(const Sphere& sphere_1, const Sphere& sphere_2)
 /////////////////////////////////////////
 /////////////////////////////////////////////////////////////////////////////////////////
 
+/////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////// Child tests
+//////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////////////////
+
+// The children are separable: on each axis a child is in the lower or upper half. Terms
+// that only depend on one axis are computed for both halves, lane i then combines the
+// terms of the halves child i is in
+
+// The children with the lower or upper half on each axis
+static constexpr std::uint8_t CHILD_HALF[3][2] = {
+    {0x55, 0xAA}, {0x33, 0xCC}, {0x0F, 0xF0}};
+
+// Tests the children one at a time, for the ones without a separable test
+template <typename F>
+static ChildMask childMaskScalar(const Point& parent_center, double child_half_size,
+                                 F intersects_child)
+{
+	ChildMask mask;
+	AABB child;
+	child.half_size = Point(child_half_size, child_half_size, child_half_size);
+	for (unsigned int i = 0; i < 8; ++i) {
+		for (int a = 0; a < 3; ++a) {
+			child.center[a] =
+			    parent_center[a] + ((i & (1U << a)) ? child_half_size : -child_half_size);
+		}
+		if (intersects_child(child)) {
+			mask.intersects |= 1U << i;
+		}
+	}
+	return mask;
+}
+
+ChildMask childMask(const AABB& aabb, const Point& parent_center, double child_half_size)
+{
+	Point min = aabb.getMin();
+	Point max = aabb.getMax();
+
+	std::uint8_t intersects = 0xFF;
+	std::uint8_t inside = 0xFF;
+	for (int a = 0; a < 3; ++a) {
+		std::uint8_t axis_intersects = 0;
+		std::uint8_t axis_inside = 0;
+		for (int h = 0; h < 2; ++h) {
+			double center = parent_center[a] + (h ? child_half_size : -child_half_size);
+			double child_min = center - child_half_size;
+			double child_max = center + child_half_size;
+			if (child_min <= max[a] && min[a] <= child_max) {
+				axis_intersects |= CHILD_HALF[a][h];
+			}
+			if (min[a] <= child_min && child_max <= max[a]) {
+				axis_inside |= CHILD_HALF[a][h];
+			}
+		}
+		intersects &= axis_intersects;
+		inside &= axis_inside;
+	}
+	return ChildMask{intersects, std::uint8_t(intersects & inside)};
+}
+
+ChildMask childMask(const Frustum& frustum, const Point& parent_center,
+                    double child_half_size)
+{
+	// Same as classify(child, plane) < 0 for some plane, so outside a plane if
+	// d + r < 0, and inside all planes if d - r >= 0 for all of them
+	std::uint8_t intersects = 0xFF;
+	std::uint8_t inside = 0xFF;
+	for (const Plane& plane : frustum.planes) {
+		double r = std::abs(child_half_size * plane.normal.x()) +
+		           std::abs(child_half_size * plane.normal.y()) +
+		           std::abs(child_half_size * plane.normal.z());
+		double term[3][2];
+		for (int a = 0; a < 3; ++a) {
+			for (int h = 0; h < 2; ++h) {
+				double center = parent_center[a] + (h ? child_half_size : -child_half_size);
+				term[a][h] = plane.normal[a] * center;
+			}
+		}
+
+		double d[8];
+		for (unsigned int i = 0; i < 8; ++i) {
+			d[i] = term[0][i & 1] + term[1][(i >> 1) & 1] + term[2][(i >> 2) & 1] +
+			       plane.distance;
+		}
+		for (unsigned int i = 0; i < 8; ++i) {
+			if (0.0 > d[i] + r) {
+				intersects &= ~(1U << i);
+			}
+			if (0.0 > d[i] - r || std::abs(d[i]) < r) {
+				inside &= ~(1U << i);
+			}
+		}
+	}
+	return ChildMask{intersects, std::uint8_t(intersects & inside)};
+}
+
+ChildMask childMask(const LineSegment& line_segment, const Point& parent_center,
+                    double child_half_size)
+{
+	return childMaskScalar(parent_center, child_half_size, [&line_segment](auto& child) {
+		return intersects(child, line_segment);
+	});
+}
+
+ChildMask childMask(const OBB& obb, const Point& parent_center, double child_half_size)
+{
+	// Same separating axes as intersects(AABB, OBB), with the projections of the children
+	// being separable. A child is inside if it is within the OBB on the OBB axes
+	std::vector<double> obb_rot_matrix;
+	obb.rotation.toRotMatrix(obb_rot_matrix);
+
+	Point axes[15] = {Point(obb_rot_matrix[0], obb_rot_matrix[1], obb_rot_matrix[2]),
+	                  Point(obb_rot_matrix[3], obb_rot_matrix[4], obb_rot_matrix[5]),
+	                  Point(obb_rot_matrix[6], obb_rot_matrix[7], obb_rot_matrix[8]),
+	                  Point(1, 0, 0),
+	                  Point(0, 1, 0),
+	                  Point(0, 0, 1)};
+	for (int i = 0; i < 3; ++i) {
+		for (int j = 0; j < 3; ++j) {
+			axes[6 + i * 3 + j] = Point::cross(axes[3 + i], axes[j]);
+		}
+	}
+
+	std::uint8_t intersects = 0xFF;
+	std::uint8_t inside = 0xFF;
+	for (int k = 0; k < 15; ++k) {
+		Point const& axis = axes[k];
+		double child_r = child_half_size *
+		                 (std::abs(axis.x()) + std::abs(axis.y()) + std::abs(axis.z()));
+		double obb_r = obb.half_size.x() * std::abs(Point::dot(axes[0], axis)) +
+		               obb.half_size.y() * std::abs(Point::dot(axes[1], axis)) +
+		               obb.half_size.z() * std::abs(Point::dot(axes[2], axis));
+		double term[3][2];
+		for (int a = 0; a < 3; ++a) {
+			for (int h = 0; h < 2; ++h) {
+				term[a][h] = axis[a] * (parent_center[a] - obb.center[a] +
+				                        (h ? child_half_size : -child_half_size));
+			}
+		}
+
+		for (unsigned int i = 0; i < 8; ++i) {
+			double d =
+			    std::abs(term[0][i & 1] + term[1][(i >> 1) & 1] + term[2][(i >> 2) & 1]);
+			if (d > child_r + obb_r) {
+				intersects &= ~(1U << i);
+			}
+			if (3 > k && d + child_r > obb.half_size[k]) {
+				inside &= ~(1U << i);
+			}
+		}
+	}
+	return ChildMask{intersects, std::uint8_t(intersects & inside)};
+}
+
+ChildMask childMask(const Plane& plane, const Point& parent_center,
+                    double child_half_size)
+{
+	double p_len = child_half_size * std::abs(plane.normal.x()) +
+	               child_half_size * std::abs(plane.normal.y()) +
+	               child_half_size * std::abs(plane.normal.z());
+	double term[3][2];
+	for (int a = 0; a < 3; ++a) {
+		for (int h = 0; h < 2; ++h) {
+			double center = parent_center[a] + (h ? child_half_size : -child_half_size);
+			term[a][h] = plane.normal[a] * center;
+		}
+	}
+
+	ChildMask mask;
+	for (unsigned int i = 0; i < 8; ++i) {
+		double distance = term[0][i & 1] + term[1][(i >> 1) & 1] + term[2][(i >> 2) & 1] -
+		                  plane.distance;
+		if (std::abs(distance) <= p_len) {
+			mask.intersects |= 1U << i;
+		}
+	}
+	return mask;
+}
+
+ChildMask childMask(const Point& point, const Point& parent_center,
+                    double child_half_size)
+{
+	return childMaskScalar(parent_center, child_half_size,
+	                       [&point](auto& child) { return intersects(child, point); });
+}
+
+ChildMask childMask(const Ray& ray, const Point& parent_center, double child_half_size)
+{
+	return childMaskScalar(parent_center, child_half_size,
+	                       [&ray](auto& child) { return intersects(child, ray); });
+}
+
+ChildMask childMask(const Sphere& sphere, const Point& parent_center,
+                    double child_half_size)
+{
+	// Squared distance from the center to the closest and the furthest point of the
+	// children, per axis and half
+	double closest[3][2];
+	double furthest[3][2];
+	for (int a = 0; a < 3; ++a) {
+		for (int h = 0; h < 2; ++h) {
+			double center = parent_center[a] + (h ? child_half_size : -child_half_size);
+			double child_min = center - child_half_size;
+			double child_max = center + child_half_size;
+			double c = sphere.center[a] - std::clamp(sphere.center[a], child_min, child_max);
+			double f = std::max(std::abs(sphere.center[a] - child_min),
+			                    std::abs(sphere.center[a] - child_max));
+			closest[a][h] = c * c;
+			furthest[a][h] = f * f;
+		}
+	}
+
+	double radius_squared = sphere.radius * sphere.radius;
+	ChildMask mask;
+	for (unsigned int i = 0; i < 8; ++i) {
+		unsigned int x = i & 1;
+		unsigned int y = (i >> 1) & 1;
+		unsigned int z = (i >> 2) & 1;
+		if (closest[0][x] + closest[1][y] + closest[2][z] < radius_squared) {
+			mask.intersects |= 1U << i;
+		}
+		if (furthest[0][x] + furthest[1][y] + furthest[2][z] < radius_squared) {
+			mask.inside |= 1U << i;
+		}
+	}
+	return mask;
+}
+
 }  // namespace ufo::geometry
\ No newline at end of file
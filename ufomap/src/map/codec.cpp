@@ -0,0 +1,217 @@
+/**
+ * UFOMap: An Efficient Probabilistic 3D Mapping Framework That Embraces the Unknown
+ *
+ * @author D. Duberg, KTH Royal Institute of Technology, Copyright (c) 2020.
+ * @see https://github.com/UnknownFreeOccupied/ufomap
+ * License: BSD 3
+ *
+ */
+
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2020, D. Duberg, KTH Royal Institute of Technology
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <ufo/map/codec.h>
+
+// STD
+#include <limits>
+#include <memory>
+
+// LZ4
+#include <lz4.h>
+#include <lz4hc.h>
+
+#ifdef UFOMAP_ZSTD
+// zstd
+#include <zdict.h>
+#include <zstd.h>
+#endif
+
+namespace ufo::map
+{
+//
+// Names
+//
+
+std::string_view toString(Codec codec) noexcept
+{
+	switch (codec) {
+		case Codec::none:
+			return "none";
+		case Codec::lz4:
+			return "lz4";
+		case Codec::lz4_hc:
+			return "lz4_hc";
+		case Codec::zstd:
+			return "zstd";
+	}
+	return "";
+}
+
+std::optional<Codec> codecFromString(std::string_view name) noexcept
+{
+	for (Codec codec : {Codec::none, Codec::lz4, Codec::lz4_hc, Codec::zstd}) {
+		if (toString(codec) == name) {
+			return codec;
+		}
+	}
+	return std::nullopt;
+}
+
+bool isCodecAvailable(Codec codec) noexcept
+{
+#ifdef UFOMAP_ZSTD
+	return Codec::zstd >= codec;
+#else
+	return Codec::lz4_hc >= codec;
+#endif
+}
+
+//
+// Compress
+//
+
+bool compress(Codec codec, std::string_view src, std::string& dst, int level,
+              [[maybe_unused]] std::string_view dictionary)
+{
+	if (std::numeric_limits<int>::max() < src.size()) {
+		return false;
+	}
+
+	switch (codec) {
+		case Codec::none:
+			dst.assign(src);
+			return true;
+		case Codec::lz4:
+		case Codec::lz4_hc: {
+			dst.resize(LZ4_compressBound(src.size()));
+			int const size =
+			    Codec::lz4 == codec
+			        ? LZ4_compress_fast(src.data(), dst.data(), src.size(), dst.size(),
+			                            0 < level ? level : 1)
+			        : LZ4_compress_HC(src.data(), dst.data(), src.size(), dst.size(),
+			                          0 < level ? level : LZ4HC_CLEVEL_DEFAULT);
+			// Empty data compresses to one byte, so zero is an error
+			if (0 >= size) {
+				return false;
+			}
+			dst.resize(size);
+			return true;
+		}
+		case Codec::zstd: {
+#ifdef UFOMAP_ZSTD
+			// Contexts are reused by each thread, chunks are compressed in parallel
+			thread_local std::unique_ptr<ZSTD_CCtx, decltype(&ZSTD_freeCCtx)> context(
+			    ZSTD_createCCtx(), &ZSTD_freeCCtx);
+			dst.resize(ZSTD_compressBound(src.size()));
+			std::size_t const size = ZSTD_compress_usingDict(
+			    context.get(), dst.data(), dst.size(), src.data(), src.size(),
+			    dictionary.data(), dictionary.size(), 0 < level ? level : ZSTD_CLEVEL_DEFAULT);
+			if (ZSTD_isError(size)) {
+				return false;
+			}
+			dst.resize(size);
+			return true;
+#else
+			return false;
+#endif
+		}
+	}
+	return false;
+}
+
+//
+// Decompress
+//
+
+bool decompress(Codec codec, std::string_view src, std::string& dst,
+                [[maybe_unused]] std::string_view dictionary)
+{
+	switch (codec) {
+		case Codec::none:
+			if (src.size() != dst.size()) {
+				return false;
+			}
+			dst.assign(src);
+			return true;
+		case Codec::lz4:
+		case Codec::lz4_hc:
+			if (std::numeric_limits<int>::max() < src.size() ||
+			    std::numeric_limits<int>::max() < dst.size()) {
+				return false;
+			}
+			return static_cast<int>(dst.size()) ==
+			       LZ4_decompress_safe(src.data(), dst.data(), src.size(), dst.size());
+		case Codec::zstd: {
+#ifdef UFOMAP_ZSTD
+			thread_local std::unique_ptr<ZSTD_DCtx, decltype(&ZSTD_freeDCtx)> context(
+			    ZSTD_createDCtx(), &ZSTD_freeDCtx);
+			std::size_t const size =
+			    ZSTD_decompress_usingDict(context.get(), dst.data(), dst.size(), src.data(),
+			                              src.size(), dictionary.data(), dictionary.size());
+			return !ZSTD_isError(size) && dst.size() == size;
+#else
+			return false;
+#endif
+		}
+	}
+	return false;
+}
+
+//
+// Dictionary
+//
+
+std::string trainDictionary([[maybe_unused]] std::vector<std::string> const& samples,
+                            [[maybe_unused]] std::size_t max_size)
+{
+#ifdef UFOMAP_ZSTD
+	std::string buffer;
+	std::vector<std::size_t> sizes;
+	sizes.reserve(samples.size());
+	for (std::string const& sample : samples) {
+		buffer += sample;
+		sizes.push_back(sample.size());
+	}
+
+	std::string dictionary(max_size, '\0');
+	std::size_t const size = ZDICT_trainFromBuffer(
+	    dictionary.data(), dictionary.size(), buffer.data(), sizes.data(), sizes.size());
+	if (ZDICT_isError(size)) {
+		return std::string();
+	}
+	dictionary.resize(size);
+	return dictionary;
+#else
+	return std::string();
+#endif
+}
+}  // namespace ufo::map
@@ -0,0 +1,292 @@
+/**
+ * UFOMap: An Efficient Probabilistic 3D Mapping Framework That Embraces the Unknown
+ *
+ * @author D. Duberg, KTH Royal Institute of Technology, Copyright (c) 2020.
+ * @see https://github.com/UnknownFreeOccupied/ufomap
+ * License: BSD 3
+ *
+ */
+
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2020, D. Duberg, KTH Royal Institute of Technology
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <ufo/map/distance_field.h>
+
+// STD
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace ufo::map
+{
+DistanceField::DistanceField(double resolution, double max_distance)
+    : resolution_(resolution),
+      max_distance_(max_distance),
+      max_distance_squared_(static_cast<std::uint32_t>(
+          std::floor((max_distance / resolution) * (max_distance / resolution)))),
+      open_(max_distance_squared_ + 1)
+{
+}
+
+void DistanceField::clear()
+{
+	blocks_.clear();
+	obstacles_.clear();
+	for (auto& bucket : open_) {
+		bucket.clear();
+	}
+	open_min_ = 0;
+	open_size_ = 0;
+	cleared_.clear();
+}
+
+//
+// Cells
+//
+
+DistanceField::Cell const* DistanceField::find(Key const& key) const
+{
+	auto it = blocks_.find(toBlockKey(key));
+	return blocks_.end() == it ? nullptr : &it->second.cells[toCellIndex(key)];
+}
+
+DistanceField::Cell* DistanceField::find(Key const& key)
+{
+	auto it = blocks_.find(toBlockKey(key));
+	return blocks_.end() == it ? nullptr : &it->second.cells[toCellIndex(key)];
+}
+
+DistanceField::Cell& DistanceField::get(Key const& key)
+{
+	return blocks_[toBlockKey(key)].cells[toCellIndex(key)];
+}
+
+//
+// Obstacles
+//
+
+void DistanceField::setObstacle(Code const& code, bool obstacle)
+{
+	DepthType const depth = code.getDepth();
+	CodeType const first = code.toDepth(depth).getCode();
+	CodeType const last = first + (CodeType(1) << (3 * depth));
+
+	if (obstacle) {
+		for (CodeType c = first; last != c; ++c) {
+			addObstacle(Code(c).toKey());
+		}
+		return;
+	}
+
+	auto begin = obstacles_.lower_bound(first);
+	auto end = obstacles_.lower_bound(last);
+	std::vector<CodeType> removed(begin, end);
+	obstacles_.erase(begin, end);
+	for (CodeType c : removed) {
+		removeObstacle(Code(c).toKey());
+	}
+}
+
+void DistanceField::addObstacle(Key const& key)
+{
+	if (!obstacles_.insert(Code(key).getCode()).second) {
+		return;
+	}
+
+	Cell& cell = get(key);
+	if (cell.raise) {
+		// Let the cells behind it know their obstacle is gone before it blocks the way
+		raise(key);
+	}
+	cell.obstacle = {key[0], key[1], key[2]};
+	cell.distance = 0;
+	push(0, key);
+}
+
+void DistanceField::removeObstacle(Key const& key)
+{
+	Cell& cell = get(key);
+	cell.distance = NONE;
+	cell.raise = true;
+	push(0, key);
+	cleared_.push_back(key);
+}
+
+//
+// Update
+//
+
+void DistanceField::update()
+{
+	while (0 != open_size_) {
+		while (open_[open_min_].empty()) {
+			++open_min_;
+		}
+		std::uint32_t const distance = static_cast<std::uint32_t>(open_min_);
+		Key const key = open_[open_min_].back();
+		open_[open_min_].pop_back();
+		--open_size_;
+
+		Cell const* cell = find(key);
+		if (!cell) {
+			continue;
+		}
+
+		if (cell->raise) {
+			raise(key);
+		} else if (distance == cell->distance && isObstacle(cell->obstacle)) {
+			lower(key, cell->obstacle);
+		}
+	}
+
+	// Blocks the raise emptied and no obstacle reached again
+	KeySet blocks;
+	for (Key const& key : cleared_) {
+		blocks.insert(toBlockKey(key));
+	}
+	cleared_.clear();
+	for (Key const& block_key : blocks) {
+		auto it = blocks_.find(block_key);
+		if (blocks_.end() != it &&
+		    std::all_of(it->second.cells.begin(), it->second.cells.end(),
+		                [](Cell const& cell) { return NONE == cell.distance; })) {
+			blocks_.erase(it);
+		}
+	}
+}
+
+void DistanceField::lower(Key const& key, std::array<KeyType, 3> const& obstacle)
+{
+	NeighborBlocks blocks(key);
+	forEachNeighbor(key, [&](Key const& neighbor) {
+		std::int64_t const dx = std::int64_t(neighbor[0]) - std::int64_t(obstacle[0]);
+		std::int64_t const dy = std::int64_t(neighbor[1]) - std::int64_t(obstacle[1]);
+		std::int64_t const dz = std::int64_t(neighbor[2]) - std::int64_t(obstacle[2]);
+		std::int64_t const distance = dx * dx + dy * dy + dz * dz;
+		if (distance > max_distance_squared_) {
+			return;
+		}
+
+		Cell& cell = blocks.get(blocks_, neighbor);
+		if (cell.raise || distance >= cell.distance) {
+			return;
+		}
+		cell.obstacle = obstacle;
+		cell.distance = static_cast<std::uint32_t>(distance);
+		push(cell.distance, neighbor);
+	});
+}
+
+void DistanceField::raise(Key const& key)
+{
+	find(key)->raise = false;
+	NeighborBlocks blocks(key);
+	forEachNeighbor(key, [&](Key const& neighbor) {
+		Cell* cell_ptr = blocks.find(blocks_, neighbor);
+		if (!cell_ptr) {
+			return;
+		}
+
+		Cell& cell = *cell_ptr;
+		if (cell.raise || NONE == cell.distance) {
+			return;
+		}
+
+		push(cell.distance, neighbor);
+		if (!isObstacle(cell.obstacle)) {
+			// Lost its obstacle as well, keep raising
+			cell.distance = NONE;
+			cell.raise = true;
+			cleared_.push_back(neighbor);
+		}
+		// Otherwise it lowers into the cleared cells when popped
+	});
+}
+
+template <typename F>
+void DistanceField::forEachNeighbor(Key const& key, F f)
+{
+	constexpr KeyType max = std::numeric_limits<KeyType>::max();
+	for (int x = -1; 1 >= x; ++x) {
+		if ((0 > x && 0 == key[0]) || (0 < x && max == key[0])) {
+			continue;
+		}
+		for (int y = -1; 1 >= y; ++y) {
+			if ((0 > y && 0 == key[1]) || (0 < y && max == key[1])) {
+				continue;
+			}
+			for (int z = -1; 1 >= z; ++z) {
+				if ((0 > z && 0 == key[2]) || (0 < z && max == key[2]) ||
+				    (0 == x && 0 == y && 0 == z)) {
+					continue;
+				}
+				f(Key(key[0] + x, key[1] + y, key[2] + z, 0));
+			}
+		}
+	}
+}
+
+//
+// Queries
+//
+
+double DistanceField::getDistance(Key const& key) const
+{
+	Cell const* cell = find(key);
+	if (!cell || NONE == cell->distance) {
+		return max_distance_;
+	}
+	return std::min(max_distance_, std::sqrt(double(cell->distance)) * resolution_);
+}
+
+Point3 DistanceField::getGradient(Key const& key) const
+{
+	Cell const* cell = find(key);
+	if (!cell || NONE == cell->distance || 0 == cell->distance) {
+		return Point3();
+	}
+
+	Point3 gradient(static_cast<int>(key[0]) - static_cast<int>(cell->obstacle[0]),
+	                static_cast<int>(key[1]) - static_cast<int>(cell->obstacle[1]),
+	                static_cast<int>(key[2]) - static_cast<int>(cell->obstacle[2]));
+	return gradient / std::sqrt(double(cell->distance));
+}
+
+std::size_t DistanceField::memoryUsage() const
+{
+	// Node based containers, counting the node pointers as overhead
+	return blocks_.size() * (sizeof(std::pair<Key const, Block>) + 2 * sizeof(void*)) +
+	       blocks_.bucket_count() * sizeof(void*) +
+	       obstacles_.size() * (sizeof(CodeType) + 4 * sizeof(void*)) +
+	       cleared_.capacity() * sizeof(Key) + open_.capacity() * sizeof(std::vector<Key>);
+}
+}  // namespace ufo::map
@@ -63,4 +63,10 @@ OccupancyMap::OccupancyMap(std::string const& filename, bool automatic_pruning,
 }
 
 OccupancyMap::OccupancyMap(OccupancyMap const& other) : OccupancyMapBase(other) {}
+
+OccupancyMap::OccupancyMap(OccupancyMap const& other,
+                           ufo::geometry::BoundingVolume const& bounding_volume)
+    : OccupancyMapBase(other, bounding_volume)
+{
+}
 }  // namespace ufo::map
\ No newline at end of file
@@ -67,6 +67,12 @@ OccupancyMapColor::OccupancyMapColor(OccupancyMapColor const& other)
 {
 }
 
+OccupancyMapColor::OccupancyMapColor(OccupancyMapColor const& other,
+                                     ufo::geometry::BoundingVolume const& bounding_volume)
+    : OccupancyMapBase(other, bounding_volume)
+{
+}
+
 //
 // Set color
 //
@@ -90,22 +96,50 @@ Color OccupancyMapColor::getColor(Code const& code) const
 }
 
 //
-// Integrate colors
+// Merge color hits
 //
 
-void OccupancyMapColor::integrateColors(Point3 const& sensor_origin,
-                                        PointCloudColor const& cloud, double max_range)
+void OccupancyMapColor::mergeColorHits(std::vector<ColorHit>& color_hits)
 {
-	CodeMap<std::vector<Color>> colors;
-	for (Point3Color const& point : cloud) {
-		if (0 > max_range || (point - sensor_origin).norm() < max_range) {
-			colors[Base::toCode(point)].push_back(point.getColor());
-		}
+	if (color_hits.empty()) {
+		return;
 	}
 
-	for (auto const& [code, color] : colors) {
-		updateNodeColor(code, getAverageColor(color));
+	{
+		StageTimer timer(Base::metrics_, IntegrationStage::sort);
+		sortByCode(color_hits, color_sort_buffer_);
 	}
+
+	auto merged = color_hits.begin();
+	for (auto first = color_hits.begin(); color_hits.end() != first;) {
+		// Same as getAverageColor, without collecting the colors first
+		double r = 0;
+		double g = 0;
+		double b = 0;
+		std::size_t num_colors = 0;
+		auto last = first;
+		for (; color_hits.end() != last && std::get<0>(*first) == std::get<0>(*last);
+		     ++last) {
+			Color const& color = std::get<2>(*last);
+			if (color.isSet()) {
+				r += static_cast<double>(color.r) * static_cast<double>(color.r);
+				g += static_cast<double>(color.g) * static_cast<double>(color.g);
+				b += static_cast<double>(color.b) * static_cast<double>(color.b);
+				++num_colors;
+			}
+		}
+
+		*merged = *first;
+		if (0 == num_colors) {
+			std::get<2>(*merged) = Color();
+		} else {
+			double n = static_cast<double>(num_colors);
+			std::get<2>(*merged) = Color(std::sqrt(r / n), std::sqrt(g / n), std::sqrt(b / n));
+		}
+		++merged;
+		first = last;
+	}
+	color_hits.erase(merged, color_hits.end());
 }
 
 //
@@ -125,25 +159,11 @@ bool OccupancyMapColor::updateNode(INNER_NODE& node, DepthType depth)
 // Update node color
 //
 
-void OccupancyMapColor::updateNodeColor(Code code, Color update)
-{
-	if (!update.isSet()) {
-		return;
-	}
-
-	auto path = Base::createNode(code);
-	DepthType depth = code.getDepth();
-
-	updateNodeColor(*path[depth], update, 1.0 - Base::getOccupancy(*path[depth]));
-
-	Base::updateParents(path, depth);
-}
-
 void OccupancyMapColor::updateNodeColor(LEAF_NODE& node, Color update, double prob)
 {
 	Color& current = node.value.color;
 
-	if (current == update) {
+	if (!update.isSet() || current == update) {
 		return;
 	}
 
@@ -181,16 +201,27 @@ Color OccupancyMapColor::getAverageChildColor(INNER_NODE const& node,
 		return node.value.color;
 	}
 
-	std::vector<Color> colors;
-
+	// Same as getAverageColor, this is called for every inner node that is updated so the
+	// colors are not collected first
+	double r = 0;
+	double g = 0;
+	double b = 0;
+	int num_colors = 0;
 	for (int i = 0; i < 8; ++i) {
-		LEAF_NODE& child = getChild(node, depth - 1, i);
-		if (child.value.color.isSet()) {
-			colors.push_back(child.value.color);
+		Color const& color = getChild(node, depth - 1, i).value.color;
+		if (color.isSet()) {
+			r += static_cast<double>(color.r) * static_cast<double>(color.r);
+			g += static_cast<double>(color.g) * static_cast<double>(color.g);
+			b += static_cast<double>(color.b) * static_cast<double>(color.b);
+			++num_colors;
 		}
 	}
 
-	return getAverageColor(colors);
+	if (0 == num_colors) {
+		return Color();
+	}
+	return Color(std::sqrt(r / num_colors), std::sqrt(g / num_colors),
+	             std::sqrt(b / num_colors));
 }
 
 //
@@ -0,0 +1,74 @@
+/**
+ * UFOMap: An Efficient Probabilistic 3D Mapping Framework That Embraces the Unknown
+ *
+ * @author D. Duberg, KTH Royal Institute of Technology, Copyright (c) 2020.
+ * @see https://github.com/UnknownFreeOccupied/ufomap
+ * License: BSD 3
+ *
+ */
+
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2020, D. Duberg, KTH Royal Institute of Technology
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <ufo/map/occupancy_map_small.h>
+
+namespace ufo::map
+{
+OccupancyMapSmall::OccupancyMapSmall(double resolution, DepthType depth_levels,
+                                     bool automatic_pruning, double occupied_thres,
+                                     double free_thres, double prob_hit, double prob_miss,
+                                     double clamping_thres_min, double clamping_thres_max)
+    : OccupancyMapBase(resolution, depth_levels, automatic_pruning, occupied_thres,
+                       free_thres, prob_hit, prob_miss, clamping_thres_min,
+                       clamping_thres_max)
+{
+}
+
+OccupancyMapSmall::OccupancyMapSmall(std::string const& filename, bool automatic_pruning,
+                                     double occupied_thres, double free_thres,
+                                     double prob_hit, double prob_miss,
+                                     double clamping_thres_min, double clamping_thres_max)
+    : OccupancyMapBase(filename, automatic_pruning, occupied_thres, free_thres, prob_hit,
+                       prob_miss, clamping_thres_min, clamping_thres_max)
+{
+}
+
+OccupancyMapSmall::OccupancyMapSmall(OccupancyMapSmall const& other) : OccupancyMapBase(other)
+{
+}
+
+OccupancyMapSmall::OccupancyMapSmall(OccupancyMapSmall const& other,
+                                     ufo::geometry::BoundingVolume const& bounding_volume)
+    : OccupancyMapBase(other, bounding_volume)
+{
+}
+}  // namespace ufo::map
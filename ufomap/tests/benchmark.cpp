@@ -0,0 +1,359 @@
+/**
+ * UFOMap: An Efficient Probabilistic 3D Mapping Framework That Embraces the Unknown
+ *
+ * @author D. Duberg, KTH Royal Institute of Technology, Copyright (c) 2020.
+ * @see https://github.com/UnknownFreeOccupied/ufomap
+ * License: BSD 3
+ *
+ */
+
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2020, D. Duberg, KTH Royal Institute of Technology
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+// UFO
+#include <ufo/map/code.h>
+#include <ufo/map/codec.h>
+#include <ufo/map/occupancy_map.h>
+#include <ufo/map/occupancy_map_t.h>
+
+#include "synthetic.h"
+
+// Google Benchmark
+#include <benchmark/benchmark.h>
+
+// STD
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+//
+// Benchmarks of the core operations on a synthetic scene, so that two builds (e.g. with
+// and without UFOMAP_BMI2) or two versions can be compared on the same data. Run with
+// --benchmark_format=json to keep the results.
+//
+
+namespace
+{
+using namespace ufo::map;
+
+constexpr double RESOLUTION = 0.05;
+constexpr double MAX_RANGE = 15.0;
+constexpr std::size_t BEAMS = 32;
+constexpr std::size_t COLUMNS = 1024;
+constexpr std::size_t NUM_FRAMES = 8;
+
+Point3 const ORIGIN = synthetic::trajectory(0, NUM_FRAMES);
+
+PointCloud const& scan()
+{
+	static PointCloud const cloud = synthetic::scan(ORIGIN, BEAMS, COLUMNS);
+	return cloud;
+}
+
+// A loop around the pillar, built once and shared by the benchmarks that only read
+OccupancyMap const& sceneMap()
+{
+	static OccupancyMap const map = [] {
+		OccupancyMap map(RESOLUTION);
+		for (std::size_t i = 0; NUM_FRAMES != i; ++i) {
+			Point3 origin = synthetic::trajectory(i, NUM_FRAMES);
+			map.insertPointCloudDiscrete(origin, synthetic::scan(origin, BEAMS, COLUMNS, i),
+			                             MAX_RANGE);
+		}
+		return map;
+	}();
+	return map;
+}
+
+std::vector<Point3> randomDirections(std::size_t num)
+{
+	std::mt19937 gen(0);
+	std::normal_distribution<double> dist;
+	std::vector<Point3> directions;
+	directions.reserve(num);
+	while (directions.size() != num) {
+		Point3 direction(dist(gen), dist(gen), 0.2 * dist(gen));
+		directions.push_back(direction / direction.norm());
+	}
+	return directions;
+}
+
+//
+// Integration
+//
+
+// The same scan is integrated into the same map over and over, after the first few
+// iterations the occupancy is clamped and the cost per scan is steady
+void BM_InsertPointCloud(benchmark::State& state)
+{
+	DepthType depth = state.range(0);
+	OccupancyMap map(RESOLUTION);
+	for (auto _ : state) {
+		map.insertPointCloud(ORIGIN, scan(), MAX_RANGE, depth);
+	}
+	state.SetItemsProcessed(state.iterations() * scan().size());
+}
+BENCHMARK(BM_InsertPointCloud)
+    ->ArgName("depth")
+    ->DenseRange(0, 3)
+    ->Unit(benchmark::kMillisecond);
+
+void BM_InsertPointCloudDiscrete(benchmark::State& state)
+{
+	DepthType depth = state.range(0);
+	OccupancyMap map(RESOLUTION);
+	for (auto _ : state) {
+		map.insertPointCloudDiscrete(ORIGIN, scan(), MAX_RANGE, depth);
+	}
+	state.SetItemsProcessed(state.iterations() * scan().size());
+}
+BENCHMARK(BM_InsertPointCloudDiscrete)
+    ->ArgName("depth")
+    ->DenseRange(0, 3)
+    ->Unit(benchmark::kMillisecond);
+
+//
+// Fixed depth
+//
+
+// The same work on the runtime depth map and the compile time depth map, to see what
+// fixing the depth levels buys
+template <class Map>
+void BM_FixedDepthInsert(benchmark::State& state)
+{
+	Map map(RESOLUTION);
+	for (auto _ : state) {
+		map.insertPointCloudDiscrete(ORIGIN, scan(), MAX_RANGE);
+	}
+	state.SetItemsProcessed(state.iterations() * scan().size());
+}
+BENCHMARK_TEMPLATE(BM_FixedDepthInsert, OccupancyMap)->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(BM_FixedDepthInsert, OccupancyMapT<16>)->Unit(benchmark::kMillisecond);
+
+template <class Map>
+void BM_FixedDepthQuery(benchmark::State& state)
+{
+	Map map(RESOLUTION);
+	map.insertPointCloudDiscrete(ORIGIN, scan(), MAX_RANGE);
+	std::vector<Point3> points;
+	points.reserve(scan().size());
+	for (Point3 const& point : scan()) {
+		points.push_back(point);
+	}
+	std::size_t i = 0;
+	for (auto _ : state) {
+		benchmark::DoNotOptimize(map.getOccupancy(points[i]));
+		benchmark::DoNotOptimize(map.toCoord(map.toKey(points[i], 2)));
+		i = (i + 1) % points.size();
+	}
+	state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK_TEMPLATE(BM_FixedDepthQuery, OccupancyMap);
+BENCHMARK_TEMPLATE(BM_FixedDepthQuery, OccupancyMapT<16>);
+
+//
+// Cast ray
+//
+
+void BM_CastRay(benchmark::State& state)
+{
+	bool hierarchical = state.range(0);
+	OccupancyMap const& map = sceneMap();
+	std::vector<Point3> const directions = randomDirections(4096);
+	std::size_t i = 0;
+	for (auto _ : state) {
+		benchmark::DoNotOptimize(
+		    map.castRay(ORIGIN, directions[i], false, MAX_RANGE, 0, hierarchical));
+		i = (i + 1) % directions.size();
+	}
+	state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_CastRay)->ArgName("hierarchical")->Arg(0)->Arg(1);
+
+//
+// Iteration
+//
+
+void BM_LeafIteration(benchmark::State& state)
+{
+	OccupancyMap const& map = sceneMap();
+	std::size_t num = 0;
+	for (auto _ : state) {
+		num = 0;
+		for (auto it = map.beginLeaves(), last = map.endLeaves(); last != it; ++it) {
+			benchmark::DoNotOptimize(it.getDepth());
+			++num;
+		}
+	}
+	state.SetItemsProcessed(state.iterations() * num);
+}
+BENCHMARK(BM_LeafIteration)->Unit(benchmark::kMillisecond);
+
+// The k nearest occupied leaves to points along the trajectory
+void BM_NearestLeaves(benchmark::State& state)
+{
+	std::size_t k = state.range(0);
+	OccupancyMap const& map = sceneMap();
+	std::size_t i = 0;
+	for (auto _ : state) {
+		Point3 point = synthetic::trajectory(i++, 64);
+		std::size_t num = 0;
+		for (auto it = map.beginNNLeaves(point, true, false), last = map.endNNLeaves();
+		     last != it && k != num; ++it, ++num) {
+			benchmark::DoNotOptimize(it.getDepth());
+		}
+	}
+	state.SetItemsProcessed(state.iterations() * k);
+}
+BENCHMARK(BM_NearestLeaves)->ArgName("k")->RangeMultiplier(10)->Range(1, 1000);
+
+//
+// Set value volume
+//
+
+// Alternates between free and occupied, so every iteration changes the volume
+void BM_SetValueVolume(benchmark::State& state)
+{
+	double half_size = state.range(0) * RESOLUTION / 2.0;
+	OccupancyMap map(sceneMap());
+	ufo::geometry::AABB aabb(ORIGIN, half_size);
+	bool occupied = false;
+	for (auto _ : state) {
+		map.setValueVolume(aabb, occupied ? 0.9 : 0.1);
+		occupied = !occupied;
+	}
+	state.SetItemsProcessed(state.iterations() * state.range(0) * state.range(0) *
+	                        state.range(0));
+}
+BENCHMARK(BM_SetValueVolume)
+    ->ArgName("voxels_per_side")
+    ->RangeMultiplier(4)
+    ->Range(8, 128)
+    ->Unit(benchmark::kMicrosecond);
+
+//
+// Input/output
+//
+
+void BM_Write(benchmark::State& state)
+{
+	Codec codec = static_cast<Codec>(state.range(0));
+	if (!isCodecAvailable(codec)) {
+		state.SkipWithError("codec not available in this build");
+		return;
+	}
+	OccupancyMap const& map = sceneMap();
+	std::size_t size = 0;
+	for (auto _ : state) {
+		std::ostringstream s(std::ios_base::binary);
+		map.write(s, codec);
+		size = s.tellp();
+	}
+	state.SetBytesProcessed(state.iterations() * size);
+	state.counters["bytes"] = size;
+}
+BENCHMARK(BM_Write)
+    ->ArgName("codec")
+    ->DenseRange(static_cast<int>(Codec::none), static_cast<int>(Codec::zstd))
+    ->Unit(benchmark::kMillisecond);
+
+void BM_Read(benchmark::State& state)
+{
+	Codec codec = static_cast<Codec>(state.range(0));
+	if (!isCodecAvailable(codec)) {
+		state.SkipWithError("codec not available in this build");
+		return;
+	}
+	std::ostringstream out(std::ios_base::binary);
+	sceneMap().write(out, codec);
+	std::string const data = out.str();
+	for (auto _ : state) {
+		std::istringstream s(data, std::ios_base::binary);
+		OccupancyMap map(RESOLUTION);
+		benchmark::DoNotOptimize(map.read(s));
+	}
+	state.SetBytesProcessed(state.iterations() * data.size());
+}
+BENCHMARK(BM_Read)
+    ->ArgName("codec")
+    ->DenseRange(static_cast<int>(Codec::none), static_cast<int>(Codec::zstd))
+    ->Unit(benchmark::kMillisecond);
+
+//
+// Code set
+//
+
+std::vector<Code> randomCodes(std::size_t num)
+{
+	std::mt19937_64 gen(0);
+	std::vector<Code> codes;
+	codes.reserve(num);
+	for (std::size_t i = 0; num != i; ++i) {
+		// In a cube of 4096 leaves per side
+		codes.emplace_back(gen() & ((CodeType(1) << 36) - 1), 0);
+	}
+	return codes;
+}
+
+void BM_CodeSetInsert(benchmark::State& state)
+{
+	std::vector<Code> const codes = randomCodes(state.range(0));
+	CodeSet set;
+	for (auto _ : state) {
+		set.clear();
+		for (Code const& code : codes) {
+			benchmark::DoNotOptimize(set.insert(code));
+		}
+	}
+	state.SetItemsProcessed(state.iterations() * codes.size());
+}
+BENCHMARK(BM_CodeSetInsert)->ArgName("codes")->RangeMultiplier(10)->Range(1000, 100000);
+
+void BM_CodeSetIterate(benchmark::State& state)
+{
+	CodeSet set;
+	for (Code const& code : randomCodes(state.range(0))) {
+		set.insert(code);
+	}
+	for (auto _ : state) {
+		for (Code const& code : set) {
+			benchmark::DoNotOptimize(code.getCode());
+		}
+	}
+	state.SetItemsProcessed(state.iterations() * set.size());
+}
+BENCHMARK(BM_CodeSetIterate)->ArgName("codes")->RangeMultiplier(10)->Range(1000, 100000);
+}  // namespace
+
+BENCHMARK_MAIN();
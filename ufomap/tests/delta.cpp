@@ -0,0 +1,100 @@
+/**
+ * UFOMap: An Efficient Probabilistic 3D Mapping Framework That Embraces the Unknown
+ *
+ * @author D. Duberg, KTH Royal Institute of Technology, Copyright (c) 2020.
+ * @see https://github.com/UnknownFreeOccupied/ufomap
+ * License: BSD 3
+ *
+ */
+
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2020, D. Duberg, KTH Royal Institute of Technology
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+
+// UFO
+#include <ufo/map/occupancy_map.h>
+
+#include "test.h"
+
+// STD
+#include <sstream>
+
+//
+// Deltas: applying the delta of the changes to a map that had the same state before
+// the changes gives the same map, inner nodes included.
+//
+
+using namespace ufo::map;
+
+namespace
+{
+void roundTrip(bool lazy_propagation, bool compress)
+{
+	OccupancyMap sender(test::RESOLUTION);
+	OccupancyMap receiver(test::RESOLUTION);
+	sender.enableLazyPropagation(lazy_propagation);
+	receiver.enableLazyPropagation(lazy_propagation);
+	test::integrate(sender, 0, 3);
+	test::integrate(receiver, 0, 3);
+	CHECK_SAME_TREE(sender, receiver);
+
+	sender.enableChangeDetection(true);
+	test::integrate(sender, 3, 6);
+
+	std::stringstream delta;
+	CHECK(sender.writeDelta(delta, compress));
+	CHECK(receiver.applyDelta(delta));
+	receiver.propagate();
+	CHECK_SAME_TREE(sender, receiver);
+}
+}  // namespace
+
+UFO_TEST(delta) { roundTrip(false, false); }
+
+UFO_TEST(delta_compressed) { roundTrip(false, true); }
+
+UFO_TEST(delta_lazy_propagation) { roundTrip(true, false); }
+
+UFO_TEST(delta_mismatch)
+{
+	OccupancyMap sender(test::RESOLUTION);
+	sender.enableChangeDetection(true);
+	test::integrate(sender, 0, 1);
+	std::stringstream delta;
+	CHECK(sender.writeDelta(delta));
+
+	OccupancyMap receiver(2 * test::RESOLUTION);
+	CHECK(!receiver.applyDelta(delta));
+}
+
+int main(int argc, char** argv) { return test::run(argc, argv); }
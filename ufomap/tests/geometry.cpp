@@ -0,0 +1,212 @@
+/**
+ * UFOMap: An Efficient Probabilistic 3D Mapping Framework That Embraces the Unknown
+ *
+ * @author D. Duberg, KTH Royal Institute of Technology, Copyright (c) 2020.
+ * @see https://github.com/UnknownFreeOccupied/ufomap
+ * License: BSD 3
+ *
+ */
+
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2020, D. Duberg, KTH Royal Institute of Technology
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+
+// UFO
+#include <ufo/geometry/bounding_volume.h>
+#include <ufo/geometry/collision_checks.h>
+
+#include "test.h"
+
+// STD
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <type_traits>
+#include <variant>
+#include <vector>
+
+//
+// Geometry: the child masks that bound the tree traversal give the same children as
+// testing each child against the volume by itself.
+//
+
+using namespace ufo::geometry;
+
+namespace
+{
+// A few of each kind of volume, around the origin
+std::vector<BoundingVar> randomVolumes(std::size_t num_each)
+{
+	std::mt19937 gen(0);
+	std::uniform_real_distribution<double> coord(-2.0, 2.0);
+	std::uniform_real_distribution<double> size(0.01, 1.5);
+	std::uniform_real_distribution<double> angle(0.3, 1.5);
+	auto const point = [&] { return Point(coord(gen), coord(gen), coord(gen)); };
+	auto const direction = [&] {
+		Point p = point();
+		return p / p.norm();
+	};
+
+	std::vector<BoundingVar> volumes;
+	for (std::size_t i = 0; num_each != i; ++i) {
+		Point const center = point();
+		volumes.emplace_back(AABB(center, Point(size(gen), size(gen), size(gen))));
+		volumes.emplace_back(Frustum(center, center + direction(), direction(), angle(gen),
+		                             angle(gen), size(gen), 2 + 2 * size(gen)));
+		volumes.emplace_back(LineSegment(center, point()));
+		volumes.emplace_back(OBB(center, Point(size(gen), size(gen), size(gen)), point()));
+		volumes.emplace_back(Plane(direction(), coord(gen)));
+		volumes.emplace_back(center);
+		volumes.emplace_back(Ray(center, direction()));
+		volumes.emplace_back(Sphere(center, size(gen)));
+	}
+	return volumes;
+}
+
+AABB child(Point const& parent_center, double child_half_size, unsigned int i)
+{
+	Point center = parent_center;
+	for (int a = 0; 3 > a; ++a) {
+		center[a] += (i & (1U << a)) ? child_half_size : -child_half_size;
+	}
+	return AABB(center, child_half_size);
+}
+
+// Whether all corners of aabb are inside the volume, for the volumes that compute it
+template <class Volume>
+bool cornersInside(AABB const& aabb, Volume const& volume)
+{
+	bool inside = true;
+	for (unsigned int i = 0; 8 != i; ++i) {
+		Point corner = aabb.center;
+		for (int a = 0; 3 > a; ++a) {
+			corner[a] += (i & (1U << a)) ? aabb.half_size[a] : -aabb.half_size[a];
+		}
+		if constexpr (std::is_same_v<Volume, AABB>) {
+			inside = inside && volume.getMin()[0] <= corner[0] &&
+			         volume.getMin()[1] <= corner[1] && volume.getMin()[2] <= corner[2] &&
+			         volume.getMax()[0] >= corner[0] && volume.getMax()[1] >= corner[1] &&
+			         volume.getMax()[2] >= corner[2];
+		} else if constexpr (std::is_same_v<Volume, OBB>) {
+			// On the OBB axes, the rows of the rotation matrix as in intersects(AABB, OBB)
+			std::vector<double> rot;
+			volume.rotation.toRotMatrix(rot);
+			for (int a = 0; 3 > a; ++a) {
+				Point const axis(rot[3 * a], rot[3 * a + 1], rot[3 * a + 2]);
+				inside =
+				    inside && volume.half_size[a] >= std::abs(axis.dot(corner - volume.center));
+			}
+		} else if constexpr (std::is_same_v<Volume, Frustum>) {
+			for (Plane const& plane : volume.planes) {
+				inside = inside && 0.0 <= plane.normal.dot(corner) + plane.distance;
+			}
+		} else if constexpr (std::is_same_v<Volume, Sphere>) {
+			inside = inside && volume.radius > (corner - volume.center).norm();
+		} else {
+			inside = false;
+		}
+	}
+	return inside;
+}
+}  // namespace
+
+UFO_TEST(child_mask)
+{
+	std::mt19937 gen(1);
+	std::uniform_real_distribution<double> coord(-2.0, 2.0);
+	std::vector<double> const child_half_sizes{0.05, 0.2, 0.8, 1.6};
+
+	std::size_t num_intersects = 0;
+	std::size_t num_inside = 0;
+	std::size_t num_diff = 0;
+	for (BoundingVar const& volume : randomVolumes(50)) {
+		for (std::size_t p = 0; 200 != p; ++p) {
+			Point const parent_center(coord(gen), coord(gen), coord(gen));
+			double const child_half_size = child_half_sizes[p % child_half_sizes.size()];
+
+			std::visit(
+			    [&](auto const& v) {
+				    ChildMask const mask = childMask(v, parent_center, child_half_size);
+				    std::uint8_t intersects = 0;
+				    std::uint8_t inside = 0;
+				    for (unsigned int i = 0; 8 != i; ++i) {
+					    AABB const aabb = child(parent_center, child_half_size, i);
+					    intersects |= ufo::geometry::intersects(aabb, v) ? 1U << i : 0U;
+					    inside |= cornersInside(aabb, v) ? 1U << i : 0U;
+				    }
+				    num_diff += intersects != mask.intersects || inside != mask.inside;
+				    num_intersects += 0 != mask.intersects;
+				    num_inside += 0 != mask.inside;
+			    },
+			    volume);
+		}
+	}
+	CHECK(0 == num_diff);
+	CHECK(0 < num_intersects);
+	CHECK(0 < num_inside);
+}
+
+UFO_TEST(bounding_volume_child_mask)
+{
+	// Any of the volumes, sphere and box first to also hit the all inside early exit
+	std::mt19937 gen(2);
+	std::uniform_real_distribution<double> coord(-2.0, 2.0);
+	std::vector<BoundingVar> const volumes = randomVolumes(2);
+
+	BoundingVolume bv;
+	bv.add(Sphere(Point(0, 0, 0), 3.0));
+	for (BoundingVar const& volume : volumes) {
+		bv.add(volume);
+	}
+
+	std::size_t num_diff = 0;
+	for (std::size_t p = 0; 2000 != p; ++p) {
+		Point const parent_center(coord(gen), coord(gen), coord(gen));
+		double const child_half_size = 0.05 + 0.01 * (p % 100);
+
+		ChildMask expected = childMask(Sphere(Point(0, 0, 0), 3.0), parent_center,
+		                               child_half_size);
+		for (BoundingVar const& volume : volumes) {
+			ChildMask const mask = std::visit(
+			    [&](auto const& v) { return childMask(v, parent_center, child_half_size); },
+			    volume);
+			expected.intersects |= mask.intersects;
+			expected.inside |= mask.inside;
+		}
+		ChildMask const mask = bv.childMask(parent_center, child_half_size);
+		num_diff += expected.intersects != mask.intersects || expected.inside != mask.inside;
+	}
+	CHECK(0 == num_diff);
+}
+
+int main(int argc, char** argv) { return ufo::map::test::run(argc, argv); }
@@ -0,0 +1,560 @@
+/**
+ * UFOMap: An Efficient Probabilistic 3D Mapping Framework That Embraces the Unknown
+ *
+ * @author D. Duberg, KTH Royal Institute of Technology, Copyright (c) 2020.
+ * @see https://github.com/UnknownFreeOccupied/ufomap
+ * License: BSD 3
+ *
+ */
+
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2020, D. Duberg, KTH Royal Institute of Technology
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+
+// UFO
+#include <ufo/map/bounded_queue.h>
+#include <ufo/map/code.h>
+#include <ufo/map/code_concurrent.h>
+#include <ufo/map/depth_schedule.h>
+#include <ufo/map/integration_metrics.h>
+#include <ufo/map/occupancy_map.h>
+#include <ufo/map/prefilter.h>
+
+#include "test.h"
+
+// STD
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <map>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+//
+// Integration: the concurrent tables, single precision point clouds, parallel and
+// asynchronous ray casting, lazy propagation, the pipeline, and read only copies give the
+// same map as the default serial integration. The integration metrics count what was
+// integrated.
+//
+
+using namespace ufo::map;
+
+namespace
+{
+OccupancyMap reference()
+{
+	OccupancyMap map(test::RESOLUTION);
+	test::integrate(map, 0, test::NUM_FRAMES);
+	CHECK(0 != map.getNumLeafNodes());
+	return map;
+}
+}  // namespace
+
+UFO_TEST(concurrent_code_set)
+{
+	// The codes of all end points, inserted from several threads at once
+	std::vector<Code> codes;
+	OccupancyMap map(test::RESOLUTION);
+	for (std::size_t i = 0; 2 != i; ++i) {
+		for (Point3 const& point : test::scan(i)) {
+			codes.push_back(map.toCode(point));
+		}
+	}
+
+	// CodeSet has no lookup, so what it kept is checked through what it iterates
+	CodeSet code_set;
+	for (Code const& code : codes) {
+		code_set.insert(code);
+	}
+	std::unordered_set<Code, Code::Hash> expected(code_set.begin(), code_set.end());
+	CHECK(code_set.size() == expected.size());
+
+	ConcurrentCodeSet set;
+	std::size_t const num_threads = 4;
+	std::vector<std::thread> threads;
+	for (std::size_t t = 0; num_threads != t; ++t) {
+		threads.emplace_back([&codes, &set, t] {
+			for (std::size_t i = t; codes.size() > i; i += num_threads) {
+				set.insert(codes[i]);
+			}
+		});
+	}
+	for (auto& thread : threads) {
+		thread.join();
+	}
+
+	CHECK(expected.size() == set.size());
+	std::size_t num_iterated = 0;
+	for (Code const& code : set) {
+		CHECK(expected.count(code));
+		++num_iterated;
+	}
+	CHECK(expected.size() == num_iterated);
+	for (Code const& code : expected) {
+		CHECK(set.contains(code));
+	}
+
+	set.clear();
+	CHECK(set.empty());
+	CHECK(set.end() == set.begin());
+	CHECK(!set.contains(codes.front()));
+}
+
+UFO_TEST(parallel)
+{
+	OccupancyMap map(test::RESOLUTION);
+	for (std::size_t i = 0; test::NUM_FRAMES != i; ++i) {
+		map.insertPointCloudDiscrete(test::origin(i), test::scan(i), test::MAX_RANGE, 0,
+		                             false, 0, false, true);
+	}
+	CHECK_SAME_TREE(reference(), map);
+}
+
+UFO_TEST(async)
+{
+	OccupancyMap map(test::RESOLUTION);
+	for (std::size_t i = 0; test::NUM_FRAMES != i; ++i) {
+		map.insertPointCloudDiscrete(test::origin(i), test::scan(i), test::MAX_RANGE, 0,
+		                             false, 0, true);
+	}
+	map.insertPointCloudWait();
+	CHECK_SAME_TREE(reference(), map);
+
+	// The end is when the integration was applied, not when insert returned
+	auto const before = std::chrono::steady_clock::now();
+	map.insertPointCloudDiscrete(test::origin(0), test::scan(0), test::MAX_RANGE, 0, false,
+	                             0, true);
+	auto const returned = std::chrono::steady_clock::now();
+	map.insertPointCloudWait();
+	CHECK(before < map.insertPointCloudEnd());
+	CHECK(returned <= map.insertPointCloudEnd());
+	CHECK(std::chrono::steady_clock::now() >= map.insertPointCloudEnd());
+}
+
+UFO_TEST(single_precision)
+{
+	// The float clouds give the same map as the same points in double precision
+	OccupancyMap map_double(test::RESOLUTION);
+	OccupancyMap map_float(test::RESOLUTION);
+	OccupancyMap map_soa(test::RESOLUTION);
+	for (std::size_t i = 0; test::NUM_FRAMES != i; ++i) {
+		PointCloudF cloud_float;
+		PointCloud cloud_double;
+		for (Point3 const& point : test::scan(i)) {
+			cloud_float.push_back(Point3F(point));
+			cloud_double.push_back(Point3F(point));
+		}
+		PointCloudSoA const cloud_soa(cloud_float);
+
+		map_double.insertPointCloudDiscrete(test::origin(i), cloud_double, test::MAX_RANGE);
+		map_float.insertPointCloudDiscrete(test::origin(i), cloud_float, test::MAX_RANGE);
+		map_soa.insertPointCloudDiscrete(test::origin(i), cloud_soa, test::MAX_RANGE);
+	}
+	CHECK_SAME_TREE(map_double, map_float);
+	CHECK_SAME_TREE(map_double, map_soa);
+
+	// The float transforms agree with the double one up to float precision, parallel and
+	// serial exactly
+	ufo::math::Pose6 const pose(1.5, -2.0, 0.5, 0.1, -0.2, 2.5);
+	PointCloudF cloud_float;
+	for (Point3 const& point : test::scan(0)) {
+		cloud_float.push_back(Point3F(point));
+	}
+	PointCloud cloud_double;
+	for (Point3F const& point : cloud_float) {
+		cloud_double.push_back(point);
+	}
+	PointCloudSoA cloud_soa(cloud_float);
+	PointCloudSoA cloud_soa_parallel(cloud_float);
+
+	cloud_double.transform(pose);
+	cloud_float.transform(pose);
+	cloud_soa.transform(pose);
+	cloud_soa_parallel.transform(pose, true);
+
+	std::size_t num_diff = 0;
+	for (std::size_t i = 0; cloud_double.size() != i; ++i) {
+		Point3 const expected = cloud_double[i];
+		num_diff += 1e-4 < (expected - Point3(cloud_float[i])).norm() ||
+		            1e-4 < (expected - Point3(cloud_soa[i])).norm() ||
+		            cloud_soa[i] != cloud_soa_parallel[i];
+	}
+	CHECK(0 == num_diff);
+}
+
+UFO_TEST(lazy_propagation)
+{
+	OccupancyMap map(test::RESOLUTION);
+	map.enableLazyPropagation(true);
+	test::integrate(map, 0, test::NUM_FRAMES);
+	map.propagate();
+	CHECK_SAME_TREE(reference(), map);
+}
+
+UFO_TEST(depth_schedule)
+{
+	DepthSchedule schedule({{10.0, DepthType(2)}, {5.0, DepthType(1)}});
+	schedule.add(10.0, 3);
+	CHECK(0 == schedule.depth(0.0) && 0 == schedule.depth(4.9));
+	CHECK(1 == schedule.depth(5.0) && 1 == schedule.depth(9.9));
+	CHECK(3 == schedule.depth(10.0) && 3 == schedule.maxDepth());
+	auto const intervals = schedule.intervals();
+	CHECK(3 == intervals.size());
+	CHECK(0.0 == intervals.front().first.first && 0 == intervals.front().second);
+	CHECK(10.0 == intervals.back().first.first && 3 == intervals.back().second);
+
+	// Depth 0 all the way, or only beyond the range, is the default integration
+	OccupancyMap const expected = reference();
+	for (DepthSchedule const& depth_zero :
+	     {DepthSchedule(), DepthSchedule({{2 * test::MAX_RANGE, DepthType(2)}})}) {
+		OccupancyMap map(test::RESOLUTION);
+		for (std::size_t i = 0; test::NUM_FRAMES != i; ++i) {
+			map.insertPointCloudDiscrete(test::origin(i), test::scan(i), depth_zero,
+			                             test::MAX_RANGE);
+		}
+		CHECK_SAME_TREE(expected, map);
+	}
+
+	// Asynchronous and parallel give the same map as serial
+	OccupancyMap serial(test::RESOLUTION);
+	for (std::size_t i = 0; test::NUM_FRAMES != i; ++i) {
+		serial.insertPointCloudDiscrete(test::origin(i), test::scan(i), schedule,
+		                                test::MAX_RANGE);
+	}
+	CHECK(0 != test::compareTrees(expected, serial, 0.0, 0));
+	for (bool async : {false, true}) {
+		OccupancyMap map(test::RESOLUTION);
+		for (std::size_t i = 0; test::NUM_FRAMES != i; ++i) {
+			map.insertPointCloudDiscrete(test::origin(i), test::scan(i), schedule,
+			                             test::MAX_RANGE, false, 0, async, true);
+		}
+		map.insertPointCloudWait();
+		CHECK_SAME_TREE(serial, map);
+	}
+}
+
+UFO_TEST(prefilter)
+{
+	OccupancyMap map(test::RESOLUTION);
+	PointCloud const cloud = test::scan(0);
+	PointCloud filtered;
+
+	// Nothing enabled keeps every point
+	PrefilterOptions none;
+	none.voxel_filter = false;
+	PrefilterStats stats = map.prefilter(test::origin(0), cloud, filtered, none);
+	CHECK(cloud.size() == stats.input && cloud.size() == stats.kept);
+	CHECK(0 == stats.dropped() && cloud.size() == filtered.size());
+
+	// The voxel filter keeps the centroid of the points in each node
+	std::map<CodeType, std::pair<Point3, std::size_t>> centroids;
+	for (Point3 const& point : cloud) {
+		auto& [sum, num] = centroids[map.toCode(point).getCode()];
+		sum += point;
+		++num;
+	}
+	stats = map.prefilter(test::origin(0), cloud, filtered, PrefilterOptions());
+	CHECK(centroids.size() == stats.kept && centroids.size() == filtered.size());
+	CHECK(cloud.size() == stats.kept + stats.voxel_dropped);
+	std::size_t num_wrong = 0;
+	for (Point3 const& point : filtered) {
+		auto const it = centroids.find(map.toCode(point).getCode());
+		if (centroids.end() == it) {
+			++num_wrong;
+			continue;
+		}
+		auto const& [sum, num] = it->second;
+		if (1e-9 < (sum / static_cast<double>(num) - point).norm()) {
+			++num_wrong;
+		}
+	}
+	CHECK(0 == num_wrong);
+
+	// The angular filter only drops points
+	PrefilterOptions angular = none;
+	angular.angular_resolution = 0.05;
+	angular.range_tolerance = 0.5;
+	stats = map.prefilter(test::origin(0), cloud, filtered, angular);
+	CHECK(0 != stats.angular_dropped);
+	CHECK(cloud.size() == stats.kept + stats.dropped());
+
+	// Without filters, and with the voxel filter at the resolution, the discrete
+	// integration sees the same end nodes, so the map is the same as without prefilter
+	OccupancyMap const expected = reference();
+	for (PrefilterOptions const& options : {none, PrefilterOptions()}) {
+		OccupancyMap prefiltered(test::RESOLUTION);
+		prefiltered.enablePrefilter(true);
+		prefiltered.setPrefilterOptions(options);
+		test::integrate(prefiltered, 0, test::NUM_FRAMES);
+		CHECK_SAME_TREE(expected, prefiltered);
+	}
+}
+
+UFO_TEST(pipeline)
+{
+	OccupancyMap map(test::RESOLUTION);
+	map.startPipeline();
+	IntegrationTicket last = 0;
+	for (std::size_t i = 0; test::NUM_FRAMES != i; ++i) {
+		last = map.insertPointCloudPipelined(test::origin(i), test::scan(i), std::nullopt,
+		                                     test::MAX_RANGE, 0, false, 0, false, true);
+	}
+	map.waitFor(last);
+	for (IntegrationTicket ticket = 1; last >= ticket; ++ticket) {
+		CHECK(map.isDone(ticket));
+		CHECK(!map.wasDropped(ticket));
+	}
+	map.stopPipeline();
+	CHECK_SAME_TREE(reference(), map);
+}
+
+UFO_TEST(pipeline_drop_oldest)
+{
+	// Queue the frames several times over, far faster than they can be integrated
+	std::size_t const num_clouds = 4 * test::NUM_FRAMES;
+	OccupancyMap map(test::RESOLUTION);
+	map.startPipeline(1, BackpressurePolicy::drop_oldest);
+	std::vector<IntegrationTicket> tickets;
+	for (std::size_t i = 0; num_clouds != i; ++i) {
+		std::size_t const frame = i % test::NUM_FRAMES;
+		tickets.push_back(map.insertPointCloudPipelined(test::origin(frame),
+		                                                test::scan(frame), std::nullopt,
+		                                                test::MAX_RANGE, 0, false, 0,
+		                                                false, true));
+	}
+	map.waitFor(tickets.back());
+
+	// The map is what inserting the clouds that were not dropped, in order, gives. The
+	// drops are asked for after later tickets have been applied
+	OccupancyMap expected(test::RESOLUTION);
+	std::size_t num_dropped = 0;
+	for (std::size_t i = 0; num_clouds != i; ++i) {
+		CHECK(map.isDone(tickets[i]));
+		if (map.wasDropped(tickets[i])) {
+			++num_dropped;
+			continue;
+		}
+		std::size_t const frame = i % test::NUM_FRAMES;
+		expected.insertPointCloudDiscrete(test::origin(frame), test::scan(frame),
+		                                  test::MAX_RANGE);
+	}
+	CHECK(0 != num_dropped);
+	CHECK(num_clouds != num_dropped);
+	map.stopPipeline();
+	CHECK_SAME_TREE(expected, map);
+}
+
+UFO_TEST(pipeline_merge)
+{
+	// Merged clouds are applied occupied hits first, that only gives the same occupancy
+	// as sequential insertion if no node is clamped in between
+	auto make_map = [] {
+		OccupancyMap map(test::RESOLUTION);
+		map.setClampingThresMin(0.0001);
+		map.setClampingThresMax(0.9999);
+		return map;
+	};
+
+	OccupancyMap expected = make_map();
+	test::integrate(expected, 0, test::NUM_FRAMES);
+
+	OccupancyMap map = make_map();
+	map.startPipeline(1, BackpressurePolicy::merge);
+	IntegrationTicket last = 0;
+	for (std::size_t i = 0; test::NUM_FRAMES != i; ++i) {
+		last = map.insertPointCloudPipelined(test::origin(i), test::scan(i), std::nullopt,
+		                                     test::MAX_RANGE, 0, false, 0, false, true);
+	}
+	map.waitFor(last);
+	for (IntegrationTicket ticket = 1; last >= ticket; ++ticket) {
+		CHECK(map.isDone(ticket));
+		CHECK(!map.wasDropped(ticket));
+	}
+	map.stopPipeline();
+	CHECK(0 == test::compareTrees(expected, map, 1e-4));
+}
+
+UFO_TEST(read_only_copy)
+{
+	OccupancyMap map(test::RESOLUTION);
+	map.enableLazyPropagation(true);
+	test::integrate(map, 0, test::NUM_FRAMES / 2);
+	auto copy = map.readOnlyCopy();
+	CHECK_SAME_TREE(map, *copy);
+
+	// Later updates are not seen by the copy
+	OccupancyMap half(test::RESOLUTION);
+	test::integrate(half, 0, test::NUM_FRAMES / 2);
+	test::integrate(map, test::NUM_FRAMES / 2, test::NUM_FRAMES);
+	CHECK_SAME_TREE(half, *copy);
+}
+
+UFO_TEST(concurrent_queries)
+{
+	OccupancyMap map(test::RESOLUTION);
+	map.enableConcurrentQueries(true);
+
+	// A reader that only sees whole updates, holding the read lock over several queries
+	// that read the map again, and a writer that keeps waiting for the lock in between
+	std::atomic_bool done = false;
+	std::atomic_size_t num_reads = 0;
+	std::atomic_size_t num_inconsistent = 0;
+	std::thread reader([&] {
+		PointCloud const cloud = test::scan(0);
+		std::vector<Point3> const points(cloud.begin(), cloud.end());
+		std::vector<double> occupancies;
+		std::vector<double> occupancies_again;
+		while (!done) {
+			auto lock = map.readLock();
+			std::atomic_size_t num_parallel = 0;
+			map.parallelForEachLeaf([&num_parallel](auto const&) { ++num_parallel; });
+			map.getOccupancies(points, occupancies);
+			std::size_t num_serial = 0;
+			for (auto it = map.beginLeaves(), end = map.endLeaves(); end != it; ++it) {
+				++num_serial;
+			}
+			map.getOccupancies(points, occupancies_again);
+			if (num_parallel != num_serial || occupancies != occupancies_again) {
+				++num_inconsistent;
+			}
+			++num_reads;
+		}
+	});
+	std::thread writer([&] {
+		while (!done) {
+			{
+				auto lock = map.writeLock();
+			}
+			std::this_thread::sleep_for(std::chrono::microseconds(100));
+		}
+	});
+
+	for (std::size_t i = 0; test::NUM_FRAMES != i; ++i) {
+		map.insertPointCloudDiscrete(test::origin(i), test::scan(i), test::MAX_RANGE, 0,
+		                             false, 0, true);
+	}
+	map.insertPointCloudWait();
+	// Let the reader see the final map at least once
+	std::size_t const num_reads_before = num_reads;
+	while (num_reads_before + 1 >= num_reads) {
+		std::this_thread::yield();
+	}
+	done = true;
+	reader.join();
+	writer.join();
+
+	CHECK(0 == num_inconsistent);
+	CHECK_SAME_TREE(reference(), map);
+}
+
+UFO_TEST(metrics)
+{
+	// Bucket i holds [2^i, 2^(i + 1)) us
+	TimingHistogram histogram;
+	for (double seconds : {1.0e-6, 3.0e-6, 5.0e-6, 6.0e-6, 1.0e3}) {
+		histogram.add(seconds);
+	}
+	CHECK(5 == histogram.count);
+	CHECK(1 == histogram.buckets[0] && 1 == histogram.buckets[1] &&
+	      2 == histogram.buckets[2]);
+	CHECK(1 == histogram.buckets[TimingHistogram::NUM_BUCKETS - 1]);
+	CHECK(1.0e-6 == histogram.min && 1.0e3 == histogram.max);
+	CHECK(1.0e-9 > std::abs((1.0e3 + 15.0e-6) / 5 - histogram.mean()));
+	CHECK(1.0e-12 > std::abs(8.0e-6 - histogram.quantile(0.5)));
+	CHECK(1.0e3 == histogram.quantile(1.0));
+
+	OccupancyMap map(test::RESOLUTION);
+	OccupancyMap map_parallel(test::RESOLUTION);
+	std::uint64_t num_points = 0;
+	for (std::size_t i = 0; test::NUM_FRAMES != i; ++i) {
+		num_points += test::scan(i).size();
+		map.insertPointCloudDiscrete(test::origin(i), test::scan(i), test::MAX_RANGE);
+		map_parallel.insertPointCloudDiscrete(test::origin(i), test::scan(i),
+		                                      test::MAX_RANGE, 0, false, 0, false, true);
+	}
+
+	IntegrationStats const stats = map.getIntegrationStats();
+	if (!OccupancyMap::isIntegrationMetricsEnabled()) {
+		// Not collected
+		for (std::uint64_t counter : stats.counters) {
+			CHECK(0 == counter);
+		}
+		for (TimingHistogram const& stage : stats.stages) {
+			CHECK(0 == stage.count);
+		}
+		return;
+	}
+
+	CHECK(test::NUM_FRAMES == stats[IntegrationCounter::clouds]);
+	CHECK(num_points == stats[IntegrationCounter::points]);
+	CHECK(0 < stats[IntegrationCounter::rays]);
+	CHECK(num_points >= stats[IntegrationCounter::rays]);
+	CHECK(stats[IntegrationCounter::rays] <= stats[IntegrationCounter::dda_steps]);
+	CHECK(stats[IntegrationCounter::dda_steps] ==
+	      stats[IntegrationCounter::hash_inserts] +
+	          stats[IntegrationCounter::hash_collisions]);
+	CHECK(0 == stats[IntegrationCounter::early_stops]);
+	CHECK(0 < stats[IntegrationCounter::nodes_created]);
+	CHECK(0 < stats[IntegrationCounter::node_updates]);
+
+	// One discretize, ray cast and collect per cloud, sort and update for both the
+	// occupied and the free space, and no lazy propagation
+	for (IntegrationStage stage : {IntegrationStage::discretize, IntegrationStage::ray_cast,
+	                               IntegrationStage::collect}) {
+		CHECK(test::NUM_FRAMES == stats[stage].count);
+	}
+	CHECK(test::NUM_FRAMES <= stats[IntegrationStage::sort].count);
+	CHECK(test::NUM_FRAMES <= stats[IntegrationStage::update].count);
+	CHECK(0 == stats[IntegrationStage::propagate].count);
+
+	// The same rays are cast in parallel
+	IntegrationStats const stats_parallel = map_parallel.getIntegrationStats();
+	for (IntegrationCounter counter :
+	     {IntegrationCounter::clouds, IntegrationCounter::points, IntegrationCounter::rays,
+	      IntegrationCounter::dda_steps, IntegrationCounter::nodes_created}) {
+		CHECK(stats[counter] == stats_parallel[counter]);
+	}
+
+	map.resetIntegrationStats();
+	IntegrationStats const reset = map.getIntegrationStats();
+	for (std::uint64_t counter : reset.counters) {
+		CHECK(0 == counter);
+	}
+	for (TimingHistogram const& stage : reset.stages) {
+		CHECK(0 == stage.count);
+	}
+}
+
+int main(int argc, char** argv) { return test::run(argc, argv); }
@@ -0,0 +1,222 @@
+/**
+ * UFOMap: An Efficient Probabilistic 3D Mapping Framework That Embraces the Unknown
+ *
+ * @author D. Duberg, KTH Royal Institute of Technology, Copyright (c) 2020.
+ * @see https://github.com/UnknownFreeOccupied/ufomap
+ * License: BSD 3
+ *
+ */
+
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2020, D. Duberg, KTH Royal Institute of Technology
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+
+// UFO
+#include <ufo/geometry/aabb.h>
+#include <ufo/geometry/bounding_volume.h>
+#include <ufo/map/codec.h>
+#include <ufo/map/occupancy_map.h>
+#include <ufo/map/occupancy_map_compact.h>
+
+#include "test.h"
+
+// STD
+#include <cmath>
+#include <filesystem>
+#include <sstream>
+#include <string>
+
+// TBB
+#include <tbb/global_control.h>
+#include <tbb/task_arena.h>
+
+//
+// IO: writing and reading back a map, with each codec, chunk depth, and bounding volume,
+// or as a flat file that is mapped, gives the same map. So does building the subtrees of
+// a load in parallel.
+//
+
+using namespace ufo::map;
+
+namespace
+{
+OccupancyMap reference()
+{
+	OccupancyMap map(test::RESOLUTION);
+	test::integrate(map, 0, test::NUM_FRAMES);
+	CHECK(0 != map.getNumLeafNodes());
+	return map;
+}
+
+// The sides are between voxel faces, so no voxel only touches the box
+ufo::geometry::BoundingVolume box()
+{
+	ufo::geometry::BoundingVolume bv;
+	bv.add(ufo::geometry::AABB(Point3(2.02, 0.03, 1.01), 1.96));
+	return bv;
+}
+
+std::string tempFile(std::string const& name)
+{
+	return (std::filesystem::temp_directory_path() / name).string();
+}
+
+// Whether b has the occupancy of a at every leaf of a intersecting bounding_volume. Only
+// compares values, since the unread parts of b can make b prune where a does not.
+template <class Map>
+bool sameInside(Map const& a, Map const& b,
+                ufo::geometry::BoundingVolume const& bounding_volume)
+{
+	for (auto it = a.beginLeaves(bounding_volume, true, true, true), end = a.endLeaves();
+	     end != it; ++it) {
+		if (it.getOccupancy() != b.getOccupancy(it.getCode())) {
+			return false;
+		}
+	}
+	return true;
+}
+}  // namespace
+
+UFO_TEST(codecs)
+{
+	OccupancyMap const map = reference();
+	for (Codec codec : {Codec::none, Codec::lz4, Codec::lz4_hc, Codec::zstd}) {
+		if (!isCodecAvailable(codec)) {
+			continue;
+		}
+		std::stringstream s;
+		CHECK(map.write(s, codec));
+		OccupancyMap read(test::RESOLUTION);
+		CHECK(read.read(s));
+		CHECK_SAME_TREE(map, read);
+	}
+}
+
+UFO_TEST(chunks)
+{
+	OccupancyMap map = reference();
+	DepthType const max_depth = map.getTreeDepthLevels() - 1;
+	for (DepthType depth : {DepthType(2), DepthType(5), max_depth}) {
+		map.setChunkDepth(depth);
+		std::stringstream s;
+		CHECK(map.write(s, Codec::lz4));
+		OccupancyMap read(test::RESOLUTION);
+		CHECK(read.read(s));
+		CHECK_SAME_TREE(map, read);
+	}
+}
+
+UFO_TEST(read_bounding_volume)
+{
+	OccupancyMap map = reference();
+	map.setChunkDepth(5);
+	std::stringstream s;
+	CHECK(map.write(s, Codec::lz4));
+
+	OccupancyMap part(test::RESOLUTION);
+	CHECK(part.read(s, box()));
+	CHECK(sameInside(map, part, box()));
+	CHECK(map.getNumLeafNodes() > part.getNumLeafNodes());
+}
+
+UFO_TEST(write_bounding_volume)
+{
+	OccupancyMap const map = reference();
+	std::stringstream s;
+	CHECK(map.write(s, box(), Codec::lz4));
+
+	// The data of a bounding volume write is read with the same bounding volume
+	OccupancyMap part(test::RESOLUTION);
+	CHECK(part.read(s, box()));
+	CHECK(sameInside(map, part, box()));
+	CHECK(map.getNumLeafNodes() > part.getNumLeafNodes());
+}
+
+UFO_TEST(flat)
+{
+	OccupancyMapCompact compact(test::RESOLUTION);
+	test::integrate(compact, 0, test::NUM_FRAMES);
+	CHECK_SAME_TREE(reference(), compact);
+
+	std::string const filename = tempFile("ufomap_test_io.flat");
+	CHECK(compact.writeFlat(filename));
+
+	OccupancyMapCompact mapped(test::RESOLUTION);
+	CHECK(mapped.mapFlat(filename));
+	CHECK_SAME_TREE(compact, mapped);
+
+	// Changes to a mapped tree are not written to the file
+	test::integrate(mapped, 0, 1);
+	OccupancyMapCompact mapped_again(test::RESOLUTION);
+	CHECK(mapped_again.mapFlat(filename));
+	CHECK_SAME_TREE(compact, mapped_again);
+
+	// Not a flat file
+	std::string const not_flat = tempFile("ufomap_test_io.um");
+	CHECK(compact.write(not_flat));
+	CHECK(!mapped_again.mapFlat(not_flat));
+
+	std::filesystem::remove(filename);
+	std::filesystem::remove(not_flat);
+}
+
+UFO_TEST(parallel_read)
+{
+	// Many chunks, so a load builds many subtrees at once. The workers are allowed also
+	// where there are fewer cores than threads.
+	tbb::global_control const control(tbb::global_control::max_allowed_parallelism, 8);
+	OccupancyMap map = reference();
+	map.setChunkDepth(3);
+	std::string const filename = tempFile("ufomap_test_io_parallel.um");
+	CHECK(map.write(filename, Codec::lz4));
+
+	OccupancyMap sequential(test::RESOLUTION);
+	tbb::task_arena(1).execute([&] { CHECK(sequential.read(filename)); });
+	CHECK_SAME_TREE(map, sequential);
+
+	for (int threads : {2, 4, 8}) {
+		OccupancyMap parallel(test::RESOLUTION);
+		tbb::task_arena(threads).execute([&] { CHECK(parallel.read(filename)); });
+		CHECK_SAME_TREE(sequential, parallel);
+
+		// Also when only part of the map is read
+		OccupancyMap part(test::RESOLUTION);
+		tbb::task_arena(threads).execute([&] { CHECK(part.read(filename, box())); });
+		CHECK(sameInside(map, part, box()));
+		CHECK(map.getNumLeafNodes() > part.getNumLeafNodes());
+	}
+
+	std::filesystem::remove(filename);
+}
+
+int main(int argc, char** argv) { return test::run(argc, argv); }
@@ -0,0 +1,252 @@
+/**
+ * UFOMap: An Efficient Probabilistic 3D Mapping Framework That Embraces the Unknown
+ *
+ * @author D. Duberg, KTH Royal Institute of Technology, Copyright (c) 2020.
+ * @see https://github.com/UnknownFreeOccupied/ufomap
+ * License: BSD 3
+ *
+ */
+
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2020, D. Duberg, KTH Royal Institute of Technology
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+
+// UFO
+#include <ufo/map/code.h>
+#include <ufo/map/color.h>
+#include <ufo/map/occupancy_map.h>
+#include <ufo/map/occupancy_map_color.h>
+#include <ufo/map/occupancy_map_small.h>
+#include <ufo/map/occupancy_map_tiny.h>
+
+#include "test.h"
+
+// STD
+#include <array>
+#include <cmath>
+#include <map>
+#include <unordered_set>
+
+//
+// Map types: the color map integrates the occupancy like the default OccupancyMap, and
+// its batched color update gives the colors of updating the nodes one by one. The fixed
+// point maps give the states of the float map, with occupancies within the rounding.
+//
+
+using namespace ufo::map;
+
+namespace
+{
+// The scan with a color per point, every seventh point without. With one_per_node only
+// the first point in each node is kept, so there is nothing to merge.
+PointCloudColor coloredScan(OccupancyMap const& map, std::size_t frame,
+                            bool one_per_node)
+{
+	PointCloudColor cloud;
+	std::unordered_set<Code, Code::Hash> nodes;
+	std::size_t i = 0;
+	for (Point3 const& point : test::scan(frame)) {
+		++i;
+		if (one_per_node && !nodes.insert(map.toCode(point)).second) {
+			continue;
+		}
+		Color const color =
+		    0 == i % 7 ? Color()
+		               : Color(1 + (37 * i + 11 * frame) % 255, 1 + (59 * i) % 255,
+		                       1 + (13 * i + 101 * frame) % 255);
+		cloud.push_back(Point3Color(point, color));
+	}
+	return cloud;
+}
+
+PointCloud uncolored(PointCloudColor const& cloud)
+{
+	PointCloud points;
+	for (Point3Color const& point : cloud) {
+		points.push_back(point);
+	}
+	return points;
+}
+
+// The colors of the nodes when the hits are applied one node at a time. The hits in a
+// node are merged into their root mean square color, which is then blended with the
+// color of the node by its occupancy before the hit.
+std::map<CodeType, Color> referenceColors(bool one_per_node)
+{
+	OccupancyMap occupancy(test::RESOLUTION);
+	double const prob_hit = occupancy.getProbHit();
+	std::map<CodeType, Color> colors;
+	for (std::size_t frame = 0; test::NUM_FRAMES != frame; ++frame) {
+		PointCloudColor const cloud = coloredScan(occupancy, frame, one_per_node);
+
+		std::map<CodeType, std::array<double, 4>> sums;
+		for (Point3Color const& point : cloud) {
+			Point3 const end = point;
+			// The scans are well inside the map
+			if (!end.isFinite() ||
+			    test::MAX_RANGE * test::MAX_RANGE <= (end - test::origin(frame)).squaredNorm()) {
+				continue;
+			}
+			Color const color = point.getColor();
+			std::array<double, 4>& sum = sums[occupancy.toCode(end).getCode()];
+			if (color.isSet()) {
+				sum[0] += static_cast<double>(color.r) * static_cast<double>(color.r);
+				sum[1] += static_cast<double>(color.g) * static_cast<double>(color.g);
+				sum[2] += static_cast<double>(color.b) * static_cast<double>(color.b);
+				sum[3] += 1.0;
+			}
+		}
+
+		for (auto const& [code, sum] : sums) {
+			if (0.0 == sum[3]) {
+				continue;
+			}
+			Color const update(std::sqrt(sum[0] / sum[3]), std::sqrt(sum[1] / sum[3]),
+			                   std::sqrt(sum[2] / sum[3]));
+			Color& current = colors[code];
+			if (!current.isSet()) {
+				current = update;
+			} else if (current != update) {
+				double const prob = prob_hit / (prob_hit + occupancy.getOccupancy(Code(code)));
+				auto blend = [prob](ColorType c, ColorType u) -> ColorType {
+					double const cd = static_cast<double>(c);
+					double const ud = static_cast<double>(u);
+					return std::sqrt((cd * cd) * (1.0 - prob) + (ud * ud) * prob);
+				};
+				current = Color(blend(current.r, update.r), blend(current.g, update.g),
+				                blend(current.b, update.b));
+			}
+		}
+
+		occupancy.insertPointCloudDiscrete(test::origin(frame), uncolored(cloud),
+		                                   test::MAX_RANGE);
+	}
+	return colors;
+}
+
+// Number of nodes at depth 0 whose color differs from expected
+std::size_t compareColors(OccupancyMapColor const& map,
+                          std::map<CodeType, Color> const& expected)
+{
+	std::size_t num_diff = 0;
+	for (auto const& [code, color] : expected) {
+		if (color != map.getColor(Code(code))) {
+			++num_diff;
+		}
+	}
+	for (auto it = map.beginLeaves(true, true, true), end = map.endLeaves(); end != it;
+	     ++it) {
+		if (0 == it.getDepth() && map.getColor(it.getCode()).isSet() &&
+		    0 == expected.count(it.getCode().getCode())) {
+			++num_diff;
+		}
+	}
+	return num_diff;
+}
+
+// Nodes of expected, at the depth of its leaves, where map has another state or an
+// occupancy further away than tolerance
+template <class Map>
+std::pair<std::size_t, std::size_t> compareStates(OccupancyMap const& expected,
+                                                  Map const& map, double tolerance)
+{
+	std::size_t num_states = 0;
+	std::size_t num_occupancies = 0;
+	for (auto it = expected.beginLeaves(true, true, true), end = expected.endLeaves();
+	     end != it; ++it) {
+		Code const code = it.getCode();
+		if (expected.getState(code) != map.getState(code)) {
+			++num_states;
+		}
+		if (tolerance < std::abs(expected.getOccupancy(code) - map.getOccupancy(code))) {
+			++num_occupancies;
+		}
+	}
+	return {num_states, num_occupancies};
+}
+}  // namespace
+
+UFO_TEST(color_occupancy)
+{
+	OccupancyMap expected(test::RESOLUTION);
+	OccupancyMapColor map(test::RESOLUTION);
+	for (std::size_t frame = 0; test::NUM_FRAMES != frame; ++frame) {
+		PointCloudColor const cloud = coloredScan(expected, frame, false);
+		expected.insertPointCloudDiscrete(test::origin(frame), uncolored(cloud),
+		                                  test::MAX_RANGE);
+		map.insertPointCloudDiscrete(test::origin(frame), cloud, test::MAX_RANGE);
+	}
+	CHECK_SAME_TREE(expected, map);
+}
+
+UFO_TEST(color)
+{
+	OccupancyMap codes(test::RESOLUTION);
+	for (bool one_per_node : {true, false}) {
+		std::map<CodeType, Color> const expected = referenceColors(one_per_node);
+		CHECK(!expected.empty());
+
+		// Synchronous and asynchronous, with the hits merged on the integrating thread or
+		// on their own thread while the free space is found
+		for (bool async : {false, true}) {
+			for (bool parallel : {false, true}) {
+				OccupancyMapColor map(test::RESOLUTION);
+				for (std::size_t frame = 0; test::NUM_FRAMES != frame; ++frame) {
+					map.insertPointCloudDiscrete(test::origin(frame),
+					                             coloredScan(codes, frame, one_per_node),
+					                             test::MAX_RANGE, 0, false, 0, async, parallel);
+				}
+				map.insertPointCloudWait();
+				CHECK(0 == compareColors(map, expected));
+			}
+		}
+	}
+}
+
+UFO_TEST(fixed_point)
+{
+	OccupancyMap expected(test::RESOLUTION);
+	OccupancyMapSmall small(test::RESOLUTION);
+	OccupancyMapTiny tiny(test::RESOLUTION);
+	test::integrate(expected, 0, test::NUM_FRAMES);
+	test::integrate(small, 0, test::NUM_FRAMES);
+	test::integrate(tiny, 0, test::NUM_FRAMES);
+
+	// The logits are rounded to steps of 1/4096 and 1/32
+	auto const [small_states, small_occupancies] = compareStates(expected, small, 1e-4);
+	auto const [tiny_states, tiny_occupancies] = compareStates(expected, tiny, 5e-3);
+	CHECK(0 == small_states && 0 == small_occupancies);
+	CHECK(0 == tiny_states && 0 == tiny_occupancies);
+}
+
+int main(int argc, char** argv) { return test::run(argc, argv); }
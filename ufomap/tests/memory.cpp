@@ -0,0 +1,192 @@
+/**
+ * UFOMap: An Efficient Probabilistic 3D Mapping Framework That Embraces the Unknown
+ *
+ * @author D. Duberg, KTH Royal Institute of Technology, Copyright (c) 2020.
+ * @see https://github.com/UnknownFreeOccupied/ufomap
+ * License: BSD 3
+ *
+ */
+
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2020, D. Duberg, KTH Royal Institute of Technology
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+
+// UFO
+#include <ufo/map/occupancy_map.h>
+#include <ufo/map/occupancy_map_compact.h>
+
+#include "test.h"
+
+// STD
+#include <chrono>
+#include <filesystem>
+
+//
+// Node storage: pool and brick allocation, the node index, compact inner nodes, and the
+// sliding window change where and how the nodes are stored, not the map.
+//
+
+using namespace ufo::map;
+
+namespace
+{
+OccupancyMap reference()
+{
+	OccupancyMap map(test::RESOLUTION);
+	test::integrate(map, 0, test::NUM_FRAMES);
+	CHECK(0 != map.getNumLeafNodes());
+	return map;
+}
+}  // namespace
+
+UFO_TEST(clear)
+{
+	OccupancyMap map(test::RESOLUTION);
+	test::integrate(map, 0, test::NUM_FRAMES);
+	map.clear();
+	CHECK(0 == map.getNumLeafNodes());
+	CHECK(map.isUnknown(map.getRootCode()));
+	test::integrate(map, 0, test::NUM_FRAMES);
+	CHECK_SAME_TREE(reference(), map);
+}
+
+UFO_TEST(prune_incremental)
+{
+	// Without automatic pruning the children below nodes that become leaves are kept
+	OccupancyMap expected(test::RESOLUTION, 16, false);
+	test::integrate(expected, 0, test::NUM_FRAMES);
+	CHECK(expected.prune());
+
+	// Pruned after each update, also the subtrees created by the earlier frames are
+	// changed by the later ones
+	OccupancyMap map(test::RESOLUTION, 16, false);
+	test::integrate(map, 0, test::NUM_FRAMES / 2);
+	CHECK(0 != map.getNumPrunePending());
+	CHECK(map.pruneIncremental(std::chrono::hours(1)));
+	test::integrate(map, test::NUM_FRAMES / 2, test::NUM_FRAMES);
+	CHECK(map.pruneIncremental(std::chrono::hours(1)));
+	CHECK(0 == map.getNumPrunePending());
+	CHECK(expected.getNumInnerNodes() == map.getNumInnerNodes());
+	CHECK(expected.getNumLeafNodes() == map.getNumLeafNodes());
+	CHECK_SAME_TREE(expected, map);
+
+	// Pruning the children of the root one by one is the same as pruning the root
+	OccupancyMap by_node(test::RESOLUTION, 16, false);
+	test::integrate(by_node, 0, test::NUM_FRAMES);
+	for (std::size_t i = 0; 8 != i; ++i) {
+		by_node.pruneNode(by_node.getRootCode().getChild(i));
+	}
+	CHECK(expected.getNumInnerNodes() == by_node.getNumInnerNodes());
+	CHECK_SAME_TREE(expected, by_node);
+}
+
+UFO_TEST(pools)
+{
+	OccupancyMap map(test::RESOLUTION);
+	map.enablePoolAllocation(true);
+	test::integrate(map, 0, test::NUM_FRAMES);
+	CHECK_SAME_TREE(reference(), map);
+	CHECK(0 != map.getPoolStats().live_blocks);
+
+	// Clearing releases the pools at once
+	map.clear();
+	CHECK(0 == map.getPoolStats().live_blocks);
+	test::integrate(map, 0, test::NUM_FRAMES);
+	CHECK_SAME_TREE(reference(), map);
+}
+
+UFO_TEST(bricks)
+{
+	for (DepthType brick_depth : {2, 3}) {
+		OccupancyMap map(test::RESOLUTION);
+		map.enableBrickAllocation(brick_depth);
+		test::integrate(map, 0, test::NUM_FRAMES);
+		CHECK_SAME_TREE(reference(), map);
+	}
+}
+
+UFO_TEST(node_index)
+{
+	OccupancyMap map(test::RESOLUTION);
+	map.enableNodeIndex(4);
+	test::integrate(map, 0, test::NUM_FRAMES / 2);
+	CHECK(0 != map.getNodeIndexSize());
+
+	// Enabled on an existing map
+	OccupancyMap late(test::RESOLUTION);
+	test::integrate(late, 0, test::NUM_FRAMES / 2);
+	late.enableNodeIndex(2);
+	CHECK(0 != late.getNodeIndexSize());
+
+	test::integrate(map, test::NUM_FRAMES / 2, test::NUM_FRAMES);
+	test::integrate(late, test::NUM_FRAMES / 2, test::NUM_FRAMES);
+	OccupancyMap const expected = reference();
+	CHECK_SAME_TREE(expected, map);
+	CHECK_SAME_TREE(expected, late);
+	for (auto it = expected.beginLeaves(true, false, false), end = expected.endLeaves();
+	     end != it; ++it) {
+		CHECK(it.getOccupancy() == map.getOccupancy(it.getCode()));
+	}
+}
+
+UFO_TEST(compact)
+{
+	OccupancyMapCompact map(test::RESOLUTION);
+	test::integrate(map, 0, test::NUM_FRAMES);
+	CHECK_SAME_TREE(reference(), map);
+}
+
+UFO_TEST(sliding_window)
+{
+	std::string const directory =
+	    (std::filesystem::temp_directory_path() / "ufomap_test_sliding_window").string();
+	std::filesystem::remove_all(directory);
+
+	OccupancyMap map(test::RESOLUTION);
+	map.enableSlidingWindow(directory, 5);
+	std::size_t max_evicted = 0;
+	for (std::size_t i = 0; test::NUM_FRAMES != i; ++i) {
+		map.updateWindow(test::origin(i), 4.0);
+		map.insertPointCloudDiscrete(test::origin(i), test::scan(i), test::MAX_RANGE);
+		max_evicted = std::max(max_evicted, map.getNumEvictedTiles());
+	}
+	CHECK(0 != max_evicted);
+
+	map.disableSlidingWindow();
+	CHECK(0 == map.getNumEvictedTiles());
+	CHECK_SAME_TREE(reference(), map);
+
+	std::filesystem::remove_all(directory);
+}
+
+int main(int argc, char** argv) { return test::run(argc, argv); }
@@ -0,0 +1,432 @@
+/**
+ * UFOMap: An Efficient Probabilistic 3D Mapping Framework That Embraces the Unknown
+ *
+ * @author D. Duberg, KTH Royal Institute of Technology, Copyright (c) 2020.
+ * @see https://github.com/UnknownFreeOccupied/ufomap
+ * License: BSD 3
+ *
+ */
+
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2020, D. Duberg, KTH Royal Institute of Technology
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+
+// UFO
+#include <ufo/geometry/aabb.h>
+#include <ufo/geometry/bounding_volume.h>
+#include <ufo/geometry/sphere.h>
+#include <ufo/map/occupancy_map.h>
+
+#include "test.h"
+
+// STD
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <limits>
+#include <mutex>
+#include <utility>
+#include <variant>
+#include <vector>
+
+//
+// Queries: the incrementally updated distance field and frontiers are the same as when
+// built from the final map, and the distance field and nearest neighbor searches agree
+// with brute force, as does collision checking. The batch queries and the queries
+// through an accessor agree with the single ones, and parallelForEachLeaf visits the
+// same nodes as the leaf iterator.
+//
+
+using namespace ufo::map;
+
+namespace
+{
+// Around the pillar, including part of the floor
+ufo::geometry::BoundingVolume region()
+{
+	ufo::geometry::BoundingVolume bv;
+	bv.add(ufo::geometry::AABB(Point3(0, 0, 0), 2.5));
+	return bv;
+}
+
+std::vector<Point3> queries()
+{
+	std::vector<Point3> points;
+	for (double x = -2.05; 2 > x; x += 0.3) {
+		for (double y = -1.95; 2 > y; y += 0.3) {
+			for (double z = -0.95; 2 > z; z += 0.3) {
+				points.emplace_back(x, y, z);
+			}
+		}
+	}
+	return points;
+}
+
+// The centers of the depth 0 voxels in the occupied leaves intersecting bounding_volume
+std::vector<Point3> occupiedVoxels(OccupancyMap const& map,
+                                   ufo::geometry::BoundingVolume const& bounding_volume)
+{
+	std::vector<Point3> voxels;
+	double const resolution = map.getResolution();
+	for (auto it = map.beginLeaves(bounding_volume, true, false, false),
+	          end = map.endLeaves();
+	     end != it; ++it) {
+		Point3 const min = it.getCenter() - (it.getHalfSize() - resolution / 2);
+		std::size_t const n = std::size_t(1) << it.getDepth();
+		for (std::size_t x = 0; n != x; ++x) {
+			for (std::size_t y = 0; n != y; ++y) {
+				for (std::size_t z = 0; n != z; ++z) {
+					voxels.push_back(min + Point3(x, y, z) * resolution);
+				}
+			}
+		}
+	}
+	return voxels;
+}
+
+double squaredDistance(Point3 const& point, Point3 const& center, double half_size)
+{
+	double squared_distance = 0;
+	for (int i = 0; 3 > i; ++i) {
+		double const d = std::max(0.0, std::abs(point[i] - center[i]) - half_size);
+		squared_distance += d * d;
+	}
+	return squared_distance;
+}
+
+// Squared distances from point to all occupied leaves, closest first
+std::vector<double> occupiedSquaredDistances(OccupancyMap const& map, Point3 const& point)
+{
+	std::vector<double> squared_distances;
+	for (auto it = map.beginLeaves(true, false, false), end = map.endLeaves(); end != it;
+	     ++it) {
+		squared_distances.push_back(squaredDistance(point, it.getCenter(), it.getHalfSize()));
+	}
+	std::sort(squared_distances.begin(), squared_distances.end());
+	return squared_distances;
+}
+}  // namespace
+
+UFO_TEST(distance_field)
+{
+	double const max_distance = 1.0;
+
+	OccupancyMap map(test::RESOLUTION);
+	test::integrate(map, 0, 1);
+	map.enableDistanceField(max_distance);
+	for (std::size_t i = 1; test::NUM_FRAMES != i; ++i) {
+		test::integrate(map, i, i + 1);
+		map.updateDistanceField();
+	}
+
+	OccupancyMap rebuilt(test::RESOLUTION);
+	test::integrate(rebuilt, 0, test::NUM_FRAMES);
+	rebuilt.enableDistanceField(max_distance);
+
+	// Obstacles further away than max_distance do not matter
+	ufo::geometry::BoundingVolume near;
+	near.add(ufo::geometry::AABB(Point3(0, 0, 0), 2.5 + max_distance));
+	std::vector<Point3> const obstacles = occupiedVoxels(rebuilt, near);
+	CHECK(!obstacles.empty());
+
+	std::size_t num_within = 0;
+	for (Point3 const& point : queries()) {
+		double const distance = map.getDistance(point);
+		CHECK(rebuilt.getDistance(point) == distance);
+		// With several closest obstacles the gradient can point away from any of them
+		double const gradient = map.getDistanceGradient(point).norm();
+		if (0 == distance) {
+			CHECK(0 == gradient);
+		} else if (max_distance > distance) {
+			CHECK(1e-6 > std::abs(1 - gradient));
+		}
+
+		double expected = max_distance;
+		for (Point3 const& obstacle : obstacles) {
+			expected = std::min(expected, (obstacle - point).norm());
+		}
+		// The field is an approximation, the closest obstacle is found through the
+		// neighbors
+		CHECK(std::abs(expected - distance) <= test::RESOLUTION / 2);
+		num_within += max_distance > expected;
+	}
+	CHECK(0 != num_within);
+}
+
+UFO_TEST(frontiers)
+{
+	OccupancyMap map(test::RESOLUTION);
+	map.enableFrontiers();
+	for (std::size_t i = 0; test::NUM_FRAMES != i; ++i) {
+		test::integrate(map, i, i + 1);
+		map.updateFrontiers();
+	}
+
+	OccupancyMap rebuilt(test::RESOLUTION);
+	test::integrate(rebuilt, 0, test::NUM_FRAMES);
+	rebuilt.enableFrontiers();
+
+	CHECK(0 != rebuilt.numFrontiers());
+	CHECK(rebuilt.getFrontiers() == map.getFrontiers());
+	CHECK(rebuilt.getFrontiers(region()) == map.getFrontiers(region()));
+
+	// A frontier is a free leaf
+	for (Code const& code : map.getFrontiers()) {
+		CHECK(map.isFree(code));
+	}
+}
+
+UFO_TEST(knn)
+{
+	OccupancyMap map(test::RESOLUTION);
+	test::integrate(map, 0, test::NUM_FRAMES);
+
+	std::size_t const k = 16;
+	OccupancyMap::SearchContext context;
+	std::vector<Code> codes;
+	std::vector<double> squared_distances;
+	for (Point3 const& point : {Point3(0, 0, 1), Point3(3, -2, 0.5), Point3(-7, 6, 2)}) {
+		std::vector<double> const expected = occupiedSquaredDistances(map, point);
+		CHECK(k <= expected.size());
+
+		CHECK(k == map.knnSearch(point, k, codes, context, &squared_distances));
+		CHECK(k == codes.size());
+		for (std::size_t i = 0; k > i && codes.size() > i; ++i) {
+			CHECK(1e-9 > std::abs(expected[i] - squared_distances[i]));
+			CHECK(map.isOccupied(codes[i]));
+		}
+	}
+}
+
+UFO_TEST(radius)
+{
+	OccupancyMap map(test::RESOLUTION);
+	test::integrate(map, 0, test::NUM_FRAMES);
+
+	// Not a multiple of half the resolution from any voxel, so there are no ties
+	double const radius = 1.013;
+	Point3 const point(0.51, 0.23, 1.07);
+	std::vector<double> const all = occupiedSquaredDistances(map, point);
+	std::size_t const expected =
+	    std::upper_bound(all.begin(), all.end(), radius * radius) - all.begin();
+	CHECK(0 != expected);
+
+	std::vector<Code> codes;
+	std::vector<double> squared_distances;
+	CHECK(expected == map.radiusSearch(point, radius, codes, &squared_distances));
+	CHECK(std::is_sorted(codes.begin(), codes.end()));
+	std::sort(squared_distances.begin(), squared_distances.end());
+	CHECK(std::equal(squared_distances.begin(), squared_distances.end(), all.begin(),
+	                 [](double a, double b) { return 1e-9 > std::abs(a - b); }));
+}
+
+UFO_TEST(batch_queries)
+{
+	OccupancyMap map(test::RESOLUTION);
+	test::integrate(map, 0, test::NUM_FRAMES);
+
+	// End points, in scan order, and a grid with free and unknown space
+	PointCloud const cloud = test::scan(test::NUM_FRAMES - 1);
+	std::vector<Point3> points(cloud.begin(), cloud.end());
+	std::vector<Point3> const grid = queries();
+	points.insert(points.end(), grid.begin(), grid.end());
+
+	std::vector<OccupancyState> states;
+	std::vector<double> occupancies;
+	for (DepthType depth : {DepthType(0), DepthType(2)}) {
+		map.getStates(points, states, depth);
+		map.getOccupancies(points, occupancies, depth);
+		CHECK(points.size() == states.size() && points.size() == occupancies.size());
+		std::size_t num_diff = 0;
+		for (std::size_t i = 0; points.size() != i; ++i) {
+			if (map.getState(points[i], depth) != states[i] ||
+			    map.getOccupancy(points[i], depth) != occupancies[i]) {
+				++num_diff;
+			}
+		}
+		CHECK(0 == num_diff);
+	}
+}
+
+UFO_TEST(accessor)
+{
+	OccupancyMap map(test::RESOLUTION);
+	test::integrate(map, 0, test::NUM_FRAMES / 2);
+
+	PointCloud const cloud = test::scan(test::NUM_FRAMES - 1);
+	std::vector<Point3> points(cloud.begin(), cloud.end());
+	std::vector<Point3> const grid = queries();
+	points.insert(points.end(), grid.begin(), grid.end());
+
+	// The accessor keeps its path between the queries, and has to notice when the nodes
+	// on it are freed or created. The queries start and end in the pillar, so the first
+	// query after a change starts from the path the last one before it left.
+	Point3 const pillar(0.05, 0.05, 0.55);
+	points.insert(points.begin(), pillar);
+	points.push_back(pillar);
+	OccupancyMap::Accessor accessor(map);
+	auto num_diff = [&map, &points, &accessor] {
+		std::size_t num = 0;
+		for (DepthType depth : {DepthType(0), DepthType(1), DepthType(0)}) {
+			for (Point3 const& point : points) {
+				if (map.getOccupancy(point, depth) != map.getOccupancy(point, accessor, depth) ||
+				    map.getState(point, depth) != map.getState(point, accessor, depth)) {
+					++num;
+				}
+			}
+		}
+		return num;
+	};
+	CHECK(0 == num_diff());
+
+	// Sets the pillar to one value, the nodes in it can be pruned
+	map.setValueVolume(ufo::geometry::AABB(Point3(0, 0, 0), 1.0), 0.9);
+	CHECK(0 == num_diff());
+
+	// Creates nodes
+	test::integrate(map, test::NUM_FRAMES / 2, test::NUM_FRAMES);
+	CHECK(0 == num_diff());
+
+	// Frees all nodes
+	map.clear();
+	CHECK(0 == num_diff());
+	test::integrate(map, 0, 1);
+	CHECK(0 == num_diff());
+}
+
+UFO_TEST(any_occupied)
+{
+	OccupancyMap map(test::RESOLUTION);
+	test::integrate(map, 0, test::NUM_FRAMES);
+
+	// Spheres and boxes of a few sizes, more than one group of 64. The sizes do not line
+	// up with the node boundaries, where touching is decided by rounding.
+	std::vector<ufo::geometry::BoundingVar> volumes;
+	std::size_t i = 0;
+	for (Point3 const& point : queries()) {
+		if (0 == i++ % 7) {
+			double const size = 0.053 + 0.1 * (i % 4);
+			if (0 == i % 2) {
+				volumes.emplace_back(ufo::geometry::Sphere(point, size));
+			} else {
+				volumes.emplace_back(ufo::geometry::AABB(point, size));
+			}
+		}
+	}
+	CHECK(64 < volumes.size());
+
+	for (bool unknown_as_occupied : {false, true}) {
+		// Brute force, every volume against every occupied (and unknown) leaf
+		std::vector<bool> expected(volumes.size(), false);
+		for (auto it = map.beginLeaves(true, false, unknown_as_occupied),
+		          end = map.endLeaves();
+		     end != it; ++it) {
+			ufo::geometry::AABB const aabb(it.getCenter(), it.getHalfSize());
+			for (std::size_t v = 0; volumes.size() != v; ++v) {
+				expected[v] = expected[v] ||
+				              std::visit(
+				                  [&aabb](auto const& volume) {
+					                  return ufo::geometry::intersects(volume, aabb);
+				                  },
+				                  volumes[v]);
+			}
+		}
+		CHECK(expected.end() != std::find(expected.begin(), expected.end(), true));
+		CHECK(expected.end() != std::find(expected.begin(), expected.end(), false));
+
+		std::vector<bool> occupied;
+		map.anyOccupied(volumes, occupied, unknown_as_occupied);
+		CHECK(expected == occupied);
+	}
+}
+
+UFO_TEST(parallel_for_each_leaf)
+{
+	OccupancyMap map(test::RESOLUTION);
+	test::integrate(map, 0, test::NUM_FRAMES);
+
+	using Node = std::pair<CodeType, DepthType>;
+	auto key = [](auto const& it) {
+		return Node(it.getCode().getCode(), it.getCode().getDepth());
+	};
+
+	// Occupied; occupied and free; everything; and coarser nodes only
+	struct Filter {
+		bool occupied, free, unknown;
+		DepthType min_depth;
+	};
+	for (Filter const& filter : {Filter{true, false, false, 0}, Filter{true, true, false, 0},
+	                             Filter{true, true, true, 0}, Filter{true, true, true, 2}}) {
+		for (bool bounded : {false, true}) {
+			for (bool contains : {false, true}) {
+				ufo::geometry::BoundingVolume const bv =
+				    bounded ? region() : ufo::geometry::BoundingVolume();
+
+				std::vector<Node> expected;
+				for (auto it = map.beginLeaves(bv, filter.occupied, filter.free,
+				                               filter.unknown, contains, filter.min_depth),
+				          end = map.endLeaves();
+				     end != it; ++it) {
+					expected.push_back(key(it));
+				}
+
+				std::mutex mutex;
+				std::vector<Node> visited;
+				map.parallelForEachLeaf(
+				    bv,
+				    [&](auto const& it) {
+					    std::scoped_lock lock(mutex);
+					    visited.push_back(key(it));
+				    },
+				    filter.occupied, filter.free, filter.unknown, contains, filter.min_depth);
+
+				CHECK(!expected.empty());
+				std::sort(expected.begin(), expected.end());
+				std::sort(visited.begin(), visited.end());
+				CHECK(expected == visited);
+			}
+		}
+	}
+
+	// Without a bounding volume
+	std::size_t expected = 0;
+	for (auto it = map.beginLeaves(), end = map.endLeaves(); end != it; ++it) {
+		++expected;
+	}
+	std::atomic<std::size_t> visited = 0;
+	map.parallelForEachLeaf([&visited](auto const&) { ++visited; });
+	CHECK(0 < expected);
+	CHECK(expected == visited);
+}
+
+int main(int argc, char** argv) { return test::run(argc, argv); }
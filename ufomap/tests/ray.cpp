@@ -0,0 +1,239 @@
+/**
+ * UFOMap: An Efficient Probabilistic 3D Mapping Framework That Embraces the Unknown
+ *
+ * @author D. Duberg, KTH Royal Institute of Technology, Copyright (c) 2020.
+ * @see https://github.com/UnknownFreeOccupied/ufomap
+ * License: BSD 3
+ *
+ */
+
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2020, D. Duberg, KTH Royal Institute of Technology
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+
+// UFO
+#include <ufo/map/occupancy_map.h>
+#include <ufo/map/ray_packet.h>
+
+#include "test.h"
+
+// STD
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <utility>
+#include <vector>
+
+//
+// Ray casting: hierarchical ray casting gives the same hits as stepping through the
+// nodes one at a time, and rays traversed in packets visit the same nodes as when
+// traversed one by one.
+//
+
+using namespace ufo::map;
+
+namespace
+{
+OccupancyMap const& sceneMap()
+{
+	static OccupancyMap const map = [] {
+		OccupancyMap map(test::RESOLUTION);
+		test::integrate(map, 0, test::NUM_FRAMES);
+		return map;
+	}();
+	return map;
+}
+
+std::vector<Point3> randomDirections(std::size_t num)
+{
+	std::mt19937 gen(0);
+	std::normal_distribution<double> dist;
+	std::vector<Point3> directions;
+	directions.reserve(num);
+	while (directions.size() != num) {
+		Point3 direction(dist(gen), dist(gen), dist(gen));
+		directions.push_back(direction / direction.norm());
+	}
+	return directions;
+}
+
+// Gives access to the ray initialization the packets are filled from
+class RayMap : public OccupancyMap
+{
+ public:
+	using OccupancyMap::OccupancyMap;
+	using OccupancyMap::computeRayInit;
+	using OccupancyMap::computeRayTakeStep;
+};
+
+struct Ray {
+	Key current;
+	Key end;
+	std::array<int, 3> step;
+	Point3 t_delta;
+	Point3 t_max;
+	double distance;
+};
+
+// Rays of very different lengths, from the first origin
+std::vector<Ray> packetRays(RayMap const& map, DepthType depth)
+{
+	std::mt19937 gen(0);
+	std::uniform_real_distribution<double> length(0.0, test::MAX_RANGE);
+	Point3 const origin = test::origin(0);
+	std::vector<Ray> rays;
+	for (Point3 const& direction : randomDirections(3000)) {
+		Point3 const end = origin + direction * length(gen);
+		Ray ray;
+		ray.distance = (end - origin).norm();
+		map.computeRayInit(origin, end, direction, ray.current, ray.end, ray.step,
+		                   ray.t_delta, ray.t_max, depth);
+		if (ray.current != ray.end) {
+			rays.push_back(ray);
+		}
+	}
+	return rays;
+}
+
+using Visited = std::vector<std::pair<CodeType, DepthType>>;
+
+template <std::size_t N>
+Visited packetVisited(RayMap const& map, std::vector<Ray> const& rays)
+{
+	Visited visited;
+	auto const visit = [&map, &visited](Key const& key) {
+		Code const code = map.toCode(key);
+		visited.emplace_back(code.getCode(), code.getDepth());
+	};
+
+	// Filled the same way as in freeSpacePacket
+	RayPacket<N> packet;
+	for (Ray const& ray : rays) {
+		packet.add(ray.current, ray.end, ray.step, ray.t_delta, ray.t_max, ray.distance);
+		while (packet.full()) {
+			packet.visit(visit);
+			packet.step();
+		}
+	}
+	while (!packet.empty()) {
+		packet.visit(visit);
+		packet.step();
+	}
+
+	std::sort(visited.begin(), visited.end());
+	return visited;
+}
+
+void comparePacket(DepthType depth)
+{
+	RayMap const map(test::RESOLUTION);
+	std::vector<Ray> const rays = packetRays(map, depth);
+
+	Visited expected;
+	for (Ray ray : rays) {
+		do {
+			Code const code = map.toCode(ray.current);
+			expected.emplace_back(code.getCode(), code.getDepth());
+			RayMap::computeRayTakeStep(ray.current, ray.step, ray.t_delta, ray.t_max);
+		} while (ray.current != ray.end && ray.t_max.min() <= ray.distance);
+	}
+	std::sort(expected.begin(), expected.end());
+	CHECK(rays.size() < expected.size());
+
+	// The default size, the plain loop and the SIMD ones when enabled
+	CHECK(expected == packetVisited<RAY_PACKET_SIZE>(map, rays));
+	CHECK(expected == packetVisited<1>(map, rays));
+	CHECK(expected == packetVisited<3>(map, rays));
+	CHECK(expected == packetVisited<4>(map, rays));
+	CHECK(expected == packetVisited<8>(map, rays));
+	CHECK(expected == packetVisited<32>(map, rays));
+}
+
+void compareHierarchical(bool ignore_unknown, double max_range, DepthType depth)
+{
+	OccupancyMap const& map = sceneMap();
+	std::vector<Point3> const origins{test::origin(0)};
+	std::vector<Point3> const directions = randomDirections(3000);
+
+	std::vector<RayHit> steps;
+	std::vector<RayHit> leaps;
+	map.castRays(origins, directions, max_range, steps, ignore_unknown, depth, false);
+	map.castRays(origins, directions, max_range, leaps, ignore_unknown, depth, true);
+
+	// Rays at depth > 0 step through keys at the centers of the nodes, so their codes are
+	// compared at depth
+	std::size_t num_diff = 0;
+	for (std::size_t i = 0; directions.size() != i; ++i) {
+		if (steps[i].code.toDepth(depth) != leaps[i].code.toDepth(depth) ||
+		    steps[i].state != leaps[i].state ||
+		    1e-6 < std::abs(steps[i].distance - leaps[i].distance)) {
+			if (5 > num_diff) {
+				std::fprintf(stderr, "  ray %zu: state %d vs %d, distance %f vs %f\n", i,
+				             static_cast<int>(steps[i].state), static_cast<int>(leaps[i].state),
+				             steps[i].distance, leaps[i].distance);
+			}
+			++num_diff;
+		}
+	}
+	CHECK(0 == num_diff);
+}
+}  // namespace
+
+UFO_TEST(hierarchical) { compareHierarchical(false, -1, 0); }
+
+UFO_TEST(hierarchical_ignore_unknown) { compareHierarchical(true, 15, 0); }
+
+UFO_TEST(hierarchical_depth) { compareHierarchical(true, 15, 2); }
+
+UFO_TEST(packet) { comparePacket(0); }
+
+UFO_TEST(packet_depth) { comparePacket(2); }
+
+UFO_TEST(cast_ray)
+{
+	// The pillar is straight ahead from the first origin
+	OccupancyMap const& map = sceneMap();
+	Point3 const origin = test::origin(0);
+	for (bool hierarchical : {false, true}) {
+		auto hit = map.castRay(origin, -origin, true, -1, 0, hierarchical);
+		CHECK(hit.has_value());
+		if (hit) {
+			CHECK(std::abs(map.toCoord(*hit)[0] - synthetic::PILLAR_HALF_SIZE) <
+			      2 * test::RESOLUTION);
+		}
+	}
+}
+
+int main(int argc, char** argv) { return test::run(argc, argv); }
@@ -0,0 +1,368 @@
+/**
+ * UFOMap: An Efficient Probabilistic 3D Mapping Framework That Embraces the Unknown
+ *
+ * @author D. Duberg, KTH Royal Institute of Technology, Copyright (c) 2020.
+ * @see https://github.com/UnknownFreeOccupied/ufomap
+ * License: BSD 3
+ *
+ */
+
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2020, D. Duberg, KTH Royal Institute of Technology
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+// UFO
+#include <ufo/map/occupancy_map.h>
+#include <ufo/math/pose6.h>
+
+#include "synthetic.h"
+
+// STD
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+//
+// Replays a recorded sequence of point clouds with their poses through the
+// integration, as fast as possible, and reports the throughput and the latency of each
+// cloud.
+//
+// The recording is a little-endian binary file of frames, one after another:
+//   double    stamp (s)
+//   double[7] sensor pose in the map frame: x y z qw qx qy qz
+//   uint64    number of points
+//   float[3]  the points in the sensor frame, number of points times
+//
+
+namespace
+{
+using namespace ufo::map;
+using Clock = std::chrono::steady_clock;
+
+struct Frame {
+	double stamp;
+	ufo::math::Pose6 pose;
+	PointCloud cloud;
+};
+
+struct Options {
+	std::string file;
+	std::size_t generate = 0;
+	double resolution = 0.05;
+	DepthType depth_levels = 16;
+	double max_range = -1.0;
+	DepthType insert_depth = 0;
+	bool simple_ray_casting = false;
+	unsigned int early_stopping = 0;
+	bool parallel = false;
+	bool discrete = true;
+	bool pipeline = false;
+	std::size_t queue_capacity = 2;
+};
+
+void usage(char const* name)
+{
+	std::cerr
+	    << "Usage: " << name << " FILE [options]\n"
+	    << "  --generate N         Write a synthetic recording of N frames to FILE\n"
+	    << "  --resolution R       Leaf size (m), default 0.05\n"
+	    << "  --depth-levels D     Depth levels of the map, default 16\n"
+	    << "  --max-range R        Max range (m), default -1 (unlimited)\n"
+	    << "  --insert-depth D     Depth free space is integrated at, default 0\n"
+	    << "  --simple             Simple ray casting\n"
+	    << "  --early-stopping N   Early stopping, default 0 (disabled)\n"
+	    << "  --parallel           Cast the rays of a cloud in parallel\n"
+	    << "  --not-discrete       Use insertPointCloud instead of the discrete version\n"
+	    << "  --pipeline           Integrate through the integration pipeline\n"
+	    << "  --queue-capacity N   Queue capacity of the pipeline, default 2\n";
+}
+
+bool parse(int argc, char** argv, Options& options)
+{
+	if (2 > argc) {
+		return false;
+	}
+	options.file = argv[1];
+	for (int i = 2; argc != i; ++i) {
+		std::string arg = argv[i];
+		auto value = [&]() -> char const* { return argc > i + 1 ? argv[++i] : nullptr; };
+		char const* v = nullptr;
+		if ("--simple" == arg) {
+			options.simple_ray_casting = true;
+		} else if ("--parallel" == arg) {
+			options.parallel = true;
+		} else if ("--not-discrete" == arg) {
+			options.discrete = false;
+		} else if ("--pipeline" == arg) {
+			options.pipeline = true;
+		} else if (!(v = value())) {
+			return false;
+		} else if ("--generate" == arg) {
+			options.generate = std::strtoul(v, nullptr, 10);
+		} else if ("--resolution" == arg) {
+			options.resolution = std::strtod(v, nullptr);
+		} else if ("--depth-levels" == arg) {
+			options.depth_levels = std::strtoul(v, nullptr, 10);
+		} else if ("--max-range" == arg) {
+			options.max_range = std::strtod(v, nullptr);
+		} else if ("--insert-depth" == arg) {
+			options.insert_depth = std::strtoul(v, nullptr, 10);
+		} else if ("--early-stopping" == arg) {
+			options.early_stopping = std::strtoul(v, nullptr, 10);
+		} else if ("--queue-capacity" == arg) {
+			options.queue_capacity = std::max(1ul, std::strtoul(v, nullptr, 10));
+		} else {
+			return false;
+		}
+	}
+	return true;
+}
+
+template <typename T>
+void write(std::ostream& s, T const& value)
+{
+	s.write(reinterpret_cast<char const*>(&value), sizeof(T));
+}
+
+template <typename T>
+bool read(std::istream& s, T& value)
+{
+	return static_cast<bool>(s.read(reinterpret_cast<char*>(&value), sizeof(T)));
+}
+
+// A loop around the pillar of the synthetic room, the same every time
+bool generate(std::string const& file, std::size_t num_frames)
+{
+	std::ofstream s(file, std::ios_base::binary);
+	for (std::size_t i = 0; num_frames != i; ++i) {
+		Point3 origin = synthetic::trajectory(i, num_frames);
+		double yaw = 2.0 * M_PI * i / num_frames;
+		ufo::math::Pose6 pose(origin[0], origin[1], origin[2], 0.0, 0.0, yaw);
+		PointCloud cloud = synthetic::scan(origin, 32, 1024, i);
+		// Into the sensor frame
+		cloud.transform(pose.inversed());
+
+		write(s, 0.1 * i);
+		ufo::math::Vector3 t = pose.translation();
+		ufo::math::Quaternion q = pose.rotation();
+		for (double v : {t[0], t[1], t[2], q[0], q[1], q[2], q[3]}) {
+			write(s, v);
+		}
+		write(s, static_cast<std::uint64_t>(cloud.size()));
+		for (Point3 const& point : cloud) {
+			for (int j : {0, 1, 2}) {
+				write(s, static_cast<float>(point[j]));
+			}
+		}
+	}
+	return static_cast<bool>(s);
+}
+
+bool load(std::string const& file, std::vector<Frame>& frames)
+{
+	std::ifstream s(file, std::ios_base::binary);
+	if (!s) {
+		return false;
+	}
+	Frame frame;
+	while (read(s, frame.stamp)) {
+		double p[7];
+		std::uint64_t size;
+		for (double& v : p) {
+			if (!read(s, v)) {
+				return false;
+			}
+		}
+		if (!read(s, size)) {
+			return false;
+		}
+		frame.pose = ufo::math::Pose6(p[0], p[1], p[2], p[3], p[4], p[5], p[6]);
+		std::vector<float> data(3 * size);
+		if (!s.read(reinterpret_cast<char*>(data.data()), data.size() * sizeof(float))) {
+			return false;
+		}
+		frame.cloud.clear();
+		frame.cloud.reserve(size);
+		for (std::size_t i = 0; data.size() != i; i += 3) {
+			frame.cloud.push_back(Point3(data[i], data[i + 1], data[i + 2]));
+		}
+		frames.push_back(frame);
+	}
+	return s.eof();
+}
+
+// Nearest rank percentile of sorted values
+double percentile(std::vector<double> const& sorted, double p)
+{
+	if (sorted.empty()) {
+		return 0.0;
+	}
+	std::size_t rank = std::max(1.0, std::ceil(p / 100.0 * sorted.size()));
+	return sorted[std::min(rank, sorted.size()) - 1];
+}
+
+double seconds(Clock::duration duration)
+{
+	return std::chrono::duration<double>(duration).count();
+}
+}  // namespace
+
+int main(int argc, char** argv)
+{
+	Options options;
+	if (!parse(argc, argv, options)) {
+		usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	if (0 != options.generate) {
+		if (!generate(options.file, options.generate)) {
+			std::cerr << "Could not write " << options.file << '\n';
+			return EXIT_FAILURE;
+		}
+		return EXIT_SUCCESS;
+	}
+
+	std::vector<Frame> frames;
+	if (!load(options.file, frames) || frames.empty()) {
+		std::cerr << "Could not read " << options.file << '\n';
+		return EXIT_FAILURE;
+	}
+
+	OccupancyMap map(options.resolution, options.depth_levels);
+
+	// Latency is from when a cloud is handed to the map until it is in the map
+	std::vector<double> latencies(frames.size());
+	std::size_t num_points = 0;
+	Clock::time_point start = Clock::now();
+	if (options.pipeline) {
+		map.startPipeline(options.queue_capacity);
+		std::vector<Clock::time_point> submitted(frames.size());
+		std::vector<IntegrationTicket> tickets(frames.size());
+		std::size_t num_submitted = 0;
+		std::mutex mutex;
+		std::condition_variable cv;
+
+		// Tickets are done in order, so one thread can wait for them one at a time
+		std::thread waiter([&] {
+			for (std::size_t i = 0; frames.size() != i; ++i) {
+				{
+					std::unique_lock lock(mutex);
+					cv.wait(lock, [&] { return num_submitted > i; });
+				}
+				map.waitFor(tickets[i]);
+				latencies[i] = seconds(Clock::now() - submitted[i]);
+			}
+		});
+
+		for (std::size_t i = 0; frames.size() != i; ++i) {
+			Frame const& frame = frames[i];
+			num_points += frame.cloud.size();
+			submitted[i] = Clock::now();
+			IntegrationTicket ticket = map.insertPointCloudPipelined(
+			    frame.pose.translation(), frame.cloud, frame.pose, options.max_range,
+			    options.insert_depth, options.simple_ray_casting, options.early_stopping,
+			    options.parallel, options.discrete);
+			{
+				std::scoped_lock lock(mutex);
+				tickets[i] = ticket;
+				++num_submitted;
+			}
+			cv.notify_one();
+		}
+		waiter.join();
+		map.stopPipeline();
+	} else {
+		for (std::size_t i = 0; frames.size() != i; ++i) {
+			Frame const& frame = frames[i];
+			num_points += frame.cloud.size();
+			Clock::time_point submitted = Clock::now();
+			if (options.discrete) {
+				map.insertPointCloudDiscrete(frame.pose.translation(), frame.cloud, frame.pose,
+				                             options.max_range, options.insert_depth,
+				                             options.simple_ray_casting,
+				                             options.early_stopping, false, options.parallel);
+			} else {
+				map.insertPointCloud(frame.pose.translation(), frame.cloud, frame.pose,
+				                     options.max_range, options.insert_depth,
+				                     options.simple_ray_casting, options.early_stopping,
+				                     false, options.parallel);
+			}
+			latencies[i] = seconds(Clock::now() - submitted);
+		}
+	}
+	double total = seconds(Clock::now() - start);
+
+	std::vector<double> sorted = latencies;
+	std::sort(sorted.begin(), sorted.end());
+
+	std::printf("Clouds:     %zu (%zu points)\n", frames.size(), num_points);
+	std::printf("Total (s):  %.3f\n", total);
+	std::printf("Throughput: %.2f clouds/s, %.0f points/s\n", frames.size() / total,
+	            num_points / total);
+	std::printf("Latency (ms): p50 %.3f  p90 %.3f  p99 %.3f  max %.3f\n",
+	            1000.0 * percentile(sorted, 50), 1000.0 * percentile(sorted, 90),
+	            1000.0 * percentile(sorted, 99), 1000.0 * sorted.back());
+	std::printf("Map:        %zu leaf nodes, %.1f MB\n", map.getNumLeafNodes(),
+	            map.getMemoryReport().total() / 1.0e6);
+
+	if constexpr (METRICS_ENABLED) {
+		IntegrationStats stats = map.getIntegrationStats();
+		std::printf("Stages (ms): mean / p99 / max\n");
+		for (std::size_t i = 0; NUM_INTEGRATION_STAGES != i; ++i) {
+			auto stage = static_cast<IntegrationStage>(i);
+			TimingHistogram const& h = stats[stage];
+			if (0 != h.count) {
+				std::printf("  %-11s %9.3f %9.3f %9.3f\n", std::string(toString(stage)).c_str(),
+				            1000.0 * h.mean(), 1000.0 * h.quantile(0.99), 1000.0 * h.max);
+			}
+		}
+		std::printf("Counters:\n");
+		for (std::size_t i = 0; NUM_INTEGRATION_COUNTERS != i; ++i) {
+			auto counter = static_cast<IntegrationCounter>(i);
+			std::printf("  %-16s %llu\n", std::string(toString(counter)).c_str(),
+			            static_cast<unsigned long long>(stats[counter]));
+		}
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,136 @@
+/**
+ * UFOMap: An Efficient Probabilistic 3D Mapping Framework That Embraces the Unknown
+ *
+ * @author D. Duberg, KTH Royal Institute of Technology, Copyright (c) 2020.
+ * @see https://github.com/UnknownFreeOccupied/ufomap
+ * License: BSD 3
+ *
+ */
+
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2020, D. Duberg, KTH Royal Institute of Technology
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef UFO_MAP_TESTS_SYNTHETIC_H
+#define UFO_MAP_TESTS_SYNTHETIC_H
+
+// UFO
+#include <ufo/map/point_cloud.h>
+#include <ufo/map/types.h>
+
+// STD
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <random>
+
+namespace ufo::map::synthetic
+{
+// The room the scans are taken in, with a pillar in the middle
+inline constexpr double ROOM_HALF_SIZE = 10.0;
+inline constexpr double ROOM_FLOOR = -1.0;
+inline constexpr double ROOM_CEILING = 3.0;
+inline constexpr double PILLAR_HALF_SIZE = 0.5;
+
+// Distance along the ray to where it leaves the box, or enters it if inside is false
+inline double boxDistance(Point3 const& origin, Point3 const& direction,
+                          Point3 const& min, Point3 const& max, bool inside)
+{
+	double near = 0.0;
+	double far = std::numeric_limits<double>::infinity();
+	for (int i : {0, 1, 2}) {
+		if (0.0 == direction[i]) {
+			if (origin[i] < min[i] || origin[i] > max[i]) {
+				return std::numeric_limits<double>::infinity();
+			}
+			continue;
+		}
+		double t_1 = (min[i] - origin[i]) / direction[i];
+		double t_2 = (max[i] - origin[i]) / direction[i];
+		near = std::max(near, std::min(t_1, t_2));
+		far = std::min(far, std::max(t_1, t_2));
+	}
+	if (near > far) {
+		return std::numeric_limits<double>::infinity();
+	}
+	return inside ? far : near;
+}
+
+/**
+ * @brief A spinning lidar scan of the room taken at origin, in the map frame
+ *
+ * @details beams rows between -15 and 15 degrees of elevation, columns points per row
+ * and 1 cm range noise. The same seed always gives the same scan.
+ */
+inline PointCloud scan(Point3 const& origin, std::size_t beams, std::size_t columns,
+                       std::uint32_t seed = 0)
+{
+	std::mt19937 gen(seed);
+	std::normal_distribution<double> noise(0.0, 0.01);
+
+	Point3 const room_min(-ROOM_HALF_SIZE, -ROOM_HALF_SIZE, ROOM_FLOOR);
+	Point3 const room_max(ROOM_HALF_SIZE, ROOM_HALF_SIZE, ROOM_CEILING);
+	Point3 const pillar_min(-PILLAR_HALF_SIZE, -PILLAR_HALF_SIZE, ROOM_FLOOR);
+	Point3 const pillar_max(PILLAR_HALF_SIZE, PILLAR_HALF_SIZE, ROOM_CEILING);
+
+	double const max_elevation = 15.0 * M_PI / 180.0;
+	PointCloud cloud;
+	cloud.reserve(beams * columns);
+	for (std::size_t b = 0; beams != b; ++b) {
+		double elevation =
+		    1 == beams ? 0.0 : -max_elevation + 2.0 * max_elevation * b / (beams - 1);
+		for (std::size_t c = 0; columns != c; ++c) {
+			double azimuth = 2.0 * M_PI * c / columns;
+			Point3 direction(std::cos(elevation) * std::cos(azimuth),
+			                 std::cos(elevation) * std::sin(azimuth), std::sin(elevation));
+			double distance =
+			    std::min(boxDistance(origin, direction, room_min, room_max, true),
+			             boxDistance(origin, direction, pillar_min, pillar_max, false));
+			cloud.push_back(origin + direction * (distance + noise(gen)));
+		}
+	}
+	return cloud;
+}
+
+/**
+ * @brief Sensor origin of frame i of a loop around the pillar
+ */
+inline Point3 trajectory(std::size_t i, std::size_t num_frames)
+{
+	double angle = 2.0 * M_PI * i / std::max(std::size_t(1), num_frames);
+	return Point3(5.0 * std::cos(angle), 5.0 * std::sin(angle), 1.0);
+}
+}  // namespace ufo::map::synthetic
+
+#endif  // UFO_MAP_TESTS_SYNTHETIC_H
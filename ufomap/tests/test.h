@@ -0,0 +1,202 @@
+/**
+ * UFOMap: An Efficient Probabilistic 3D Mapping Framework That Embraces the Unknown
+ *
+ * @author D. Duberg, KTH Royal Institute of Technology, Copyright (c) 2020.
+ * @see https://github.com/UnknownFreeOccupied/ufomap
+ * License: BSD 3
+ *
+ */
+
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2020, D. Duberg, KTH Royal Institute of Technology
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+
+#ifndef UFO_MAP_TESTS_TEST_H
+#define UFO_MAP_TESTS_TEST_H
+
+// UFO
+#include <ufo/map/code.h>
+#include <ufo/map/point_cloud.h>
+#include <ufo/map/types.h>
+
+#include "synthetic.h"
+
+// STD
+#include <cmath>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+//
+// Minimal test framework for the behavior tests. A test is a function registered with
+// UFO_TEST, CHECK records a failure and continues. Each test executable runs all of its
+// tests, or only the one given on the command line, and fails if any check failed.
+//
+
+namespace ufo::map::test
+{
+inline int num_failures = 0;
+
+inline std::vector<std::pair<std::string, std::function<void()>>>& tests()
+{
+	static std::vector<std::pair<std::string, std::function<void()>>> tests;
+	return tests;
+}
+
+struct Register {
+	Register(char const* name, std::function<void()> test)
+	{
+		tests().emplace_back(name, std::move(test));
+	}
+};
+
+inline void fail(char const* file, int line, std::string const& what)
+{
+	++num_failures;
+	std::fprintf(stderr, "%s:%d: check failed: %s\n", file, line, what.c_str());
+}
+
+inline int run(int argc, char** argv)
+{
+	for (auto const& [name, test] : tests()) {
+		if (1 < argc && name != argv[1]) {
+			continue;
+		}
+		int const failures_before = num_failures;
+		test();
+		std::printf("%s %s\n", num_failures == failures_before ? "[ OK ]" : "[FAIL]",
+		            name.c_str());
+	}
+	return 0 == num_failures ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+//
+// Synthetic maps
+//
+
+inline constexpr double RESOLUTION = 0.1;
+inline constexpr double MAX_RANGE = 12.0;
+inline constexpr std::size_t BEAMS = 16;
+inline constexpr std::size_t COLUMNS = 512;
+inline constexpr std::size_t NUM_FRAMES = 8;
+
+inline Point3 origin(std::size_t frame)
+{
+	return synthetic::trajectory(frame, NUM_FRAMES);
+}
+
+inline PointCloud scan(std::size_t frame)
+{
+	return synthetic::scan(origin(frame), BEAMS, COLUMNS, frame);
+}
+
+// Integrate frames [first, last) into map with the default settings
+template <class Map>
+void integrate(Map& map, std::size_t first, std::size_t last)
+{
+	for (std::size_t i = first; last != i; ++i) {
+		map.insertPointCloudDiscrete(origin(i), scan(i), MAX_RANGE);
+	}
+}
+
+//
+// Tree comparison
+//
+
+/**
+ * @brief Number of nodes, inner nodes included, that differ between the two maps in
+ * code, occupancy, flags, or whether they are leaves. The first few differences are
+ * printed.
+ */
+template <class MapA, class MapB>
+std::size_t compareTrees(MapA const& a, MapB const& b, double tolerance = 0.0,
+                         std::size_t max_print = 5)
+{
+	std::size_t num_diff = 0;
+	auto report = [&](Code const& code, char const* what, double value_a, double value_b) {
+		if (max_print > num_diff) {
+			std::fprintf(stderr, "  node %llu at depth %u differs in %s: %f vs %f\n",
+			             static_cast<unsigned long long>(code.getCode()), code.getDepth(),
+			             what, value_a, value_b);
+		}
+		++num_diff;
+	};
+
+	auto it_a = a.beginTree(true, true, true);
+	auto it_b = b.beginTree(true, true, true);
+	auto const end_a = a.endTree();
+	auto const end_b = b.endTree();
+	for (; end_a != it_a && end_b != it_b; ++it_a, ++it_b) {
+		Code const code = it_a.getCode();
+		if (code != it_b.getCode()) {
+			report(code, "code", code.getCode(), it_b.getCode().getCode());
+			return num_diff;
+		}
+		if (tolerance < std::abs(it_a.getOccupancy() - it_b.getOccupancy())) {
+			report(code, "occupancy", it_a.getOccupancy(), it_b.getOccupancy());
+		} else if (it_a.isLeaf() != it_b.isLeaf()) {
+			report(code, "leaf", it_a.isLeaf(), it_b.isLeaf());
+		} else if (it_a.containsFree() != it_b.containsFree() ||
+		           it_a.containsUnknown() != it_b.containsUnknown()) {
+			report(code, "flags", it_a.containsFree(), it_b.containsFree());
+		}
+	}
+	if ((end_a == it_a) != (end_b == it_b)) {
+		report(Code(), "number of nodes", end_a == it_a, end_b == it_b);
+	}
+	return num_diff;
+}
+}  // namespace ufo::map::test
+
+#define UFO_TEST_CAT_(a, b) a##b
+#define UFO_TEST_CAT(a, b) UFO_TEST_CAT_(a, b)
+
+#define UFO_TEST(name)                                                        \
+	static void name();                                                         \
+	static ufo::map::test::Register UFO_TEST_CAT(register_, name)(#name, name); \
+	static void name()
+
+#define CHECK(condition)                                    \
+	do {                                                      \
+		if (!(condition)) {                                     \
+			ufo::map::test::fail(__FILE__, __LINE__, #condition); \
+		}                                                       \
+	} while (false)
+
+#define CHECK_SAME_TREE(a, b) CHECK(0 == ufo::map::test::compareTrees(a, b))
+
+#endif  // UFO_MAP_TESTS_TEST_H
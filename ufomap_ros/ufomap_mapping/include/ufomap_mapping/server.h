@@ -43,9 +43,14 @@
 #define UFO_MAP_MAPPING_SERVER_H
 
 // UFO
+#include <ufo/map/bounded_queue.h>
+#include <ufo/map/codec.h>
 #include <ufo/map/occupancy_map.h>
 #include <ufo/map/occupancy_map_color.h>
+#include <ufo/map/point_cloud.h>
+#include <ufo/math/pose6.h>
 #include <ufomap_mapping/ServerConfig.h>
+#include <ufomap_msgs/UFOMapDeltaStamped.h>
 #include <ufomap_srvs/ClearVolume.h>
 #include <ufomap_srvs/GetMap.h>
 #include <ufomap_srvs/Reset.h>
@@ -60,7 +65,15 @@
 #include <tf2_sensor_msgs/tf2_sensor_msgs.h>
 
 // STD
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
 #include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
 #include <variant>
 #include <vector>
 
@@ -71,13 +84,81 @@ class Server
  public:
 	Server(ros::NodeHandle &nh, ros::NodeHandle &nh_priv);
 
+	~Server();
+
  private:
-	void cloudCallback(sensor_msgs::PointCloud2::ConstPtr const &msg);
+	/**
+	 * @brief A point cloud with its transform into the map frame, waiting to be
+	 * integrated. The cloud is read in place when it is integrated.
+	 */
+	struct PreparedCloud {
+		std::size_t topic;
+		std_msgs::Header header;
+		ufo::math::Pose6 transform;
+		sensor_msgs::PointCloud2::ConstPtr msg;
+	};
+
+	/**
+	 * @brief A subscribed point cloud topic with its own preprocessing worker
+	 */
+	struct CloudTopic {
+		using Item = std::pair<std::uint64_t, sensor_msgs::PointCloud2::ConstPtr>;
+
+		CloudTopic(std::string const &name, std::size_t queue_size)
+		    : name(name), queue(queue_size, ufo::map::BackpressurePolicy::drop_oldest)
+		{
+		}
+
+		std::string name;
+		ros::Subscriber sub;
+		ufo::map::BoundedQueue<Item> queue;
+		std::thread worker;
+
+		// Statistics
+		std::atomic_size_t num_received = 0;
+		std::atomic_size_t num_dropped = 0;
+		std::atomic_size_t num_tf_failures = 0;
+		std::atomic_size_t num_integrated = 0;
+	};
+
+	void subscribeClouds();
+
+	void cloudCallback(sensor_msgs::PointCloud2::ConstPtr const &msg, std::size_t topic);
+
+	void preprocessWorker(std::size_t topic);
+
+	void deliver(std::uint64_t sequence, std::optional<PreparedCloud> cloud);
+
+	void integrationWorker();
+
+	void integrate(PreparedCloud const &cloud);
+
+	/**
+	 * @brief Publish the part of the map that changed and the delta, if it is time to.
+	 * The integration of the changes has to be done, or the delta waits for it.
+	 */
+	template <class Map>
+	void publishChanges(Map &map, ros::Time const &stamp);
+
+	/**
+	 * @brief Step the degradation level up when the integration is over budget and back
+	 * down when it is well below it
+	 */
+	void adaptToBudget(double integration_time);
 
 	void publishInfo();
 
 	void mapConnectCallback(ros::SingleSubscriberPublisher const &pub, int depth);
 
+	void mapDeltaConnectCallback(ros::SingleSubscriberPublisher const &pub);
+
+	/**
+	 * @brief The whole map as a full delta message, so that the deltas after
+	 * delta_sequence_ can be applied to it. The caller holds map_mutex_.
+	 */
+	template <class Map>
+	ufomap_msgs::UFOMapDeltaStamped::Ptr fullDelta(Map const &map) const;
+
 	bool getMapCallback(ufomap_srvs::GetMap::Request &request,
 	                    ufomap_srvs::GetMap::Response &response);
 
@@ -104,7 +185,7 @@ class Server
 	ros::NodeHandle &nh_priv_;
 
 	// Subscribers
-	ros::Subscriber cloud_sub_;
+	std::vector<std::unique_ptr<CloudTopic>> cloud_topics_;
 	unsigned int cloud_in_queue_size_;
 
 	// Publishers
@@ -116,6 +197,12 @@ class Server
 	ros::Time last_update_time_;
 	ros::Publisher info_pub_;
 
+	// Deltas, built from the exact change detection of the map. A new subscriber first
+	// gets the whole map, with the sequence number of the last delta.
+	ros::Publisher map_delta_pub_;
+	std::uint64_t delta_sequence_ = 0;
+	ros::Time last_delta_time_;
+
 	// Services
 	ros::ServiceServer get_map_server_;
 	ros::ServiceServer clear_volume_server_;
@@ -137,6 +224,20 @@ class Server
 	// Map
 	std::variant<std::monostate, ufo::map::OccupancyMap, ufo::map::OccupancyMapColor> map_;
 	std::string frame_id_;
+	// Held by everything that reads or modifies the map, except the preprocessing
+	std::mutex map_mutex_;
+
+	// Ordered integration, clouds are integrated in the order they arrived in over all
+	// topics. A sequence number without a cloud was dropped or could not be transformed.
+	std::atomic<std::uint64_t> next_sequence_ = 0;
+	std::uint64_t next_integration_ = 0;
+	std::map<std::uint64_t, std::optional<PreparedCloud>> integration_buffer_;
+	std::size_t integration_buffer_size_;
+	bool integration_stop_ = false;
+	std::mutex integration_mutex_;
+	std::condition_variable integration_ready_;
+	std::condition_variable integration_space_;
+	std::thread integration_thread_;
 
 	// Integration
 	double max_range_;
@@ -145,6 +246,15 @@ class Server
 	unsigned int early_stopping_;
 	bool async_;
 
+	// Load shedding, each degradation level trades some quality for integration time:
+	// 1 simple ray casting, 2 early stopping, 3-4 coarser insert depth, 5-6 subsampling
+	static constexpr unsigned int MAX_DEGRADATION = 6;
+	double integration_budget_;
+	unsigned int degradation_ = 0;
+	// Smoothed integration time and number of clouds at the current degradation level
+	double budget_integration_time_ = 0.0;
+	unsigned int num_at_degradation_ = 0;
+
 	// Clear robot
 	bool clear_robot_;
 	std::string robot_frame_id_;
@@ -152,8 +262,9 @@ class Server
 	double robot_radius_;
 	int clearing_depth_;
 
-	// Publishing
-	bool compress_;
+	// Publishing, the codec is none if the msgs are not compressed
+	ufo::map::Codec codec_;
+	int compression_level_;
 	bool update_part_of_map_;
 	ufo::map::DepthType publish_depth_;
 	std::future<void> update_async_handler_;
@@ -186,6 +297,12 @@ class Server
 	double accumulated_whole_time_ = 0.0;
 	int num_wholes_ = 0;
 
+	// Publish delta
+	double min_delta_time_;
+	double max_delta_time_ = 0.0;
+	double accumulated_delta_time_ = 0.0;
+	int num_deltas_ = 0;
+
 	// Verbose
 	bool verbose_;
 };
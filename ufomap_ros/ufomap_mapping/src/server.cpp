@@ -46,9 +46,12 @@
 #include <ufomap_ros/conversions.h>
 
 // STD
+#include <algorithm>
 #include <chrono>
 #include <future>
+#include <memory>
 #include <numeric>
+#include <optional>
 
 namespace ufomap_mapping
 {
@@ -67,18 +70,36 @@ Server::Server(ros::NodeHandle &nh, ros::NodeHandle &nh_priv)
 		map_.emplace<ufo::map::OccupancyMap>(resolution, depth_levels, false);
 	}
 
-	// Enable min/max change detection
+	// Enable min/max change detection for the partial updates and exact change detection
+	// for the deltas
 	std::visit(
 	    [this](auto &map) {
 		    if constexpr (!std::is_same_v<std::decay_t<decltype(map)>, std::monostate>) {
 			    map.enableMinMaxChangeDetection(true);
+			    map.enableChangeDetection(true);
 		    }
 	    },
 	    map_);
 
+	// Set up the point cloud topics, each looks up its transform in its own worker and
+	// they are integrated one at a time in the order they arrived
+	std::vector<std::string> cloud_topics =
+	    nh_priv_.param("cloud_topics", std::vector<std::string>{"cloud_in"});
+	std::size_t preprocess_queue_size = nh_priv_.param("preprocess_queue_size", 2);
+	integration_buffer_size_ = std::max(1, nh_priv_.param("integration_buffer_size", 4));
+	for (std::string const &topic : cloud_topics) {
+		cloud_topics_.push_back(std::make_unique<CloudTopic>(topic, preprocess_queue_size));
+	}
+
 	// Set up dynamic reconfigure server
 	cs_.setCallback(boost::bind(&Server::configCallback, this, _1, _2));
 
+	// Start after the configuration is read, the workers use it
+	for (std::size_t i = 0; i != cloud_topics_.size(); ++i) {
+		cloud_topics_[i]->worker = std::thread(&Server::preprocessWorker, this, i);
+	}
+	integration_thread_ = std::thread(&Server::integrationWorker, this);
+
 	// Set up publisher
 	info_pub_ = nh_priv_.advertise<diagnostic_msgs::DiagnosticStatus>("info", 10, false);
 
@@ -91,38 +112,207 @@ Server::Server(ros::NodeHandle &nh, ros::NodeHandle &nh_priv)
 	    nh_priv_.advertiseService("save_map", &Server::saveMapCallback, this);
 }
 
-void Server::cloudCallback(sensor_msgs::PointCloud2::ConstPtr const &msg)
+Server::~Server()
 {
-	ufo::math::Pose6 transform;
-	try {
-		transform =
-		    ufomap_ros::rosToUfo(tf_buffer_
-		                             .lookupTransform(frame_id_, msg->header.frame_id,
-		                                              msg->header.stamp, transform_timeout_)
-		                             .transform);
-	} catch (tf2::TransformException &ex) {
-		ROS_WARN_THROTTLE(1, "%s", ex.what());
-		return;
+	for (auto &topic : cloud_topics_) {
+		topic->sub.shutdown();
+		topic->queue.close();
+	}
+
+	{
+		std::scoped_lock lock(integration_mutex_);
+		integration_stop_ = true;
+	}
+	integration_ready_.notify_all();
+	integration_space_.notify_all();
+
+	for (auto &topic : cloud_topics_) {
+		if (topic->worker.joinable()) {
+			topic->worker.join();
+		}
+	}
+	if (integration_thread_.joinable()) {
+		integration_thread_.join();
+	}
+	if (update_async_handler_.valid()) {
+		update_async_handler_.wait();
+	}
+}
+
+void Server::subscribeClouds()
+{
+	for (std::size_t i = 0; i != cloud_topics_.size(); ++i) {
+		cloud_topics_[i]->sub = nh_.subscribe<sensor_msgs::PointCloud2>(
+		    cloud_topics_[i]->name, cloud_in_queue_size_,
+		    boost::bind(&Server::cloudCallback, this, _1, i));
+	}
+}
+
+void Server::cloudCallback(sensor_msgs::PointCloud2::ConstPtr const &msg,
+                           std::size_t topic)
+{
+	// Only hand the cloud over to the preprocessing worker of the topic, so a slow topic
+	// does not hold up the others
+	CloudTopic &t = *cloud_topics_[topic];
+	++t.num_received;
+	if (auto dropped = t.queue.push({next_sequence_++, msg})) {
+		++t.num_dropped;
+		deliver(dropped->first, std::nullopt);
+	}
+}
+
+void Server::preprocessWorker(std::size_t topic)
+{
+	CloudTopic &t = *cloud_topics_[topic];
+	CloudTopic::Item item;
+	while (t.queue.pop(item)) {
+		auto const &[sequence, msg] = item;
+
+		PreparedCloud cloud;
+		cloud.topic = topic;
+		cloud.header = msg->header;
+		try {
+			cloud.transform =
+			    ufomap_ros::rosToUfo(tf_buffer_
+			                             .lookupTransform(frame_id_, msg->header.frame_id,
+			                                              msg->header.stamp, transform_timeout_)
+			                             .transform);
+		} catch (tf2::TransformException &ex) {
+			ROS_WARN_THROTTLE(1, "%s", ex.what());
+			++t.num_tf_failures;
+			deliver(sequence, std::nullopt);
+			continue;
+		}
+
+		cloud.msg = msg;
+
+		deliver(sequence, std::move(cloud));
+	}
+}
+
+void Server::deliver(std::uint64_t sequence, std::optional<PreparedCloud> cloud)
+{
+	{
+		std::unique_lock lock(integration_mutex_);
+		// The cloud that is integrated next never waits, otherwise the workers could wait
+		// for each other
+		if (cloud) {
+			integration_space_.wait(lock, [this, sequence] {
+				return integration_stop_ || next_integration_ == sequence ||
+				       integration_buffer_size_ > integration_buffer_.size();
+			});
+		}
+		integration_buffer_.emplace(sequence, std::move(cloud));
+	}
+	integration_ready_.notify_one();
+}
+
+void Server::integrationWorker()
+{
+	while (true) {
+		std::optional<PreparedCloud> cloud;
+		{
+			std::unique_lock lock(integration_mutex_);
+			integration_ready_.wait(lock, [this] {
+				return integration_stop_ ||
+				       integration_buffer_.count(next_integration_);
+			});
+			if (integration_stop_) {
+				return;
+			}
+			auto it = integration_buffer_.find(next_integration_);
+			cloud = std::move(it->second);
+			integration_buffer_.erase(it);
+			++next_integration_;
+		}
+		integration_space_.notify_all();
+
+		if (cloud) {
+			integrate(*cloud);
+			++cloud_topics_[cloud->topic]->num_integrated;
+		}
 	}
+}
+
+void Server::integrate(PreparedCloud const &cloud)
+{
+	std::scoped_lock lock(map_mutex_);
 
 	std::visit(
-	    [this, &msg, &transform](auto &map) {
+	    [this, &cloud](auto &map) {
 		    if constexpr (!std::is_same_v<std::decay_t<decltype(map)>, std::monostate>) {
 			    auto start = std::chrono::steady_clock::now();
 
-			    // Update map
-			    ufo::map::PointCloudColor cloud;
-			    ufomap_ros::rosToUfo(*msg, cloud);
-			    cloud.transform(transform, true);
+			    // Lower the quality step by step while over the integration budget
+			    bool simple_ray_casting = simple_ray_casting_ || 1 <= degradation_;
+			    unsigned int early_stopping = early_stopping_;
+			    if (2 <= degradation_) {
+				    early_stopping = 0 == early_stopping ? 2 : std::min(early_stopping, 2u);
+			    }
+			    ufo::map::DepthType insert_depth = insert_depth_;
+			    if (3 <= degradation_) {
+				    insert_depth = std::min(insert_depth + std::min(degradation_ - 2, 2u),
+				                            map.getTreeDepthLevels() - 1);
+			    }
+			    std::size_t const subsample = 5 > degradation_ ? 1 : (5 == degradation_ ? 2 : 4);
+
+			    // Update map, the cloud is transformed, filtered and discretized in one pass
+			    // straight from the message data if it can be read in place
+			    if (auto const reason = ufomap_ros::notViewableReason(*cloud.msg)) {
+				    ROS_WARN_STREAM_ONCE("Copying point clouds that cannot be read in place: "
+				                         << *reason);
+
+				    ufo::map::PointCloudColor points;
+				    ufomap_ros::rosToUfo(*cloud.msg, points);
+				    if (1 < subsample) {
+					    std::size_t num = 0;
+					    for (std::size_t i = 0; points.size() > i; i += subsample) {
+						    points[num++] = points[i];
+					    }
+					    points.resize(num);
+				    }
+				    points.transform(cloud.transform, true);
+
+				    map.insertPointCloudDiscrete(cloud.transform.translation(), points,
+				                                 max_range_, insert_depth, simple_ray_casting,
+				                                 early_stopping, async_);
+			    } else {
+				    ufo::map::PointCloudView view;
+				    ufomap_ros::rosToUfo(*cloud.msg, view, cloud.transform);
+				    view.subsample(subsample);
+
+				    map.insertPointCloudDiscrete(cloud.transform.translation(), view, max_range_,
+				                                 insert_depth, simple_ray_casting,
+				                                 early_stopping, async_);
+			    }
 
-			    map.insertPointCloudDiscrete(transform.translation(), cloud, max_range_,
-			                                 insert_depth_, simple_ray_casting_,
-			                                 early_stopping_, async_);
+			    // The robot transform is looked up while an async integration runs
+			    std::optional<ufo::math::Pose6> robot;
+			    double lookup_time = 0.0;
+			    if (clear_robot_) {
+				    auto const lookup_start = std::chrono::steady_clock::now();
+				    try {
+					    robot = ufomap_ros::rosToUfo(
+					        tf_buffer_
+					            .lookupTransform(frame_id_, robot_frame_id_, cloud.header.stamp,
+					                             transform_timeout_)
+					            .transform);
+				    } catch (tf2::TransformException &ex) {
+					    ROS_WARN_THROTTLE(1, "%s", ex.what());
+				    }
+				    lookup_time = std::chrono::duration<float, std::chrono::seconds::period>(
+				                      std::chrono::steady_clock::now() - lookup_start)
+				                      .count();
+			    }
 
+			    // Until the integration, ray casting included, was applied to the map, also
+			    // when it is async
+			    map.insertPointCloudWait();
 			    double integration_time =
 			        std::chrono::duration<float, std::chrono::seconds::period>(
-			            std::chrono::steady_clock::now() - start)
+			            map.insertPointCloudEnd() - start)
 			            .count();
+			    adaptToBudget(integration_time);
 
 			    if (0 == num_integrations_ || integration_time < min_integration_time_) {
 				    min_integration_time_ = integration_time;
@@ -134,29 +324,17 @@ void Server::cloudCallback(sensor_msgs::PointCloud2::ConstPtr const &msg)
 			    ++num_integrations_;
 
 			    // Clear robot
-			    if (clear_robot_) {
+			    if (robot) {
 				    start = std::chrono::steady_clock::now();
 
-				    try {
-					    transform = ufomap_ros::rosToUfo(
-					        tf_buffer_
-					            .lookupTransform(frame_id_, robot_frame_id_, msg->header.stamp,
-					                             transform_timeout_)
-					            .transform);
-				    } catch (tf2::TransformException &ex) {
-					    ROS_WARN_THROTTLE(1, "%s", ex.what());
-					    return;
-				    }
-
 				    ufo::map::Point3 r(robot_radius_, robot_radius_, robot_height_ / 2.0);
-				    ufo::geometry::AABB aabb(transform.translation() - r,
-				                             transform.translation() + r);
+				    ufo::geometry::AABB aabb(robot->translation() - r, robot->translation() + r);
 				    map.setValueVolume(aabb, map.getClampingThresMin(), clearing_depth_);
 
 				    double clear_time =
-				        std::chrono::duration<float, std::chrono::seconds::period>(
-				            std::chrono::steady_clock::now() - start)
-				            .count();
+				        lookup_time + std::chrono::duration<float, std::chrono::seconds::period>(
+				                          std::chrono::steady_clock::now() - start)
+				                          .count();
 				    if (0 == num_clears_ || clear_time < min_clear_time_) {
 					    min_clear_time_ = clear_time;
 				    }
@@ -167,62 +345,8 @@ void Server::cloudCallback(sensor_msgs::PointCloud2::ConstPtr const &msg)
 				    ++num_clears_;
 			    }
 
-			    // Publish update
-			    if (!map_pub_.empty() && update_part_of_map_ && map.validMinMaxChange() &&
-			        (!last_update_time_.isValid() ||
-			         (msg->header.stamp - last_update_time_) >= update_rate_)) {
-				    bool can_update = true;
-				    if (update_async_handler_.valid()) {
-					    can_update = std::future_status::ready ==
-					                 update_async_handler_.wait_for(std::chrono::seconds(0));
-				    }
-
-				    if (can_update) {
-					    last_update_time_ = msg->header.stamp;
-					    start = std::chrono::steady_clock::now();
-
-					    ufo::geometry::AABB aabb(map.minChange(), map.maxChange());
-					    // TODO: should this be here?
-					    map.resetMinMaxChangeDetection();
-
-					    update_async_handler_ = std::async(
-					        std::launch::async, [this, aabb, stamp = msg->header.stamp]() {
-						        std::visit(
-						            [this, &aabb, stamp](auto &map) {
-							            if constexpr (!std::is_same_v<std::decay_t<decltype(map)>,
-							                                          std::monostate>) {
-								            for (int i = 0; i < map_pub_.size(); ++i) {
-									            if (map_pub_[i] && (0 < map_pub_[i].getNumSubscribers() ||
-									                                map_pub_[i].isLatched())) {
-										            ufomap_msgs::UFOMapStamped::Ptr msg(
-										                new ufomap_msgs::UFOMapStamped);
-										            if (ufomap_msgs::ufoToMsg(map, msg->map, aabb, compress_,
-										                                      i)) {
-											            msg->header.stamp = stamp;
-											            msg->header.frame_id = frame_id_;
-											            map_pub_[i].publish(msg);
-										            }
-									            }
-								            }
-							            }
-						            },
-						            map_);
-					        });
-
-					    double update_time =
-					        std::chrono::duration<float, std::chrono::seconds::period>(
-					            std::chrono::steady_clock::now() - start)
-					            .count();
-					    if (0 == num_updates_ || update_time < min_update_time_) {
-						    min_update_time_ = update_time;
-					    }
-					    if (update_time > max_update_time_) {
-						    max_update_time_ = update_time;
-					    }
-					    accumulated_update_time_ += update_time;
-					    ++num_updates_;
-				    }
-			    }
+			    // Publish the changes, the integration is done
+			    publishChanges(map, cloud.header.stamp);
 
 			    publishInfo();
 		    }
@@ -230,6 +354,146 @@ void Server::cloudCallback(sensor_msgs::PointCloud2::ConstPtr const &msg)
 	    map_);
 }
 
+template <class Map>
+void Server::publishChanges(Map &map, ros::Time const &stamp)
+{
+	// Publish update
+	if (!map_pub_.empty() && update_part_of_map_ && map.validMinMaxChange() &&
+	    (!last_update_time_.isValid() ||
+	     (stamp - last_update_time_) >= update_rate_)) {
+		bool can_update = true;
+		if (update_async_handler_.valid()) {
+			can_update = std::future_status::ready ==
+			             update_async_handler_.wait_for(std::chrono::seconds(0));
+		}
+
+		if (can_update) {
+			last_update_time_ = stamp;
+			auto start = std::chrono::steady_clock::now();
+
+			ufo::geometry::AABB aabb(map.minChange(), map.maxChange());
+			// TODO: should this be here?
+			map.resetMinMaxChangeDetection();
+
+			// The publisher copies the changed part and writes the messages from the copy,
+			// so the integration does not wait for the copy and the map can be updated by
+			// the next cloud while it is being published
+			update_async_handler_ = std::async(
+			    std::launch::async, [this, &map, aabb, stamp]() {
+				    ufo::geometry::BoundingVolume bv;
+				    bv.add(aabb);
+				    std::shared_ptr<Map const> copy;
+				    {
+					    std::scoped_lock lock(map_mutex_);
+					    copy = map.readOnlyCopy(bv);
+				    }
+
+				    for (int i = 0; i < map_pub_.size(); ++i) {
+					    if (map_pub_[i] &&
+					        (0 < map_pub_[i].getNumSubscribers() || map_pub_[i].isLatched())) {
+						    ufomap_msgs::UFOMapStamped::Ptr msg(new ufomap_msgs::UFOMapStamped);
+						    if (ufomap_msgs::ufoToMsg(*copy, msg->map, aabb, codec_, i,
+						                          compression_level_)) {
+							    msg->header.stamp = stamp;
+							    msg->header.frame_id = frame_id_;
+							    map_pub_[i].publish(msg);
+						    }
+					    }
+				    }
+			    });
+
+			double update_time =
+			    std::chrono::duration<float, std::chrono::seconds::period>(
+			        std::chrono::steady_clock::now() - start)
+			        .count();
+			if (0 == num_updates_ || update_time < min_update_time_) {
+				min_update_time_ = update_time;
+			}
+			if (update_time > max_update_time_) {
+				max_update_time_ = update_time;
+			}
+			accumulated_update_time_ += update_time;
+			++num_updates_;
+		}
+	}
+
+	// Publish delta. Without subscribers the changes are dropped, a new subscriber
+	// gets the whole map first.
+	if (map_delta_pub_ &&
+	    (!last_delta_time_.isValid() ||
+	     (stamp - last_delta_time_) >= update_rate_)) {
+		last_delta_time_ = stamp;
+
+		// The changes are written and reset after the integration is done
+		map.insertPointCloudWait();
+
+		if (0 < map_delta_pub_.getNumSubscribers()) {
+			auto start = std::chrono::steady_clock::now();
+
+			// The sequence is stepped even if the delta could not be written, so
+			// the subscribers see the gap and ask for the whole map
+			ufomap_msgs::UFOMapDeltaStamped::Ptr msg(
+			    new ufomap_msgs::UFOMapDeltaStamped);
+			msg->delta.sequence = ++delta_sequence_;
+			if (ufomap_msgs::ufoToMsg(map, msg->delta, codec_, compression_level_)) {
+				msg->header.stamp = stamp;
+				msg->header.frame_id = frame_id_;
+				map_delta_pub_.publish(msg);
+			}
+
+			double delta_time =
+			    std::chrono::duration<float, std::chrono::seconds::period>(
+			        std::chrono::steady_clock::now() - start)
+			        .count();
+			if (0 == num_deltas_ || delta_time < min_delta_time_) {
+				min_delta_time_ = delta_time;
+			}
+			if (delta_time > max_delta_time_) {
+				max_delta_time_ = delta_time;
+			}
+			accumulated_delta_time_ += delta_time;
+			++num_deltas_;
+		}
+
+		map.resetChangeDetection();
+	}
+}
+
+void Server::adaptToBudget(double integration_time)
+{
+	if (0 >= integration_budget_) {
+		degradation_ = 0;
+		num_at_degradation_ = 0;
+		return;
+	}
+
+	// Restart the smoothing at each level, so a change is judged by its own clouds
+	budget_integration_time_ =
+	    0 == num_at_degradation_
+	        ? integration_time
+	        : 0.8 * budget_integration_time_ + 0.2 * integration_time;
+	++num_at_degradation_;
+
+	// Give each level a few clouds to settle, and only restore quality when there is
+	// plenty of room so it does not flip back and forth
+	constexpr unsigned int settle = 5;
+	unsigned int degradation = degradation_;
+	if (settle > num_at_degradation_) {
+		return;
+	} else if (integration_budget_ < budget_integration_time_ &&
+	           MAX_DEGRADATION > degradation_) {
+		++degradation_;
+	} else if (0.5 * integration_budget_ > budget_integration_time_ && 0 < degradation_) {
+		--degradation_;
+	}
+
+	if (degradation != degradation_) {
+		num_at_degradation_ = 0;
+		ROS_INFO("UFOMap integration %s budget, degradation level %u",
+		         degradation < degradation_ ? "over" : "under", degradation_);
+	}
+}
+
 void Server::publishInfo()
 {
 	if (verbose_) {
@@ -254,6 +518,22 @@ void Server::publishInfo()
 			       accumulated_whole_time_, accumulated_whole_time_ / num_wholes_,
 			       max_whole_time_);
 		}
+		if (0 != num_deltas_) {
+			printf("\tDelta time (s):       %5d %09.6f\t(%09.6f +- %09.6f)\n", num_deltas_,
+			       accumulated_delta_time_, accumulated_delta_time_ / num_deltas_,
+			       max_delta_time_);
+		}
+		if (0 < integration_budget_) {
+			printf("\tDegradation level:    %5u %09.6f\t(budget %09.6f)\n", degradation_,
+			       budget_integration_time_, integration_budget_);
+		}
+		printf("Topics (received, dropped, TF failures, integrated, queue length):\n");
+		for (auto const &topic : cloud_topics_) {
+			printf("\t%s: %zu %zu %zu %zu %zu\n", topic->name.c_str(),
+			       topic->num_received.load(), topic->num_dropped.load(),
+			       topic->num_tf_failures.load(), topic->num_integrated.load(),
+			       topic->queue.size());
+		}
 	}
 
 	if (info_pub_ && 0 < info_pub_.getNumSubscribers()) {
@@ -286,12 +566,106 @@ void Server::publishInfo()
 		msg.values[10].value = std::to_string(max_whole_time_);
 		msg.values[11].key = "Average whole time (ms)";
 		msg.values[11].value = std::to_string(accumulated_whole_time_ / num_wholes_);
+
+		auto add_time = [&msg](std::string const &key, double value) {
+			diagnostic_msgs::KeyValue v;
+			v.key = key;
+			v.value = std::to_string(value);
+			msg.values.push_back(v);
+		};
+		add_time("Min delta time (ms)", min_delta_time_);
+		add_time("Max delta time (ms)", max_delta_time_);
+		add_time("Average delta time (ms)", accumulated_delta_time_ / num_deltas_);
+		add_time("Integration budget (ms)", integration_budget_);
+		add_time("Smoothed integration time (ms)", budget_integration_time_);
+		{
+			diagnostic_msgs::KeyValue v;
+			v.key = "Degradation level";
+			v.value = std::to_string(degradation_);
+			msg.values.push_back(v);
+		}
+		if (0 < degradation_) {
+			msg.level = diagnostic_msgs::DiagnosticStatus::WARN;
+			msg.message = "Integration over budget, quality lowered";
+		}
+
+		std::visit(
+		    [&msg](auto &map) {
+			    if constexpr (!std::is_same_v<std::decay_t<decltype(map)>, std::monostate>) {
+				    // The report reads the integration buffers
+				    map.insertPointCloudWait();
+				    ufo::map::MemoryReport report = map.getMemoryReport();
+
+				    auto add = [&msg](std::string const &key, std::size_t bytes) {
+					    diagnostic_msgs::KeyValue value;
+					    value.key = key;
+					    value.value = std::to_string(bytes / 1.0e6);
+					    msg.values.push_back(value);
+				    };
+				    add("Memory total (MB)", report.total());
+				    add("Memory inner nodes (MB)", report.inner_node_memory);
+				    add("Memory leaf nodes (MB)", report.leaf_node_memory);
+				    add("Memory allocator overhead (MB)", report.allocator_overhead);
+				    add("Memory node index (MB)", report.node_index);
+				    add("Memory integration scratch (MB)", report.integration_scratch);
+				    add("Memory change detection (MB)", report.change_detection);
+				    add("Memory distance field (MB)", report.distance_field);
+				    add("Memory pipeline (MB)", report.pipeline);
+				    for (std::size_t depth = 0; depth != report.node_memory.size(); ++depth) {
+					    add("Memory depth " + std::to_string(depth) + " (MB)",
+					        report.node_memory[depth]);
+				    }
+
+				    // Only collected if UFOMap is built with UFOMAP_METRICS
+				    if constexpr (ufo::map::METRICS_ENABLED) {
+					    ufo::map::IntegrationStats stats = map.getIntegrationStats();
+					    auto add_value = [&msg](std::string const &key, auto value) {
+						    diagnostic_msgs::KeyValue v;
+						    v.key = key;
+						    v.value = std::to_string(value);
+						    msg.values.push_back(v);
+					    };
+					    for (std::size_t i = 0; i != ufo::map::NUM_INTEGRATION_COUNTERS; ++i) {
+						    auto counter = static_cast<ufo::map::IntegrationCounter>(i);
+						    add_value("Integration " + std::string(ufo::map::toString(counter)),
+						              stats[counter]);
+					    }
+					    for (std::size_t i = 0; i != ufo::map::NUM_INTEGRATION_STAGES; ++i) {
+						    auto stage = static_cast<ufo::map::IntegrationStage>(i);
+						    ufo::map::TimingHistogram const &h = stats[stage];
+						    std::string name = "Integration " + std::string(ufo::map::toString(stage));
+						    add_value(name + " count", h.count);
+						    add_value(name + " mean (ms)", 1000.0 * h.mean());
+						    add_value(name + " p99 (ms)", 1000.0 * h.quantile(0.99));
+						    add_value(name + " max (ms)", 1000.0 * h.max);
+					    }
+				    }
+			    }
+		    },
+		    map_);
+
+		for (auto const &topic : cloud_topics_) {
+			auto add = [&msg, &topic](std::string const &key, std::size_t value) {
+				diagnostic_msgs::KeyValue v;
+				v.key = "Topic " + topic->name + " " + key;
+				v.value = std::to_string(value);
+				msg.values.push_back(v);
+			};
+			add("received", topic->num_received);
+			add("dropped", topic->num_dropped);
+			add("TF failures", topic->num_tf_failures);
+			add("integrated", topic->num_integrated);
+			add("queue length", topic->queue.size());
+		}
+
 		info_pub_.publish(msg);
 	}
 }
 
 void Server::mapConnectCallback(ros::SingleSubscriberPublisher const &pub, int depth)
 {
+	std::scoped_lock lock(map_mutex_);
+
 	// When a new node subscribes we will publish the whole map to that node.
 
 	// TODO: Make this async
@@ -302,7 +676,8 @@ void Server::mapConnectCallback(ros::SingleSubscriberPublisher const &pub, int d
 			    auto start = std::chrono::steady_clock::now();
 
 			    ufomap_msgs::UFOMapStamped::Ptr msg(new ufomap_msgs::UFOMapStamped);
-			    if (ufomap_msgs::ufoToMsg(map, msg->map, compress_, depth)) {
+			    if (ufomap_msgs::ufoToMsg(map, msg->map, codec_, depth,
+			                              compression_level_)) {
 				    msg->header.stamp = ros::Time::now();
 				    msg->header.frame_id = frame_id_;
 				    pub.publish(msg);
@@ -324,16 +699,50 @@ void Server::mapConnectCallback(ros::SingleSubscriberPublisher const &pub, int d
 	    map_);
 }
 
+template <class Map>
+ufomap_msgs::UFOMapDeltaStamped::Ptr Server::fullDelta(Map const &map) const
+{
+	ufomap_msgs::UFOMapDeltaStamped::Ptr msg(new ufomap_msgs::UFOMapDeltaStamped);
+	msg->full = true;
+	msg->delta.id = map.getTreeType();
+	msg->delta.sequence = delta_sequence_;
+	if (!ufomap_msgs::ufoToMsg(map, msg->map, codec_, 0, compression_level_)) {
+		return nullptr;
+	}
+	msg->header.stamp = ros::Time::now();
+	msg->header.frame_id = frame_id_;
+	return msg;
+}
+
+void Server::mapDeltaConnectCallback(ros::SingleSubscriberPublisher const &pub)
+{
+	std::scoped_lock lock(map_mutex_);
+
+	std::visit(
+	    [this, &pub](auto &map) {
+		    if constexpr (!std::is_same_v<std::decay_t<decltype(map)>, std::monostate>) {
+			    if (auto msg = fullDelta(map)) {
+				    pub.publish(msg);
+			    }
+		    }
+	    },
+	    map_);
+}
+
 bool Server::getMapCallback(ufomap_srvs::GetMap::Request &request,
                             ufomap_srvs::GetMap::Response &response)
 {
+	std::scoped_lock lock(map_mutex_);
+
 	std::visit(
 	    [this, &request, &response](auto &map) {
 		    if constexpr (!std::is_same_v<std::decay_t<decltype(map)>, std::monostate>) {
 			    ufo::geometry::BoundingVolume bv =
 			        ufomap_msgs::msgToUfo(request.bounding_volume);
-			    response.success = ufomap_msgs::ufoToMsg(map, response.map, bv,
-			                                             request.compress, request.depth);
+			    std::optional<ufo::map::Codec> codec =
+			        ufomap_msgs::msgToUfoCodec(request.compress, request.codec);
+			    response.success =
+			        codec && ufomap_msgs::ufoToMsg(map, response.map, bv, *codec, request.depth);
 		    } else {
 			    response.success = false;
 		    }
@@ -345,6 +754,8 @@ bool Server::getMapCallback(ufomap_srvs::GetMap::Request &request,
 bool Server::clearVolumeCallback(ufomap_srvs::ClearVolume::Request &request,
                                  ufomap_srvs::ClearVolume::Response &response)
 {
+	std::scoped_lock lock(map_mutex_);
+
 	std::visit(
 	    [this, &request, &response](auto &map) {
 		    if constexpr (!std::is_same_v<std::decay_t<decltype(map)>, std::monostate>) {
@@ -365,11 +776,21 @@ bool Server::clearVolumeCallback(ufomap_srvs::ClearVolume::Request &request,
 bool Server::resetCallback(ufomap_srvs::Reset::Request &request,
                            ufomap_srvs::Reset::Response &response)
 {
+	std::scoped_lock lock(map_mutex_);
+
 	std::visit(
 	    [this, &request, &response](auto &map) {
 		    if constexpr (!std::is_same_v<std::decay_t<decltype(map)>, std::monostate>) {
 			    map.clear(request.new_resolution, request.new_depth_levels);
 			    response.success = true;
+
+			    // The deltas can not describe a reset, send the whole map instead
+			    map.resetChangeDetection();
+			    if (map_delta_pub_ && 0 < map_delta_pub_.getNumSubscribers()) {
+				    if (auto msg = fullDelta(map)) {
+					    map_delta_pub_.publish(msg);
+				    }
+			    }
 		    } else {
 			    response.success = false;
 		    }
@@ -381,13 +802,17 @@ bool Server::resetCallback(ufomap_srvs::Reset::Request &request,
 bool Server::saveMapCallback(ufomap_srvs::SaveMap::Request &request,
                              ufomap_srvs::SaveMap::Response &response)
 {
+	std::scoped_lock lock(map_mutex_);
+
 	std::visit(
 	    [this, &request, &response](auto &map) {
 		    if constexpr (!std::is_same_v<std::decay_t<decltype(map)>, std::monostate>) {
 			    ufo::geometry::BoundingVolume bv =
 			        ufomap_msgs::msgToUfo(request.bounding_volume);
-			    response.success = map.write(request.filename, bv, request.compress,
-			                                 request.depth, 1, request.compression_level);
+			    std::optional<ufo::map::Codec> codec = ufomap_msgs::msgToUfoCodec(
+			        request.compress, request.codec, request.compression_level);
+			    response.success = codec && map.write(request.filename, bv, *codec,
+			                                          request.depth, request.compression_level);
 		    } else {
 			    response.success = false;
 		    }
@@ -398,6 +823,8 @@ bool Server::saveMapCallback(ufomap_srvs::SaveMap::Request &request,
 
 void Server::timerCallback(ros::TimerEvent const &event)
 {
+	std::scoped_lock lock(map_mutex_);
+
 	std_msgs::Header header;
 	header.stamp = ros::Time::now();
 	header.frame_id = frame_id_;
@@ -413,7 +840,8 @@ void Server::timerCallback(ros::TimerEvent const &event)
 						    auto start = std::chrono::steady_clock::now();
 
 						    ufomap_msgs::UFOMapStamped::Ptr msg(new ufomap_msgs::UFOMapStamped);
-						    if (ufomap_msgs::ufoToMsg(map, msg->map, compress_, i)) {
+						    if (ufomap_msgs::ufoToMsg(map, msg->map, codec_, i,
+						                              compression_level_)) {
 							    msg->header = header;
 							    map_pub_[i].publish(msg);
 						    }
@@ -451,6 +879,7 @@ void Server::configCallback(ufomap_mapping::ServerConfig &config, uint32_t level
 	simple_ray_casting_ = config.simple_ray_casting;
 	early_stopping_ = config.early_stopping;
 	async_ = config.async;
+	integration_budget_ = config.integration_budget;
 
 	clear_robot_ = config.clear_robot;
 	robot_frame_id_ = config.robot_frame_id;
@@ -458,10 +887,18 @@ void Server::configCallback(ufomap_mapping::ServerConfig &config, uint32_t level
 	robot_radius_ = config.robot_radius;
 	clearing_depth_ = config.clearing_depth;
 
-	compress_ = config.compress;
+	codec_ = config.compress ? static_cast<ufo::map::Codec>(config.compression_codec)
+	                         : ufo::map::Codec::none;
+	if (!ufo::map::isCodecAvailable(codec_)) {
+		ROS_WARN_STREAM("UFOMap codec " << ufo::map::toString(codec_)
+		                                << " is not available, using lz4");
+		codec_ = ufo::map::Codec::lz4;
+	}
+	compression_level_ = config.compression_level;
 	update_part_of_map_ = config.update_part_of_map;
 	publish_depth_ = config.publish_depth;
 
+	std::unique_lock map_lock(map_mutex_);
 	std::visit(
 	    [this, &config](auto &map) {
 		    if constexpr (!std::is_same_v<std::decay_t<decltype(map)>, std::monostate>) {
@@ -472,6 +909,7 @@ void Server::configCallback(ufomap_mapping::ServerConfig &config, uint32_t level
 		    }
 	    },
 	    map_);
+	map_lock.unlock();
 
 	transform_timeout_.fromSec(config.transform_timeout);
 
@@ -487,13 +925,18 @@ void Server::configCallback(ufomap_mapping::ServerConfig &config, uint32_t level
 			    boost::bind(&Server::mapConnectCallback, this, _1, i),
 			    ros::SubscriberStatusCallback(), ros::VoidConstPtr(), config.map_latch);
 		}
+
+		// Never latched, a latched delta would reach a new subscriber after the whole map
+		map_delta_pub_ = nh_priv_.advertise<ufomap_msgs::UFOMapDeltaStamped>(
+		    "map_delta", map_queue_size_,
+		    boost::bind(&Server::mapDeltaConnectCallback, this, _1));
 	}
 
-	// Set up subscriber
-	if (!cloud_sub_ || cloud_in_queue_size_ != config.cloud_in_queue_size) {
+	// Set up subscribers
+	if (cloud_topics_.empty() || !cloud_topics_[0]->sub ||
+	    cloud_in_queue_size_ != config.cloud_in_queue_size) {
 		cloud_in_queue_size_ = config.cloud_in_queue_size;
-		cloud_sub_ =
-		    nh_.subscribe("cloud_in", cloud_in_queue_size_, &Server::cloudCallback, this);
+		subscribeClouds();
 	}
 
 	// Set up timer
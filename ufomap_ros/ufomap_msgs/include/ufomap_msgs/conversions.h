@@ -43,6 +43,8 @@
 #define UFOMAP_ROS_MSGS_CONVERSIONS_H
 
 // UFO
+#include <ufo/map/codec.h>
+#include <ufo/map/memory_stream.h>
 #include <ufo/geometry/aabb.h>
 #include <ufo/geometry/bounding_volume.h>
 #include <ufo/geometry/frustum.h>
@@ -64,8 +66,14 @@
 #include <ufomap_msgs/Ray.h>
 #include <ufomap_msgs/Sphere.h>
 #include <ufomap_msgs/UFOMap.h>
+#include <ufomap_msgs/UFOMapDelta.h>
 
 // STD
+#include <cstdint>
+#include <istream>
+#include <optional>
+#include <ostream>
+#include <string>
 #include <type_traits>
 
 namespace ufomap_msgs
@@ -92,6 +100,13 @@ ufo::geometry::Sphere msgToUfo(ufomap_msgs::Sphere const& sphere);
 
 ufo::geometry::BoundingVolume msgToUfo(ufomap_msgs::BoundingVolume const& msg);
 
+/**
+ * @brief The codec named by a message or service field, std::nullopt if it is unknown
+ * or not in this build. An empty name is LZ4, or LZ4-HC if compression_level is above 0.
+ */
+std::optional<ufo::map::Codec> msgToUfoCodec(bool compressed, std::string const& codec,
+                                             int compression_level = 0);
+
 //
 // UFO type to ROS message type
 //
@@ -122,17 +137,33 @@ ufomap_msgs::BoundingVolume ufoToMsg(
 template <typename TreeType>
 bool msgToUfo(ufomap_msgs::UFOMap const& msg, TreeType& tree)
 {
-	std::stringstream data_stream(std::ios_base::in | std::ios_base::out |
-	                              std::ios_base::binary);
-	if (!msg.data.empty()) {
-		data_stream.write((char const*)&msg.data[0], msg.data.size());
-		return tree.readData(data_stream, msgToUfo(msg.info.bounding_volume),
+	std::optional<ufo::map::Codec> const codec =
+	    msgToUfoCodec(msg.info.compressed, msg.info.codec);
+	if (!msg.data.empty() && codec) {
+		// Read in place from the message data
+		return tree.readData(msg.data, msgToUfo(msg.info.bounding_volume),
 		                     msg.info.resolution, msg.info.depth_levels,
-		                     msg.info.uncompressed_data_size, msg.info.compressed);
+		                     msg.info.uncompressed_data_size, *codec, msg.info.version);
 	}
 	return false;
 }
 
+/**
+ * @brief Apply a delta to tree, see OccupancyMapBase::applyDelta. The sequence is left
+ * to the caller.
+ */
+template <typename TreeType>
+bool msgToUfo(ufomap_msgs::UFOMapDelta const& msg, TreeType& tree)
+{
+	if (msg.id != tree.getTreeType() || msg.data.empty()) {
+		return false;
+	}
+	// Read in place from the message data
+	ufo::map::MemoryStreamBuffer buffer(msg.data.data(), msg.data.size());
+	std::istream s(&buffer);
+	return tree.applyDelta(s);
+}
+
 //
 // UFO type to ROS message type
 //
@@ -163,25 +194,75 @@ bool ufoToMsg(TreeType const& tree, ufomap_msgs::UFOMap& msg,
               ufo::geometry::BoundingVolume const& bounding_volume, bool compress = false,
               unsigned int depth = 0, int compression_acceleration_level = 1,
               int compression_level = 0)
+{
+	auto const [codec, level] =
+	    TreeType::toCodec(compress, compression_acceleration_level, compression_level);
+	return ufoToMsg(tree, msg, bounding_volume, codec, depth, level);
+}
+
+template <typename TreeType>
+bool ufoToMsg(TreeType const& tree, ufomap_msgs::UFOMap& msg, ufo::map::Codec codec,
+              unsigned int depth = 0, int compression_level = 0)
+{
+	return ufoToMsg(tree, msg, ufo::geometry::BoundingVolume(), codec, depth,
+	                compression_level);
+}
+
+template <typename TreeType, typename BoundingType>
+bool ufoToMsg(TreeType const& tree, ufomap_msgs::UFOMap& msg,
+              BoundingType const& bounding_volume, ufo::map::Codec codec,
+              unsigned int depth = 0, int compression_level = 0)
+{
+	ufo::geometry::BoundingVolume bv;
+	bv.add(bounding_volume);
+	return ufoToMsg(tree, msg, bv, codec, depth, compression_level);
+}
+
+/**
+ * @param compression_level The level of codec, see ufo::map::compress().
+ */
+template <typename TreeType>
+bool ufoToMsg(TreeType const& tree, ufomap_msgs::UFOMap& msg,
+              ufo::geometry::BoundingVolume const& bounding_volume,
+              ufo::map::Codec codec, unsigned int depth = 0, int compression_level = 0)
 {
 	msg.info.version = tree.getFileVersion();
 	msg.info.id = tree.getTreeType();
 	msg.info.resolution = tree.getResolution();
 	msg.info.depth_levels = tree.getTreeDepthLevels();
-	msg.info.compressed = compress;
+	msg.info.compressed = ufo::map::Codec::none != codec;
+	msg.info.codec = std::string(ufo::map::toString(codec));
 	msg.info.bounding_volume = ufoToMsg(bounding_volume);
 
-	std::stringstream data_stream(std::ios_base::in | std::ios_base::out |
-	                              std::ios_base::binary);
+	// Written straight into the message data, which keeps its capacity if the message is
+	// reused
+	msg.data.clear();
 	msg.info.uncompressed_data_size =
-	    tree.writeData(data_stream, bounding_volume, compress, depth,
-	                   compression_acceleration_level, compression_level);
+	    tree.writeData(msg.data, bounding_volume, codec, depth, compression_level);
 	if (0 > msg.info.uncompressed_data_size) {
+		msg.data.clear();
 		return false;
 	}
+	return true;
+}
+
+/**
+ * @brief Write the nodes of tree that changed since its change detection was last reset,
+ * see OccupancyMapBase::writeDelta. The sequence is left to the caller.
+ */
+template <typename TreeType>
+bool ufoToMsg(TreeType const& tree, ufomap_msgs::UFOMapDelta& msg, ufo::map::Codec codec,
+              int compression_level = 0)
+{
+	msg.id = tree.getTreeType();
 
-	std::string const& data_string = data_stream.str();
-	msg.data = std::vector<int8_t>(data_string.begin(), data_string.end());
+	msg.data.clear();
+	ufo::map::VectorStreamBuffer<std::int8_t> buffer(msg.data);
+	std::ostream s(&buffer);
+	if (!tree.writeDelta(s, codec, compression_level)) {
+		msg.data.clear();
+		return false;
+	}
 	return true;
 }
 
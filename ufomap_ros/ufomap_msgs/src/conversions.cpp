@@ -122,6 +122,22 @@ ufo::geometry::BoundingVolume msgToUfo(ufomap_msgs::BoundingVolume const& msg)
 	return bv;
 }
 
+std::optional<ufo::map::Codec> msgToUfoCodec(bool compressed, std::string const& codec,
+                                             int compression_level)
+{
+	if (!compressed) {
+		return ufo::map::Codec::none;
+	}
+	if (codec.empty()) {
+		return 0 < compression_level ? ufo::map::Codec::lz4_hc : ufo::map::Codec::lz4;
+	}
+	std::optional<ufo::map::Codec> named = ufo::map::codecFromString(codec);
+	if (!named || !ufo::map::isCodecAvailable(*named)) {
+		return std::nullopt;
+	}
+	return named;
+}
+
 //
 // UFOMap type to ROS message type
 //
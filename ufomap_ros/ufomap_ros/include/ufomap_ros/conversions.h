@@ -55,6 +55,10 @@
 #include <geometry_msgs/Vector3.h>
 #include <sensor_msgs/PointCloud2.h>
 
+// STD
+#include <optional>
+#include <string>
+
 namespace ufomap_ros
 {
 // Point clouds
@@ -63,6 +67,29 @@ void rosToUfo(sensor_msgs::PointCloud2 const& cloud_in, ufo::map::PointCloud& cl
 void rosToUfo(sensor_msgs::PointCloud2 const& cloud_in,
               ufo::map::PointCloudColor& cloud_out);
 
+/**
+ * @brief View cloud_in's data in place, without copying, applying transform to each
+ * point when it is read. cloud_in has to outlive cloud_out. The xyz fields have to be
+ * float32, the r, g, and b fields uint8, and the rows unpadded and little-endian.
+ *
+ * @throws std::runtime_error If cloud_in cannot be viewed in place, see
+ * isViewable.
+ */
+void rosToUfo(sensor_msgs::PointCloud2 const& cloud_in,
+              ufo::map::PointCloudView& cloud_out,
+              ufo::math::Pose6 const& transform = ufo::math::Pose6());
+
+/**
+ * @brief Whether cloud_in can be read in place by a PointCloudView, otherwise this is
+ * the reason it cannot.
+ */
+std::optional<std::string> notViewableReason(sensor_msgs::PointCloud2 const& cloud_in);
+
+inline bool isViewable(sensor_msgs::PointCloud2 const& cloud_in)
+{
+	return !notViewableReason(cloud_in);
+}
+
 void ufoToRos(ufo::map::PointCloud const& cloud_in, sensor_msgs::PointCloud2& cloud_out);
 
 void ufoToRos(ufo::map::PointCloudColor const& cloud_in,
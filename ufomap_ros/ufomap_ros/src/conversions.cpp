@@ -137,6 +137,107 @@ void rosToUfo(sensor_msgs::PointCloud2 const& cloud_in,
 	}
 }
 
+namespace
+{
+// The fields a PointCloudView reads
+struct ViewFields {
+	sensor_msgs::PointField const* x = nullptr;
+	sensor_msgs::PointField const* y = nullptr;
+	sensor_msgs::PointField const* z = nullptr;
+	sensor_msgs::PointField const* rgb = nullptr;
+	sensor_msgs::PointField const* r = nullptr;
+	sensor_msgs::PointField const* g = nullptr;
+	sensor_msgs::PointField const* b = nullptr;
+};
+
+ViewFields getViewFields(sensor_msgs::PointCloud2 const& cloud)
+{
+	ViewFields fields;
+	for (auto const& field : cloud.fields) {
+		if ("x" == field.name) {
+			fields.x = &field;
+		} else if ("y" == field.name) {
+			fields.y = &field;
+		} else if ("z" == field.name) {
+			fields.z = &field;
+		} else if ("rgb" == field.name || "rgba" == field.name) {
+			fields.rgb = &field;
+		} else if ("r" == field.name) {
+			fields.r = &field;
+		} else if ("g" == field.name) {
+			fields.g = &field;
+		} else if ("b" == field.name) {
+			fields.b = &field;
+		}
+	}
+	return fields;
+}
+}  // namespace
+
+std::optional<std::string> notViewableReason(sensor_msgs::PointCloud2 const& cloud_in)
+{
+	ViewFields const fields = getViewFields(cloud_in);
+
+	if (!fields.x || !fields.y || !fields.z) {
+		return "cloud_in missing one or more of the xyz fields";
+	}
+
+	for (auto field : {fields.x, fields.y, fields.z}) {
+		if (sensor_msgs::PointField::FLOAT32 != field->datatype) {
+			return "cloud_in xyz fields are not float32";
+		}
+	}
+
+	if (fields.r && fields.g && fields.b) {
+		for (auto field : {fields.r, fields.g, fields.b}) {
+			if (sensor_msgs::PointField::UINT8 != field->datatype) {
+				return "cloud_in rgb fields are not uint8";
+			}
+		}
+	} else if (fields.rgb && sensor_msgs::PointField::FLOAT32 != fields.rgb->datatype &&
+	           sensor_msgs::PointField::UINT32 != fields.rgb->datatype) {
+		return "cloud_in packed rgb field is not float32 or uint32";
+	}
+
+	if (cloud_in.is_bigendian) {
+		return "cloud_in is big-endian";
+	}
+
+	// The view steps through the points at point_step, so the rows cannot be padded
+	if (cloud_in.row_step != cloud_in.width * cloud_in.point_step) {
+		return "cloud_in rows are padded, row_step is not width * point_step";
+	}
+
+	if (cloud_in.data.size() <
+	    static_cast<std::size_t>(cloud_in.row_step) * cloud_in.height) {
+		return "cloud_in data is smaller than row_step * height";
+	}
+
+	return std::nullopt;
+}
+
+void rosToUfo(sensor_msgs::PointCloud2 const& cloud_in,
+              ufo::map::PointCloudView& cloud_out, ufo::math::Pose6 const& transform)
+{
+	if (auto reason = notViewableReason(cloud_in)) {
+		throw std::runtime_error(*reason);
+	}
+
+	ViewFields const fields = getViewFields(cloud_in);
+
+	cloud_out = ufo::map::PointCloudView(
+	    cloud_in.data.data(), cloud_in.width * cloud_in.height, cloud_in.point_step,
+	    fields.x->offset, fields.y->offset, fields.z->offset, transform);
+
+	if (fields.r && fields.g && fields.b) {
+		cloud_out.setColorOffsets(fields.r->offset, fields.g->offset, fields.b->offset);
+	} else if (fields.rgb) {
+		// Packed as bgra, same as PointCloud2ConstIterator reads it
+		cloud_out.setColorOffsets(fields.rgb->offset + 2, fields.rgb->offset + 1,
+		                          fields.rgb->offset);
+	}
+}
+
 void ufoToRos(ufo::map::PointCloud const& cloud_in, sensor_msgs::PointCloud2& cloud_out)
 {
 	bool has_x, has_y, has_z, has_rgb;
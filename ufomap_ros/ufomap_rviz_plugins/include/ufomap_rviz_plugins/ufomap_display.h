@@ -47,6 +47,7 @@
 #include <ufo/map/occupancy_map_color.h>
 
 // UFO ROS
+#include <ufomap_msgs/UFOMapDeltaStamped.h>
 #include <ufomap_msgs/UFOMapStamped.h>
 #include <ufomap_msgs/UFOMapMetaData.h>
 
@@ -57,6 +58,7 @@
 #include <rviz/ogre_helpers/point_cloud.h>
 #endif  // Q_MOC_RUN
 
+#include <OGRE/OgreCamera.h>
 #include <OGRE/OgreSceneManager.h>
 #include <OGRE/OgreSceneNode.h>
 #include <message_filters/subscriber.h>
@@ -70,13 +72,27 @@
 #include <rviz/properties/ros_topic_property.h>
 #include <rviz/properties/tf_frame_property.h>
 #include <rviz/properties/vector_property.h>
+#include <rviz/view_controller.h>
+#include <rviz/view_manager.h>
 #include <rviz/visualization_manager.h>
 
 // STD
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <map>
 #include <memory>
 #include <mutex>
+#include <optional>
+#include <thread>
 #include <unordered_map>
+#include <unordered_set>
+#include <utility>
 #include <variant>
+#include <vector>
 
 namespace ufomap_ros::rviz_plugins
 {
@@ -115,6 +131,8 @@ class UFOMapDisplay : public rviz::Display
 
 	void updateTopic();
 
+	void updateDelta();
+
 	void updateDepth();
 
 	void updateOccupiedFreeThres();
@@ -131,9 +149,85 @@ class UFOMapDisplay : public rviz::Display
 
 	void updateBBX();
 
+	void updateLOD();
+
+	/**
+	 * @brief Read the properties that decide which voxels are shown and how they are
+	 * colored, and rebuild all blocks with them.
+	 */
+	void updateRenderSettings();
+
+	/**
+	 * @brief Apply the style, alpha and scale to the clouds on screen, no rebuild needed.
+	 */
+	void updateCloudStyle();
+
 	void updateReset();
 
  protected:
+	/**
+	 * @brief The properties that decide which voxels are shown and their color, read on
+	 * the main thread for the render worker. Indexed by VoxelType.
+	 */
+	struct RenderSettings {
+		std::array<bool, 3> render{};
+		std::array<int, 3> coloring{};
+		std::array<QColor, 3> color;
+		std::array<float, 3> color_factor{};
+		ufo::map::DepthType min_depth = 0;
+		bool use_bbx = false;
+		ufo::geometry::AABB bbx;
+
+		// Level of detail, the camera is in the map frame
+		bool lod = false;
+		double lod_distance = 1.0;
+		int lod_bias = 0;
+		ufo::map::Point3 camera;
+	};
+
+	// A voxel type and depth, each has its own cloud since all points in a cloud have the
+	// same size
+	using CloudKey = std::pair<VoxelType, ufo::map::DepthType>;
+
+	/**
+	 * @brief The points of a block, built by the render worker.
+	 */
+	struct BlockPoints {
+		ufo::map::Code code;
+		ufo::geometry::AABB aabb;
+		double resolution;
+		// The minimum depth the block was built with
+		ufo::map::DepthType depth;
+		std::map<CloudKey, std::vector<rviz::PointCloud::Point>> points;
+	};
+
+	/**
+	 * @brief The clouds on screen for a block, only touched by the main thread.
+	 */
+	struct Block {
+		Ogre::SceneNode* node = nullptr;
+		ufo::geometry::AABB aabb;
+		double resolution;
+		ufo::map::DepthType depth;
+		std::size_t num_points = 0;
+		std::map<CloudKey, std::unique_ptr<rviz::PointCloud>> clouds;
+	};
+
+	// The bounds of the voxels colored by axis, indexed by VoxelType
+	using ColorRange =
+	    std::array<std::optional<std::pair<ufo::map::Point3, ufo::map::Point3>>, 3>;
+
+	// The map is split into blocks of nodes at this depth, or the depth below the root
+	// for maps with few depth levels
+	static constexpr ufo::map::DepthType BLOCK_DEPTH = 8;
+
+	// Time spent each frame swapping built blocks onto the screen, so big rebuilds are
+	// spread over several frames
+	static constexpr std::chrono::milliseconds SHOW_BUDGET{4};
+
+	// Seconds between checking the depths of the blocks against the camera
+	static constexpr float LOD_INTERVAL = 0.25f;
+
 	virtual void onEnable() override;
 
 	virtual void onDisable() override;
@@ -144,17 +238,77 @@ class UFOMapDisplay : public rviz::Display
 
 	void mapCallback(ufomap_msgs::UFOMapStamped::ConstPtr const& msg);
 
-	void addPoint(
-	    QHash<VoxelType, std::vector<std::vector<rviz::PointCloud::Point>>>& points,
-	    QHash<VoxelType, std::vector<std::vector<float>>>& probabilities,
-	    ufo::geometry::AABB const& bbx, VoxelType type, int min_depth,
-	    rviz::PointCloud::Point point, double occupancy, unsigned int depth,
-	    ufo::geometry::AABB const& aabb) const;
+	/**
+	 * @brief Replace the map with a full message, or apply the delta that follows the
+	 * last one applied. After a missed delta the topic is subscribed to again, so that the
+	 * server sends the whole map.
+	 */
+	void deltaCallback(ufomap_msgs::UFOMapDeltaStamped::ConstPtr const& msg);
+
+	bool receivedHeader(std_msgs::Header const& header);
+
+	/**
+	 * @brief Rebuild the blocks with the nodes that changed since the change detection
+	 * was last reset, and reset it. The caller holds mutex_.
+	 */
+	template <class Map>
+	void markChanged(Map& map);
+
+	/**
+	 * @brief Rebuild the blocks that intersect bounding_volume, all if it is empty.
+	 */
+	void markChanged(ufo::geometry::BoundingVolume const& bounding_volume);
+
+	/**
+	 * @brief Rebuild all blocks.
+	 */
+	void markAllChanged();
+
+	/**
+	 * @brief Build the points of the changed blocks, one at a time so the callbacks can
+	 * update the map in between.
+	 */
+	void renderWorker();
+
+	template <class Map>
+	BlockPoints buildBlock(Map const& map, ufo::map::Code const& code,
+	                       RenderSettings const& settings,
+	                       std::map<CloudKey, std::vector<float>>& probabilities,
+	                       ColorRange& range) const;
+
+	template <class Map>
+	static ufo::map::DepthType blockDepth(Map const& map);
+
+	/**
+	 * @brief The minimum depth to show a block at. With level of detail it is one depth
+	 * coarser each time the distance to the camera doubles beyond the detail distance, and
+	 * never above the block itself.
+	 */
+	static ufo::map::DepthType lodDepth(RenderSettings const& settings,
+	                                    ufo::geometry::AABB const& aabb,
+	                                    ufo::map::DepthType block_depth);
+
+	/**
+	 * @brief Hide the blocks outside the camera frustum and rebuild those whose depth no
+	 * longer fits the camera distance. The detail is lowered, or raised, one step at a
+	 * time to keep the points in view within the budget.
+	 */
+	void updateLevelOfDetail(float wall_dt);
+
+	/**
+	 * @brief Show the points of a block, replacing all of its clouds at once.
+	 */
+	void showBlock(BlockPoints& points);
+
+	void styleCloud(rviz::PointCloud& cloud, CloudKey const& key, double resolution) const;
+
+	void clearBlocks();
 
 	void updateInfo(double res, size_t num_leaf_nodes, size_t num_inner_nodes, size_t size);
 
-	void colorPoint(rviz::PointCloud::Point& point, ufo::map::Point3 const& min_value,
-	                ufo::map::Point3 max_value, double probability, VoxelType type) const;
+	void colorPoint(rviz::PointCloud::Point& point, RenderSettings const& settings,
+	                ufo::map::Point3 const& min_value, ufo::map::Point3 max_value,
+	                double probability, VoxelType type) const;
 
 	void setColor(double value, double min_value, double max_value, double color_factor,
 	              rviz::PointCloud::Point& point) const;
@@ -176,15 +330,24 @@ class UFOMapDisplay : public rviz::Display
 	std::variant<std::monostate, ufo::map::OccupancyMap, ufo::map::OccupancyMapColor> map_;
 
 	unsigned int num_messages_received_ = 0;
-	bool should_update_ = false;
 
+	// Held by everything that reads or modifies the map
 	std::mutex mutex_;
 
 	std::shared_ptr<message_filters::Subscriber<ufomap_msgs::UFOMapStamped>> sub_;
+	std::shared_ptr<message_filters::Subscriber<ufomap_msgs::UFOMapDeltaStamped>>
+	    delta_sub_;
+
+	// The sequence number of the last delta applied, std::nullopt until a full message
+	// has been received
+	std::optional<std::uint64_t> delta_sequence_;
+	// Set by the delta callback when a delta was missed, handled in update
+	std::atomic_bool resubscribe_ = false;
 
 	// Plugin properties
 	rviz::IntProperty* queue_size_property_;
 	rviz::RosTopicProperty* topic_property_;
+	rviz::BoolProperty* delta_property_;
 	QHash<VoxelType, rviz::BoolProperty*> render_type_;
 	rviz::Property* render_category_property_;
 	QHash<VoxelType, rviz::EnumProperty*> render_mode_;
@@ -194,6 +357,9 @@ class UFOMapDisplay : public rviz::Display
 	QHash<VoxelType, rviz::FloatProperty*> alpha_property_;
 	QHash<VoxelType, rviz::FloatProperty*> scale_property_;
 	rviz::IntProperty* depth_property_;
+	rviz::BoolProperty* lod_property_;
+	rviz::FloatProperty* lod_distance_property_;
+	rviz::IntProperty* point_budget_property_;
 	rviz::Property* occupancy_thres_category_property_;
 	rviz::IntProperty* occupied_thres_property_;
 	rviz::IntProperty* free_thres_property_;
@@ -207,8 +373,25 @@ class UFOMapDisplay : public rviz::Display
 	rviz::StringProperty* num_inner_nodes_property_;
 	rviz::StringProperty* size_property_;
 
-	// Point clouds
-	QHash<VoxelType, std::vector<rviz::PointCloud>> clouds_;
+	// Blocks on screen and the built blocks waiting to be shown, main thread only
+	std::unordered_map<ufo::map::Code, Block, ufo::map::Code::Hash> blocks_;
+	std::deque<BlockPoints> pending_blocks_;
+	float lod_time_ = 0.0f;
+
+	// Render worker, the members below are guarded by render_mutex_. The generation is
+	// stepped when the blocks are cleared, blocks built before that are dropped.
+	std::thread render_thread_;
+	std::mutex render_mutex_;
+	std::condition_variable render_cv_;
+	bool render_stop_ = false;
+	bool render_busy_ = false;
+	std::uint64_t render_generation_ = 0;
+	RenderSettings render_settings_;
+	bool render_all_ = false;
+	std::vector<ufo::geometry::BoundingVolume> changed_volumes_;
+	std::unordered_set<ufo::map::Code, ufo::map::Code::Hash> changed_blocks_;
+	std::vector<BlockPoints> built_blocks_;
+
 	std_msgs::Header header_;
 };
 }  // namespace ufomap_ros::rviz_plugins
@@ -45,19 +45,27 @@
 
 #include <QLocale>
 
+// STD
+#include <algorithm>
+#include <cmath>
+#include <iterator>
+
 namespace ufomap_ros::rviz_plugins
 {
 UFOMapDisplay::UFOMapDisplay() : rviz::Display() {}
 
 UFOMapDisplay::~UFOMapDisplay()
 {
-	unsubscribe();
-
-	clouds_.clear();
-
-	if (scene_node_) {
-		scene_node_->detachAllObjects();
+	{
+		std::scoped_lock lock(render_mutex_);
+		render_stop_ = true;
+	}
+	render_cv_.notify_all();
+	if (render_thread_.joinable()) {
+		render_thread_.join();
 	}
+
+	unsubscribe();
 }
 
 void UFOMapDisplay::onInitialize()
@@ -75,6 +83,12 @@ void UFOMapDisplay::onInitialize()
 	    SLOT(updateQueueSize()));
 	queue_size_property_->setMin(1);
 
+	delta_property_ = new rviz::BoolProperty(
+	    "Delta Updates", false,
+	    "Subscribe to the deltas of the topic, <topic>_delta, and apply them to the map. "
+	    "Only the full resolution map has deltas.",
+	    this, SLOT(updateDelta()));
+
 	info_property_ = new rviz::Property("Information", QVariant(), "", this);
 	resolution_property_ = new rviz::StringProperty(
 	    "Resolution", "", "Resolution of the occupancy map", info_property_, nullptr, this);
@@ -176,6 +190,23 @@ void UFOMapDisplay::onInitialize()
 	depth_property_->setMin(0);
 	depth_property_->setMax(21);  // FIXME: Should not be hardcoded
 
+	lod_property_ = new rviz::BoolProperty(
+	    "Automatic LOD", false,
+	    "Pick the depth of each part of the map from its distance to the camera, within "
+	    "the point budget, and hide the parts outside the view",
+	    this, SLOT(updateLOD()), this);
+	lod_property_->setDisableChildrenIfFalse(true);
+	lod_distance_property_ = new rviz::FloatProperty(
+	    "Detail Distance", 5.0,
+	    "Closer than this (m) the map is shown at Min. Depth, one depth coarser each time "
+	    "the distance doubles",
+	    lod_property_);
+	lod_distance_property_->setMin(0.01);
+	point_budget_property_ = new rviz::IntProperty(
+	    "Point Budget", 2000000,
+	    "The detail is lowered until at most this many points are in view", lod_property_);
+	point_budget_property_->setMin(1);
+
 	occupancy_thres_category_property_ =
 	    new rviz::Property("Occupancy Thresholds", QVariant(), "", this);
 	occupied_thres_property_ = new rviz::IntProperty(
@@ -206,151 +237,38 @@ void UFOMapDisplay::onInitialize()
 	    Ogre::Vector3(1000),  // FIXME: Should not be hardcoded
 	    "Defines the maximum BBX to display", use_bbx_property_, SLOT(updateBBX()), this);
 
-	std::lock_guard<std::mutex> lock(mutex_);
-	for (VoxelType const& type : {OCCUPIED, FREE, UNKNOWN}) {
-		clouds_[type].resize(21);  // FIXME: Should not be hardcoded
-
-		for (unsigned int d = 0; d < clouds_[type].size(); ++d) {
-			std::stringstream sname;
-			sname << getStrVoxelType(type) << " point cloud depth " << d;
-			clouds_[type][d].setName(sname.str());
-			clouds_[type][d].setRenderMode(rviz::PointCloud::RM_FLAT_SQUARES);
-			clouds_[type][d].setCastShadows(false);
-			scene_node_->attachObject(&clouds_[type][d]);
-		}
-	}
+	updateRenderSettings();
+	render_thread_ = std::thread(&UFOMapDisplay::renderWorker, this);
 }
 
 void UFOMapDisplay::update(float wall_dt, float ros_dt)
 {
-	if (should_update_) {
-		std::lock_guard<std::mutex> lock(mutex_);
-		should_update_ = false;
-
-		if (!std::holds_alternative<std::monostate>(map_) &&
-		    (render_type_[OCCUPIED]->getBool() || render_type_[FREE]->getBool() ||
-		     render_type_[UNKNOWN]->getBool())) {
-			std::visit(
-			    [this](auto& map) {
-				    using T = std::decay_t<decltype(map)>;
-				    if constexpr (!std::is_same_v<T, std::monostate>) {
-					    QHash<VoxelType, std::vector<std::vector<rviz::PointCloud::Point>>> points;
-					    QHash<VoxelType, std::vector<std::vector<float>>> probabilities;
-					    for (VoxelType const& type : {OCCUPIED, FREE, UNKNOWN}) {
-						    points[type].resize(clouds_[type].size());
-						    probabilities[type].resize(clouds_[type].size());
-					    }
-
-					    ufo::map::Point3 min_value = map.getMin();
-					    ufo::map::Point3 max_value = map.getMax();
-
-					    if (use_bbx_property_->getBool()) {
-						    Ogre::Vector3 position;
-						    Ogre::Quaternion orientation;
-						    context_->getFrameManager()->getTransform(
-						        tf_bbx_property_->getFrameStd(), ros::Time(0), position, orientation);
-
-						    Ogre::Vector3 min_bbx = min_bbx_property_->getVector() + position;
-						    Ogre::Vector3 max_bbx = max_bbx_property_->getVector() + position;
-
-						    for (int i = 0; i < 3; ++i) {
-							    min_value[i] = std::max(min_value[i], static_cast<double>(min_bbx[i]));
-							    max_value[i] = std::min(max_value[i], static_cast<double>(max_bbx[i]));
-						    }
-					    }
-
-					    QHash<VoxelType, ufo::map::Point3> min_coord;
-					    QHash<VoxelType, ufo::map::Point3> max_coord;
-
-					    ufo::geometry::AABB aabb_bbx(min_value, max_value);
-					    int min_depth = depth_property_->getInt();
-					    for (auto it = map.beginLeaves(aabb_bbx, render_type_[OCCUPIED]->getBool(),
-					                                   render_type_[FREE]->getBool(),
-					                                   render_type_[UNKNOWN]->getBool(), false,
-					                                   min_depth),
-					              end = map.endLeaves();
-					         it != end; ++it) {
-						    VoxelType type;
-						    if (it.isOccupied()) {
-							    type = OCCUPIED;
-						    } else if (it.isFree()) {
-							    type = FREE;
-						    } else {
-							    type = UNKNOWN;
-						    }
-
-						    ufo::geometry::AABB it_aabb = it.getBoundingVolume();
-						    ufo::map::Point3 it_min = it_aabb.getMin();
-						    ufo::map::Point3 it_max = it_aabb.getMax();
-
-						    if (min_coord.contains(type)) {
-							    for (int i : {0, 1, 2}) {
-								    min_coord[type][i] = std::min(min_coord[type][i], it_min[i]);
-								    max_coord[type][i] = std::max(max_coord[type][i], it_max[i]);
-							    }
-						    } else {
-							    min_coord[type] = it_min;
-							    max_coord[type] = it_max;
-						    }
-
-						    rviz::PointCloud::Point point;
-						    if constexpr (std::is_same_v<T, ufo::map::OccupancyMapColor>) {
-							    point.setColor(it->color.r / 255.0, it->color.g / 255.0,
-							                   it->color.b / 255.0, it.getOccupancy());
-						    }
-
-						    addPoint(points, probabilities, aabb_bbx, type, min_depth, point,
-						             it.getOccupancy(), it.getDepth(), it.getBoundingVolume());
-					    }
-
-					    for (VoxelType const& type : points.keys()) {
-						    if (OCCUPIED != type ||
-						        VOXEL_COLOR != coloring_property_[type]->getOptionInt()) {
-							    for (int i : {0, 1, 2}) {
-								    // Make sure it is not outside BBX
-								    min_coord[type][i] = std::max(min_coord[type][i], min_value[i]);
-								    max_coord[type][i] = std::min(max_coord[type][i], max_value[i]);
-							    }
-							    // Color points
-							    for (size_t i = 0; i < points[type].size(); ++i) {
-								    for (size_t j = 0; j < points[type][i].size(); ++j) {
-									    colorPoint(points[type][i][j], min_coord[type], max_coord[type],
-									               probabilities[type][i][j], type);
-								    }
-							    }
-						    }
-					    }
+	if (resubscribe_.exchange(false)) {
+		subscribe();
+	}
 
-					    for (VoxelType const& type : clouds_.keys()) {
-						    float scale = scale_property_[type]->getFloat();
-						    for (size_t i = 0; i < clouds_[type].size(); ++i) {
-							    clouds_[type][i].clear();
-							    clouds_[type][i].setAlpha(alpha_property_[type]->getFloat());
-							    if (i < map.getTreeDepthLevels()) {
-								    float size = scale * map.getNodeSize(i);
-								    clouds_[type][i].setDimensions(size, size, size);
-							    }
-							    if (!points[type][i].empty()) {
-								    clouds_[type][i].addPoints(&points[type][i].front(),
-								                               points[type][i].size());
-							    }
-						    }
-					    }
-				    }
-			    },
-			    map_);
-		} else {
-			for (VoxelType const& type : clouds_.keys()) {
-				for (size_t i = 0; i < clouds_[type].size(); ++i) {
-					clouds_[type][i].clear();
-				}
-			}
-		}
+	{
+		std::scoped_lock lock(render_mutex_);
+		std::move(built_blocks_.begin(), built_blocks_.end(),
+		          std::back_inserter(pending_blocks_));
+		built_blocks_.clear();
+	}
 
-		updateRenderStyle();  // TODO: Should not have to call this here
+	// Each block is swapped in whole, the rest wait for the next frame once the budget
+	// is spent
+	if (!pending_blocks_.empty()) {
+		auto const start = std::chrono::steady_clock::now();
+		do {
+			showBlock(pending_blocks_.front());
+			pending_blocks_.pop_front();
+		} while (!pending_blocks_.empty() &&
+		         SHOW_BUDGET > std::chrono::steady_clock::now() - start);
+		context_->queueRender();
 	}
 
 	updateFromTF();
+
+	updateLevelOfDetail(wall_dt);
 }
 
 void UFOMapDisplay::reset()
@@ -370,7 +288,9 @@ void UFOMapDisplay::updateTopic()
 	context_->queueRender();
 }
 
-void UFOMapDisplay::updateDepth() { should_update_ = true; }
+void UFOMapDisplay::updateDelta() { updateTopic(); }
+
+void UFOMapDisplay::updateDepth() { updateRenderSettings(); }
 
 void UFOMapDisplay::updateOccupiedFreeThres()
 {
@@ -387,21 +307,12 @@ void UFOMapDisplay::updateOccupiedFreeThres()
 		    }
 	    },
 	    map_);
-	should_update_ = true;
+	markAllChanged();
 }
 
-void UFOMapDisplay::updateRenderMode() { should_update_ = true; }
+void UFOMapDisplay::updateRenderMode() { updateRenderSettings(); }
 
-void UFOMapDisplay::updateRenderStyle()
-{
-	for (VoxelType const& type : render_mode_.keys()) {
-		for (auto& cloud : clouds_[type]) {
-			cloud.setRenderMode(
-			    static_cast<rviz::PointCloud::RenderMode>(render_mode_[type]->getOptionInt()));
-		}
-	}
-	should_update_ = true;
-}
+void UFOMapDisplay::updateRenderStyle() { updateCloudStyle(); }
 
 void UFOMapDisplay::updateColorMode()
 {
@@ -423,14 +334,74 @@ void UFOMapDisplay::updateColorMode()
 		}
 	}
 
-	should_update_ = true;
+	updateRenderSettings();
+}
+
+void UFOMapDisplay::updateAlpha() { updateCloudStyle(); }
+
+void UFOMapDisplay::updateScale() { updateCloudStyle(); }
+
+void UFOMapDisplay::updateBBX() { updateRenderSettings(); }
+
+void UFOMapDisplay::updateLOD()
+{
+	if (!lod_property_->getBool()) {
+		for (auto& [code, block] : blocks_) {
+			block.node->setVisible(true);
+		}
+	}
+	updateRenderSettings();
 }
 
-void UFOMapDisplay::updateAlpha() { should_update_ = true; }
+void UFOMapDisplay::updateRenderSettings()
+{
+	RenderSettings settings;
+	for (VoxelType const& type : {OCCUPIED, FREE, UNKNOWN}) {
+		settings.render[type] = render_type_[type]->getBool();
+		settings.coloring[type] = coloring_property_[type]->getOptionInt();
+		settings.color[type] = color_property_[type]->getColor();
+		settings.color_factor[type] = color_factor_property_[type]->getFloat();
+	}
+	settings.min_depth = depth_property_->getInt();
+
+	settings.use_bbx = use_bbx_property_->getBool();
+	if (settings.use_bbx) {
+		Ogre::Vector3 position;
+		Ogre::Quaternion orientation;
+		context_->getFrameManager()->getTransform(tf_bbx_property_->getFrameStd(),
+		                                          ros::Time(0), position, orientation);
+
+		Ogre::Vector3 min_bbx = min_bbx_property_->getVector() + position;
+		Ogre::Vector3 max_bbx = max_bbx_property_->getVector() + position;
+		settings.bbx = ufo::geometry::AABB(ufo::map::Point3(min_bbx.x, min_bbx.y, min_bbx.z),
+		                                   ufo::map::Point3(max_bbx.x, max_bbx.y, max_bbx.z));
+	}
 
-void UFOMapDisplay::updateScale() { should_update_ = true; }
+	settings.lod = lod_property_->getBool();
+	settings.lod_distance = lod_distance_property_->getFloat();
 
-void UFOMapDisplay::updateBBX() { should_update_ = true; }
+	{
+		std::scoped_lock lock(render_mutex_);
+		// The camera and bias are kept up to date by updateLevelOfDetail
+		if (settings.lod) {
+			settings.lod_bias = render_settings_.lod_bias;
+			settings.camera = render_settings_.camera;
+		}
+		render_settings_ = settings;
+		render_all_ = true;
+	}
+	render_cv_.notify_one();
+}
+
+void UFOMapDisplay::updateCloudStyle()
+{
+	for (auto& [code, block] : blocks_) {
+		for (auto& [key, cloud] : block.clouds) {
+			styleCloud(*cloud, key, block.resolution);
+		}
+	}
+	context_->queueRender();
+}
 
 void UFOMapDisplay::onEnable()
 {
@@ -456,7 +427,18 @@ void UFOMapDisplay::subscribe()
 
 		std::string const& topic(topic_property_->getStdString());
 
-		if (!topic.empty()) {
+		if (topic.empty()) {
+			return;
+		}
+
+		if (delta_property_->getBool()) {
+			delta_sub_.reset(
+			    new message_filters::Subscriber<ufomap_msgs::UFOMapDeltaStamped>());
+			delta_sub_->subscribe(threaded_nh_, topic + "_delta",
+			                      queue_size_property_->getInt());
+			delta_sub_->registerCallback(
+			    boost::bind(&UFOMapDisplay::deltaCallback, this, _1));
+		} else {
 			sub_.reset(new message_filters::Subscriber<ufomap_msgs::UFOMapStamped>());
 			sub_->subscribe(threaded_nh_, topic, queue_size_property_->getInt());
 			sub_->registerCallback(boost::bind(&UFOMapDisplay::mapCallback, this, _1));
@@ -473,6 +455,7 @@ void UFOMapDisplay::unsubscribe()
 
 	try {
 		sub_.reset();
+		delta_sub_.reset();
 	} catch (ros::Exception& e) {
 		setStatus(rviz::StatusProperty::Error, "Topic",
 		          (std::string("Error unsubscribing: ") + e.what()).c_str());
@@ -486,12 +469,7 @@ void UFOMapDisplay::mapCallback(ufomap_msgs::UFOMapStamped::ConstPtr const& msg)
 	          QString::number(num_messages_received_) + " UFOMap messages received");
 	setStatusStd(rviz::StatusProperty::Ok, "Type", msg->map.info.id.c_str());
 
-	header_ = msg->header;
-	if (!updateFromTF()) {
-		std::stringstream ss;
-		ss << "Failed to transform from frame [" << header_.frame_id << "] to frame ["
-		   << context_->getFrameManager()->getFixedFrame() << "]";
-		setStatusStd(rviz::StatusProperty::Error, "Message", ss.str());
+	if (!receivedHeader(msg->header)) {
 		return;
 	}
 
@@ -511,6 +489,9 @@ void UFOMapDisplay::mapCallback(ufomap_msgs::UFOMapStamped::ConstPtr const& msg)
 			        if (ufomap_msgs::msgToUfo(msg->map, map)) {
 				        updateInfo(map.getResolution(), map.getNumLeafNodes(),
 				                   map.getNumInnerNodes(), map.memoryUsage());
+				        // Only the part of the map in the message changed
+				        map.resetChangeDetection();
+				        markChanged(ufomap_msgs::msgToUfo(msg->map.info.bounding_volume));
 				        return true;
 			        }
 			        return false;
@@ -520,47 +501,521 @@ void UFOMapDisplay::mapCallback(ufomap_msgs::UFOMapStamped::ConstPtr const& msg)
 	        map_)) {
 		setStatusStd(rviz::StatusProperty::Error, "Message", "Could not create UFOMap");
 	}
+}
+
+void UFOMapDisplay::deltaCallback(ufomap_msgs::UFOMapDeltaStamped::ConstPtr const& msg)
+{
+	++num_messages_received_;
+	setStatus(rviz::StatusProperty::Ok, "Messages",
+	          QString::number(num_messages_received_) + " UFOMap messages received");
+	setStatusStd(rviz::StatusProperty::Ok, "Type", msg->delta.id.c_str());
+
+	if (!receivedHeader(msg->header)) {
+		return;
+	}
 
-	should_update_ = true;
-}
-
-void UFOMapDisplay::addPoint(
-    QHash<VoxelType, std::vector<std::vector<rviz::PointCloud::Point>>>& points,
-    QHash<VoxelType, std::vector<std::vector<float>>>& probabilities,
-    ufo::geometry::AABB const& bbx, VoxelType type, int min_depth,
-    rviz::PointCloud::Point point, double occupancy, unsigned int depth,
-    ufo::geometry::AABB const& aabb) const
-{
-	// ufo::map::Point3 min = aabb.getMin();
-	// ufo::map::Point3 max = aabb.getMax();
-
-	// bool valid = depth <= min_depth || (ufo::geometry::intersects(bbx, min) &&
-	//                                     ufo::geometry::intersects(bbx, max));
-
-	// if (valid) {
-	probabilities[type][depth].push_back(occupancy);
-	point.position.x = aabb.center[0];
-	point.position.y = aabb.center[1];
-	point.position.z = aabb.center[2];
-	points[type][depth].push_back(point);
-	return;
-	// }
-
-	// // Recurse down
-	// ufo::geometry::AABB child_aabb;
-	// child_aabb.half_size = aabb.half_size / 2.0;
-	// for (size_t i = 0; i < 8; ++i) {
-	// 	child_aabb.center[0] +=
-	// 	    ((i & 1) ? child_aabb.half_size[0] : -child_aabb.half_size[0]);
-	// 	child_aabb.center[1] +=
-	// 	    ((i & 2) ? child_aabb.half_size[1] : -child_aabb.half_size[1]);
-	// 	child_aabb.center[2] +=
-	// 	    ((i & 4) ? child_aabb.half_size[2] : -child_aabb.half_size[2]);
-	// 	if (ufo::geometry::intersects(bbx, child_aabb)) {
-	// 		addPoint(points, probabilities, bbx, type, min_depth, point, occupancy, depth - 1,
-	// 		         child_aabb);
-	// 	}
-	// }
+	std::lock_guard<std::mutex> lock(mutex_);
+
+	if (msg->full) {
+		// Start over from the whole map
+		delta_sequence_.reset();
+		if (!createMap(msg->map.info)) {
+			setStatusStd(rviz::StatusProperty::Error, "Message",
+			             (std::string("Unknown UFOMap type '") + msg->map.info.id + "'").c_str());
+			return;
+		}
+	} else if (!delta_sequence_ || msg->delta.sequence <= *delta_sequence_) {
+		// From before the whole map, the changes are already in it
+		return;
+	} else if (*delta_sequence_ + 1 != msg->delta.sequence) {
+		setStatusStd(rviz::StatusProperty::Warn, "Message",
+		             "Missed a UFOMap delta, waiting for the whole map");
+		delta_sequence_.reset();
+		resubscribe_ = true;
+		return;
+	}
+
+	bool const applied = std::visit(
+	    [this, &msg](auto& map) -> bool {
+		    if constexpr (!std::is_same_v<std::decay_t<decltype(map)>, std::monostate>) {
+			    if (msg->full ? ufomap_msgs::msgToUfo(msg->map, map)
+			                  : ufomap_msgs::msgToUfo(msg->delta, map)) {
+				    updateInfo(map.getResolution(), map.getNumLeafNodes(),
+				               map.getNumInnerNodes(), map.memoryUsage());
+				    markChanged(map);
+				    return true;
+			    }
+		    }
+		    return false;
+	    },
+	    map_);
+
+	if (applied) {
+		delta_sequence_ = msg->delta.sequence;
+	} else {
+		setStatusStd(rviz::StatusProperty::Error, "Message",
+		             "Could not apply UFOMap delta, waiting for the whole map");
+		delta_sequence_.reset();
+		resubscribe_ = true;
+	}
+}
+
+bool UFOMapDisplay::receivedHeader(std_msgs::Header const& header)
+{
+	header_ = header;
+	if (!updateFromTF()) {
+		std::stringstream ss;
+		ss << "Failed to transform from frame [" << header_.frame_id << "] to frame ["
+		   << context_->getFrameManager()->getFixedFrame() << "]";
+		setStatusStd(rviz::StatusProperty::Error, "Message", ss.str());
+		return false;
+	}
+	return true;
+}
+
+//
+// Blocks
+//
+
+template <class Map>
+ufo::map::DepthType UFOMapDisplay::blockDepth(Map const& map)
+{
+	return std::min<ufo::map::DepthType>(BLOCK_DEPTH, map.getTreeDepthLevels() - 1);
+}
+
+template <class Map>
+void UFOMapDisplay::markChanged(Map& map)
+{
+	// A node above the block depth is shown by the block at its minimum corner. The blocks
+	// of all ancestors are marked, in case one of them was split or pruned.
+	ufo::map::DepthType const block_depth = blockDepth(map);
+	ufo::map::DepthType const root_depth = map.getTreeDepthLevels();
+	{
+		std::scoped_lock lock(render_mutex_);
+		for (auto it = map.changesBegin(), end = map.changesEnd(); it != end; ++it) {
+			for (ufo::map::DepthType depth = std::max(it->getDepth(), block_depth);
+			     depth <= root_depth; ++depth) {
+				changed_blocks_.insert(it->toDepth(depth).toDepth(block_depth));
+			}
+		}
+	}
+	map.resetChangeDetection();
+	render_cv_.notify_one();
+}
+
+void UFOMapDisplay::markChanged(ufo::geometry::BoundingVolume const& bounding_volume)
+{
+	if (bounding_volume.empty()) {
+		markAllChanged();
+		return;
+	}
+
+	{
+		std::scoped_lock lock(render_mutex_);
+		changed_volumes_.push_back(bounding_volume);
+	}
+	render_cv_.notify_one();
+}
+
+void UFOMapDisplay::markAllChanged()
+{
+	{
+		std::scoped_lock lock(render_mutex_);
+		render_all_ = true;
+	}
+	render_cv_.notify_one();
+}
+
+void UFOMapDisplay::renderWorker()
+{
+	// The blocks with points, shown or about to be, and the range they were colored with
+	std::uint64_t generation = 0;
+	std::unordered_set<ufo::map::Code, ufo::map::Code::Hash> shown;
+	ColorRange range;
+
+	std::unique_lock render_lock(render_mutex_);
+	while (true) {
+		render_cv_.wait(render_lock, [this] {
+			return render_stop_ || render_all_ || !changed_volumes_.empty() ||
+			       !changed_blocks_.empty();
+		});
+		if (render_stop_) {
+			return;
+		}
+
+		if (generation != render_generation_) {
+			generation = render_generation_;
+			shown.clear();
+			range = ColorRange();
+		}
+		bool const all = std::exchange(render_all_, false);
+		std::vector<ufo::geometry::BoundingVolume> volumes = std::move(changed_volumes_);
+		changed_volumes_.clear();
+		std::unordered_set<ufo::map::Code, ufo::map::Code::Hash> codes =
+		    std::move(changed_blocks_);
+		changed_blocks_.clear();
+		RenderSettings const settings = render_settings_;
+		render_busy_ = true;
+		render_lock.unlock();
+
+		if (all) {
+			// An empty bounding volume is the whole map, the range is found again
+			volumes.assign(1, ufo::geometry::BoundingVolume());
+			range = ColorRange();
+		}
+		ColorRange const old_range = range;
+
+		// The blocks in the changed volumes, those shown and those with nodes now
+		if (!volumes.empty()) {
+			std::scoped_lock lock(mutex_);
+			std::visit(
+			    [&volumes, &shown, &codes](auto const& map) {
+				    if constexpr (!std::is_same_v<std::decay_t<decltype(map)>, std::monostate>) {
+					    ufo::map::DepthType const block_depth = blockDepth(map);
+					    for (ufo::geometry::BoundingVolume const& bv : volumes) {
+						    for (ufo::map::Code const& code : shown) {
+							    if (bv.empty() ||
+							        bv.intersects(ufo::geometry::AABB(
+							            map.toCoord(code), map.getNodeHalfSize(code.getDepth())))) {
+								    codes.insert(code);
+							    }
+						    }
+						    for (auto it = map.beginLeaves(bv, true, true, true, false, block_depth),
+						              end = map.endLeaves();
+						         it != end; ++it) {
+							    codes.insert(it.getCode().toDepth(block_depth));
+						    }
+					    }
+				    }
+			    },
+			    map_);
+		}
+
+		// Built one block at a time, so the callbacks are not held up
+		std::vector<BlockPoints> built;
+		std::vector<std::map<CloudKey, std::vector<float>>> probabilities;
+		built.reserve(codes.size());
+		probabilities.reserve(codes.size());
+		bool cancelled = false;
+		for (ufo::map::Code const& code : codes) {
+			render_lock.lock();
+			cancelled = render_stop_ || generation != render_generation_;
+			render_lock.unlock();
+			if (cancelled) {
+				break;
+			}
+
+			std::scoped_lock lock(mutex_);
+			probabilities.emplace_back();
+			built.push_back(std::visit(
+			    [this, &code, &settings, &probabilities, &range](auto const& map) {
+				    if constexpr (!std::is_same_v<std::decay_t<decltype(map)>, std::monostate>) {
+					    return buildBlock(map, code, settings, probabilities.back(), range);
+				    } else {
+					    return BlockPoints{code, ufo::geometry::AABB(), 0.0, 0, {}};
+				    }
+			    },
+			    map_));
+		}
+
+		if (cancelled) {
+			render_lock.lock();
+			render_busy_ = false;
+			continue;
+		}
+
+		// Color after all blocks are built, the axis colorings use the range of all of them
+		for (std::size_t i = 0; i != built.size(); ++i) {
+			for (auto& [key, points] : built[i].points) {
+				VoxelType const type = key.first;
+				if (OCCUPIED == type && VOXEL_COLOR == settings.coloring[type]) {
+					continue;
+				}
+				auto const [range_min, range_max] = *range[type];
+				std::vector<float> const& probability = probabilities[i][key];
+				for (std::size_t j = 0; j != points.size(); ++j) {
+					colorPoint(points[j], settings, range_min, range_max, probability[j], type);
+				}
+			}
+
+			if (built[i].points.empty()) {
+				shown.erase(built[i].code);
+			} else {
+				shown.insert(built[i].code);
+			}
+		}
+
+		// Blocks colored with a smaller range are colored again
+		bool grew = false;
+		for (VoxelType const& type : {OCCUPIED, FREE, UNKNOWN}) {
+			bool const axis = X_AXIS_COLOR == settings.coloring[type] ||
+			                  Y_AXIS_COLOR == settings.coloring[type] ||
+			                  Z_AXIS_COLOR == settings.coloring[type];
+			grew = grew || (axis && old_range[type] && old_range[type] != range[type]);
+		}
+
+		render_lock.lock();
+		if (generation == render_generation_) {
+			if (grew) {
+				for (ufo::map::Code const& code : shown) {
+					if (0 == codes.count(code)) {
+						changed_blocks_.insert(code);
+					}
+				}
+			}
+			std::move(built.begin(), built.end(), std::back_inserter(built_blocks_));
+		}
+		render_busy_ = false;
+	}
+}
+
+template <class Map>
+UFOMapDisplay::BlockPoints UFOMapDisplay::buildBlock(
+    Map const& map, ufo::map::Code const& code, RenderSettings const& settings,
+    std::map<CloudKey, std::vector<float>>& probabilities, ColorRange& range) const
+{
+	ufo::geometry::AABB const aabb(map.toCoord(code), map.getNodeHalfSize(code.getDepth()));
+	BlockPoints block{code, aabb, map.getResolution(),
+	                  lodDepth(settings, aabb, code.getDepth()), {}};
+	if (blockDepth(map) != code.getDepth()) {
+		// From a map with other depth levels, only removed
+		return block;
+	}
+
+	for (auto it = map.beginLeaves(aabb, settings.render[OCCUPIED], settings.render[FREE],
+	                               settings.render[UNKNOWN], false, block.depth),
+	          end = map.endLeaves();
+	     it != end; ++it) {
+		// A node above the block depth belongs to the block at its minimum corner
+		if (it.getCode().toDepth(code.getDepth()) != code) {
+			continue;
+		}
+
+		ufo::geometry::AABB const node_aabb = it.getBoundingVolume();
+		if (settings.use_bbx && !ufo::geometry::intersects(settings.bbx, node_aabb)) {
+			continue;
+		}
+
+		VoxelType type;
+		if (it.isOccupied()) {
+			type = OCCUPIED;
+		} else if (it.isFree()) {
+			type = FREE;
+		} else {
+			type = UNKNOWN;
+		}
+		CloudKey const key(type, it.getDepth());
+
+		rviz::PointCloud::Point point;
+		if constexpr (std::is_same_v<Map, ufo::map::OccupancyMapColor>) {
+			point.setColor(it->color.r / 255.0, it->color.g / 255.0, it->color.b / 255.0,
+			               it.getOccupancy());
+		}
+		point.position.x = node_aabb.center[0];
+		point.position.y = node_aabb.center[1];
+		point.position.z = node_aabb.center[2];
+		block.points[key].push_back(point);
+		probabilities[key].push_back(it.getOccupancy());
+
+		ufo::map::Point3 node_min = node_aabb.getMin();
+		ufo::map::Point3 node_max = node_aabb.getMax();
+		if (settings.use_bbx) {
+			// Make sure it is not outside BBX
+			ufo::map::Point3 const bbx_min = settings.bbx.getMin();
+			ufo::map::Point3 const bbx_max = settings.bbx.getMax();
+			for (int i : {0, 1, 2}) {
+				node_min[i] = std::max(node_min[i], bbx_min[i]);
+				node_max[i] = std::min(node_max[i], bbx_max[i]);
+			}
+		}
+		if (range[type]) {
+			for (int i : {0, 1, 2}) {
+				range[type]->first[i] = std::min(range[type]->first[i], node_min[i]);
+				range[type]->second[i] = std::max(range[type]->second[i], node_max[i]);
+			}
+		} else {
+			range[type].emplace(node_min, node_max);
+		}
+	}
+
+	return block;
+}
+
+void UFOMapDisplay::showBlock(BlockPoints& points)
+{
+	auto it = blocks_.find(points.code);
+	if (points.points.empty()) {
+		if (blocks_.end() != it) {
+			it->second.node->detachAllObjects();
+			scene_manager_->destroySceneNode(it->second.node);
+			blocks_.erase(it);
+		}
+		return;
+	}
+
+	if (blocks_.end() == it) {
+		it = blocks_.emplace(points.code, Block()).first;
+		it->second.node = scene_node_->createChildSceneNode();
+	}
+	Block& block = it->second;
+	block.aabb = points.aabb;
+	block.resolution = points.resolution;
+	block.depth = points.depth;
+	block.num_points = 0;
+
+	// Voxel types and depths no longer in the block
+	for (auto cloud = block.clouds.begin(); block.clouds.end() != cloud;) {
+		if (0 == points.points.count(cloud->first)) {
+			block.node->detachObject(cloud->second.get());
+			cloud = block.clouds.erase(cloud);
+		} else {
+			++cloud;
+		}
+	}
+
+	for (auto& [key, list] : points.points) {
+		std::unique_ptr<rviz::PointCloud>& cloud = block.clouds[key];
+		if (!cloud) {
+			cloud = std::make_unique<rviz::PointCloud>();
+			cloud->setName(getStrVoxelType(key.first) + " point cloud depth " +
+			               std::to_string(key.second));
+			cloud->setCastShadows(false);
+			block.node->attachObject(cloud.get());
+		}
+		cloud->clear();
+		styleCloud(*cloud, key, block.resolution);
+		cloud->addPoints(&list.front(), list.size());
+		block.num_points += list.size();
+	}
+}
+
+ufo::map::DepthType UFOMapDisplay::lodDepth(RenderSettings const& settings,
+                                            ufo::geometry::AABB const& aabb,
+                                            ufo::map::DepthType block_depth)
+{
+	if (!settings.lod) {
+		return settings.min_depth;
+	}
+
+	// Distance from the camera to the closest point of the block
+	ufo::map::Point3 const min = aabb.getMin();
+	ufo::map::Point3 const max = aabb.getMax();
+	double distance = 0.0;
+	for (int i : {0, 1, 2}) {
+		double const d =
+		    std::max({min[i] - settings.camera[i], 0.0, settings.camera[i] - max[i]});
+		distance += d * d;
+	}
+	distance = std::sqrt(distance);
+
+	int depth = settings.min_depth + settings.lod_bias;
+	if (settings.lod_distance < distance) {
+		depth += static_cast<int>(std::log2(distance / settings.lod_distance));
+	}
+	int const max_depth = std::max<int>(settings.min_depth, block_depth);
+	return static_cast<ufo::map::DepthType>(
+	    std::clamp<int>(depth, settings.min_depth, max_depth));
+}
+
+void UFOMapDisplay::updateLevelOfDetail(float wall_dt)
+{
+	if (!lod_property_->getBool() || blocks_.empty()) {
+		return;
+	}
+
+	// The camera in the map frame
+	Ogre::Camera const* camera = context_->getViewManager()->getCurrent()->getCamera();
+	Ogre::Vector3 const position =
+	    scene_node_->convertWorldToLocalPosition(camera->getDerivedPosition());
+	Ogre::Quaternion const orientation =
+	    scene_node_->convertWorldToLocalOrientation(camera->getDerivedOrientation());
+	Ogre::Vector3 const target = position + orientation * Ogre::Vector3::NEGATIVE_UNIT_Z;
+	Ogre::Vector3 const up = orientation * Ogre::Vector3::UNIT_Y;
+	auto const to_ufo = [](Ogre::Vector3 const& v) {
+		return ufo::map::Point3(v.x, v.y, v.z);
+	};
+
+	// A far clip distance of 0 means infinite
+	double const vertical_angle = camera->getFOVy().valueRadians();
+	double const far_distance =
+	    0 < camera->getFarClipDistance() ? camera->getFarClipDistance() : 1.0e6;
+	ufo::geometry::Frustum const frustum(
+	    to_ufo(position), to_ufo(target), to_ufo(up), vertical_angle,
+	    vertical_angle * camera->getAspectRatio(), camera->getNearClipDistance(),
+	    far_distance);
+
+	std::size_t num_points = 0;
+	for (auto& [code, block] : blocks_) {
+		bool const visible = ufo::geometry::intersects(block.aabb, frustum);
+		block.node->setVisible(visible);
+		if (visible) {
+			num_points += block.num_points;
+		}
+	}
+
+	lod_time_ += wall_dt;
+	if (LOD_INTERVAL > lod_time_) {
+		return;
+	}
+	lod_time_ = 0.0f;
+
+	std::unique_lock render_lock(render_mutex_);
+	RenderSettings settings = render_settings_;
+	bool const settled = !render_busy_ && !render_all_ && changed_blocks_.empty() &&
+	                     changed_volumes_.empty() && built_blocks_.empty() &&
+	                     pending_blocks_.empty();
+	render_lock.unlock();
+
+	// The bias only moves once the blocks of the last step are on screen. Raising the
+	// detail one depth gives up to 8 times the points, hence the margin.
+	std::size_t const budget = point_budget_property_->getInt();
+	if (settled && budget < num_points &&
+	    static_cast<int>(BLOCK_DEPTH) > settings.lod_bias) {
+		++settings.lod_bias;
+	} else if (settled && 8 * num_points < budget && 0 < settings.lod_bias) {
+		--settings.lod_bias;
+	}
+	settings.lod_distance = lod_distance_property_->getFloat();
+	settings.camera = to_ufo(position);
+
+	std::vector<ufo::map::Code> changed;
+	for (auto const& [code, block] : blocks_) {
+		if (lodDepth(settings, block.aabb, code.getDepth()) != block.depth) {
+			changed.push_back(code);
+		}
+	}
+
+	render_lock.lock();
+	render_settings_.lod_bias = settings.lod_bias;
+	render_settings_.lod_distance = settings.lod_distance;
+	render_settings_.camera = settings.camera;
+	changed_blocks_.insert(changed.begin(), changed.end());
+	render_lock.unlock();
+	if (!changed.empty()) {
+		render_cv_.notify_one();
+	}
+}
+
+void UFOMapDisplay::styleCloud(rviz::PointCloud& cloud, CloudKey const& key,
+                               double resolution) const
+{
+	VoxelType const type = key.first;
+	cloud.setRenderMode(
+	    static_cast<rviz::PointCloud::RenderMode>(render_mode_[type]->getOptionInt()));
+	cloud.setAlpha(alpha_property_[type]->getFloat());
+	float const size =
+	    scale_property_[type]->getFloat() * std::ldexp(resolution, key.second);
+	cloud.setDimensions(size, size, size);
+}
+
+void UFOMapDisplay::clearBlocks()
+{
+	for (auto& [code, block] : blocks_) {
+		block.node->detachAllObjects();
+		scene_manager_->destroySceneNode(block.node);
+	}
+	blocks_.clear();
+	pending_blocks_.clear();
 }
 
 void UFOMapDisplay::updateInfo(double res, size_t num_leaf_nodes, size_t num_inner_nodes,
@@ -587,32 +1042,33 @@ void UFOMapDisplay::updateInfo(double res, size_t num_leaf_nodes, size_t num_inn
 }
 
 void UFOMapDisplay::colorPoint(rviz::PointCloud::Point& point,
+                               RenderSettings const& settings,
                                ufo::map::Point3 const& min_value,
                                ufo::map::Point3 max_value, double probability,
                                VoxelType type) const
 {
-	switch (coloring_property_[type]->getOptionInt()) {
+	switch (settings.coloring[type]) {
 		case X_AXIS_COLOR:
 			setColor(point.position.x, min_value.x(), max_value.x(),
-			         color_factor_property_[type]->getFloat(), point);
+			         settings.color_factor[type], point);
 			break;
 		case Y_AXIS_COLOR:
 			setColor(point.position.y, min_value.y(), max_value.y(),
-			         color_factor_property_[type]->getFloat(), point);
+			         settings.color_factor[type], point);
 			break;
 		case Z_AXIS_COLOR:
 			setColor(point.position.z, min_value.z(), max_value.z(),
-			         color_factor_property_[type]->getFloat(), point);
+			         settings.color_factor[type], point);
 			break;
 		case PROBABLILTY_COLOR: {
-			QColor color = color_property_[type]->getColor();
+			QColor const& color = settings.color[type];
 			point.setColor(probability * (color.red() / 255.0),
 			               probability * (color.green() / 255.0),
 			               probability * (color.blue() / 255.0));
 			break;
 		}
 		case FIXED_COLOR: {
-			QColor color = color_property_[type]->getColor();
+			QColor const& color = settings.color[type];
 			point.setColor(color.red() / 255.0, color.green() / 255.0, color.blue() / 255.0);
 			break;
 		}
@@ -668,17 +1124,21 @@ void UFOMapDisplay::setColor(double value, double min_value, double max_value,
 
 void UFOMapDisplay::clear()
 {
-	std::lock_guard<std::mutex> lock(mutex_);
-
-	map_.emplace<std::monostate>();
-
-	for (VoxelType const& type : clouds_.keys()) {
-		for (size_t i = 0; i < clouds_[type].size(); ++i) {
-			clouds_[type][i].clear();
-		}
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		map_.emplace<std::monostate>();
+		delta_sequence_.reset();
 	}
 
-	// TODO: Implement
+	{
+		std::scoped_lock lock(render_mutex_);
+		++render_generation_;
+		render_all_ = false;
+		changed_volumes_.clear();
+		changed_blocks_.clear();
+		built_blocks_.clear();
+	}
+	clearBlocks();
 }
 
 bool UFOMapDisplay::updateFromTF()
@@ -700,13 +1160,18 @@ bool UFOMapDisplay::createMap(ufomap_msgs::UFOMapMetaData const& info)
 	double free_thres = free_thres_property_->getInt() / 100.0;
 
 	// FIXME: Remove hardcoded
+	// The changes decide which blocks to rebuild, the new map replaces all of them
 	if ("occupancy_map" == info.id) {
 		map_.emplace<ufo::map::OccupancyMap>(info.resolution, info.depth_levels, true,
-		                                     occupied_thres, free_thres);
+		                                     occupied_thres, free_thres)
+		    .enableChangeDetection(true);
+		markAllChanged();
 		return true;
 	} else if ("occupancy_map_color" == info.id) {
 		map_.emplace<ufo::map::OccupancyMapColor>(info.resolution, info.depth_levels, true,
-		                                          occupied_thres, free_thres);
+		                                          occupied_thres, free_thres)
+		    .enableChangeDetection(true);
+		markAllChanged();
 		return true;
 	}
 